@@ -82,6 +82,27 @@ typedef struct DISC_INTERFACE_STRUCT DISC_INTERFACE;
 /* NTFS cache options */
 #define CACHE_DEFAULT_PAGE_COUNT        128  /* The default number of pages in the cache */
 #define CACHE_DEFAULT_PAGE_SIZE         8    /* The default number of sectors per cache page */
+#define CACHE_READAHEAD_MAX             0x100000  /* The biggest read-ahead of a sequential read (in bytes) */
+#define CACHE_COALESCE_MAX              0x100000  /* The biggest write of contiguous dirty pages (in bytes) */
+
+/* NTFS cache device i/o sizes: <=4KB, <=16KB, <=64KB, <=256KB, <=1MB, >1MB */
+#define CACHE_IO_SIZES                  6
+
+/**
+ * ntfs_cache_stats - NTFS cache counters (in sectors, except the number of device i/o)
+ */
+typedef struct _ntfs_cache_stats {
+    uint64_t reads;                                 /* Sectors read through the cache */
+    uint64_t read_hits;                             /* ... found in a page of the cache */
+    uint64_t readahead_hits;                        /* ... found in the read-ahead window */
+    uint64_t writes;                                /* Sectors written through the cache */
+    uint64_t dev_reads;                             /* Device reads */
+    uint64_t dev_read_sectors;
+    uint64_t dev_read_size[CACHE_IO_SIZES];         /* Device reads per size */
+    uint64_t dev_writes;                            /* Device writes */
+    uint64_t dev_write_sectors;
+    uint64_t dev_write_size[CACHE_IO_SIZES];        /* Device writes per size */
+} ntfs_cache_stats;
 
 /* NTFS mount flags */
 #define NTFS_DEFAULT                    0x00000000 /* Standard mount, expects a clean, non-hibernated volume */
@@ -163,6 +184,25 @@ extern bool ntfsMount (const char *name, const DISC_INTERFACE *interface, sec_t
  */
 extern void ntfsUnmount (const char *name, bool force);
 
+/**
+ * Set the cache used by the next ntfsMountAll() and ntfsMountDevice().
+ *
+ * @param CACHEPAGECOUNT The total number of pages in the device cache (CACHE_DEFAULT_PAGE_COUNT if 0)
+ * @param CACHEPAGESIZE The number of sectors per cache page (CACHE_DEFAULT_PAGE_SIZE if 0)
+ */
+extern void ntfsSetCacheDefaults (u32 cachePageCount, u32 cachePageSize);
+
+/**
+ * Get the counters of the cache of a mounted NTFS partition.
+ *
+ * @param NAME The name of mount (see @ntfsMountAll, @ntfsMountDevice, and @ntfsMount)
+ * @param STATS (out) The counters since the mount or the last ntfsResetCacheStats()
+ *
+ * @return True if the partition has a cache
+ */
+extern bool ntfsGetCacheStats (const char *name, ntfs_cache_stats *stats);
+extern void ntfsResetCacheStats (const char *name);
+
 /**
  * Get the volume name of a mounted NTFS partition.
  *
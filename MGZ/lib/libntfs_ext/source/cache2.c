@@ -45,6 +45,46 @@
 
 #define CACHE_FREE UINT_MAX
 
+/*
+Device i/o, counted by size in the cache stats
+*/
+
+static int _NTFS_cache_ioSize(NTFS_CACHE* cache, sec_t numSectors)
+{
+	u64 size = (u64) numSectors * cache->sectorSize;
+	int i = 0;
+	u64 limit = 0x1000;
+
+	while (i < CACHE_IO_SIZES - 1 && size > limit) {
+		limit <<= 2;
+		i++;
+	}
+
+	return i;
+}
+
+static bool _NTFS_cache_devRead(NTFS_CACHE* cache, sec_t sector, sec_t numSectors, void* buffer)
+{
+	cache->stats.dev_reads++;
+	cache->stats.dev_read_sectors += numSectors;
+	cache->stats.dev_read_size[_NTFS_cache_ioSize(cache, numSectors)]++;
+
+	return cache->disc->readSectors(sector, numSectors, buffer);
+}
+
+static bool _NTFS_cache_devWrite(NTFS_CACHE* cache, sec_t sector, sec_t numSectors, const void* buffer)
+{
+	// the read-ahead window isn't updated, it's dropped
+	if(cache->readAheadCount && sector < cache->readAheadSector + cache->readAheadCount && cache->readAheadSector < sector + numSectors)
+		cache->readAheadCount = 0;
+
+	cache->stats.dev_writes++;
+	cache->stats.dev_write_sectors += numSectors;
+	cache->stats.dev_write_size[_NTFS_cache_ioSize(cache, numSectors)]++;
+
+	return cache->disc->writeSectors(sector, numSectors, buffer);
+}
+
 NTFS_CACHE* _NTFS_cache_constructor (unsigned int numberOfPages, unsigned int sectorsPerPage, const DISC_INTERFACE* discInterface,
     sec_t startOfPartition, sec_t endOfPartition, sec_t sectorSize) {
 	NTFS_CACHE* cache;
@@ -90,6 +130,24 @@ NTFS_CACHE* _NTFS_cache_constructor (unsigned int numberOfPages, unsigned int se
 
 	cache->cacheEntries = cacheEntries;
 
+	// the read-ahead and coalescing buffers are allocated at their first use, up to half the size of the pages.
+	// Without them, there's no read-ahead or write coalescing
+	sec_t bufferMax = (sec_t) numberOfPages * sectorsPerPage / 2;
+
+	cache->readAheadMax = CACHE_READAHEAD_MAX / sectorSize;
+	if (cache->readAheadMax > bufferMax) cache->readAheadMax = bufferMax;
+	cache->readAhead = NULL;
+	cache->readAheadSize = sectorsPerPage;
+	cache->readAheadSector = 0;
+	cache->readAheadCount = 0;
+	cache->nextSector = CACHE_FREE;
+
+	cache->coalesceMax = CACHE_COALESCE_MAX / sectorSize;
+	if (cache->coalesceMax > bufferMax) cache->coalesceMax = bufferMax;
+	cache->coalesce = NULL;
+
+	memset(&cache->stats, 0, sizeof(ntfs_cache_stats));
+
 	return cache;
 }
 
@@ -106,6 +164,8 @@ void _NTFS_cache_destructor (NTFS_CACHE* cache) {
 		ntfs_free (cache->cacheEntries[i].cache);
 	}
 	ntfs_free (cache->cacheEntries);
+	if (cache->readAhead) ntfs_free (cache->readAhead);
+	if (cache->coalesce) ntfs_free (cache->coalesce);
 	ntfs_free (cache);
 }
 
@@ -116,6 +176,150 @@ static u32 accessTime(){
 	return accessCounter;
 }
 
+static NTFS_CACHE_ENTRY* _NTFS_cache_findPage(NTFS_CACHE *cache, sec_t sector/*, sec_t count*/) {
+
+	unsigned int i;
+	NTFS_CACHE_ENTRY* cacheEntries = cache->cacheEntries;
+	unsigned int numberOfPages = cache->numberOfPages;
+	NTFS_CACHE_ENTRY *entry = NULL;
+	// old sec_t	lowest = UINT_MAX;
+
+	for(i=0;i<numberOfPages;i++) {
+		if (cacheEntries[i].sector != CACHE_FREE) {
+			/*
+            old
+
+            bool intersect;
+			
+            if (sector > cacheEntries[i].sector) {
+				intersect = sector - cacheEntries[i].sector < cacheEntries[i].count;
+			} else {
+				intersect = cacheEntries[i].sector - sector < count;
+			}
+
+			if ( intersect && (cacheEntries[i].sector < lowest)) {
+				lowest = cacheEntries[i].sector;
+				entry = &cacheEntries[i];
+			}
+            */
+
+            if(sector >= cacheEntries[i].sector && sector < (cacheEntries[i].sector + cacheEntries[i].count))
+                {entry = &cacheEntries[i]; return entry;}
+
+		}
+	}
+
+	return entry;
+}
+
+/*
+Returns the first sector of [sector, end[ that is in a page of the cache, end if there's none
+*/
+
+static sec_t _NTFS_cache_nextPage(NTFS_CACHE *cache, sec_t sector, sec_t end)
+{
+	unsigned int i;
+	NTFS_CACHE_ENTRY* cacheEntries = cache->cacheEntries;
+
+	for(i=0;i<cache->numberOfPages;i++) {
+		if(cacheEntries[i].sector == CACHE_FREE) continue;
+
+		if(sector >= cacheEntries[i].sector && sector < (cacheEntries[i].sector + cacheEntries[i].count)) return sector;
+		if(cacheEntries[i].sector > sector && cacheEntries[i].sector < end) end = cacheEntries[i].sector;
+	}
+
+	return end;
+}
+
+static bool _NTFS_cache_allocReadAhead(NTFS_CACHE *cache)
+{
+	if(cache->readAhead) return true;
+	if(cache->readAheadMax <= cache->sectorsPerPage) return false;
+
+	cache->readAhead = (uint8_t*) ntfs_align ( cache->readAheadMax * cache->sectorSize );
+	// not tried again
+	if(cache->readAhead == NULL) cache->readAheadMax = cache->sectorsPerPage;
+
+	return cache->readAhead != NULL;
+}
+
+static bool _NTFS_cache_allocCoalesce(NTFS_CACHE *cache)
+{
+	if(cache->coalesce) return true;
+	if(cache->coalesceMax == 0) return false;
+
+	cache->coalesce = (uint8_t*) ntfs_align ( cache->coalesceMax * cache->sectorSize );
+	if(cache->coalesce == NULL) cache->coalesceMax = 0;
+
+	return cache->coalesce != NULL;
+}
+
+/*
+Writes a dirty page with the dirty pages contiguous to it, in one device write when they fit in the
+coalescing buffer.
+*/
+
+static bool _NTFS_cache_writeBack(NTFS_CACHE *cache, NTFS_CACHE_ENTRY *entry)
+{
+	NTFS_CACHE_ENTRY *first = entry, *page;
+	sec_t count = entry->count;
+	sec_t sector;
+
+	if(cache->coalesceMax) {
+		// the dirty pages before it
+		while(first->sector > cache->startOfPartition) {
+			page = _NTFS_cache_findPage(cache, first->sector - 1);
+			if(page == NULL || page->dirty == false || page->sector + page->count != first->sector) break;
+			if(count + page->count > cache->coalesceMax) break;
+			count += page->count;
+			first = page;
+		}
+		// and after it
+		sector = entry->sector + entry->count;
+		while(sector < cache->endOfPartition) {
+			page = _NTFS_cache_findPage(cache, sector);
+			if(page == NULL || page->dirty == false || page->sector != sector) break;
+			if(count + page->count > cache->coalesceMax) break;
+			count += page->count;
+			sector += page->count;
+		}
+	}
+
+	// the page alone when there's no buffer to gather them
+	if(count > first->count && _NTFS_cache_allocCoalesce(cache) == false) {
+		first = entry;
+		count = entry->count;
+	}
+
+	if(count == first->count) {
+        // start of partition correction offset
+        sec_t salign = (first->sector < cache->startOfPartition) ? cache->startOfPartition - first->sector : 0;
+
+		if(!_NTFS_cache_devWrite(cache, first->sector + salign, first->count - salign, first->cache + salign * cache->sectorSize)) return false;
+		first->dirty = false;
+		return true;
+	}
+
+	sec_t start = first->sector;
+	sector = start;
+	while(sector < start + count) {
+		page = _NTFS_cache_findPage(cache, sector);
+		memcpy(cache->coalesce + (sector - start) * cache->sectorSize, page->cache, page->count * cache->sectorSize);
+		sector += page->count;
+	}
+
+	if(!_NTFS_cache_devWrite(cache, start, count, cache->coalesce)) return false;
+
+	sector = start;
+	while(sector < start + count) {
+		page = _NTFS_cache_findPage(cache, sector);
+		page->dirty = false;
+		sector += page->count;
+	}
+
+	return true;
+}
+
 static NTFS_CACHE_ENTRY* _NTFS_cache_getPage(NTFS_CACHE *cache,sec_t sector)
 {
 	unsigned int i;
@@ -144,19 +348,17 @@ static NTFS_CACHE_ENTRY* _NTFS_cache_getPage(NTFS_CACHE *cache,sec_t sector)
 	}
 
 	if(foundFree==false && cacheEntries[oldUsed].dirty==true) {
-        // start of partition correction offset
-        sec_t salign = (cacheEntries[oldUsed].sector < cache->startOfPartition) 
-            ? cache->startOfPartition - cacheEntries[oldUsed].sector : 0;
-
-		if(!cache->disc->writeSectors(cacheEntries[oldUsed].sector + salign,
-            cacheEntries[oldUsed].count - salign, cacheEntries[oldUsed].cache + salign * cache->sectorSize)) return NULL;
-		cacheEntries[oldUsed].dirty = false;
+		if(!_NTFS_cache_writeBack(cache, &cacheEntries[oldUsed])) return NULL;
 	}
 	sector = cache->startOfPartition + ((sector - cache->startOfPartition)/sectorsPerPage)*sectorsPerPage; // align base sector to page size
 	sec_t next_page = sector + sectorsPerPage;
 	if(next_page > cache->endOfPartition)	next_page = cache->endOfPartition;
 
-	if(!cache->disc->readSectors(sector,next_page-sector,cacheEntries[oldUsed].cache)) return NULL;
+	// the page is reused, it must not be found while it's loaded
+	cacheEntries[oldUsed].sector = CACHE_FREE;
+	cacheEntries[oldUsed].count = 0;
+
+	if(!_NTFS_cache_devRead(cache,sector,next_page-sector,cacheEntries[oldUsed].cache)) return NULL;
 
     cacheEntries[oldUsed].dirty = false;
 	cacheEntries[oldUsed].sector = sector;
@@ -166,61 +368,91 @@ static NTFS_CACHE_ENTRY* _NTFS_cache_getPage(NTFS_CACHE *cache,sec_t sector)
 	return &(cacheEntries[oldUsed]);
 }
 
-static NTFS_CACHE_ENTRY* _NTFS_cache_findPage(NTFS_CACHE *cache, sec_t sector/*, sec_t count*/) {
-
-	unsigned int i;
-	NTFS_CACHE_ENTRY* cacheEntries = cache->cacheEntries;
-	unsigned int numberOfPages = cache->numberOfPages;
-	NTFS_CACHE_ENTRY *entry = NULL;
-	// old sec_t	lowest = UINT_MAX;
-
-	for(i=0;i<numberOfPages;i++) {
-		if (cacheEntries[i].sector != CACHE_FREE) {
-			/*
-            old
-
-            bool intersect;
-			
-            if (sector > cacheEntries[i].sector) {
-				intersect = sector - cacheEntries[i].sector < cacheEntries[i].count;
-			} else {
-				intersect = cacheEntries[i].sector - sector < count;
-			}
-
-			if ( intersect && (cacheEntries[i].sector < lowest)) {
-				lowest = cacheEntries[i].sector;
-				entry = &cacheEntries[i];
-			}
-            */
-
-            if(sector >= cacheEntries[i].sector && sector < (cacheEntries[i].sector + cacheEntries[i].count))
-                {entry = &cacheEntries[i]; return entry;}
-
-		}
-	}
-
-	return entry;
-}
-
 bool _NTFS_cache_readSectors(NTFS_CACHE *cache,sec_t sector,sec_t numSectors,void *buffer)
 {
 	sec_t sec;
 	sec_t secs_to_read;
 	NTFS_CACHE_ENTRY *entry;
 	uint8_t *dest = buffer;
+	bool sequential;
 
     // if sector is before of start of partition return with error
     if(sector < cache->startOfPartition) return false;
 
+	cache->stats.reads += numSectors;
+
+	// the read-ahead window doubles while the reads follow each other, it's halved by a random read
+	sequential = (sector == cache->nextSector) ||
+		(cache->readAheadCount && sector >= cache->readAheadSector && sector < cache->readAheadSector + cache->readAheadCount);
+	if(sequential) {
+		if(cache->readAheadSize < cache->readAheadMax) cache->readAheadSize *= 2;
+		if(cache->readAheadSize > cache->readAheadMax) cache->readAheadSize = cache->readAheadMax;
+	} else {
+		if(cache->readAheadSize > cache->sectorsPerPage) cache->readAheadSize /= 2;
+	}
+	cache->nextSector = sector + numSectors;
+
 	while(numSectors>0) {
-		entry = _NTFS_cache_getPage(cache,sector);
-		if(entry==NULL) return false;
+		entry = _NTFS_cache_findPage(cache,sector);
+
+		if(entry==NULL && cache->readAheadCount &&
+			sector >= cache->readAheadSector && sector < cache->readAheadSector + cache->readAheadCount) {
+
+			// from the read-ahead window, up to the next page of the cache (it can be dirty)
+			sec = sector - cache->readAheadSector;
+			secs_to_read = cache->readAheadCount - sec;
+			if(secs_to_read>numSectors) secs_to_read = numSectors;
+			secs_to_read = _NTFS_cache_nextPage(cache, sector, sector + secs_to_read) - sector;
+
+			memcpy(dest,cache->readAhead + (sec*cache->sectorSize),(secs_to_read*cache->sectorSize));
+			cache->stats.readahead_hits += secs_to_read;
+
+			dest += (secs_to_read*cache->sectorSize);
+			sector += secs_to_read;
+			numSectors -= secs_to_read;
+			continue;
+		}
+
+		if(entry==NULL) {
+			// the sectors that aren't in the cache
+			secs_to_read = _NTFS_cache_nextPage(cache, sector, sector + numSectors) - sector;
+
+			if(sequential && secs_to_read < cache->readAheadSize && _NTFS_cache_allocReadAhead(cache)) {
+				// read ahead, the window can cover pages of the cache, they're read first
+				secs_to_read = cache->readAheadSize;
+				if(sector + secs_to_read > cache->endOfPartition) secs_to_read = cache->endOfPartition - sector;
+
+				if(!_NTFS_cache_devRead(cache, sector, secs_to_read, cache->readAhead)) {
+					cache->readAheadCount = 0;
+					return false;
+				}
+				cache->readAheadSector = sector;
+				cache->readAheadCount = secs_to_read;
+				continue;
+			}
+
+			if(secs_to_read >= cache->sectorsPerPage) {
+				// big read, straight to the buffer without going through the pages
+				if(!_NTFS_cache_devRead(cache, sector, secs_to_read, dest)) return false;
+
+				dest += (secs_to_read*cache->sectorSize);
+				sector += secs_to_read;
+				numSectors -= secs_to_read;
+				continue;
+			}
+
+			entry = _NTFS_cache_getPage(cache,sector);
+			if(entry==NULL) return false;
+		} else {
+			entry->last_access = accessTime();
+		}
 
 		sec = sector - entry->sector;
 		secs_to_read = entry->count - sec;
 		if(secs_to_read>numSectors) secs_to_read = numSectors;
 
 		memcpy(dest,entry->cache + (sec*cache->sectorSize),(secs_to_read*cache->sectorSize));
+		cache->stats.read_hits += secs_to_read;
 
 		dest += (secs_to_read*cache->sectorSize);
 		sector += secs_to_read;
@@ -338,6 +570,8 @@ bool _NTFS_cache_writeSectors (NTFS_CACHE* cache, sec_t sector, sec_t numSectors
     // if sector is before of start of partition return with error
     if(sector < cache->startOfPartition) return false;
 
+	cache->stats.writes += numSectors;
+
 	while(numSectors>0)
 	{
 		entry = _NTFS_cache_findPage(cache,sector/*,numSectors*/);
@@ -398,7 +632,7 @@ bool _NTFS_cache_writeSectors (NTFS_CACHE* cache, sec_t sector, sec_t numSectors
             // start of partition correction offset
             sec_t salign = (sector < cache->startOfPartition) ? cache->startOfPartition - sector : 0;
 
-            if(!cache->disc->writeSectors(sector + salign, secs_to_write - salign,src + salign * cache->sectorSize)) return false;
+            if(!_NTFS_cache_devWrite(cache, sector + salign, secs_to_write - salign,src + salign * cache->sectorSize)) return false;
 			src += (secs_to_write*cache->sectorSize);
 			sector += secs_to_write;
 			numSectors -= secs_to_write;
@@ -416,10 +650,7 @@ bool _NTFS_cache_flush (NTFS_CACHE* cache) {
 
 	for (i = 0; i < cache->numberOfPages; i++) {
 		if (cache->cacheEntries[i].dirty) {
-            // start of partition correction offset
-            sec_t salign = (cache->cacheEntries[i].sector < cache->startOfPartition) ? cache->startOfPartition - cache->cacheEntries[i].sector : 0;
-
-			if (!cache->disc->writeSectors (cache->cacheEntries[i].sector + salign, cache->cacheEntries[i].count - salign, cache->cacheEntries[i].cache + salign * cache->sectorSize)) {
+			if (!_NTFS_cache_writeBack(cache, &cache->cacheEntries[i])) {
 				return false;
 			}
 		}
@@ -441,4 +672,6 @@ void _NTFS_cache_invalidate (NTFS_CACHE* cache) {
 		cache->cacheEntries[i].count = 0;
 		cache->cacheEntries[i].dirty = false;
 	}
+	cache->readAheadCount = 0;
+	cache->nextSector = CACHE_FREE;
 }
@@ -62,6 +62,20 @@ typedef struct {
 	unsigned int          sectorsPerPage;
 	sec_t                 sectorSize;
 	NTFS_CACHE_ENTRY*     cacheEntries;
+
+	// sequential reads are detected and read ahead in a window that grows up to readAheadMax
+	sec_t                 nextSector;
+	sec_t                 readAheadSize;
+	sec_t                 readAheadMax;
+	sec_t                 readAheadSector;
+	sec_t                 readAheadCount;
+	u8*                   readAhead;
+
+	// contiguous dirty pages are gathered here to be written at once
+	sec_t                 coalesceMax;
+	u8*                   coalesce;
+
+	ntfs_cache_stats      stats;
 } NTFS_CACHE;
 
 /*
@@ -98,6 +98,16 @@ void ntfsInit (void)
 
 int partition_type[NTFS_MAX_PARTITIONS] = {0};
 
+// Cache of the partitions mounted by ntfsMountAll and ntfsMountDevice
+static u32 cache_page_count = CACHE_DEFAULT_PAGE_COUNT;
+static u32 cache_page_size = CACHE_DEFAULT_PAGE_SIZE;
+
+void ntfsSetCacheDefaults (u32 cachePageCount, u32 cachePageSize)
+{
+    cache_page_count = (cachePageCount ? cachePageCount : CACHE_DEFAULT_PAGE_COUNT);
+    cache_page_size = (cachePageSize ? cachePageSize : CACHE_DEFAULT_PAGE_SIZE);
+}
+
 int ntfsFindPartitions (const DISC_INTERFACE *interface, sec_t **partitions)
 {
     MASTER_BOOT_RECORD mbr;
@@ -393,7 +403,7 @@ int ntfsMountAll (ntfs_md **mounts, u32 flags)
                 // Mount the partition
                 if (mount_count < NTFS_MAX_MOUNTS) {
                     // ntfs
-                    if (!partition_type[j] && ntfsMount(name, disc->interface, partitions[j], CACHE_DEFAULT_PAGE_COUNT, CACHE_DEFAULT_PAGE_SIZE, flags)) {
+                    if (!partition_type[j] && ntfsMount(name, disc->interface, partitions[j], cache_page_count, cache_page_size, flags)) {
                         strcpy(mount_points[mount_count].name, name);
                         mount_points[mount_count].interface = disc->interface;
                         mount_points[mount_count].startSector = partitions[j];
@@ -474,7 +484,7 @@ int ntfsMountDevice (const DISC_INTERFACE *interface, ntfs_md **mounts, u32 flag
                     if (mount_count < NTFS_MAX_MOUNTS) {
                         // NTFS
 
-                        if (!partition_type[j] && ntfsMount(name, disc->interface, partitions[j], CACHE_DEFAULT_PAGE_COUNT, CACHE_DEFAULT_PAGE_SIZE, flags)) {
+                        if (!partition_type[j] && ntfsMount(name, disc->interface, partitions[j], cache_page_count, cache_page_size, flags)) {
                             strcpy(mount_points[mount_count].name, name);
                             mount_points[mount_count].interface = disc->interface;
                             mount_points[mount_count].startSector = partitions[j];
@@ -663,6 +673,45 @@ void ntfsUnmount (const char *name, bool force)
     return;
 }
 
+static NTFS_CACHE *ntfsGetCache (const char *name)
+{
+    ntfs_vd *vd = NULL;
+    gekko_fd *fd = NULL;
+
+    // Sanity check
+    if (!name)
+        return NULL;
+
+    // Get the devices volume descriptor
+    vd = ntfsGetVolume(name);
+    if (!vd || !vd->dev)
+        return NULL;
+
+    fd = (gekko_fd *) vd->dev->d_private;
+    if (!fd)
+        return NULL;
+
+    return fd->cache;
+}
+
+bool ntfsGetCacheStats (const char *name, ntfs_cache_stats *stats)
+{
+    NTFS_CACHE *cache = ntfsGetCache(name);
+    if (!cache || !stats)
+        return false;
+
+    memcpy(stats, &cache->stats, sizeof(ntfs_cache_stats));
+
+    return true;
+}
+
+void ntfsResetCacheStats (const char *name)
+{
+    NTFS_CACHE *cache = ntfsGetCache(name);
+    if (cache)
+        memset(&cache->stats, 0, sizeof(ntfs_cache_stats));
+}
+
 const char *ext2GetVolumeName (const char *name);
 
 const char *ntfsGetVolumeName (const char *name)
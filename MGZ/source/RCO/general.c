@@ -157,36 +157,43 @@ zlib_unpacked_size (void *src, uint32_t srcLen)
 
 uint32_t
 rlz_compress (void *src, uint32_t srcLen, void *dest, uint32_t destLen,
-    int mode)
+    int mode, int level)
 {
   if (mode == -1) {
     // theme creator compatible mode
-    // we'll be just as bad as the theme creator and run _4_ compression passes
-    //
-    // >_>
+    // the theme creator runs _4_ compression passes (5, 6, 7 then the best
+    // one again); we pack each mode into its own buffer and keep the
+    // smallest, which saves the last pass
+    int sizes[3], best = -1, i;
+    void *bufs[3];
+
+    bufs[0] = dest;
+    bufs[1] = malloc (srcLen);
+    bufs[2] = malloc (srcLen);
+    if (!bufs[1] || !bufs[2]) {
+      free (bufs[1]);
+      free (bufs[2]);
+      // not enough memory for the extra buffers, do it the old way
+      return rlz_compress (src, srcLen, dest, destLen, 7, level);
+    }
 
-    int size5, size6, size7;
+    for (i = 0; i < 3; i++) {
+      sizes[i] = rlzcompress (bufs[i], srcLen, src, 5 + i, level);
+      if (sizes[i] != -1 && (best == -1 || sizes[i] <= sizes[best]))
+	best = i;
+    }
 
-    size5 = rlzcompress (dest, srcLen, src, 5);
-    size6 = rlzcompress (dest, srcLen, src, 6);
-    size7 = rlzcompress (dest, srcLen, src, 7);
+    if (best > 0)
+      memcpy (dest, bufs[best], sizes[best]);
+    free (bufs[1]);
+    free (bufs[2]);
 
-    if ((size5 == -1) && (size6 == -1) && (size7 == -1))
+    if (best == -1)
       return 0;			// all failed, lol
-
-    if (size7 != -1 && (size7 < size6 || size6 != -1)
-	&& (size7 < size5 || size5 != -1))
-      return size7;		// okay, we're _slightly_ more optimised than
-    // the theme creator :P
-    if (size6 != -1 && (size6 < size5 || size5 != -1))
-      return rlzcompress (dest, srcLen, src, 6);
-    if (size5 != -1)
-      return rlzcompress (dest, srcLen, src, 5);
-
-    return 0;			// should never occur
+    return sizes[best];
 
   } else {
-    int size = rlzcompress (dest, srcLen, src, mode);
+    int size = rlzcompress (dest, srcLen, src, mode, level);
 
     if (size == -1)
       return 0;
@@ -30,12 +30,13 @@
 #define ENDIAN_SWAP_HALF32(x)	(((x) & 0xFF) << 8 | ((x) & 0xFF00) >> 8 | ((x) & 0xFF0000) << 8 | ((x) & 0xFF000000) >> 8)
 
 extern void print_load(char *format, ...);
-extern uint8_t ERR;
-extern uint8_t WAR;
+// ERR/WAR are set under the lock of print_load, the RCO dumper prints from several threads
+extern void print_load_error(char *format, ...);
+extern void print_load_warning(char *format, ...);
 
 #define info(...) 		{print_load(__VA_ARGS__);}
-#define error(...) 		{ERR = TRUE ; print_load( __VA_ARGS__);}
-#define warning(...)	{WAR = TRUE ; print_load(__VA_ARGS__);}
+#define error(...) 		{print_load_error( __VA_ARGS__);}
+#define warning(...)	{print_load_warning(__VA_ARGS__);}
 
 #define fileread(fp, buf, len) fread(buf, len, 1, fp)
 #define filewrite(fp, buf, len) fwrite(buf, len, 1, fp)
@@ -64,7 +65,7 @@ int zlib_uncompress (void *dest, unsigned int destLen, const void *src,
     unsigned int srcLen);
 uint32_t zlib_unpacked_size (void *src, uint32_t srcLen);
 uint32_t rlz_compress (void *src, uint32_t srcLen, void *dest, uint32_t destLen,
-    int mode);
+    int mode, int level);
 uint8_t file_exists (char *fn);
 
 uint32_t filesize (const char *fn);
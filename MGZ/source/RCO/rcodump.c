@@ -16,6 +16,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/file.h>
+#include <sys/thread.h>
+#include <sys/mutex.h>
+#include <sys/systime.h>
 #define makedir(s) mkdir(s, 0777);
 
 #include "general.h"
@@ -142,10 +145,143 @@ uint8_t dump_output_vsmxdec (char *dest, void *buf, rRCOEntry * entry)
   return FALSE;
 }
 
-void dump_resources (char *labels, rRCOEntry * parent, const RcoTableMap extMap, char *pathPrefix)
+// resources are dumped by a small pool of worker threads : the entry tree is
+// walked once to build the job list, workers then read+convert one job at a
+// time (so at most DUMP_THREADS resources are held in memory) and the entries
+// are updated afterwards in tree order.
+#define DUMP_THREADS		2
+#define DUMP_STACK_SIZE		0x10000
+
+enum {
+	DUMP_CONV_DATA=0,
+	DUMP_CONV_GIM,
+	DUMP_CONV_WAV,
+	DUMP_CONV_VSMX,
+	DUMP_CONV_NUM
+};
+
+static const char *dump_conv_name[DUMP_CONV_NUM] = { "data", "gim", "wav", "vsmx" };
+
+typedef struct {
+	char dest[MAX_FILENAME_LEN];
+	char *label;
+	rRCOEntry entry;		// copy, channel jobs adjust srcAddr/srcLen
+	OutputDumpFunc func;
+	uint8_t conv;
+	uint8_t ret;
+} DumpJob;
+
+typedef struct {
+	DumpJob *jobs;
+	uint32_t num;
+	uint32_t next;
+	sys_lwmutex_t lock;
+	uint64_t convTime[DUMP_CONV_NUM];	// in microseconds
+	uint32_t convCount[DUMP_CONV_NUM];
+} DumpPool;
+
+static uint64_t dump_time_usec()
 {
-	if (!parent || !parent->numSubentries)	return;
+	u64 sec=0, nsec=0;
+	sysGetCurrentTime(&sec, &nsec);
+	return sec * 1000000ULL + nsec / 1000;
+}
+
+static uint8_t dump_output_conv(OutputDumpFunc of)
+{
+	if (of == dump_output_gimconv) return DUMP_CONV_GIM;
+	if (of == dump_output_wav) return DUMP_CONV_WAV;
+	if (of == dump_output_vsmxdec) return DUMP_CONV_VSMX;
+	return DUMP_CONV_DATA;
+}
+
+// the caller reserves room for every job first, nothing is reallocated here
+static DumpJob *dump_add_job (DumpJob * jobs, uint32_t * num, rRCOEntry * entry, char *dest, char *label, OutputDumpFunc of)
+{
+	DumpJob *job = &jobs[*num];
+	(*num)++;
+
+	strcpy (job->dest, dest);
+	memcpy (&job->entry, entry, sizeof (rRCOEntry));
+	job->label = label;
+	job->func = of;
+	job->conv = dump_output_conv(of);
+	job->ret = FALSE;
+
+	return job;
+}
+
+static void dump_worker (void *arg)
+{
+	DumpPool *pool = (DumpPool *) arg;
+
+	while (TRUE) {
+		sysLwMutexLock (&pool->lock, 0);
+		uint32_t i = pool->next++;
+		sysLwMutexUnlock (&pool->lock);
+
+		if (i >= pool->num) break;
+
+		DumpJob *job = &pool->jobs[i];
+		uint64_t t = dump_time_usec();
+
+		job->ret = dump_resource (job->dest, &job->entry, job->func);
 
+		t = dump_time_usec() - t;
+		sysLwMutexLock (&pool->lock, 0);
+		pool->convTime[job->conv] += t;
+		pool->convCount[job->conv]++;
+		sysLwMutexUnlock (&pool->lock);
+	}
+
+	sysThreadExit (0);
+}
+
+static void dump_run_jobs (DumpJob * jobs, uint32_t num)
+{
+	static const sys_lwmutex_attr_t attr = {
+		SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""
+	};
+	sys_ppu_thread_t tid[DUMP_THREADS];
+	uint8_t started[DUMP_THREADS];
+	DumpPool pool;
+	uint32_t i;
+	u64 ret;
+
+	if (!num) return;
+
+	memset (&pool, 0, sizeof (pool));
+	pool.jobs = jobs;
+	pool.num = num;
+	sysLwMutexCreate (&pool.lock, &attr);
+
+	for (i = 0; i < DUMP_THREADS; i++)
+		started[i] = (sysThreadCreate (&tid[i], dump_worker, &pool, 1000, DUMP_STACK_SIZE, THREAD_JOINABLE, "rco_dump") == 0);
+
+	// no thread could be started, do the work ourselves
+	if (!started[0]) {
+		for (i = 0; i < num; i++) {
+			uint64_t t = dump_time_usec();
+			jobs[i].ret = dump_resource (jobs[i].dest, &jobs[i].entry, jobs[i].func);
+			pool.convTime[jobs[i].conv] += dump_time_usec() - t;
+			pool.convCount[jobs[i].conv]++;
+		}
+		pool.next = num;
+	}
+
+	for (i = 0; i < DUMP_THREADS; i++)
+		if (started[i]) sysThreadJoin (tid[i], &ret);
+
+	sysLwMutexDestroy (&pool.lock);
+
+	for (i = 0; i < DUMP_CONV_NUM; i++)
+		if (pool.convCount[i])
+			print_load ("%s : %d file(s) in %d ms", dump_conv_name[i], pool.convCount[i], (int) (pool.convTime[i] / 1000));
+}
+
+// dump the entries one after the other, used when the jobs can't be allocated
+static void dump_resources_seq (char *labels, rRCOEntry * parent, const RcoTableMap extMap, char *pathPrefix)
+{
 	char fullOutName[MAX_FILENAME_LEN];
 	uint32_t extMapLen = 0;
 	char dat[5] = "dat";
@@ -194,7 +330,6 @@ void dump_resources (char *labels, rRCOEntry * parent, const RcoTableMap extMap,
 			rRCOSoundEntry *rse = (rRCOSoundEntry *) entry->extra;
 			char soundSetSrc[MAX_FILENAME_LEN] = "\0";
 
-			
 			for (i = 0; i < ENDIAN_SWAP(rse->channels); i++) {
 				outName[len + 1] = '\0';
 				if (!soundSetSrc[0]) {
@@ -203,13 +338,12 @@ void dump_resources (char *labels, rRCOEntry * parent, const RcoTableMap extMap,
 				}
 				
 				sprintf (outName + len + 1, "ch%d.", i);
-				
 				strcpy (outName + strlen (outName), ext);
 				
 				uint32_t origAddr = entry->srcAddr, origLen = entry->srcLen, origLenUnpacked = entry->srcLenUnpacked;
 				
-				entry->srcLen = entry->srcLenUnpacked = ((rRCOSoundEntry *) entry->extra)->channelData[i * 2];
-				entry->srcAddr += ((rRCOSoundEntry *) entry->extra)->channelData[i * 2 + 1];
+				entry->srcLen = entry->srcLenUnpacked = rse->channelData[i * 2];
+				entry->srcAddr += rse->channelData[i * 2 + 1];
 				
 				if (dump_resource (fullOutName, entry, of) == FALSE) warning ("Unable to dump resource '%s'.", label);
 				
@@ -232,6 +366,138 @@ void dump_resources (char *labels, rRCOEntry * parent, const RcoTableMap extMap,
 	}
 }
 
+void dump_resources (char *labels, rRCOEntry * parent, const RcoTableMap extMap, char *pathPrefix)
+{
+	if (!parent || !parent->numSubentries)	return;
+
+	char fullOutName[MAX_FILENAME_LEN];
+	uint32_t extMapLen = 0;
+	char dat[5] = "dat";
+
+	strcpy (fullOutName, pathPrefix);
+	char *outName = fullOutName + strlen (pathPrefix);
+
+	while (extMap[extMapLen][0])
+		extMapLen++;
+
+	uint32_t i;
+	rRCOEntry *entry;
+
+	// one job per file : the wav and each channel of a sound, one for the others
+	uint32_t numJobs = 0, numEntries = 0;
+	for (entry = parent->firstChild; entry && numEntries < parent->numSubentries; entry = entry->next, numEntries++) {
+		if (entry->id == RCO_TABLE_SOUND)
+			numJobs += 1 + ENDIAN_SWAP(((rRCOSoundEntry *) entry->extra)->channels);
+		else
+			numJobs++;
+	}
+
+	DumpJob *jobs = (DumpJob *) malloc (numJobs * sizeof (DumpJob));
+	// first and last job of each entry, used to update the entries once dumped
+	uint32_t *entryJobs = (uint32_t *) malloc (parent->numSubentries * 2 * sizeof (uint32_t));
+
+	// nothing is touched yet, the entries can still be dumped in order
+	if (!jobs || !entryJobs) {
+		free (entryJobs);
+		free (jobs);
+		dump_resources_seq (labels, parent, extMap, pathPrefix);
+		return;
+	}
+
+	numJobs = numEntries = 0;
+
+	for (entry = parent->firstChild; entry && numEntries < parent->numSubentries; entry = entry->next, numEntries++) {
+		char *ext = (char *) dat;
+		if (entry->id == RCO_TABLE_IMG || entry->id == RCO_TABLE_MODEL) {
+			uint32_t fmt = ((rRCOImgModelEntry *) entry->extra)->format;
+			if (fmt <= extMapLen) ext = (char *) extMap[fmt];
+		} else if (entry->id == RCO_TABLE_SOUND) {
+			rRCOSoundEntry *rse = (rRCOSoundEntry *) entry->extra;
+			if (rse->format == RCO_SOUND_VAG) strcpy (ext, "vag");
+		}
+
+		char *label = get_label_from_offset (labels, entry->labelOffset);
+		uint32_t len = strlen (label);
+
+		if (len > MAX_LABEL_LEN) len = MAX_LABEL_LEN;
+		memcpy (outName, label, len);
+		outName[len] = '.';
+
+		OutputDumpFunc of = dump_output_data;
+
+		if (entry->id == RCO_TABLE_IMG && ((rRCOImgModelEntry *) entry->extra)->format == RCO_IMG_GIM) 
+		of = dump_output_gimconv;
+
+		entryJobs[numEntries * 2] = numJobs;
+
+		if(entry->id == RCO_TABLE_SOUND) {
+			
+			char wavName[255];
+			strcpy(wavName , pathPrefix);
+			strcat(wavName , label );
+			strcat(wavName , ".wav");
+			dump_add_job (jobs, &numJobs, entry, wavName, label, dump_output_wav);
+			
+			rRCOSoundEntry *rse = (rRCOSoundEntry *) entry->extra;
+			char soundSetSrc[MAX_FILENAME_LEN] = "\0";
+
+			for (i = 0; i < ENDIAN_SWAP(rse->channels); i++) {
+				outName[len + 1] = '\0';
+				if (!soundSetSrc[0]) {
+					strcpy(soundSetSrc, fullOutName);
+					strcpy(soundSetSrc + strlen (soundSetSrc), "ch*.vag");
+				}
+				
+				sprintf (outName + len + 1, "ch%d.", i);
+				strcpy (outName + strlen (outName), ext);
+				
+				DumpJob *job = dump_add_job (jobs, &numJobs, entry, fullOutName, label, of);
+				
+				job->entry.srcLen = job->entry.srcLenUnpacked = rse->channelData[i * 2];
+				job->entry.srcAddr += rse->channelData[i * 2 + 1];
+			}
+			// jobs hold their own copy of the entry, it can be updated now
+			strcpy (entry->srcFile, soundSetSrc);
+		}
+		else {
+			strcpy (outName + len + 1, ext);
+			dump_add_job (jobs, &numJobs, entry, fullOutName, label, of);
+			strcpy (entry->srcFile, fullOutName);
+		}
+
+		entryJobs[numEntries * 2 + 1] = numJobs;
+	}
+
+	dump_run_jobs (jobs, numJobs);
+
+	// report and update the entries in tree order
+	for (entry = parent->firstChild, i = 0; entry && i < numEntries; entry = entry->next, i++) {
+		uint32_t j;
+		char *label = get_label_from_offset (labels, entry->labelOffset);
+
+		print_load(" %s", label);
+
+		for (j = entryJobs[i * 2]; j < entryJobs[i * 2 + 1]; j++) {
+			if (jobs[j].ret == FALSE) {
+				if (jobs[j].conv == DUMP_CONV_WAV) {
+					warning("Warning : Unable to dump resource '%s.wav'", label);
+				} else {
+					warning ("Unable to dump resource '%s'.", label);
+				}
+			}
+		}
+
+		if(entry->id != RCO_TABLE_SOUND)
+			entry->srcLenUnpacked = filesize (entry->srcFile);
+		entry->srcAddr = 0;
+		entry->srcLen = entry->srcLenUnpacked;
+		entry->srcCompression = RCO_DATA_COMPRESSION_NONE;
+	}
+
+	free (entryJobs);
+	free (jobs);
+}
+
 void dump_text_resources(char *labels, rRCOEntry * parent, uint8_t writeHeader, char *pathPrefix, uint8_t bWriteXML)
 {
 	if (!parent || !parent->numSubentries)
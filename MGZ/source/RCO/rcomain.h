@@ -27,6 +27,7 @@ typedef struct {
 #define WRITERCO_ZLIB_METHOD_ZFIXED Z_FIXED
 #define WRITERCO_ZLIB_METHOD_7Z Z_USE_7Z
   int rlzMode;
+  int rlzLevel;			// RLZ_LEVEL_* (rlzpack.h), 0 for RLZ_LEVEL_DEFAULT
 } writerco_options;
 
 typedef struct __rRCOEntry {
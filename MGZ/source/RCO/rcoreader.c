@@ -38,18 +38,29 @@ typedef struct {
 
   uint8_t ps3;			// TRUE if PS3 RCO
 
+  // offset -> entry index, filled by read_entry so that fix_refs doesn't
+  // have to walk the whole tree for every reference
+  rRCOEntry **offsetIdx;
+  uint32_t offsetIdxSize;
+  uint32_t offsetIdxCount;
+
 } rRCOFile_readhelper;
 
+#define RCO_READ_FBUF_SIZE 65536	// stdio buffer for uncompressed tables
+#define RCO_OFFSET_IDX_INIT 1021	// initial index size (prime)
+
 void read_entry (rRCOFile_readhelper * rcoH, rRCOFile * rco, rRCOEntry * data,
     uint8_t readSubEntries);
 rRCOEntry *find_entry_from_offset (rRCOEntry * parent, uint32_t offset);
+void offset_idx_add (rRCOFile_readhelper * rcoH, rRCOEntry * entry);
+rRCOEntry *offset_idx_find (rRCOFile_readhelper * rcoH, uint32_t offset);
 uint8_t check_file_region (uint32_t fSize, uint32_t offset, uint32_t size);
 uint32_t rco_fread (rRCOFile_readhelper * rcoH, void *buf, uint32_t len);
 uint32_t rcoread_ftell (rRCOFile_readhelper * rcoH);
 int rcoread_fseek (rRCOFile_readhelper * rcoH, uint32_t pos);
 
-void fix_refs (rRCOFile * rco, rRCOEntry * entry, const int *lenArray,
-    const uint32_t lenNum, uint8_t isObj);
+void fix_refs (rRCOFile_readhelper * rcoH, rRCOFile * rco, rRCOEntry * entry,
+    const int *lenArray, const uint32_t lenNum, uint8_t isObj);
 
 rRCOFile *
 read_rco (char *fn)
@@ -64,6 +75,19 @@ read_rco (char *fn)
     error ("Unable to open file %s", fn);
     return NULL;
   }
+  // uncompressed tables are parsed with lots of tiny reads, so give stdio a
+  // decent sized buffer to work with
+  char *fBuf = (char *) malloc (RCO_READ_FBUF_SIZE);
+
+  if (fBuf)
+    setvbuf (rcoH.fp, fBuf, _IOFBF, RCO_READ_FBUF_SIZE);
+
+  rcoH.offsetIdxCount = 0;
+  rcoH.offsetIdxSize = RCO_OFFSET_IDX_INIT;
+  rcoH.offsetIdx =
+      (rRCOEntry **) calloc (rcoH.offsetIdxSize, sizeof (rRCOEntry *));
+  rcoH.tables = 0;
+  rcoH.ptrsObj = rcoH.ptrsAnim = 0;
 
   fseek (rcoH.fp, 0, SEEK_END);
   rcoH.fSizeExpanded = rcoH.fSize = ftell (rcoH.fp);
@@ -73,7 +97,7 @@ read_rco (char *fn)
 
   if (!check_file_region (rcoH.fSize, 0, sizeof (header))) {
     error ("File too small to be a valid RCO file.");
-    return NULL;
+    goto fail;
   }
   fileread (rcoH.fp, &header, sizeof (header));
 
@@ -86,7 +110,7 @@ read_rco (char *fn)
 
   if (header.signature != RCO_SIGNATURE) {
     error ("[header] Invalid signature - not a valid RCO file.");
-    return NULL;
+    goto fail;
   }
   if (header.null != 0) {
     warning ("[header] Unexpected value @ 0x8: 0x%d (expected: 0x0).",
@@ -179,7 +203,7 @@ read_rco (char *fn)
       error
 	  ("[header] Unknown compression type 0x%x - process cannot continue.",
 	  rco->headerCompression);
-      return NULL;
+      goto fail;
       /* warning("[header] Unknown compression type 0x%x - assuming
        * uncompressed data.", rco->headerCompression); // set it to no
        * compression rco->headerCompression = RCO_DATA_COMPRESSION_NONE; */
@@ -201,7 +225,7 @@ read_rco (char *fn)
 
     if (!fileread (rcoH.fp, &ci, sizeof (ci))) {
       error ("[header] Unable to read in compression info!");
-      return NULL;
+      goto fail;
     }
     if (rco->eSwap)
       es_headerComprInfo (&ci);
@@ -211,7 +235,7 @@ read_rco (char *fn)
     if (ci.lenUnpacked > MAX_TREE_DATA || ci.lenPacked > MAX_TREE_DATA) {
       error
 	  ("[header] Size of tree data exceeds sane limit.  This is probably a bad RCO.");
-      return NULL;
+      goto fail;
     }
 
     rcoH.tables = malloc (ci.lenUnpacked);
@@ -229,7 +253,7 @@ read_rco (char *fn)
 
 	  if (uRet != Z_OK && uRet != Z_DATA_ERROR) {
 	    error ("[entries] Unable to decompress tree entries!");
-	    return FALSE;
+	    goto fail;
 	  } else if (uRet == Z_DATA_ERROR) {
 	    warning
 		("Encountered 'data error' when decompressing tree entries.");
@@ -244,7 +268,7 @@ read_rco (char *fn)
       case RCO_DATA_COMPRESSION_RLZ:
 	error
 	    ("[header] This RCO uses RLZ compression which currently cannot be decompressed with rcomage.  (use Z33's Resurssiklunssi to decompress the RCO)");
-	return NULL;
+	goto fail;
 
       default:			// this won't actually ever be executed due to
 	// the new compression checking code above...
@@ -252,7 +276,7 @@ read_rco (char *fn)
 	error
 	    ("[header] Unknown compression method specified (0x%x) - can't continue.",
 	    rco->headerCompression);
-	return NULL;
+	goto fail;
     }
 
     // decompress text data
@@ -267,7 +291,7 @@ read_rco (char *fn)
       do {
 	if (!fileread (rcoH.fp, &tci, sizeof (tci))) {
 	  error ("Failed to read in text compression info.");
-	  return NULL;
+	  goto fail;
 	}
 	if (rco->eSwap)
 	  es_textComprInfo (&tci);
@@ -279,7 +303,7 @@ read_rco (char *fn)
 
 	if (tci.unpackedLen > MAX_LABEL_DATA || tci.packedLen > MAX_LABEL_DATA) {
 	  error ("[text-data] Size of text data exceeds sane limits.");
-	  return NULL;
+	  goto fail;
 	}
 	uint32_t oldSize = rcoH.tablesSize;
 
@@ -295,7 +319,7 @@ read_rco (char *fn)
 
 	if (uRet != Z_OK && uRet != Z_DATA_ERROR) {
 	  error ("[text-data] Unable to decompress text data!");
-	  return FALSE;
+	  goto fail;
 	} else if (uRet == Z_DATA_ERROR) {
 	  warning ("Encountered 'data error' when decompressing text data.");
 	}
@@ -325,7 +349,7 @@ read_rco (char *fn)
   if (!check_file_region (rcoH.fSizeExpanded, header.pLabelData,
 	  header.lLabelData)) {
     error ("[header] Invalid label pointer/length specified.");
-    return NULL;
+    goto fail;
   }
   if (header.lLabelData > MAX_LABEL_DATA) {
     header.lLabelData = MAX_LABEL_DATA;
@@ -342,7 +366,7 @@ read_rco (char *fn)
   if (!check_file_region (rcoH.fSizeExpanded, header.pEventData,
 	  header.lEventData)) {
     error ("[header] Invalid event pointer/length specified.");
-    return NULL;
+    goto fail;
   }
   if (header.lEventData > MAX_LABEL_DATA) {
     warning
@@ -369,7 +393,7 @@ read_rco (char *fn)
 			if(hp != RCO_NULL_PTR) { \
 				if(!check_file_region(rcoH.fSizeExpanded, hp, hl)) { \
 					error("[header] Invalid %s pointer/length specified.", s); \
-					return NULL; \
+					goto fail; \
 				} \
 				if((hl) > MAX_LABEL_DATA) { \
 					warning("[%s] Total data length (%d) exceeds safety limit of 16MB - data has been truncated!", s, hl); \
@@ -561,10 +585,11 @@ read_rco (char *fn)
 
   // fix object/anim references
   if (rco->tblObj)
-    fix_refs (rco, rco->tblObj, RCO_OBJ_EXTRA_LEN, RCO_OBJ_EXTRA_LEN_NUM, TRUE);
+    fix_refs (&rcoH, rco, rco->tblObj, RCO_OBJ_EXTRA_LEN,
+	RCO_OBJ_EXTRA_LEN_NUM, TRUE);
   if (rco->tblAnim)
-    fix_refs (rco, rco->tblAnim, RCO_ANIM_EXTRA_LEN, RCO_ANIM_EXTRA_LEN_NUM,
-	FALSE);
+    fix_refs (&rcoH, rco, rco->tblAnim, RCO_ANIM_EXTRA_LEN,
+	RCO_ANIM_EXTRA_LEN_NUM, FALSE);
 
   rco_fix_decomp_sizes (rco, &rco->tblMain);
 
@@ -603,8 +628,12 @@ read_rco (char *fn)
   }
 
   fclose (rcoH.fp);
+  if (fBuf)
+    free (fBuf);
   if (rcoH.tables)
     free (rcoH.tables);
+  if (rcoH.offsetIdx)
+    free (rcoH.offsetIdx);
 
   /* if(rcoH.ptrsText) free(rcoH.ptrsText); if(rcoH.ptrsImg)
    * free(rcoH.ptrsImg); if(rcoH.ptrsModel) free(rcoH.ptrsModel);
@@ -615,6 +644,21 @@ read_rco (char *fn)
     free (rcoH.ptrsAnim);
 
   return rco;
+
+fail:
+  // the stdio buffer belongs to the file until it's closed
+  fclose (rcoH.fp);
+  if (fBuf)
+    free (fBuf);
+  if (rcoH.tables)
+    free (rcoH.tables);
+  if (rcoH.offsetIdx)
+    free (rcoH.offsetIdx);
+  if (rcoH.ptrsObj)
+    free (rcoH.ptrsObj);
+  if (rcoH.ptrsAnim)
+    free (rcoH.ptrsAnim);
+  return NULL;
 }
 
 void
@@ -666,6 +710,7 @@ read_entry (rRCOFile_readhelper * rcoH, rRCOFile * rco, rRCOEntry * data,
   }
 
   data->srcFile[0] = '\0';
+  offset_idx_add (rcoH, data);
 
   data->extra = 0;
   data->srcBuffer = NULL;
@@ -1139,8 +1184,64 @@ read_entry (rRCOFile_readhelper * rcoH, rRCOFile * rco, rRCOEntry * data,
   }
 }
 
-// linear/recursive search - not the fastest, but eh, performance isn't that
-// much of an issue
+// offset index - open addressing with linear probing, same as the RCO label
+// hash tables; grows to the next prime above twice the size when 3/4 full
+static uint32_t
+offset_idx_slot (rRCOEntry ** idx, uint32_t size, uint32_t offset)
+{
+  uint32_t slot = offset % size;
+
+  while (idx[slot] && idx[slot]->offset != offset) {
+    slot++;
+    if (slot >= size)
+      slot = 0;
+  }
+  return slot;
+}
+
+void
+offset_idx_add (rRCOFile_readhelper * rcoH, rRCOEntry * entry)
+{
+  if (!rcoH->offsetIdx)
+    return;
+
+  if ((rcoH->offsetIdxCount + 1) * 4 > rcoH->offsetIdxSize * 3) {
+    uint32_t i, newSize = find_larger_prime (rcoH->offsetIdxSize * 2);
+    rRCOEntry **newIdx = (rRCOEntry **) calloc (newSize, sizeof (rRCOEntry *));
+
+    if (!newIdx) {
+      // fall back to the tree search in fix_refs
+      free (rcoH->offsetIdx);
+      rcoH->offsetIdx = NULL;
+      return;
+    }
+    for (i = 0; i < rcoH->offsetIdxSize; i++)
+      if (rcoH->offsetIdx[i])
+	newIdx[offset_idx_slot (newIdx, newSize,
+		rcoH->offsetIdx[i]->offset)] = rcoH->offsetIdx[i];
+    free (rcoH->offsetIdx);
+    rcoH->offsetIdx = newIdx;
+    rcoH->offsetIdxSize = newSize;
+  }
+
+  uint32_t slot =
+      offset_idx_slot (rcoH->offsetIdx, rcoH->offsetIdxSize, entry->offset);
+
+  // keep the first entry found at a given offset, like the tree search would
+  if (!rcoH->offsetIdx[slot]) {
+    rcoH->offsetIdx[slot] = entry;
+    rcoH->offsetIdxCount++;
+  }
+}
+
+rRCOEntry *
+offset_idx_find (rRCOFile_readhelper * rcoH, uint32_t offset)
+{
+  return rcoH->offsetIdx[offset_idx_slot (rcoH->offsetIdx,
+	  rcoH->offsetIdxSize, offset)];
+}
+
+// linear/recursive search - only used if the offset index couldn't be built
 rRCOEntry *
 find_entry_from_offset (rRCOEntry * parent, uint32_t offset)
 {
@@ -1160,8 +1261,8 @@ find_entry_from_offset (rRCOEntry * parent, uint32_t offset)
 }
 
 void
-fix_refs (rRCOFile * rco, rRCOEntry * entry, const int *lenArray,
-    const uint32_t lenNum, uint8_t isObj)
+fix_refs (rRCOFile_readhelper * rcoH, rRCOFile * rco, rRCOEntry * entry,
+    const int *lenArray, const uint32_t lenNum, uint8_t isObj)
 {
   uint32_t i, i2;
 
@@ -1236,7 +1337,10 @@ fix_refs (rRCOFile * rco, rRCOEntry * entry, const int *lenArray,
 	  case RCO_REF_OBJ:
 	    // TODO: consider only searching specific sections instead of the
 	    // entire table
-	    newRef->ptr = find_entry_from_offset (&(rco->tblMain), ref->ptr);
+	    if (rcoH->offsetIdx)
+	      newRef->ptr = offset_idx_find (rcoH, ref->ptr);
+	    else
+	      newRef->ptr = find_entry_from_offset (&(rco->tblMain), ref->ptr);
 	    if (!newRef->ptr)
 	      warning
 		  ("[entry (0x%x)] Unable to find referenced entry from supplied pointer.",
@@ -1268,7 +1372,7 @@ fix_refs (rRCOFile * rco, rRCOEntry * entry, const int *lenArray,
   rRCOEntry *rcoNode;
 
   for (rcoNode = entry->firstChild; rcoNode; rcoNode = rcoNode->next)
-    fix_refs (rco, rcoNode, lenArray, lenNum, isObj);
+    fix_refs (rcoH, rco, rcoNode, lenArray, lenNum, isObj);
 }
 
 uint8_t
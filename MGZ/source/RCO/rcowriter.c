@@ -382,7 +382,7 @@ write_rco (rRCOFile * rco, char *fn, writerco_options opts)
       bufferOut = (uint8_t *) malloc (rcoH.tablesSize);
       ci.lenPacked =
 	  rlz_compress (rcoH.tables, rcoH.tablesSize, bufferOut,
-	  rcoH.tablesSize, opts.rlzMode);
+	  rcoH.tablesSize, opts.rlzMode, opts.rlzLevel);
     } else {
       error ("lulwut?");
       return FALSE;
@@ -891,7 +891,7 @@ rco_write_resource (FILE * dest, rRCOEntry * entry, uint32_t destCompression,
     bufferOut = (uint8_t *) malloc (entry->srcLenUnpacked);
     packedSize =
 	rlz_compress (bufferMid, entry->srcLenUnpacked, bufferOut,
-	entry->srcLenUnpacked, opts->rlzMode);
+	entry->srcLenUnpacked, opts->rlzMode, opts->rlzLevel);
     if (!packedSize) {
       if (entry->labelOffset)
 	warning ("Failed to compress resource '%s'.",
@@ -1015,7 +1015,7 @@ rco_write_text_resource (rRCOFile_writehelper * rcoH, rRCOEntry * entry,
       bufferOut = (uint8_t *) malloc (tci.unpackedLen);
       tci.packedLen =
 	  rlz_compress (textBuffer, tci.unpackedLen, bufferOut, tci.unpackedLen,
-	  opts->rlzMode);
+	  opts->rlzMode, opts->rlzLevel);
     }
 
     if (!tci.packedLen) {	// compression failed
@@ -12,15 +12,21 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdint.h>
+#include "rlzpack.h"
 
 #define RLZI_WINDOW_SIZE	0x7FED	// *4 = 130,996 bytes (128KB - 76
 					// bytes)
 #define RLZI_DICTIONARY_SIZE	0x3FFFF	// *4 = 1,048,572 bytes (1MB - 4 bytes)
 
+// max number of hash chain links followed per match search, per level
+#define RLZI_CHAIN_FAST		16
+#define RLZI_CHAIN_NORMAL	256
+
 #define ABS_INPUT_POS ((unsigned long int) (rlzi->input + rlzi->inputpos))
 
 /** Function Prototypes **/
-int rlzcompress (void *output, int inlen, void *input, unsigned char mode);
+int rlzcompress (void *output, int inlen, void *input, unsigned char mode,
+    int level);
 
 // void sub_405810(int arg_CB8, int64_t arg_CB0);
 void flush_output (void);
@@ -67,6 +73,8 @@ typedef struct {		// unk_421D80
   // long unused_CC4; // 0xCC4 - align 8? - always 0 in program
   unsigned long inputpos;	// 0xCC8 (0x422A48)
   unsigned long inputlen;	// 0xCCC (0x422A4C)
+  unsigned long maxChain;	// chain links to follow in find_match (0 =
+  // no limit)
 
   // window stores positions of stuff; the index itself is based on hashed data
   long window[RLZI_WINDOW_SIZE];	// 0xCD0-0x20C84
@@ -85,7 +93,8 @@ RLZ_Info *rlzi = &rlzip;
 /** Functions **/
 // sub_406070
 int
-rlzcompress (void *output, int inlen, void *input, unsigned char mode)
+rlzcompress (void *output, int inlen, void *input, unsigned char mode,
+    int level)
 {
   if (!inlen)
     return -1;			// sanity check
@@ -125,6 +134,16 @@ rlzcompress (void *output, int inlen, void *input, unsigned char mode)
   rlzi->lastSearchBack = 0;
   rlzi->outputpos = 0;
   rlzi->inputpos = 0;		// added by me
+  switch (level) {
+    case RLZ_LEVEL_FAST:
+      rlzi->maxChain = RLZI_CHAIN_FAST;
+      break;
+    case RLZ_LEVEL_MAX:
+      rlzi->maxChain = 0;
+      break;
+    default:			// RLZ_LEVEL_NORMAL, 0 and unknown levels
+      rlzi->maxChain = RLZI_CHAIN_NORMAL;
+  }
 
   rlzi->sgl_120C84 = 0;
   rlzi->sgl_120C88 = 0.0625;
@@ -487,6 +506,7 @@ find_match (int *searchBackUsed, unsigned char realMode)
 {
   int tempCompare = 0;
   int maxBlockSize = 0xFF, matchLen = 1, backRef;
+  unsigned long chainLen = 0;
 
   unsigned int bytesLeft = rlzi->inputlen - rlzi->inputpos;
   unsigned long int searchBack;	// not too sure about this variable's name
@@ -693,6 +713,9 @@ find_match (int *searchBackUsed, unsigned char realMode)
     }
   loc_405F97:
     backRef = rlzi->dictionary[backRef & RLZI_DICTIONARY_SIZE];
+    // any match found is valid for the decoder, so we can stop looking early
+    if (rlzi->maxChain && ++chainLen >= rlzi->maxChain)
+      break;
   }
 
   // loc_405FB4:
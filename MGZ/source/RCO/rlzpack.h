@@ -9,5 +9,15 @@
 
 #ifndef __RLZPACK__
 #define __RLZPACK__
-int rlzcompress (void *output, int inlen, void *input, unsigned char mode);
+
+// effort levels - limit how far back the hash chains are followed when
+// searching for matches; RLZ_LEVEL_MAX searches the whole window
+// 0 or any other value is RLZ_LEVEL_DEFAULT
+#define RLZ_LEVEL_FAST		1
+#define RLZ_LEVEL_NORMAL	2
+#define RLZ_LEVEL_MAX		3
+#define RLZ_LEVEL_DEFAULT	RLZ_LEVEL_NORMAL
+
+int rlzcompress (void *output, int inlen, void *input, unsigned char mode,
+    int level);
 #endif
@@ -0,0 +1,492 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ppu-types.h>
+#include <sys/thread.h>
+#include <sys/mutex.h>
+#include <tiny3d.h>
+#include <pngdec/pngdec.h>
+
+#include "zlib.h"
+#include "apng.h"
+
+#define IHDR 0x49484452
+#define acTL 0x6163544C
+#define fcTL 0x6663544C
+#define IDAT 0x49444154
+#define fdAT 0x66644154
+#define IEND 0x49454E44
+
+#define DISPOSE_OP_NONE			0
+#define DISPOSE_OP_BACKGROUND	1
+#define DISPOSE_OP_PREVIOUS		2
+
+#define BLEND_OP_SOURCE			0
+#define BLEND_OP_OVER			1
+
+// a file with more frames is refused
+#define APNG_FRAMES_MAX		0x4000
+
+typedef struct
+{
+	u32 width;
+	u32 height;
+	u32 x_offset;
+	u32 y_offset;
+	u16 delay_num;
+	u16 delay_den;
+	u8 dispose_op;
+	u8 blend_op;
+
+	u32 first;		// offset of the first IDAT/fdAT chunk
+	u32 n_chunks;
+	u32 size;		// size of the compressed data, without the fdAT sequence numbers
+} apng_frame;
+
+struct apng_stream
+{
+	FILE *f;
+	u8 header[0x21];	// signature + IHDR
+	u32 width;
+	u32 height;
+	u8 gray;
+
+	u32 num_frames;
+	apng_frame *frames;
+
+	// composition, only used by the decoder
+	u32 *canvas;
+	u32 *previous;
+	u32 canvas_frame;	// next frame to compose
+
+	// ring of textures
+	u32 *texture[APNG_RING_MAX];
+	u32 offset[APNG_RING_MAX];
+	u32 ring;
+	u8 cached;			// every frame has its texture : decoded once
+	u8 still;			// not enough texture to stream : the first frame only
+
+	// frame counters (never reset, the frame is counter % num_frames)
+	u32 decoded;
+	u32 shown;
+	u64 shown_time;
+
+	sys_lwmutex_t lock;
+	sys_ppu_thread_t worker;
+	u8 worker_started;
+	volatile u8 running;
+};
+
+static u32 be32(const u8 *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static u16 be16(const u8 *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static void put_be32(u8 *p, u32 v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static int read_chunk_header(FILE *f, u32 *length, u32 *type)
+{
+	u8 ch[8];
+
+	if(fread(ch, 1, 8, f) != 8) return -1;
+	*length = be32(ch);
+	*type = be32(ch + 4);
+
+	return 0;
+}
+
+// first pass : offsets of the frame chunks, nothing is decoded
+static int apng_index(apng_stream *s)
+{
+	u8 buf[26];
+	u32 length, type;
+	u32 pos = 0x21;
+	u32 max_frames = 0;
+	int cur = -1;
+
+	fseek(s->f, pos, SEEK_SET);
+
+	while(read_chunk_header(s->f, &length, &type) == 0) {
+
+		if(type == IEND) break;
+
+		if(type == acTL && length >= 8) {
+			if(fread(buf, 1, 8, s->f) != 8) break;
+			max_frames = be32(buf);
+			if(max_frames == 0 || APNG_FRAMES_MAX < max_frames) return -1;
+			s->frames = (apng_frame *) calloc(max_frames, sizeof(apng_frame));
+			if(s->frames == NULL) return -1;
+		} else
+		if(type == fcTL && length >= 26 && s->frames != NULL) {
+			if(s->num_frames == max_frames) break;
+			if(fread(buf, 1, 26, s->f) != 26) break;
+
+			cur = s->num_frames++;
+			s->frames[cur].width      = be32(buf + 4);
+			s->frames[cur].height     = be32(buf + 8);
+			s->frames[cur].x_offset   = be32(buf + 12);
+			s->frames[cur].y_offset   = be32(buf + 16);
+			s->frames[cur].delay_num  = be16(buf + 20);
+			s->frames[cur].delay_den  = be16(buf + 22);
+			s->frames[cur].dispose_op = buf[24];
+			s->frames[cur].blend_op   = buf[25];
+			if(s->frames[cur].delay_den == 0) s->frames[cur].delay_den = 100;
+		} else
+		if((type == IDAT || type == fdAT) && 0 <= cur) {
+			// an IDAT without fcTL before is the default image, it isn't part of the animation
+			if(s->frames[cur].n_chunks == 0) s->frames[cur].first = pos;
+			s->frames[cur].n_chunks++;
+			s->frames[cur].size += type == fdAT ? length - 4 : length;
+		}
+
+		pos += 8 + length + 4;
+		if(fseek(s->f, pos, SEEK_SET) != 0) break;
+	}
+
+	// a frame without data can't be displayed
+	while(0 < s->num_frames && s->frames[s->num_frames-1].n_chunks == 0) s->num_frames--;
+
+	return s->num_frames ? 0 : -1;
+}
+
+// build a standalone PNG with the frame data and decode it
+static int apng_decode_frame(apng_stream *s, apng_frame *fr, pngData *out)
+{
+	static const u8 IEND_[0xC] = {0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82};
+	u32 total = 0x29 + fr->size + 4 + 0xC;
+	u32 length, type;
+	u32 n, cur_size = 0;
+	int ret = -1;
+
+	u8 *png = (u8 *) malloc(total);
+	if(png == NULL) return -1;
+
+	memcpy(png, s->header, 0x21);
+	put_be32(png + 0x10, fr->width);
+	put_be32(png + 0x14, fr->height);
+	put_be32(png + 0x1D, crc32(crc32(0L, Z_NULL, 0), png + 0xC, 0x11));
+	put_be32(png + 0x21, fr->size);
+	put_be32(png + 0x25, IDAT);
+
+	fseek(s->f, fr->first, SEEK_SET);
+
+	for(n = 0; n < fr->n_chunks; ) {
+		if(read_chunk_header(s->f, &length, &type) != 0) goto end;
+
+		if(type == IDAT || type == fdAT) {
+			if(type == fdAT) {
+				fseek(s->f, 4, SEEK_CUR); // sequence number
+				length -= 4;
+			}
+			if(fr->size < cur_size + length) goto end;
+			if(fread(png + 0x29 + cur_size, 1, length, s->f) != length) goto end;
+			cur_size += length;
+			n++;
+		} else fseek(s->f, length, SEEK_CUR);
+
+		fseek(s->f, 4, SEEK_CUR); // CRC
+	}
+
+	put_be32(png + 0x29 + fr->size, crc32(crc32(0L, Z_NULL, 0), png + 0x25, 4 + fr->size));
+	memcpy(png + 0x29 + fr->size + 4, IEND_, 0xC);
+
+	memset(out, 0, sizeof(pngData));
+	if(pngLoadFromBuffer((const void *) png, total, out) == 0 && out->bmp_out != NULL) {
+		if(out->width == fr->width && out->height == fr->height) ret = 0;
+		else {
+			free(out->bmp_out);
+			out->bmp_out = NULL;
+		}
+	}
+
+end:
+	free(png);
+	return ret;
+}
+
+static void apng_clear(apng_stream *s, apng_frame *fr)
+{
+	u32 y;
+
+	for(y = 0; y < fr->height; y++)
+		memset(&s->canvas[(fr->y_offset + y) * s->width + fr->x_offset], 0, fr->width * 4);
+}
+
+static void apng_copy_region(apng_stream *s, apng_frame *fr, u32 *dst, u32 *src)
+{
+	u32 y;
+
+	for(y = 0; y < fr->height; y++) {
+		u32 p = (fr->y_offset + y) * s->width + fr->x_offset;
+		memcpy(&dst[p], &src[p], fr->width * 4);
+	}
+}
+
+// ARGB, not premultiplied
+static u32 apng_over(u32 src, u32 dst)
+{
+	u32 sa = src >> 24;
+	u32 da = dst >> 24;
+
+	if(sa == 0xFF || da == 0) return src;
+	if(sa == 0) return dst;
+
+	u32 db = da * (0xFF - sa) / 0xFF;
+	u32 a = sa + db;
+	u32 r = (((src >> 16) & 0xFF) * sa + ((dst >> 16) & 0xFF) * db) / a;
+	u32 g = (((src >> 8) & 0xFF) * sa + ((dst >> 8) & 0xFF) * db) / a;
+	u32 b = ((src & 0xFF) * sa + (dst & 0xFF) * db) / a;
+
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+// compose the next frame in the canvas
+static void apng_compose(apng_stream *s)
+{
+	u32 i = s->canvas_frame;
+	apng_frame *fr = &s->frames[i];
+	pngData png;
+	u32 x, y;
+
+	if(i == 0) {
+		memset(s->canvas, 0, s->width * s->height * 4);
+	} else {
+		// disposal of the previous frame
+		apng_frame *last = &s->frames[i-1];
+		if(last->x_offset + last->width <= s->width && last->y_offset + last->height <= s->height) {
+			if(last->dispose_op == DISPOSE_OP_BACKGROUND || (i == 1 && last->dispose_op == DISPOSE_OP_PREVIOUS)) apng_clear(s, last);
+			else
+			if(last->dispose_op == DISPOSE_OP_PREVIOUS && s->previous) apng_copy_region(s, last, s->canvas, s->previous);
+		}
+	}
+
+	s->canvas_frame = (i + 1) % s->num_frames;
+
+	// a frame out of the canvas is ignored
+	if(s->width < fr->x_offset + fr->width || s->height < fr->y_offset + fr->height) return;
+
+	if(fr->dispose_op == DISPOSE_OP_PREVIOUS && i != 0) {
+		if(s->previous == NULL) s->previous = (u32 *) malloc(s->width * s->height * 4);
+		if(s->previous) apng_copy_region(s, fr, s->previous, s->canvas);
+	}
+
+	if(apng_decode_frame(s, fr, &png) != 0) return;
+
+	for(y = 0; y < fr->height; y++) {
+		u32 *src = (u32 *) ((u8 *) png.bmp_out + y * png.pitch);
+		u32 *dst = &s->canvas[(fr->y_offset + y) * s->width + fr->x_offset];
+
+		if(fr->blend_op == BLEND_OP_SOURCE) memcpy(dst, src, fr->width * 4);
+		else for(x = 0; x < fr->width; x++) dst[x] = apng_over(src[x], dst[x]);
+	}
+
+	free(png.bmp_out);
+}
+
+static void apng_to_texture(apng_stream *s, u32 *texture)
+{
+	u32 n, count = s->width * s->height;
+
+	if(s->gray == 0) {
+		memcpy(texture, s->canvas, count * 4);
+		return;
+	}
+
+	for(n = 0; n < count; n++) {
+		u32 c = s->canvas[n];
+		u32 Y = (77 * ((c >> 16) & 0xFF) + 150 * ((c >> 8) & 0xFF) + 29 * (c & 0xFF)) >> 8;
+		texture[n] = (c & 0xFF000000) | (Y << 16) | (Y << 8) | Y;
+	}
+}
+
+// the slot of the frame shown and the one before it (the RSX can still read it) are never written
+static int apng_can_decode(apng_stream *s)
+{
+	if(s->cached) return s->decoded < s->num_frames;
+
+	u32 ahead = 2 < s->ring ? s->ring - 2 : 1;
+
+	return s->decoded <= s->shown + ahead;
+}
+
+static void apng_decode_next(apng_stream *s)
+{
+	apng_compose(s);
+	apng_to_texture(s, s->texture[s->decoded % s->ring]);
+
+	sysLwMutexLock(&s->lock, 0);
+	s->decoded++;
+	sysLwMutexUnlock(&s->lock);
+}
+
+static void apng_worker(void *arg)
+{
+	apng_stream *s = (apng_stream *) arg;
+
+	while(s->running) {
+		sysLwMutexLock(&s->lock, 0);
+		int todo = apng_can_decode(s);
+		sysLwMutexUnlock(&s->lock);
+
+		if(todo) apng_decode_next(s);
+		else
+		if(s->cached) break;
+		else usleep(5000);
+	}
+
+	sysThreadExit(0);
+}
+
+apng_stream *APNG_Open(const char *path, u32 *texture, u32 size, u8 gray)
+{
+	static const u8 sig[8] = {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
+	u32 n;
+
+	apng_stream *s = (apng_stream *) calloc(1, sizeof(apng_stream));
+	if(s == NULL) return NULL;
+
+	s->f = fopen(path, "rb");
+	if(s->f == NULL) goto error;
+
+	if(fread(s->header, 1, 0x21, s->f) != 0x21) goto error;
+	if(memcmp(s->header, sig, 8) != 0) goto error;
+	if(be32(s->header + 12) != IHDR) goto error;
+
+	s->width = be32(s->header + 16);
+	s->height = be32(s->header + 20);
+	s->gray = gray;
+	if(s->width == 0 || s->height == 0 || 0x4000 < s->width || 0x4000 < s->height) goto error;
+
+	if(apng_index(s) != 0) goto error;
+
+	u32 frame_size = (s->width * s->height * 4 + 15) & ~15;
+
+	s->ring = size / frame_size;
+	if(s->ring == 0) goto error;
+	if(s->num_frames <= s->ring) {
+		s->ring = s->num_frames;
+		s->cached = 1;
+	} else {
+		if(APNG_RING_MAX < s->ring) s->ring = APNG_RING_MAX;
+		// streaming needs the slot shown, the one the RSX can still read and one to decode
+		if(s->ring < 3) {
+			s->ring = 1;
+			s->still = 1;
+		}
+	}
+
+	for(n = 0; n < s->ring; n++) {
+		s->texture[n] = texture + n * frame_size / 4;
+		s->offset[n] = tiny3d_TextureOffset(s->texture[n]);
+	}
+
+	s->canvas = (u32 *) malloc(s->width * s->height * 4);
+	if(s->canvas == NULL) goto error;
+
+	sys_lwmutex_attr_t attr = {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""};
+	if(sysLwMutexCreate(&s->lock, &attr) != 0) goto error;
+
+	// the first frame is ready when it returns
+	apng_decode_next(s);
+
+	if(1 < s->num_frames && !s->still) {
+		s->running = 1;
+		if(sysThreadCreate(&s->worker, apng_worker, (void *) s, 1001, 0x4000, THREAD_JOINABLE, (char *) "apng_decoder") == 0) s->worker_started = 1;
+		else s->running = 0;
+	}
+
+	return s;
+
+error:
+	if(s->f) fclose(s->f);
+	if(s->frames) free(s->frames);
+	if(s->canvas) free(s->canvas);
+	free(s);
+	return NULL;
+}
+
+void APNG_Close(apng_stream *s)
+{
+	if(s == NULL) return;
+
+	if(s->worker_started) {
+		u64 ret;
+		s->running = 0;
+		sysThreadJoin(s->worker, &ret);
+	}
+
+	sysLwMutexDestroy(&s->lock);
+
+	fclose(s->f);
+	free(s->frames);
+	free(s->canvas);
+	if(s->previous) free(s->previous);
+	free(s);
+}
+
+u32 APNG_Width(apng_stream *s)
+{
+	return s->width;
+}
+
+u32 APNG_Height(apng_stream *s)
+{
+	return s->height;
+}
+
+u32 APNG_NumFrames(apng_stream *s)
+{
+	return s->num_frames;
+}
+
+u32 APNG_TextureSize(apng_stream *s)
+{
+	return s->ring * ((s->width * s->height * 4 + 15) & ~15);
+}
+
+u32 APNG_Update(apng_stream *s, u64 now, u32 *next)
+{
+	if(s->still) {
+		if(next) *next = 0xFFFFFFFF;
+		return s->offset[0];
+	}
+
+	apng_frame *fr = &s->frames[s->shown % s->num_frames];
+	u64 delay = (u64) fr->delay_num * 1000000 / fr->delay_den;
+
+	if(s->shown_time == 0) s->shown_time = now;
+
+	if(s->shown_time + delay <= now) {
+		sysLwMutexLock(&s->lock, 0);
+		// the worker already has the next frame, or without worker it's decoded here
+		if(s->shown + 1 < s->decoded || (s->cached && s->decoded == s->num_frames)) s->shown++;
+		else
+		if(!s->worker_started) {
+			s->shown++;
+			sysLwMutexUnlock(&s->lock);
+			apng_decode_next(s);
+			sysLwMutexLock(&s->lock, 0);
+		}
+		sysLwMutexUnlock(&s->lock);
+
+		s->shown_time = now;
+		fr = &s->frames[s->shown % s->num_frames];
+		delay = (u64) fr->delay_num * 1000000 / fr->delay_den;
+	}
+
+	if(next) *next = s->shown_time + delay <= now ? 0 : s->shown_time + delay - now;
+
+	return s->offset[s->shown % s->ring];
+}
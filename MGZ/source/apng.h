@@ -0,0 +1,40 @@
+#ifndef __APNG_H__
+#define __APNG_H__
+
+#include <ppu-types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// textures of the ring : the frame displayed, the one the RSX can still read and the next ones
+#define APNG_RING_MAX		4
+
+typedef struct apng_stream apng_stream;
+
+// Index the frames of an APNG and decode the first one.
+// The frames are composed (fcTL dispose/blend) in a canvas and copied in a ring of textures
+// taken from 'texture', 'size' bytes max. A worker thread decodes the next frames.
+// Returns NULL if the file isn't an APNG or if one frame doesn't fit in 'size'.
+// When 'size' can't hold every frame nor a ring of 3, only the first frame is shown.
+apng_stream *APNG_Open(const char *path, u32 *texture, u32 size, u8 gray);
+
+void APNG_Close(apng_stream *s);
+
+u32 APNG_Width(apng_stream *s);
+u32 APNG_Height(apng_stream *s);
+u32 APNG_NumFrames(apng_stream *s);
+
+// bytes of texture used by the ring
+u32 APNG_TextureSize(apng_stream *s);
+
+// Texture offset of the frame to display at 'now' (us), 0 if there isn't any.
+// The animation doesn't skip a frame : if the next one isn't decoded yet, the current one stays.
+// 'next' receives the time before the next frame in us.
+u32 APNG_Update(apng_stream *s, u64 now, u32 *next);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __APNG_H__ */
@@ -0,0 +1,2115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <ppu-types.h>
+#include <sys/thread.h>
+#include <sys/mutex.h>
+
+#include <zip.h>
+#include "zlib.h"
+#include "bzlib.h"
+#include "unrar.h"
+#include "7z.h"
+#include "7zAlloc.h"
+#include "7zBuf.h"
+#include "7zCrc.h"
+#include "7zFile.h"
+#include "7zFunctions.h"
+
+#include "zip_extract.h"
+#include "archive.h"
+
+#define YES			1
+#define NO			0
+
+// data written at once
+#define ARCHIVE_BUFFER_SIZE		0x100000
+// data read at once from the archive
+#define ARCHIVE_IN_SIZE			0x40000
+// min time between two calls of the progress callback (us)
+#define ARCHIVE_REPORT_PERIOD	100000
+
+#define ARCHIVE_ZIP_WORKERS		3
+
+#define TAR_BLOCK				512
+
+extern void print_load(char *format, ...);
+extern u8 SetFilePerms(char *path);
+extern u64 get_usec();
+
+typedef struct archive_ctx archive_ctx;
+
+typedef struct
+{
+	u8 format;
+	char *name;
+	int (*list)(archive_ctx *ctx);
+	int (*extract)(archive_ctx *ctx);
+} archive_backend;
+
+struct archive_ctx
+{
+	char *path;
+	char *dst;
+	u8 format;
+
+	// selection, sorted, NULL for every entry
+	char **names;
+	u32 names_number;
+
+	archive_progress progress;
+	void *arg;
+	archive_status status;
+	u64 start;
+	u64 last_report;
+	int ret;
+
+	// list mode
+	archive_entry *entries;
+	u32 number;
+	u32 max;
+
+	// shared writer
+	FILE *out;
+	char *out_path;
+	u8 *buf;
+	u32 used;
+	u8 *in;
+	char *last_dir;
+};
+
+//*******************************************************
+// Common
+//*******************************************************
+
+static int cmp_name(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static u8 archive_selected(archive_ctx *ctx, char *name)
+{
+	if(bsearch(&name, ctx->names, ctx->names_number, sizeof(char *), cmp_name) != NULL) return YES;
+
+	// one of its parent folders is selected
+	char *p;
+	for(p = strchr(name, '/'); p != NULL; p = strchr(p + 1, '/')) {
+		char c = p[1];
+		p[1] = 0;
+		u8 found = (bsearch(&name, ctx->names, ctx->names_number, sizeof(char *), cmp_name) != NULL);
+		p[1] = c;
+		if(found) return YES;
+	}
+
+	return NO;
+}
+
+// absolute name or ".." component, '\\' is a separator too (archives made on Windows)
+static u8 archive_escapes(char *name)
+{
+	char *p = name;
+
+	if(*p == '/' || *p == '\\') return YES;
+
+	while(*p) {
+		char *s = p;
+		while(*p && *p != '/' && *p != '\\') p++;
+		if(p - s == 2 && s[0] == '.' && s[1] == '.') return YES;
+		if(*p) p++;
+	}
+
+	return NO;
+}
+
+// entry to extract : selected and written inside the destination folder
+static u8 archive_wanted(archive_ctx *ctx, char *name)
+{
+	if(ctx->names && archive_selected(ctx, name) == NO) return NO;
+
+	if(archive_escapes(name)) {
+		print_load("Warning : %s skipped", name);
+		return NO;
+	}
+
+	return YES;
+}
+
+static void archive_add(archive_ctx *ctx, char *name, u64 size, u8 dir)
+{
+	if(ctx->number == ctx->max) {
+		u32 max = ctx->max ? ctx->max * 2 : 256;
+		archive_entry *entries = (archive_entry *) realloc(ctx->entries, max * sizeof(archive_entry));
+		if(entries == NULL) return;
+		ctx->entries = entries;
+		ctx->max = max;
+	}
+
+	archive_entry *e = &ctx->entries[ctx->number];
+	e->name = strdup(name);
+	if(e->name == NULL) return;
+	e->size = size;
+	e->dir = dir;
+	ctx->number++;
+}
+
+// returns NO if the extraction must stop
+static u8 archive_report(archive_ctx *ctx, u64 size, u32 files_done)
+{
+	u64 now = get_usec();
+
+	ctx->status.done += size;
+	ctx->status.files_done += files_done;
+
+	if(now != ctx->start) ctx->status.speed = ctx->status.done * 1000000 / (now - ctx->start);
+
+	if(ctx->progress && ctx->ret == ARCHIVE_OK) {
+		if(files_done || ARCHIVE_REPORT_PERIOD <= now - ctx->last_report) {
+			ctx->last_report = now;
+			if(ctx->progress(&ctx->status, ctx->arg) == NO) ctx->ret = ARCHIVE_CANCELED;
+		}
+	}
+
+	return ctx->ret == ARCHIVE_OK;
+}
+
+// destination of an entry, its parent folders are created
+static char *archive_out_path(archive_ctx *ctx, char *name)
+{
+	char *path = (char *) malloc(strlen(ctx->dst) + strlen(name) + 2);
+	if(path == NULL) return NULL;
+
+	sprintf(path, "%s/%s", ctx->dst, name);
+
+	char *end;
+	for(end = path + strlen(ctx->dst) + 1; *end; end++) if(*end == '\\') *end = '/';
+
+	while(path + strlen(ctx->dst) + 1 < end && end[-1] == '/') *--end = 0;
+
+	// the entries of a folder usually follow each other
+	end = strrchr(path, '/');
+	u32 len = end - path;
+	if(strlen(ctx->last_dir) != len || strncmp(path, ctx->last_dir, len) != 0) {
+		char *p;
+		for(p = path + strlen(ctx->dst) + 1; p <= end; p++) {
+			if(*p != '/') continue;
+			*p = 0;
+			mkdir(path, 0777);
+			*p = '/';
+		}
+		if(len < ARCHIVE_IN_SIZE) {
+			memcpy(ctx->last_dir, path, len);
+			ctx->last_dir[len] = 0;
+		}
+	}
+
+	return path;
+}
+
+static void archive_mkdir(archive_ctx *ctx, char *name)
+{
+	char *path = archive_out_path(ctx, name);
+	if(path == NULL) return;
+
+	mkdir(path, 0777);
+	free(path);
+}
+
+static u8 archive_flush(archive_ctx *ctx)
+{
+	if(ctx->used == 0) return YES;
+
+	u32 size = ctx->used;
+	ctx->used = 0;
+
+	if(fwrite(ctx->buf, 1, size, ctx->out) != size) {
+		print_load("Error : failed to write %s", ctx->out_path);
+		ctx->ret = ARCHIVE_ERROR;
+		return NO;
+	}
+
+	return archive_report(ctx, size, 0);
+}
+
+static u8 archive_open_file(archive_ctx *ctx, char *name)
+{
+	ctx->out_path = archive_out_path(ctx, name);
+	if(ctx->out_path == NULL) return NO;
+
+	ctx->status.name = name;
+	ctx->used = 0;
+
+	ctx->out = fopen(ctx->out_path, "wb");
+	if(ctx->out == NULL) {
+		print_load("Error : fopen() failed : %s", ctx->out_path);
+		free(ctx->out_path);
+		ctx->out_path = NULL;
+		return NO;
+	}
+	SetFilePerms(ctx->out_path);
+
+	return YES;
+}
+
+static u8 archive_write(archive_ctx *ctx, u8 *data, u64 size)
+{
+	while(size) {
+		u32 n = ARCHIVE_BUFFER_SIZE - ctx->used;
+		if(size < n) n = size;
+
+		memcpy(ctx->buf + ctx->used, data, n);
+		ctx->used += n;
+		data += n;
+		size -= n;
+
+		if(ctx->used == ARCHIVE_BUFFER_SIZE) {
+			if(archive_flush(ctx) == NO) return NO;
+		}
+	}
+
+	return YES;
+}
+
+// an incomplete file is removed
+static u8 archive_close_file(archive_ctx *ctx, u8 ok)
+{
+	if(ctx->out == NULL) return NO;
+
+	if(ok) ok = archive_flush(ctx);
+	if(fclose(ctx->out) != 0) ok = NO;
+	if(ok == NO) unlink(ctx->out_path);
+
+	ctx->out = NULL;
+	free(ctx->out_path);
+	ctx->out_path = NULL;
+
+	if(ok) ok = archive_report(ctx, 0, 1);
+
+	return ok;
+}
+
+//*******************************************************
+// ZIP
+//*******************************************************
+
+static void zip_add(char *name, u64 size, u8 dir, void *arg)
+{
+	archive_add((archive_ctx *) arg, name, size, dir);
+}
+
+static int zip_list_entries(archive_ctx *ctx)
+{
+	if(zip_list(ctx->path, zip_add, ctx) != ZIP_EXTRACT_OK) return ARCHIVE_ERROR;
+
+	return ARCHIVE_OK;
+}
+
+// the names are checked by zip_extract
+static u8 zip_filter(char *name, void *arg)
+{
+	return archive_selected((archive_ctx *) arg, name);
+}
+
+static u8 zip_progress(u32 files_done, u32 files, u64 done, u64 total, void *arg)
+{
+	archive_ctx *ctx = (archive_ctx *) arg;
+
+	ctx->status.files = files;
+	ctx->status.total = total;
+
+	return archive_report(ctx, done - ctx->status.done, files_done - ctx->status.files_done);
+}
+
+// entries the built-in extractor can't handle (encryption, bzip2, lzma...)
+static int zip_libzip_extract(archive_ctx *ctx)
+{
+	struct zip_stat file_stat;
+	int err = 0;
+	int i;
+
+	struct zip *f_zip = zip_open(ctx->path, ZIP_CHECKCONS, &err);
+	if(err != ZIP_ER_OK || f_zip == NULL) {
+		print_load("Error : zip_open");
+		return ARCHIVE_ERROR;
+	}
+
+	int count = zip_get_num_files(f_zip);
+	if(count == -1) {
+		print_load("Error : zip_get_num_files");
+		zip_close(f_zip);
+		return ARCHIVE_ERROR;
+	}
+
+	ctx->status.files = 0;
+	ctx->status.total = 0;
+	for(i=0; i<count; i++) {
+		if(zip_stat_index(f_zip, i, 0, &file_stat) == -1) continue;
+		if(file_stat.name[0] == 0 || file_stat.name[strlen(file_stat.name)-1] == '/') continue;
+		if(ctx->names && archive_selected(ctx, (char *) file_stat.name) == NO) continue;
+		ctx->status.files++;
+		ctx->status.total += file_stat.size;
+	}
+
+	for(i=0; i<count; i++) {
+		if(zip_stat_index(f_zip, i, 0, &file_stat) == -1) {
+			print_load("Error : zip_stat_index");
+			ctx->ret = ARCHIVE_ERROR;
+			break;
+		}
+
+		char *name = (char *) file_stat.name;
+		if(archive_wanted(ctx, name) == NO) continue;
+
+		print_load("%s", name);
+
+		if(name[0] == 0 || name[strlen(name)-1] == '/') {
+			archive_mkdir(ctx, name);
+			continue;
+		}
+
+		struct zip_file *file_zip = zip_fopen_index(f_zip, i, ZIP_FL_UNCHANGED);
+		if(file_zip == NULL) {
+			print_load("Error : zip_fopen_index");
+			ctx->ret = ARCHIVE_ERROR;
+			break;
+		}
+
+		if(archive_open_file(ctx, name) == NO) {
+			zip_fclose(file_zip);
+			ctx->ret = ARCHIVE_ERROR;
+			break;
+		}
+
+		u8 ok = YES;
+		u64 pos = 0;
+		while(ok && pos < file_stat.size) {
+			u64 size = file_stat.size - pos;
+			if(ARCHIVE_IN_SIZE < size) size = ARCHIVE_IN_SIZE;
+
+			if(zip_fread(file_zip, ctx->in, size) != size) {
+				print_load("Error : zip_fread");
+				ctx->ret = ARCHIVE_ERROR;
+				ok = NO;
+				break;
+			}
+			ok = archive_write(ctx, ctx->in, size);
+			pos += size;
+		}
+		zip_fclose(file_zip);
+
+		if(archive_close_file(ctx, ok) == NO) break;
+	}
+
+	zip_close(f_zip);
+
+	return ctx->ret;
+}
+
+static int zip_extract_entries_ctx(archive_ctx *ctx)
+{
+	int ret = zip_extract_entries(ctx->path, ctx->dst, ARCHIVE_ZIP_WORKERS, ctx->names ? zip_filter : NULL, zip_progress, ctx);
+
+	if(ret == ZIP_EXTRACT_OK) return ARCHIVE_OK;
+	if(ret == ZIP_EXTRACT_CANCELED) return ARCHIVE_CANCELED;
+	if(ret == ZIP_EXTRACT_UNSUPPORTED) return zip_libzip_extract(ctx);
+
+	return ARCHIVE_ERROR;
+}
+
+//*******************************************************
+// RAR
+//*******************************************************
+
+static HANDLE rar_open(archive_ctx *ctx, u32 mode)
+{
+	struct RAROpenArchiveDataEx data;
+
+	memset(&data, 0, sizeof(data));
+	data.ArcName = ctx->path;
+	data.OpenMode = mode;
+
+	HANDLE h = RAROpenArchiveEx(&data);
+	if(data.OpenResult != ERAR_SUCCESS) {
+		print_load("Error : RAROpenArchiveEx %d", data.OpenResult);
+		if(h) RARCloseArchive(h);
+		return NULL;
+	}
+
+	return h;
+}
+
+static int rar_list_entries(archive_ctx *ctx)
+{
+	struct RARHeaderDataEx header;
+	int ret;
+
+	HANDLE h = rar_open(ctx, RAR_OM_LIST);
+	if(h == NULL) return ARCHIVE_ERROR;
+
+	memset(&header, 0, sizeof(header));
+	while((ret = RARReadHeaderEx(h, &header)) == ERAR_SUCCESS) {
+		archive_add(ctx, header.FileName, header.UnpSize + (((u64) header.UnpSizeHigh) << 32), (header.Flags & RHDF_DIRECTORY) != 0);
+		if(RARProcessFile(h, RAR_SKIP, NULL, NULL) != ERAR_SUCCESS) break;
+	}
+	RARCloseArchive(h);
+
+	if(ret != ERAR_END_ARCHIVE) return ARCHIVE_ERROR;
+
+	return ARCHIVE_OK;
+}
+
+static int CALLBACK rar_callback(unsigned int msg, LPARAM user, LPARAM p1, LPARAM p2)
+{
+	archive_ctx *ctx = (archive_ctx *) user;
+
+	if(msg == UCM_PROCESSDATA) return archive_report(ctx, p2, 0) ? 1 : -1;
+
+	// no password
+	return -1;
+}
+
+static int rar_extract_entries(archive_ctx *ctx)
+{
+	struct RARHeaderDataEx header;
+	u32 i;
+
+	// the headers are read once before for the totals, it doesn't decompress anything
+	if(rar_list_entries(ctx) != ARCHIVE_OK) return ARCHIVE_ERROR;
+	for(i=0; i<ctx->number; i++) {
+		if(ctx->entries[i].dir) continue;
+		if(ctx->names && archive_selected(ctx, ctx->entries[i].name) == NO) continue;
+		ctx->status.files++;
+		ctx->status.total += ctx->entries[i].size;
+	}
+
+	HANDLE h = rar_open(ctx, RAR_OM_EXTRACT);
+	if(h == NULL) return ARCHIVE_ERROR;
+
+	RARSetCallback(h, rar_callback, (LPARAM) ctx);
+
+	memset(&header, 0, sizeof(header));
+	while(RARReadHeaderEx(h, &header) == ERAR_SUCCESS) {
+		char *name = header.FileName;
+
+		if(archive_wanted(ctx, name) == NO) {
+			if(RARProcessFile(h, RAR_SKIP, NULL, NULL) != ERAR_SUCCESS) {
+				ctx->ret = ARCHIVE_ERROR;
+				break;
+			}
+			continue;
+		}
+
+		print_load("%s", name);
+
+		if(header.Flags & RHDF_DIRECTORY) {
+			archive_mkdir(ctx, name);
+			if(RARProcessFile(h, RAR_SKIP, NULL, NULL) != ERAR_SUCCESS) {
+				ctx->ret = ARCHIVE_ERROR;
+				break;
+			}
+			continue;
+		}
+
+		// unrar writes the file itself
+		char *path = archive_out_path(ctx, name);
+		ctx->status.name = name;
+
+		if(RARProcessFile(h, RAR_EXTRACT, NULL, path) != ERAR_SUCCESS) {
+			if(ctx->ret == ARCHIVE_OK) {
+				print_load("Error : failed to extract %s", name);
+				ctx->ret = ARCHIVE_ERROR;
+			}
+			if(path) unlink(path);
+			free(path);
+			break;
+		}
+		if(path) SetFilePerms(path);
+		free(path);
+
+		if(archive_report(ctx, 0, 1) == NO) break;
+	}
+
+	RARCloseArchive(h);
+
+	return ctx->ret;
+}
+
+//*******************************************************
+// 7Z
+//*******************************************************
+
+static const ISzAlloc alloc_7z = {SzAlloc, SzFree};
+
+typedef struct
+{
+	CFileInStream stream;
+	CLookToRead2 look;
+	CSzArEx db;
+	UInt16 *name16;
+	size_t name16_size;
+	CBuf name;
+} archive_7z;
+
+static u8 open_7z(archive_ctx *ctx, archive_7z *a)
+{
+	memset(a, 0, sizeof(archive_7z));
+	Buf_Init(&a->name);
+
+	if(InFile_Open(&a->stream.file, ctx->path)) {
+		print_load("Error : fopen() failed : %s", ctx->path);
+		return NO;
+	}
+	FileInStream_CreateVTable(&a->stream);
+
+	LookToRead2_CreateVTable(&a->look, False);
+	a->look.buf = (Byte *) ISzAlloc_Alloc(&alloc_7z, ARCHIVE_IN_SIZE);
+	if(a->look.buf == NULL) {
+		File_Close(&a->stream.file);
+		return NO;
+	}
+	a->look.bufSize = ARCHIVE_IN_SIZE;
+	a->look.realStream = &a->stream.vt;
+	LookToRead2_Init(&a->look);
+
+	CrcGenerateTable();
+	SzArEx_Init(&a->db);
+	if(SzArEx_Open(&a->db, &a->look.vt, &alloc_7z, &alloc_7z) != SZ_OK) {
+		print_load("Error : SzArEx_Open");
+		SzArEx_Free(&a->db, &alloc_7z);
+		ISzAlloc_Free(&alloc_7z, a->look.buf);
+		File_Close(&a->stream.file);
+		return NO;
+	}
+
+	return YES;
+}
+
+static void close_7z(archive_7z *a)
+{
+	Buf_Free(&a->name, &alloc_7z);
+	SzFree(NULL, a->name16);
+	SzArEx_Free(&a->db, &alloc_7z);
+	ISzAlloc_Free(&alloc_7z, a->look.buf);
+	File_Close(&a->stream.file);
+}
+
+static char *name_7z(archive_7z *a, u32 i)
+{
+	size_t len = SzArEx_GetFileNameUtf16(&a->db, i, NULL);
+
+	if(a->name16_size < len) {
+		SzFree(NULL, a->name16);
+		a->name16 = (UInt16 *) SzAlloc(NULL, len * sizeof(UInt16));
+		if(a->name16 == NULL) {
+			a->name16_size = 0;
+			return NULL;
+		}
+		a->name16_size = len;
+	}
+	SzArEx_GetFileNameUtf16(&a->db, i, a->name16);
+
+	if(Utf16_To_Char(&a->name, a->name16) != SZ_OK) return NULL;
+
+	return (char *) a->name.data;
+}
+
+static int list_7z(archive_ctx *ctx)
+{
+	archive_7z a;
+	u32 i;
+
+	if(open_7z(ctx, &a) == NO) return ARCHIVE_ERROR;
+
+	for(i=0; i<a.db.NumFiles; i++) {
+		char *name = name_7z(&a, i);
+		if(name == NULL) break;
+		archive_add(ctx, name, SzArEx_GetFileSize(&a.db, i), SzArEx_IsDir(&a.db, i) != 0);
+	}
+
+	close_7z(&a);
+
+	return ARCHIVE_OK;
+}
+
+static int extract_7z(archive_ctx *ctx)
+{
+	archive_7z a;
+	u32 i;
+
+	// decoded block, kept between the files of a solid archive
+	UInt32 block = 0xFFFFFFFF;
+	Byte *block_data = NULL;
+	size_t block_size = 0;
+
+	if(open_7z(ctx, &a) == NO) return ARCHIVE_ERROR;
+
+	for(i=0; i<a.db.NumFiles; i++) {
+		if(SzArEx_IsDir(&a.db, i)) continue;
+		char *name = name_7z(&a, i);
+		if(name == NULL) continue;
+		if(ctx->names && archive_selected(ctx, name) == NO) continue;
+		ctx->status.files++;
+		ctx->status.total += SzArEx_GetFileSize(&a.db, i);
+	}
+
+	for(i=0; i<a.db.NumFiles; i++) {
+		size_t offset = 0;
+		size_t size = 0;
+
+		char *name = name_7z(&a, i);
+		if(name == NULL) {
+			ctx->ret = ARCHIVE_ERROR;
+			break;
+		}
+
+		if(archive_wanted(ctx, name) == NO) continue;
+
+		print_load("%s", name);
+
+		if(SzArEx_IsDir(&a.db, i)) {
+			archive_mkdir(ctx, name);
+			continue;
+		}
+
+		if(SzArEx_Extract(&a.db, &a.look.vt, i, &block, &block_data, &block_size, &offset, &size, &alloc_7z, &alloc_7z) != SZ_OK) {
+			print_load("Error : failed to extract %s", name);
+			ctx->ret = ARCHIVE_ERROR;
+			break;
+		}
+
+		if(archive_open_file(ctx, name) == NO) {
+			ctx->ret = ARCHIVE_ERROR;
+			break;
+		}
+		u8 ok = archive_write(ctx, block_data + offset, size);
+		if(archive_close_file(ctx, ok) == NO) break;
+	}
+
+	ISzAlloc_Free(&alloc_7z, block_data);
+	close_7z(&a);
+
+	return ctx->ret;
+}
+
+//*******************************************************
+// TAR
+//*******************************************************
+
+typedef struct
+{
+	FILE *f;
+	u8 format;
+	z_stream z;
+	bz_stream bz;
+	u8 ready;
+	u8 end;				// end of the compressed stream
+	u8 *in;
+	u64 *read;
+	sys_lwmutex_t *lock;	// pipeline : the progress is also read by the writers
+} tar_stream;
+
+static void tar_stream_count(tar_stream *s, u64 n)
+{
+	if(s->lock) sysLwMutexLock(s->lock, 0);
+	*s->read += n;
+	if(s->lock) sysLwMutexUnlock(s->lock);
+}
+
+static u8 tar_stream_open(archive_ctx *ctx, tar_stream *s)
+{
+	memset(s, 0, sizeof(tar_stream));
+	s->format = ctx->format;
+	s->in = ctx->in;
+	s->read = &ctx->status.read;
+
+	s->f = fopen(ctx->path, "rb");
+	if(s->f == NULL) {
+		print_load("Error : fopen() failed : %s", ctx->path);
+		return NO;
+	}
+
+	if(s->format == ARCHIVE_TAR_GZ) {
+		// gzip header
+		if(inflateInit2(&s->z, 15 + 16) != Z_OK) return NO;
+	} else
+	if(s->format == ARCHIVE_TAR_BZ2) {
+		if(BZ2_bzDecompressInit(&s->bz, 0, 0) != BZ_OK) return NO;
+	}
+	s->ready = YES;
+
+	return YES;
+}
+
+static void tar_stream_close(tar_stream *s)
+{
+	if(s->ready) {
+		if(s->format == ARCHIVE_TAR_GZ) inflateEnd(&s->z);
+		if(s->format == ARCHIVE_TAR_BZ2) BZ2_bzDecompressEnd(&s->bz);
+	}
+	if(s->f) fclose(s->f);
+}
+
+static u32 tar_stream_fill(tar_stream *s)
+{
+	u32 n = fread(s->in, 1, ARCHIVE_IN_SIZE, s->f);
+	tar_stream_count(s, n);
+	return n;
+}
+
+// returns the number of bytes read, less than 'size' at the end of the archive, -1 if it's corrupted
+static s64 tar_stream_read(tar_stream *s, u8 *buf, u32 size)
+{
+	if(s->format == ARCHIVE_TAR) {
+		u32 n = fread(buf, 1, size, s->f);
+		tar_stream_count(s, n);
+		return n;
+	}
+
+	if(s->format == ARCHIVE_TAR_GZ) {
+		s->z.next_out = buf;
+		s->z.avail_out = size;
+		while(s->z.avail_out && s->end == NO) {
+			if(s->z.avail_in == 0) {
+				s->z.next_in = s->in;
+				s->z.avail_in = tar_stream_fill(s);
+				if(s->z.avail_in == 0) return -1;
+			}
+			int ret = inflate(&s->z, Z_NO_FLUSH);
+			if(ret == Z_STREAM_END) {
+				// concatenated gzip members, anything else after the end is ignored
+				if(s->z.avail_in == 0) {
+					s->z.next_in = s->in;
+					s->z.avail_in = tar_stream_fill(s);
+				}
+				if(s->z.avail_in < 2 || s->z.next_in[0] != 0x1F || s->z.next_in[1] != 0x8B) s->end = YES;
+				else inflateReset(&s->z);
+			} else
+			if(ret != Z_OK) return -1;
+		}
+		return size - s->z.avail_out;
+	}
+
+	s->bz.next_out = (char *) buf;
+	s->bz.avail_out = size;
+	while(s->bz.avail_out && s->end == NO) {
+		if(s->bz.avail_in == 0) {
+			s->bz.next_in = (char *) s->in;
+			s->bz.avail_in = tar_stream_fill(s);
+			if(s->bz.avail_in == 0) return -1;
+		}
+		int ret = BZ2_bzDecompress(&s->bz);
+		if(ret == BZ_STREAM_END) {
+			// concatenated streams (parallel bzip2)
+			if(s->bz.avail_in == 0) {
+				s->bz.next_in = (char *) s->in;
+				s->bz.avail_in = tar_stream_fill(s);
+			}
+			if(s->bz.avail_in == 0) s->end = YES;
+			else {
+				char *next_in = s->bz.next_in;
+				u32 avail_in = s->bz.avail_in;
+				BZ2_bzDecompressEnd(&s->bz);
+				if(BZ2_bzDecompressInit(&s->bz, 0, 0) != BZ_OK) {
+					s->ready = NO;
+					return -1;
+				}
+				s->bz.next_in = next_in;
+				s->bz.avail_in = avail_in;
+				s->bz.next_out = (char *) buf + size - s->bz.avail_out;
+			}
+		} else
+		if(ret != BZ_OK) return -1;
+	}
+	return size - s->bz.avail_out;
+}
+
+static u8 tar_stream_skip(tar_stream *s, u64 size, u8 *tmp)
+{
+	if(s->format == ARCHIVE_TAR) {
+		if(fseek(s->f, size, SEEK_CUR) != 0) return NO;
+		tar_stream_count(s, size);
+		return YES;
+	}
+
+	while(size) {
+		u32 n = size < ARCHIVE_BUFFER_SIZE ? size : ARCHIVE_BUFFER_SIZE;
+		if(tar_stream_read(s, tmp, n) != n) return NO;
+		size -= n;
+	}
+
+	return YES;
+}
+
+static u64 tar_number(u8 *p, u32 n)
+{
+	u64 v = 0;
+
+	// base-256 for the big sizes
+	if(p[0] & 0x80) {
+		v = p[0] & 0x7F;
+		while(--n) v = (v << 8) | *++p;
+		return v;
+	}
+
+	while(n && (*p < '0' || '7' < *p)) { p++; n--; }
+	while(n && '0' <= *p && *p <= '7') { v = v * 8 + (*p - '0'); p++; n--; }
+
+	return v;
+}
+
+static u8 tar_checksum(u8 *h)
+{
+	u32 sum = 0;
+	u32 i;
+
+	for(i=0; i<TAR_BLOCK; i++) sum += (148 <= i && i < 156) ? ' ' : h[i];
+
+	return sum == tar_number(h + 148, 8);
+}
+
+//*******************************************************
+// TAR pipeline
+//*******************************************************
+
+// tar.bz2 only : a thread finds the bzip2 blocks, they're decoded by TAR_BZ2_DECODERS threads, the caller
+// parses the tar headers and a pool of writers writes the files. tar and tar.gz are extracted by the caller
+// alone, the pipeline was slower for them.
+// The decompressed data goes to the parser in pieces of TAR_CHUNK_SIZE. A bzip2 block (up to ~46MB once
+// decoded) is as many pieces as needed : its decoder stops while
+// the decoded pieces waiting for the parser exceed TAR_BZ2_BUDGET, unless the parser waits for it.
+// The memory used is bounded by TAR_BZ2_BUDGET + a piece per decoder, and by
+// TAR_WRITE_BUDGET for the data waiting for the writers.
+// A bzip2 block is found by its magic number, which can also appear by chance in the compressed data.
+// If the parser hasn't read anything from a block that can't be decoded, the pipeline stops and the
+// rest of the archive is decoded by the parser with a tar_stream.
+
+#define TAR_CHUNK_SIZE			0x100000
+#define TAR_CHUNKS				8
+#define TAR_WRITE_BUDGET		0x800000
+#define TAR_WRITERS				2
+// the PPU has two hardware threads, a second decoder was slower than one
+#define TAR_BZ2_DECODERS		1
+#define TAR_BZ2_BUDGET			0x800000
+
+#define BZ2_BLOCK_MAGIC			0x314159265359ULL
+#define BZ2_END_MAGIC			0x177245385090ULL
+#define BZ2_MAGIC_MASK			0xFFFFFFFFFFFFULL
+
+#define TAR_OP_OPEN				0
+#define TAR_OP_DATA				1
+#define TAR_OP_CLOSE			2
+
+typedef struct tar_piece
+{
+	u8 *data;
+	u32 size;
+	struct tar_piece *next;
+} tar_piece;
+
+typedef struct
+{
+	tar_piece *head;	// decompressed data not read by the parser yet
+	tar_piece *tail;
+	u8 ready;			// every piece is there
+	u8 failed;			// bzip2 block that can't be decoded
+	u8 taken;			// the parser read a piece of it
+	u8 *in;				// bzip2 block rewritten as a standalone stream
+	u32 in_size;
+} tar_chunk;
+
+typedef struct tar_op
+{
+	u8 type;
+	u8 failed;			// TAR_OP_CLOSE : the file is incomplete
+	char *path;			// TAR_OP_OPEN
+	u8 *data;			// TAR_OP_DATA
+	u32 size;
+	struct tar_op *next;
+} tar_op;
+
+typedef struct
+{
+	tar_op *head;
+	tar_op *tail;
+	u64 queued;
+} tar_writer;
+
+typedef struct
+{
+	archive_ctx *ctx;
+	sys_lwmutex_t lock;
+
+	tar_chunk chunks[TAR_CHUNKS];
+	u32 produced;
+	u32 consumed;
+	u32 decoding;		// next bzip2 block to decode
+	u8 eof;				// every chunk is produced
+	u8 error;
+	u8 stop;
+
+	// piece read by the parser
+	tar_piece *piece;
+	u32 pos;
+	u64 delivered;		// bytes of the pieces read
+	u64 decoded_used;	// bytes of the pieces waiting for the parser
+
+	// a bzip2 block couldn't be decoded : the parser decodes the archive by itself
+	u8 fallback;
+	tar_stream seq;
+
+	tar_writer writers[TAR_WRITERS];
+	u64 write_used;
+	u8 writers_end;
+
+	sys_ppu_thread_t producer_id;
+	sys_ppu_thread_t decoder_id[TAR_BZ2_DECODERS];
+	sys_ppu_thread_t writer_id[TAR_WRITERS];
+	u8 producer_started;
+	u8 decoder_started[TAR_BZ2_DECODERS];
+	u8 writer_started[TAR_WRITERS];
+} tar_pipe;
+
+typedef struct
+{
+	tar_pipe *pipe;
+	u32 id;
+} tar_writer_arg;
+
+static void pipe_error(tar_pipe *p)
+{
+	sysLwMutexLock(&p->lock, 0);
+	p->error = YES;
+	sysLwMutexUnlock(&p->lock);
+}
+
+static u8 pipe_add_piece(tar_pipe *p, tar_chunk *c, u8 *data, u32 size)
+{
+	tar_piece *piece = (tar_piece *) malloc(sizeof(tar_piece));
+	if(piece == NULL) return NO;
+
+	piece->data = data;
+	piece->size = size;
+	piece->next = NULL;
+
+	sysLwMutexLock(&p->lock, 0);
+	if(c->tail) c->tail->next = piece;
+	else c->head = piece;
+	c->tail = piece;
+	p->decoded_used += size;
+	sysLwMutexUnlock(&p->lock);
+
+	return YES;
+}
+
+static void pipe_free_pieces(tar_chunk *c)
+{
+	while(c->head) {
+		tar_piece *piece = c->head;
+		c->head = piece->next;
+		free(piece->data);
+		free(piece);
+	}
+	c->tail = NULL;
+}
+
+// wait for a free chunk, returns NO if the pipe is stopped
+static u8 pipe_wait_slot(tar_pipe *p)
+{
+	while(1) {
+		sysLwMutexLock(&p->lock, 0);
+		if(p->stop) {
+			sysLwMutexUnlock(&p->lock);
+			return NO;
+		}
+		if(p->produced - p->consumed < TAR_CHUNKS) {
+			sysLwMutexUnlock(&p->lock);
+			return YES;
+		}
+		sysLwMutexUnlock(&p->lock);
+		usleep(1000);
+	}
+}
+
+static u32 get_bits(u8 *src, u64 pos, u32 n)
+{
+	u32 v = 0;
+
+	while(n--) {
+		v = (v << 1) | ((src[pos >> 3] >> (7 - (pos & 7))) & 1);
+		pos++;
+	}
+
+	return v;
+}
+
+static void put_bits(u8 *dst, u64 pos, u64 v, u32 n)
+{
+	while(n--) {
+		if((v >> n) & 1) dst[pos >> 3] |= 0x80 >> (pos & 7);
+		pos++;
+	}
+}
+
+// The bits [start, end[ of 'src' are a bzip2 block, it's rewritten as a standalone stream : header,
+// the block and the end of stream with the block crc as the stream crc.
+static u8 *bz2_block_stream(u8 *src, u64 start, u64 end, u32 *size)
+{
+	u64 bits = end - start;
+	u32 len = 4 + (bits + 80 + 7) / 8;
+	u64 i;
+
+	u8 *out = (u8 *) malloc(len);
+	if(out == NULL) return NULL;
+	memset(out, 0, len);
+
+	// the biggest block size, the decoder only uses it to check the block
+	memcpy(out, "BZh9", 4);
+
+	u8 *s = src + (start >> 3);
+	u32 shift = start & 7;
+	for(i=0; i < (bits + 7) / 8; i++) {
+		out[4 + i] = shift ? (s[i] << shift) | (s[i + 1] >> (8 - shift)) : s[i];
+	}
+	if(bits & 7) out[4 + bits / 8] &= 0xFF << (8 - (bits & 7));
+
+	put_bits(out, 32 + bits, BZ2_END_MAGIC, 48);
+	put_bits(out, 32 + bits + 48, get_bits(src, start + 48, 32), 32);
+
+	*size = len;
+	return out;
+}
+
+static u8 bz2_push_block(tar_pipe *p, u8 *src, u64 start, u64 end)
+{
+	u32 size;
+
+	if(pipe_wait_slot(p) == NO) return NO;
+
+	u8 *in = bz2_block_stream(src, start, end, &size);
+	if(in == NULL) return NO;
+
+	sysLwMutexLock(&p->lock, 0);
+	tar_chunk *c = &p->chunks[p->produced % TAR_CHUNKS];
+	memset(c, 0, sizeof(tar_chunk));
+	c->in = in;
+	c->in_size = size;
+	p->produced++;
+	sysLwMutexUnlock(&p->lock);
+
+	return YES;
+}
+
+// tar.bz2 : the blocks are found by their magic number (they aren't aligned on a byte), each of them
+// is decoded by one of the decoders.
+static void pipe_bz2_scanner_thread(void *arg)
+{
+	tar_pipe *p = (tar_pipe *) arg;
+	archive_ctx *ctx = p->ctx;
+	u64 reg = 0;
+	u64 scanned = 0;		// bytes
+	int k;
+	s64 block = -1;			// start of the current block (bits)
+	u64 buf_size = 0;
+	u64 buf_max = 4 * ARCHIVE_IN_SIZE;
+	u8 ok = NO;
+
+	u8 *buf = (u8 *) malloc(buf_max);
+	FILE *f = fopen(ctx->path, "rb");
+	if(buf == NULL || f == NULL) goto end;
+
+	while(1) {
+		if(buf_max - buf_size < ARCHIVE_IN_SIZE) {
+			u8 *b = (u8 *) realloc(buf, buf_max * 2);
+			if(b == NULL) goto end;
+			buf = b;
+			buf_max *= 2;
+		}
+		u32 n = fread(buf + buf_size, 1, ARCHIVE_IN_SIZE, f);
+		sysLwMutexLock(&p->lock, 0);
+		ctx->status.read += n;
+		sysLwMutexUnlock(&p->lock);
+		if(n == 0) {
+			if(block < 0) ok = YES;
+			else print_load("Error : bzip2, unexpected end");
+			break;
+		}
+		buf_size += n;
+
+		// one byte at a time, the 8 bit offsets are tested in the order of the stream
+		for(; scanned < buf_size; scanned++) {
+			reg = (reg << 8) | buf[scanned];
+
+			for(k=7; 0 <= k; k--) {
+				u64 magic = (reg >> k) & BZ2_MAGIC_MASK;
+				if(magic != BZ2_BLOCK_MAGIC && magic != BZ2_END_MAGIC) continue;
+
+				u64 last = scanned * 8 + 7 - k;
+				if(last < 47) continue;
+
+				u64 start = last - 47;
+				if(0 <= block && bz2_push_block(p, buf, block, start) == NO) goto end;
+
+				block = (magic == BZ2_BLOCK_MAGIC) ? (s64) start : -1;
+			}
+		}
+
+		// drop what isn't needed anymore
+		u64 keep = (0 <= block ? (u64) block >> 3 : scanned);
+		if(8 < keep) {
+			keep -= 8;
+			memmove(buf, buf + keep, buf_size - keep);
+			buf_size -= keep;
+			scanned -= keep;
+			if(0 <= block) block -= keep * 8;
+		}
+	}
+
+end:
+	sysLwMutexLock(&p->lock, 0);
+	// stopped by the parser, it isn't an error
+	if(ok == NO && p->stop == NO) p->error = YES;
+	p->eof = YES;
+	sysLwMutexUnlock(&p->lock);
+
+	if(f) fclose(f);
+	free(buf);
+
+	sysThreadExit(0);
+}
+
+// The decoder state and its 3.6MB table are allocated for every block, they're kept by the decoder
+// thread instead of going back to the system each time.
+#define BZ2_MEM_SLOTS			4
+
+typedef struct
+{
+	void *ptr[BZ2_MEM_SLOTS];
+	u32 size[BZ2_MEM_SLOTS];
+	u8 used[BZ2_MEM_SLOTS];
+} bz2_mem;
+
+static void *bz2_mem_alloc(void *opaque, int items, int size)
+{
+	bz2_mem *m = (bz2_mem *) opaque;
+	u32 len = items * size;
+	int i;
+
+	for(i=0; i < BZ2_MEM_SLOTS; i++) {
+		if(m->ptr[i] && m->used[i] == NO && m->size[i] == len) {
+			m->used[i] = YES;
+			return m->ptr[i];
+		}
+	}
+	for(i=0; i < BZ2_MEM_SLOTS; i++) {
+		if(m->ptr[i] == NULL) {
+			m->ptr[i] = malloc(len);
+			if(m->ptr[i] == NULL) return NULL;
+			m->size[i] = len;
+			m->used[i] = YES;
+			return m->ptr[i];
+		}
+	}
+
+	return malloc(len);
+}
+
+static void bz2_mem_free(void *opaque, void *ptr)
+{
+	bz2_mem *m = (bz2_mem *) opaque;
+	int i;
+
+	for(i=0; i < BZ2_MEM_SLOTS; i++) {
+		if(m->ptr[i] == ptr) {
+			m->used[i] = NO;
+			return;
+		}
+	}
+
+	free(ptr);
+}
+
+static void bz2_mem_release(bz2_mem *m)
+{
+	int i;
+
+	for(i=0; i < BZ2_MEM_SLOTS; i++) free(m->ptr[i]);
+	memset(m, 0, sizeof(bz2_mem));
+}
+
+// before a new piece of the block 'index', NO if the pipe is stopped
+static u8 bz2_wait_budget(tar_pipe *p, tar_chunk *c, u32 index)
+{
+	while(1) {
+		sysLwMutexLock(&p->lock, 0);
+		if(p->stop || p->error) {
+			sysLwMutexUnlock(&p->lock);
+			return NO;
+		}
+		// the block the parser waits for never waits
+		if(p->decoded_used < TAR_BZ2_BUDGET || (index == p->consumed && c->head == NULL)) {
+			sysLwMutexUnlock(&p->lock);
+			return YES;
+		}
+		sysLwMutexUnlock(&p->lock);
+		usleep(1000);
+	}
+}
+
+static u8 bz2_decode(tar_pipe *p, tar_chunk *c, u32 index, bz2_mem *mem)
+{
+	bz_stream bz;
+	u8 *data = NULL;
+	u8 ok = NO;
+
+	memset(&bz, 0, sizeof(bz_stream));
+	bz.bzalloc = bz2_mem_alloc;
+	bz.bzfree = bz2_mem_free;
+	bz.opaque = (void *) mem;
+	if(BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK) return NO;
+
+	bz.next_in = (char *) c->in;
+	bz.avail_in = c->in_size;
+
+	while(1) {
+		if(data == NULL) {
+			if(bz2_wait_budget(p, c, index) == NO) break;
+			data = (u8 *) malloc(TAR_CHUNK_SIZE);
+			if(data == NULL) break;
+			bz.next_out = (char *) data;
+			bz.avail_out = TAR_CHUNK_SIZE;
+		}
+
+		int ret = BZ2_bzDecompress(&bz);
+		if(ret != BZ_OK && ret != BZ_STREAM_END) break;
+
+		if(bz.avail_out == 0 || ret == BZ_STREAM_END) {
+			u32 size = TAR_CHUNK_SIZE - bz.avail_out;
+			if(size) {
+				if(pipe_add_piece(p, c, data, size) == NO) break;
+				data = NULL;
+			}
+			if(ret == BZ_STREAM_END) {
+				ok = YES;
+				break;
+			}
+		} else
+		if(bz.avail_in == 0) break;
+	}
+
+	free(data);
+	BZ2_bzDecompressEnd(&bz);
+	free(c->in);
+	c->in = NULL;
+
+	return ok;
+}
+
+static void pipe_bz2_decoder_thread(void *arg)
+{
+	tar_pipe *p = (tar_pipe *) arg;
+	bz2_mem mem;
+
+	memset(&mem, 0, sizeof(bz2_mem));
+
+	while(1) {
+		sysLwMutexLock(&p->lock, 0);
+		if(p->stop || p->error) {
+			sysLwMutexUnlock(&p->lock);
+			break;
+		}
+		if(p->decoding < p->produced) {
+			u32 index = p->decoding++;
+			tar_chunk *c = &p->chunks[index % TAR_CHUNKS];
+			sysLwMutexUnlock(&p->lock);
+
+			u8 ok = bz2_decode(p, c, index, &mem);
+
+			// the parser decides what to do with a block that can't be decoded
+			sysLwMutexLock(&p->lock, 0);
+			if(ok) c->ready = YES;
+			else c->failed = YES;
+			sysLwMutexUnlock(&p->lock);
+			continue;
+		}
+		if(p->eof) {
+			sysLwMutexUnlock(&p->lock);
+			break;
+		}
+		sysLwMutexUnlock(&p->lock);
+		usleep(1000);
+	}
+
+	bz2_mem_release(&mem);
+
+	sysThreadExit(0);
+}
+
+static void pipe_writer_thread(void *data)
+{
+	tar_writer_arg *arg = (tar_writer_arg *) data;
+	tar_pipe *p = arg->pipe;
+	tar_writer *w = &p->writers[arg->id];
+	archive_ctx *ctx = p->ctx;
+	FILE *f = NULL;
+	char *path = NULL;
+	u8 ok = NO;
+
+	while(1) {
+		sysLwMutexLock(&p->lock, 0);
+		tar_op *op = w->head;
+		if(op == NULL) {
+			u8 end = p->writers_end;
+			sysLwMutexUnlock(&p->lock);
+			if(end) break;
+			usleep(1000);
+			continue;
+		}
+		w->head = op->next;
+		if(w->head == NULL) w->tail = NULL;
+		sysLwMutexUnlock(&p->lock);
+
+		if(op->type == TAR_OP_OPEN) {
+			path = op->path;
+			f = fopen(path, "wb");
+			ok = (f != NULL);
+			if(ok) SetFilePerms(path);
+			else print_load("Error : fopen() failed : %s", path);
+		} else
+		if(op->type == TAR_OP_DATA) {
+			if(ok && ctx->ret == ARCHIVE_OK && fwrite(op->data, 1, op->size, f) != op->size) {
+				print_load("Error : failed to write %s", path);
+				ok = NO;
+			}
+			free(op->data);
+
+			sysLwMutexLock(&p->lock, 0);
+			p->write_used -= op->size;
+			w->queued -= op->size;
+			if(ok) archive_report(ctx, op->size, 0);
+			sysLwMutexUnlock(&p->lock);
+		} else {
+			if(f && fclose(f) != 0) ok = NO;
+			f = NULL;
+
+			sysLwMutexLock(&p->lock, 0);
+			if(ok == NO && ctx->ret == ARCHIVE_OK) ctx->ret = ARCHIVE_ERROR;
+			if(ok && op->failed == NO && ctx->ret == ARCHIVE_OK) archive_report(ctx, 0, 1);
+			else ok = NO;
+			sysLwMutexUnlock(&p->lock);
+
+			// an incomplete file is removed
+			if(ok == NO && path) unlink(path);
+			free(path);
+			path = NULL;
+		}
+		free(op);
+	}
+
+	free(arg);
+
+	sysThreadExit(0);
+}
+
+static void pipe_push(tar_pipe *p, u32 id, tar_op *op)
+{
+	tar_writer *w = &p->writers[id];
+
+	op->next = NULL;
+
+	sysLwMutexLock(&p->lock, 0);
+	if(w->tail) w->tail->next = op;
+	else w->head = op;
+	w->tail = op;
+	if(op->type == TAR_OP_DATA) {
+		p->write_used += op->size;
+		w->queued += op->size;
+	}
+	sysLwMutexUnlock(&p->lock);
+}
+
+static tar_op *pipe_op(u8 type)
+{
+	tar_op *op = (tar_op *) malloc(sizeof(tar_op));
+	if(op == NULL) return NULL;
+
+	memset(op, 0, sizeof(tar_op));
+	op->type = type;
+
+	return op;
+}
+
+// fallback : the next piece comes from the tar_stream of the parser
+static u8 pipe_fallback_read(tar_pipe *p)
+{
+	s64 n = tar_stream_read(&p->seq, p->piece->data, TAR_CHUNK_SIZE);
+	if(n < 0) {
+		print_load("Error : tar, corrupted data");
+		pipe_error(p);
+		return NO;
+	}
+	p->piece->size = n;
+	p->pos = 0;
+
+	return n != 0;
+}
+
+// The threads are stopped and the archive is decoded again from its start, up to what the parser read
+static u8 pipe_fallback(tar_pipe *p)
+{
+	archive_ctx *ctx = p->ctx;
+	u64 left = p->delivered;
+
+	print_load("Warning : bzip2, a block can't be decoded alone, the archive is decoded sequentially");
+
+	sysLwMutexLock(&p->lock, 0);
+	p->stop = YES;
+	p->fallback = YES;
+	ctx->status.read = 0;
+	sysLwMutexUnlock(&p->lock);
+
+	p->piece = (tar_piece *) malloc(sizeof(tar_piece));
+	if(p->piece) {
+		p->piece->data = (u8 *) malloc(TAR_CHUNK_SIZE);
+		p->piece->next = NULL;
+	}
+	if(p->piece == NULL || p->piece->data == NULL || tar_stream_open(ctx, &p->seq) == NO) {
+		pipe_error(p);
+		return NO;
+	}
+	p->seq.lock = &p->lock;
+
+	while(left) {
+		u32 n = left < TAR_CHUNK_SIZE ? left : TAR_CHUNK_SIZE;
+		if(tar_stream_read(&p->seq, p->piece->data, n) != n) {
+			print_load("Error : tar, corrupted data");
+			pipe_error(p);
+			return NO;
+		}
+		left -= n;
+	}
+
+	return pipe_fallback_read(p);
+}
+
+// the parser moves to the next piece, NO at the end of the data
+static u8 pipe_next_piece(tar_pipe *p)
+{
+	if(p->fallback) {
+		if(p->error) return NO;
+		return pipe_fallback_read(p);
+	}
+
+	if(p->piece) {
+		sysLwMutexLock(&p->lock, 0);
+		p->decoded_used -= p->piece->size;
+		p->delivered += p->piece->size;
+		sysLwMutexUnlock(&p->lock);
+
+		free(p->piece->data);
+		free(p->piece);
+		p->piece = NULL;
+	}
+
+	while(1) {
+		sysLwMutexLock(&p->lock, 0);
+		if(p->error || p->ctx->ret != ARCHIVE_OK) {
+			sysLwMutexUnlock(&p->lock);
+			return NO;
+		}
+		if(p->consumed < p->produced) {
+			tar_chunk *c = &p->chunks[p->consumed % TAR_CHUNKS];
+			if(c->failed && c->taken == NO) {
+				sysLwMutexUnlock(&p->lock);
+				return pipe_fallback(p);
+			}
+			if(c->head) {
+				p->piece = c->head;
+				c->head = p->piece->next;
+				if(c->head == NULL) c->tail = NULL;
+				c->taken = YES;
+				p->pos = 0;
+				sysLwMutexUnlock(&p->lock);
+				return YES;
+			}
+			if(c->ready) {
+				p->consumed++;
+				sysLwMutexUnlock(&p->lock);
+				continue;
+			}
+			// a part of the block is already extracted
+			if(c->failed) {
+				print_load("Error : bzip2, corrupted block");
+				p->error = YES;
+				sysLwMutexUnlock(&p->lock);
+				return NO;
+			}
+		} else
+		if(p->eof) {
+			sysLwMutexUnlock(&p->lock);
+			return NO;
+		}
+		sysLwMutexUnlock(&p->lock);
+		usleep(1000);
+	}
+}
+
+// copy of the data, 'buf' can be NULL to skip it
+static s64 pipe_copy(tar_pipe *p, u8 *buf, u64 size)
+{
+	u64 done = 0;
+
+	while(done < size) {
+		if(p->piece == NULL || p->pos == p->piece->size) {
+			if(pipe_next_piece(p) == NO) break;
+			continue;
+		}
+		u64 n = p->piece->size - p->pos;
+		if(size - done < n) n = size - done;
+		if(buf) memcpy(buf + done, p->piece->data + p->pos, n);
+		p->pos += n;
+		done += n;
+	}
+
+	if(p->error) return -1;
+
+	return done;
+}
+
+static s64 pipe_read(tar_pipe *p, u8 *buf, u32 size)
+{
+	return pipe_copy(p, buf, size);
+}
+
+static u8 pipe_skip(tar_pipe *p, u64 size)
+{
+	return pipe_copy(p, NULL, size) == size;
+}
+
+// the data of the file is sent to the writer with the least data to write
+static u8 pipe_extract_file(tar_pipe *p, char *name, u64 size)
+{
+	archive_ctx *ctx = p->ctx;
+	u32 id = 0;
+	u32 i;
+
+	char *path = archive_out_path(ctx, name);
+	tar_op *op = pipe_op(TAR_OP_OPEN);
+	if(path == NULL || op == NULL) {
+		free(path);
+		free(op);
+		ctx->ret = ARCHIVE_ERROR;
+		return NO;
+	}
+
+	sysLwMutexLock(&p->lock, 0);
+	for(i=1; i<TAR_WRITERS; i++) {
+		if(p->writers[i].queued < p->writers[id].queued) id = i;
+	}
+	sysLwMutexUnlock(&p->lock);
+
+	op->path = path;
+	pipe_push(p, id, op);
+
+	u8 ok = YES;
+	u64 left = size;
+	while(ok && left) {
+		u32 chunk = left < TAR_CHUNK_SIZE ? left : TAR_CHUNK_SIZE;
+		u32 read = (chunk + TAR_BLOCK - 1) & ~(TAR_BLOCK - 1);
+
+		// wait for the writers
+		while(1) {
+			sysLwMutexLock(&p->lock, 0);
+			u8 wait = (p->write_used && TAR_WRITE_BUDGET < p->write_used + read && ctx->ret == ARCHIVE_OK);
+			sysLwMutexUnlock(&p->lock);
+			if(wait == NO) break;
+			usleep(1000);
+		}
+
+		op = pipe_op(TAR_OP_DATA);
+		u8 *data = (u8 *) malloc(read);
+		if(op == NULL || data == NULL || ctx->ret != ARCHIVE_OK) {
+			free(op);
+			free(data);
+			ok = NO;
+			break;
+		}
+		if(pipe_read(p, data, read) != read) {
+			if(ctx->ret == ARCHIVE_OK) print_load("Error : tar, unexpected end");
+			free(op);
+			free(data);
+			ok = NO;
+			break;
+		}
+		op->data = data;
+		op->size = chunk;
+		pipe_push(p, id, op);
+
+		left -= chunk;
+	}
+
+	op = pipe_op(TAR_OP_CLOSE);
+	while(op == NULL) {
+		usleep(1000);
+		op = pipe_op(TAR_OP_CLOSE);
+	}
+	op->failed = !ok;
+	pipe_push(p, id, op);
+
+	if(ok == NO) {
+		sysLwMutexLock(&p->lock, 0);
+		if(ctx->ret == ARCHIVE_OK) ctx->ret = ARCHIVE_ERROR;
+		sysLwMutexUnlock(&p->lock);
+	}
+
+	return ok;
+}
+
+static u8 pipe_start(archive_ctx *ctx, tar_pipe *p)
+{
+	u32 i;
+
+	memset(p, 0, sizeof(tar_pipe));
+	p->ctx = ctx;
+
+	sys_lwmutex_attr_t attr = {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""};
+	if(sysLwMutexCreate(&p->lock, &attr) != 0) return NO;
+
+	for(i=0; i<TAR_WRITERS; i++) {
+		tar_writer_arg *arg = (tar_writer_arg *) malloc(sizeof(tar_writer_arg));
+		if(arg == NULL) break;
+		arg->pipe = p;
+		arg->id = i;
+		p->writer_started[i] = (sysThreadCreate(&p->writer_id[i], pipe_writer_thread, (void *) arg, 1000, 0x4000, THREAD_JOINABLE, "tar_writer") == 0);
+		if(p->writer_started[i] == NO) {
+			free(arg);
+			break;
+		}
+	}
+	// a file can't be given to a writer which isn't running
+	if(p->writer_started[0] == NO) {
+		sysLwMutexDestroy(&p->lock);
+		return NO;
+	}
+	for(i=0; i<TAR_WRITERS; i++) {
+		if(p->writer_started[i] == NO) p->writers[i].queued = (u64) -1;
+	}
+
+	for(i=0; i<TAR_BZ2_DECODERS; i++) {
+		p->decoder_started[i] = (sysThreadCreate(&p->decoder_id[i], pipe_bz2_decoder_thread, (void *) p, 1000, 0x4000, THREAD_JOINABLE, "tar_bz2_decoder") == 0);
+	}
+	p->producer_started = (sysThreadCreate(&p->producer_id, pipe_bz2_scanner_thread, (void *) p, 1000, 0x4000, THREAD_JOINABLE, "tar_bz2_scanner") == 0);
+	if(p->producer_started == NO) p->error = YES;
+
+	return YES;
+}
+
+static void pipe_end(tar_pipe *p)
+{
+	u64 thread_ret;
+	u32 i;
+
+	sysLwMutexLock(&p->lock, 0);
+	p->stop = YES;
+	p->writers_end = YES;
+	sysLwMutexUnlock(&p->lock);
+
+	if(p->producer_started) sysThreadJoin(p->producer_id, &thread_ret);
+	for(i=0; i<TAR_BZ2_DECODERS; i++) {
+		if(p->decoder_started[i]) sysThreadJoin(p->decoder_id[i], &thread_ret);
+	}
+	// the writers finish their queue
+	for(i=0; i<TAR_WRITERS; i++) {
+		if(p->writer_started[i]) sysThreadJoin(p->writer_id[i], &thread_ret);
+	}
+
+	for(i=0; i<TAR_CHUNKS; i++) {
+		pipe_free_pieces(&p->chunks[i]);
+		free(p->chunks[i].in);
+	}
+	if(p->piece) {
+		free(p->piece->data);
+		free(p->piece);
+	}
+	if(p->fallback) tar_stream_close(&p->seq);
+
+	sysLwMutexDestroy(&p->lock);
+}
+
+//*******************************************************
+// TAR parser
+//*******************************************************
+
+// the data comes from the pipe when the extraction is pipelined
+static s64 tar_read(tar_stream *s, tar_pipe *p, u8 *buf, u32 size)
+{
+	if(p) return pipe_read(p, buf, size);
+
+	return tar_stream_read(s, buf, size);
+}
+
+static u8 tar_skip(tar_stream *s, tar_pipe *p, u64 size, u8 *tmp)
+{
+	if(p) return pipe_skip(p, size);
+
+	return tar_stream_skip(s, size, tmp);
+}
+
+// data of the entry : 'size' bytes and the padding up to the next block
+static char *tar_read_name(tar_stream *s, tar_pipe *p, u64 size, u8 *tmp)
+{
+	u64 padded = (size + TAR_BLOCK - 1) & ~(u64) (TAR_BLOCK - 1);
+	if(ARCHIVE_BUFFER_SIZE < padded) return NULL;
+
+	if(tar_read(s, p, tmp, padded) != padded) return NULL;
+
+	char *name = (char *) malloc(size + 1);
+	if(name == NULL) return NULL;
+	memcpy(name, tmp, size);
+	name[size] = 0;
+
+	return name;
+}
+
+// pax extended header : "<len> path=<name>\n" records
+static char *tar_pax_path(char *pax)
+{
+	char *end = pax + strlen(pax);
+	char *p = pax;
+
+	while(p < end) {
+		char *rec = p;
+		u32 len = strtoul(p, &p, 10);
+		if(len == 0 || *p != ' ' || end < rec + len || rec[len-1] != '\n') break;
+		p++;
+		if(strncmp(p, "path=", 5) == 0) {
+			rec[len-1] = 0;
+			return strdup(p + 5);
+		}
+		p = rec + len;
+	}
+
+	return NULL;
+}
+
+static int tar_run(archive_ctx *ctx, u8 list, tar_pipe *pipe)
+{
+	tar_stream s;
+	u8 h[TAR_BLOCK];
+	char short_name[256 + 1];
+	char *long_name = NULL;
+
+	// the writer buffer is free while an entry is skipped
+	u8 *tmp = list ? ctx->buf : (u8 *) malloc(ARCHIVE_BUFFER_SIZE);
+	if(tmp == NULL) return ARCHIVE_ERROR;
+
+	memset(&s, 0, sizeof(tar_stream));
+	if(pipe == NULL && tar_stream_open(ctx, &s) == NO) {
+		tar_stream_close(&s);
+		if(tmp != ctx->buf) free(tmp);
+		return ARCHIVE_ERROR;
+	}
+
+	while(ctx->ret == ARCHIVE_OK) {
+		s64 n = tar_read(&s, pipe, h, TAR_BLOCK);
+		if(n == 0) break;
+		if(n != TAR_BLOCK) {
+			print_load("Error : tar, unexpected end");
+			ctx->ret = ARCHIVE_ERROR;
+			break;
+		}
+
+		u32 i;
+		for(i=0; i<TAR_BLOCK && h[i] == 0; i++);
+		if(i == TAR_BLOCK) break;
+
+		if(tar_checksum(h) == NO) {
+			print_load("Error : tar, bad checksum");
+			ctx->ret = ARCHIVE_ERROR;
+			break;
+		}
+
+		u64 size = tar_number(h + 124, 12);
+		u64 padded = (size + TAR_BLOCK - 1) & ~(u64) (TAR_BLOCK - 1);
+		char type = h[156];
+
+		// names of the next entry
+		if(type == 'L' || type == 'x') {
+			char *data = tar_read_name(&s, pipe, size, tmp);
+			if(data == NULL) {
+				ctx->ret = ARCHIVE_ERROR;
+				break;
+			}
+			free(long_name);
+			if(type == 'L') long_name = data;
+			else {
+				long_name = tar_pax_path(data);
+				free(data);
+			}
+			continue;
+		}
+
+		char *name = long_name;
+		if(name == NULL) {
+			short_name[0] = 0;
+			if(memcmp(h + 257, "ustar", 5) == 0 && h[345]) {
+				strncat(short_name, (char *) h + 345, 155);
+				strcat(short_name, "/");
+			}
+			strncat(short_name, (char *) h, 100);
+			name = short_name;
+		}
+
+		u8 dir = (type == '5');
+		u8 file = (type == '0' || type == 0 || type == '7');
+
+		if(list) {
+			if(dir || file) archive_add(ctx, name, dir ? 0 : size, dir);
+		} else
+		if((dir || file) && archive_wanted(ctx, name)) {
+			print_load("%s", name);
+			if(dir) archive_mkdir(ctx, name);
+			else
+			if(pipe) {
+				pipe_extract_file(pipe, name, size);
+				padded = 0;
+			} else {
+				if(archive_open_file(ctx, name) == NO) {
+					ctx->ret = ARCHIVE_ERROR;
+					break;
+				}
+				u8 ok = YES;
+				u64 left = size;
+				while(ok && left) {
+					u32 block = left < ARCHIVE_BUFFER_SIZE ? left : ARCHIVE_BUFFER_SIZE;
+					u32 read = (block + TAR_BLOCK - 1) & ~(TAR_BLOCK - 1);
+					if(tar_stream_read(&s, tmp, read) != read) {
+						print_load("Error : tar, unexpected end");
+						ctx->ret = ARCHIVE_ERROR;
+						ok = NO;
+						break;
+					}
+					ok = archive_write(ctx, tmp, block);
+					left -= block;
+				}
+				archive_close_file(ctx, ok);
+				padded = 0;
+			}
+		}
+
+		ctx->status.name = NULL;
+		free(long_name);
+		long_name = NULL;
+
+		if(ctx->ret != ARCHIVE_OK) break;
+
+		if(padded && tar_skip(&s, pipe, padded, tmp) == NO) {
+			print_load("Error : tar, unexpected end");
+			ctx->ret = ARCHIVE_ERROR;
+			break;
+		}
+	}
+
+	free(long_name);
+	tar_stream_close(&s);
+	if(tmp != ctx->buf) free(tmp);
+
+	return ctx->ret;
+}
+
+static int tar_list(archive_ctx *ctx)
+{
+	return tar_run(ctx, YES, NULL);
+}
+
+static int tar_extract(archive_ctx *ctx)
+{
+	tar_pipe pipe;
+
+	if(ctx->format != ARCHIVE_TAR_BZ2) return tar_run(ctx, NO, NULL);
+	if(pipe_start(ctx, &pipe) == NO) return tar_run(ctx, NO, NULL);
+
+	int ret = tar_run(ctx, NO, &pipe);
+
+	// the files still queued are written
+	pipe_end(&pipe);
+	if(ret == ARCHIVE_OK) ret = ctx->ret;
+
+	return ret;
+}
+
+//*******************************************************
+// Archive
+//*******************************************************
+
+static archive_backend backends[] = {
+	{ ARCHIVE_ZIP,		"ZIP",		zip_list_entries,	zip_extract_entries_ctx },
+	{ ARCHIVE_RAR,		"RAR",		rar_list_entries,	rar_extract_entries },
+	{ ARCHIVE_7Z,		"7Z",		list_7z,			extract_7z },
+	{ ARCHIVE_TAR,		"TAR",		tar_list,			tar_extract },
+	{ ARCHIVE_TAR_GZ,	"TAR.GZ",	tar_list,			tar_extract },
+	{ ARCHIVE_TAR_BZ2,	"TAR.BZ2",	tar_list,			tar_extract },
+};
+
+static archive_backend *get_backend(u8 format)
+{
+	u32 i;
+
+	for(i=0; i<sizeof(backends)/sizeof(archive_backend); i++) {
+		if(backends[i].format == format) return &backends[i];
+	}
+
+	return NULL;
+}
+
+u8 archive_format(char *path)
+{
+	u8 h[TAR_BLOCK];
+
+	FILE *f = fopen(path, "rb");
+	if(f == NULL) return ARCHIVE_UNKNOWN;
+
+	memset(h, 0, TAR_BLOCK);
+	u32 n = fread(h, 1, TAR_BLOCK, f);
+	fclose(f);
+
+	if(4 <= n && memcmp(h, "PK\x03\x04", 4) == 0) return ARCHIVE_ZIP;
+	if(4 <= n && memcmp(h, "PK\x05\x06", 4) == 0) return ARCHIVE_ZIP;
+	if(6 <= n && memcmp(h, "Rar!\x1A\x07", 6) == 0) return ARCHIVE_RAR;
+	if(6 <= n && memcmp(h, "7z\xBC\xAF\x27\x1C", 6) == 0) return ARCHIVE_7Z;
+	if(2 <= n && h[0] == 0x1F && h[1] == 0x8B) return ARCHIVE_TAR_GZ;
+	if(4 <= n && memcmp(h, "BZh", 3) == 0 && '1' <= h[3] && h[3] <= '9') return ARCHIVE_TAR_BZ2;
+	if(n == TAR_BLOCK && tar_checksum(h)) return ARCHIVE_TAR;
+
+	return ARCHIVE_UNKNOWN;
+}
+
+char *archive_format_name(u8 format)
+{
+	archive_backend *b = get_backend(format);
+	if(b == NULL) return "Unknown";
+
+	return b->name;
+}
+
+static u8 archive_init(archive_ctx *ctx, char *path, char *dst)
+{
+	memset(ctx, 0, sizeof(archive_ctx));
+	ctx->path = path;
+	ctx->dst = dst;
+	ctx->format = archive_format(path);
+
+	ctx->buf = (u8 *) malloc(ARCHIVE_BUFFER_SIZE);
+	ctx->in = (u8 *) malloc(ARCHIVE_IN_SIZE);
+	ctx->last_dir = (char *) malloc(ARCHIVE_IN_SIZE);
+	if(ctx->buf == NULL || ctx->in == NULL || ctx->last_dir == NULL) return NO;
+	ctx->last_dir[0] = 0;
+
+	struct stat st;
+	if(stat(path, &st) == 0) ctx->status.size = st.st_size;
+
+	return YES;
+}
+
+static void archive_end(archive_ctx *ctx)
+{
+	free(ctx->buf);
+	free(ctx->in);
+	free(ctx->last_dir);
+	free(ctx->names);
+}
+
+void archive_list_free(archive_entry *entries, u32 number)
+{
+	u32 i;
+
+	if(entries == NULL) return;
+
+	for(i=0; i<number; i++) free(entries[i].name);
+	free(entries);
+}
+
+int archive_list(char *path, archive_entry **entries, u32 *number)
+{
+	archive_ctx ctx;
+
+	*entries = NULL;
+	*number = 0;
+
+	if(archive_init(&ctx, path, NULL) == NO) {
+		archive_end(&ctx);
+		return ARCHIVE_ERROR;
+	}
+
+	archive_backend *b = get_backend(ctx.format);
+	if(b == NULL) {
+		print_load("Error : unknown archive format %s", path);
+		archive_end(&ctx);
+		return ARCHIVE_ERROR;
+	}
+
+	int ret = b->list(&ctx);
+	archive_end(&ctx);
+
+	if(ret != ARCHIVE_OK) {
+		archive_list_free(ctx.entries, ctx.number);
+		return ret;
+	}
+
+	*entries = ctx.entries;
+	*number = ctx.number;
+
+	return ARCHIVE_OK;
+}
+
+int archive_extract(char *path, char *dst, char **names, u32 names_number, archive_progress progress, void *arg)
+{
+	archive_ctx ctx;
+
+	if(archive_init(&ctx, path, dst) == NO) {
+		archive_end(&ctx);
+		return ARCHIVE_ERROR;
+	}
+
+	archive_backend *b = get_backend(ctx.format);
+	if(b == NULL) {
+		print_load("Error : unknown archive format %s", path);
+		archive_end(&ctx);
+		return ARCHIVE_ERROR;
+	}
+
+	if(names) {
+		ctx.names = (char **) malloc((names_number ? names_number : 1) * sizeof(char *));
+		if(ctx.names == NULL) {
+			archive_end(&ctx);
+			return ARCHIVE_ERROR;
+		}
+		memcpy(ctx.names, names, names_number * sizeof(char *));
+		ctx.names_number = names_number;
+		qsort(ctx.names, names_number, sizeof(char *), cmp_name);
+	}
+	ctx.progress = progress;
+	ctx.arg = arg;
+
+	print_load("Extract %s archive %s", b->name, path);
+
+	mkdir(dst, 0777);
+
+	ctx.start = get_usec();
+
+	int ret = b->extract(&ctx);
+	if(ret == ARCHIVE_OK) ret = ctx.ret;
+
+	u64 time = get_usec() - ctx.start;
+	if(time == 0) time = 1;
+	if(ret == ARCHIVE_OK) {
+		print_load("Extracted %d files, %d KB in %d ms (%d KB/s)", ctx.status.files_done, (int) (ctx.status.done / 1024),
+					(int) (time / 1000), (int) (ctx.status.done * 1000000 / 1024 / time));
+	}
+
+	// the list is only used for the totals
+	archive_list_free(ctx.entries, ctx.number);
+	archive_end(&ctx);
+
+	return ret;
+}
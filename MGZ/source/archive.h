@@ -0,0 +1,60 @@
+#ifndef __ARCHIVE_H__
+#define __ARCHIVE_H__
+
+#include <ppu-types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// detected from the content of the file, not from its extension
+#define ARCHIVE_UNKNOWN			0
+#define ARCHIVE_ZIP				1
+#define ARCHIVE_RAR				2
+#define ARCHIVE_7Z				3
+#define ARCHIVE_TAR				4
+#define ARCHIVE_TAR_GZ			5
+#define ARCHIVE_TAR_BZ2			6
+
+#define ARCHIVE_OK				0
+#define ARCHIVE_ERROR			1
+#define ARCHIVE_CANCELED		2
+
+typedef struct
+{
+	char *name;
+	u64 size;
+	u8 dir;
+} archive_entry;
+
+typedef struct
+{
+	char *name;			// entry being extracted
+	u32 files_done;
+	u32 files;			// 0 when it isn't known before the end (tar)
+	u64 done;			// bytes written
+	u64 total;			// 0 when it isn't known before the end (tar)
+	u64 read;			// bytes of the archive read, when 'total' is unknown
+	u64 size;			// size of the archive
+	u64 speed;			// bytes written per second
+} archive_status;
+
+// called while the data is written, returns 0 to cancel
+typedef u8 (*archive_progress)(archive_status *status, void *arg);
+
+u8 archive_format(char *path);
+char *archive_format_name(u8 format);
+
+// List the entries without extracting anything. The list is freed with archive_list_free.
+int archive_list(char *path, archive_entry **entries, u32 *number);
+void archive_list_free(archive_entry *entries, u32 number);
+
+// Extract the entries named in 'names' in 'dst' (a name ending with '/' selects the whole folder),
+// every entry if 'names' is NULL.
+int archive_extract(char *path, char *dst, char **names, u32 names_number, archive_progress progress, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ARCHIVE_H__ */
@@ -8,10 +8,13 @@
 #include <assert.h>
 #include <sys/file.h>
 #include <sys/stat.h>
+#include <sys/thread.h>
+#include <sys/mutex.h>
 #include <string.h>
 
 #include "cxml/cxmlutil.h"
 #include "cxml/cxmlaccess.h"
+
 #include "zlib.h"
 #include "gtf.h"
 
@@ -36,6 +39,34 @@ extern "C" void JSX2JS(char *in, char *out);
 char table[10][32];
 int lv_table=-1;
 
+#define CXML_OUT_BUFFER		0x40000
+#define CXML_CONVERT_THREADS	2
+
+// conversion of the embedded files is deferred until the xml is written : the
+// xml only depends on the magic of the file. GIM is converted by a worker pool,
+// the others are done afterwards one by one on the calling thread (JSX keeps its
+// tables on the stack, too big for the stack of a worker).
+enum {
+	CXML_CONV_GIM=0,
+	CXML_CONV_JSX,
+	CXML_CONV_GTF,
+	CXML_CONV_VAG,
+	CXML_CONV_RAF
+};
+
+typedef struct
+{
+	u8 type;
+	char in[128];
+	char out[128];
+} cxml_job;
+
+static cxml_job *cxml_jobs=NULL;
+static int cxml_jobs_number=0;
+static int cxml_jobs_max=0;
+static int cxml_jobs_next=0;
+static sys_lwmutex_t cxml_jobs_lock;
+
 using namespace cxml;
 
 int zlib_decompressed_size(void *src, int srcLen)
@@ -109,6 +140,103 @@ int mkdir_rec(const char *path)
   return ret;
 }
 
+static void add_job(u8 type, char *in, char *out)
+{
+	if(cxml_jobs_number == cxml_jobs_max) {
+		cxml_job *tmp = (cxml_job *) realloc(cxml_jobs, (cxml_jobs_max + 64) * sizeof(cxml_job));
+		if(tmp == NULL) {
+			print_load((char *) "Error : failed to realloc cxml_jobs");
+			return;
+		}
+		cxml_jobs = tmp;
+		cxml_jobs_max += 64;
+	}
+	cxml_jobs[cxml_jobs_number].type = type;
+	strcpy(cxml_jobs[cxml_jobs_number].in, in);
+	strcpy(cxml_jobs[cxml_jobs_number].out, out);
+	cxml_jobs_number++;
+}
+
+static void do_job(cxml_job *job)
+{
+	switch(job->type)
+	{
+		case CXML_CONV_GIM:
+			GIM2PNG(job->in, job->out);
+			break;
+		case CXML_CONV_JSX:
+			JSX2JS(job->in, job->out);
+			break;
+		case CXML_CONV_GTF:
+		{
+			// .gtf -> .dds -> .png
+			char png[128];
+			strcpy(png, job->out);
+			png[strlen(png)-3]='p';
+			png[strlen(png)-2]='n';
+			png[strlen(png)-1]='g';
+			if( gtf2dds(job->in, job->out, 0, 0) == false ) break;
+			ConvertImage(job->out, png);
+			break;
+		}
+		case CXML_CONV_VAG:
+			VAG2WAV(job->in, job->out);
+			break;
+		case CXML_CONV_RAF:
+			cxml_extract(job->out);
+			break;
+	}
+}
+
+static void job_thread(void *unused)
+{
+	while(1) {
+		sysLwMutexLock(&cxml_jobs_lock, 0);
+		int i = cxml_jobs_next;
+		while(i < cxml_jobs_number && cxml_jobs[i].type != CXML_CONV_GIM) i++;
+		cxml_jobs_next = i+1;
+		sysLwMutexUnlock(&cxml_jobs_lock);
+		
+		if(cxml_jobs_number <= i) break;
+		
+		do_job(&cxml_jobs[i]);
+	}
+	sysThreadExit(0);
+}
+
+static void do_jobs()
+{
+	static const sys_lwmutex_attr_t attr = {
+		SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""
+	};
+	sys_ppu_thread_t id[CXML_CONVERT_THREADS];
+	int started[CXML_CONVERT_THREADS];
+	int pool = 0;
+	u64 ret;
+	int i;
+	
+	if(cxml_jobs_number == 0) return;
+	
+	cxml_jobs_next = 0;
+	sysLwMutexCreate(&cxml_jobs_lock, &attr);
+	for(i=0; i<CXML_CONVERT_THREADS; i++) {
+		started[i] = (sysThreadCreate(&id[i], job_thread, NULL, 1000, 0x10000, THREAD_JOINABLE, (char *) "cxml_convert") == 0);
+	}
+	for(i=0; i<CXML_CONVERT_THREADS; i++) {
+		if(started[i]) {
+			sysThreadJoin(id[i], &ret);
+			pool = 1;
+		}
+	}
+	sysLwMutexDestroy(&cxml_jobs_lock);
+	
+	// the rest, or everything when no worker could be started
+	for(i=0; i<cxml_jobs_number; i++) {
+		if(pool && cxml_jobs[i].type == CXML_CONV_GIM) continue;
+		do_job(&cxml_jobs[i]);
+	}
+}
+
 static void print_indent( int indent, FILE *out )
 {
 	int i;
@@ -139,7 +267,7 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 	
 	print_indent(indent, out);
 	
-	sprintf(temp, "<%s", element.GetName() ); fputs(temp, out);
+	fprintf(out, "<%s", element.GetName() );
 	int i;
 	for( i=0 ; i<element.NumAttribute() ; i++ )
 	{
@@ -156,7 +284,7 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 		{
 		case AttributeType_None:
 			{
-				sprintf(temp, " %s=\"None\"", attr.GetName()); fputs(temp, out);
+				fprintf(out, " %s=\"None\"", attr.GetName());
 			}
 			break;
 
@@ -169,7 +297,7 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 				{
 					return ret;
 				}
-				sprintf(temp, " %s=\"%d\"", attr.GetName(), _i ); fputs(temp, out);
+				fprintf(out, " %s=\"%d\"", attr.GetName(), _i );
 				
 			}
 			break;
@@ -184,7 +312,7 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 					return ret;
 				}
 
-				sprintf(temp, " %s=\"%f\"", attr.GetName(), f ); fputs(temp, out);
+				fprintf(out, " %s=\"%f\"", attr.GetName(), f );
 			}
 			break;
 
@@ -200,7 +328,7 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 					return ret;
 				}
 
-				sprintf(temp, " %s=\"%s\"", attr.GetName(), str ); fputs(temp, out);
+				fprintf(out, " %s=\"%s\"", attr.GetName(), str );
 			}
 			break;
 
@@ -215,11 +343,11 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 				{
 					return ret;
 				}
-				sprintf(temp, " %s=\"", attr.GetName());	fputs(temp, out);
+				fprintf(out, " %s=\"", attr.GetName());
 
 				for( unsigned int k=0 ; k<num ; k++ )
 				{
-					sprintf(temp, "%d", array[k] ); fputs(temp, out);
+					fprintf(out, "%d", array[k] );
 					if(k+1<num) fputs(",", out);
 				}
 				fputs("\"", out);
@@ -237,11 +365,11 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 				{
 					return ret;
 				}
-				sprintf(temp, " %s=\"", attr.GetName());	fputs(temp, out);
+				fprintf(out, " %s=\"", attr.GetName());
 
 				for( unsigned int k=0 ; k<num ; k++ )
 				{
-					sprintf(temp, "%f", array[k] ); fputs(temp, out);
+					fprintf(out, "%f", array[k] );
 					if(k+1<num) fputs(",", out);
 				}
 				fputs("\"", out);
@@ -308,7 +436,7 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 					return ret;
 				}
 				
-				sprintf(temp, " %s=\"%s\"", attr.GetName(), id); fputs(temp, out);
+				fprintf(out, " %s=\"%s\"", attr.GetName(), id);
 				
 				have_ID = 1; strcpy(NameID, id);
 				
@@ -331,7 +459,7 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 				
 				strcpy(dst_name[n_file], id);
 				
-				sprintf(temp, " %s=\"%s\">\n", attr.GetName(), id); fputs(temp, out);
+				fprintf(out, " %s=\"%s\">\n", attr.GetName(), id);
 				
 				if(strcmp(table[lv_table], element.GetName()) == 0) {
 					lv_table++;
@@ -345,13 +473,13 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 				
 				if(i!=element.NumAttribute()-1) {
 					print_indent(indent+1, out);
-					sprintf(temp, "<%s", entity.GetName()); fputs(temp, out);
+					fprintf(out, "<%s", entity.GetName());
 				} else close=0;
 			}
 			break;
 
 		default:
-			sprintf(temp, " %s=\"invalid type\"", attr.GetName()); fputs(temp, out );
+			fprintf(out, " %s=\"invalid type\"", attr.GetName());
 			return -1;
 		}
 	}
@@ -498,7 +626,7 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 					dst[strlen(dst)-1]='g';
 				}
 			
-				GIM2PNG(temp, dst);
+				add_job(CXML_CONV_GIM, temp, dst);
 				
 				break;
 			} else
@@ -508,14 +636,7 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 				dst[strlen(dst)-2]='d';
 				dst[strlen(dst)-1]='s';
 				
-				if( gtf2dds(temp, dst, 0, 0) == false ) break;
-				
-				strcpy(temp, dst);
-				dst[strlen(dst)-3]='p';
-				dst[strlen(dst)-2]='n';
-				dst[strlen(dst)-1]='g';
-				
-				ConvertImage(temp, dst);
+				add_job(CXML_CONV_GTF, temp, dst);
 				
 				break;
 			
@@ -534,7 +655,7 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 					dst[strlen(dst)-1]='v';
 				}
 				
-				VAG2WAV(temp, dst); 
+				add_job(CXML_CONV_VAG, temp, dst);
 				
 				break;
 			} else
@@ -550,12 +671,12 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 					dst[strlen(dst)-1]=0;
 				}
 				
-				JSX2JS(temp, dst);
+				add_job(CXML_CONV_JSX, temp, dst);
 				
 				break;
 			} else 
 			if( magic == 0x5241464F) { // RAF : cxml
-				cxml_extract(dst);
+				add_job(CXML_CONV_RAF, dst, dst);
 				break;
 			}
 			
@@ -580,8 +701,7 @@ static int dump_element( const Element & element, int indent , FILE *out, char *
 	
 	if(lv_table==indent) {
 		print_indent(indent, out);
-		sprintf(temp, "</%s>\n", table[lv_table]);
-		fputs(temp, out);
+		fprintf(out, "</%s>\n", table[lv_table]);
 		memset(table[lv_table], 0, sizeof(table[lv_table]));
 		lv_table--;
 	}
@@ -602,9 +722,19 @@ void cxml_extract(char *file_path)
 	Document doc;
 	
 	FILE *out;
+	char *out_buffer = NULL;
 	char dir_path[128];
 	char out_path[128];
 	
+	// embedded RAF are extracted from do_jobs, keep the job list of the caller
+	cxml_job *parent_jobs = cxml_jobs;
+	int parent_jobs_number = cxml_jobs_number;
+	int parent_jobs_max = cxml_jobs_max;
+	
+	cxml_jobs = NULL;
+	cxml_jobs_number = 0;
+	cxml_jobs_max = 0;
+	
 	if(strstr("dev_flash", file_path) != NULL) {
 		strcpy(dir_path, "/dev_hdd0/tmp");
 		mkdir(dir_path, 0777);
@@ -629,6 +759,11 @@ void cxml_extract(char *file_path)
 		print_load((char *)"Error : failed to create xml");
 		goto error;
 	}
+	
+	// the xml is written with lots of small writes
+	out_buffer = (char *) malloc(CXML_OUT_BUFFER);
+	if(out_buffer) setvbuf(out, out_buffer, _IOFBF, CXML_OUT_BUFFER);
+	
 	// ----------------------------------------------
 
 	ret = doc.CreateFromFile( file_path );
@@ -651,4 +786,12 @@ void cxml_extract(char *file_path)
 	
 error:
 	if(out != NULL) fclose(out);
+	if(out_buffer) free(out_buffer);
+	
+	do_jobs();
+	
+	if(cxml_jobs) free(cxml_jobs);
+	cxml_jobs = parent_jobs;
+	cxml_jobs_number = parent_jobs_number;
+	cxml_jobs_max = parent_jobs_max;
 }
@@ -14,6 +14,7 @@
 */
 
 #include "dds_reader.h"
+#include "dxt.h"
 
 static const DDS_ORDER _DDS_READER_ARGB = { 16, 8, 0, 24 };
 const DDS_ORDER *DDS_READER_ARGB = &_DDS_READER_ARGB;
@@ -119,11 +120,6 @@ static int *ddsReadA8B8G8R8(int width, int height, int offset, unsigned const ch
 static int *ddsReadX8B8G8R8(int width, int height, int offset, unsigned const char *buffer, const DDS_ORDER *order);
 static int *ddsReadA8R8G8B8(int width, int height, int offset, unsigned const char *buffer, const DDS_ORDER *order);
 static int *ddsReadX8R8G8B8(int width, int height, int offset, unsigned const char *buffer, const DDS_ORDER *order);
-static int ddsGetDXTColor(int c0, int c1, int a, int t, const DDS_ORDER *order);
-static int ddsGetDXTColor2_1(int c0, int c1, int a, const DDS_ORDER *order);
-static int ddsGetDXTColor1_1(int c0, int c1, int a, const DDS_ORDER *order);
-static int ddsGetDXTColor1(int c, int a, const DDS_ORDER *order);
-static int ddsGetDXT5Alpha(int a0, int a1, int t);
 
 int *ddsRead(const unsigned char *buffer, const DDS_ORDER *order, int mipmapLevel) {
 
@@ -276,34 +272,7 @@ static int ddsGetType(const unsigned char *buffer) {
 }
 
 int *ddsDecodeDXT1(int width, int height, int offset, const unsigned char *buffer, const DDS_ORDER *order) {
-	int *pixels = (int *)ddsMalloc(4 * width*height);
-	int index = offset;
-	int w = (width + 3) / 4;
-	int h = (height + 3) / 4;
-	int i;
-	for(i = 0; i<h; i++) {
-		int j;
-		for (j = 0; j<w; j++) {
-			int c0 = (buffer[index] & 0xFF) | (buffer[index + 1] & 0xFF) << 8; index += 2;
-			int c1 = (buffer[index] & 0xFF) | (buffer[index + 1] & 0xFF) << 8; index += 2;
-			int k;
-			for (k = 0; k<4; k++) {
-				if (4 * i + k >= height) break;
-				int t0 = (buffer[index] & 0x03);
-				int t1 = (buffer[index] & 0x0C) >> 2;
-				int t2 = (buffer[index] & 0x30) >> 4;
-				int t3 = (buffer[index++] & 0xC0) >> 6;
-				pixels[4 * width*i + 4 * j + width*k + 0] = ddsGetDXTColor(c0, c1, 0xFF, t0, order);
-				if (4 * j + 1 >= width) continue;
-				pixels[4 * width*i + 4 * j + width*k + 1] = ddsGetDXTColor(c0, c1, 0xFF, t1, order);
-				if (4 * j + 2 >= width) continue;
-				pixels[4 * width*i + 4 * j + width*k + 2] = ddsGetDXTColor(c0, c1, 0xFF, t2, order);
-				if (4 * j + 3 >= width) continue;
-				pixels[4 * width*i + 4 * j + width*k + 3] = ddsGetDXTColor(c0, c1, 0xFF, t3, order);
-			}
-		}
-	}
-	return pixels;
+	return dxtDecode(DXT_FORMAT_DXT1, width, height, buffer + offset, order);
 }
 
 int *ddsDecodeDXT2(int width, int height, int offset, const unsigned char *buffer, const DDS_ORDER *order) {
@@ -311,45 +280,7 @@ int *ddsDecodeDXT2(int width, int height, int offset, const unsigned char *buffe
 }
 
 int *ddsDecodeDXT3(int width, int height, int offset, const unsigned char *buffer, const DDS_ORDER *order) {
-	int *pixels = (int *)ddsMalloc(4 * width*height);
-	int index = offset;
-	int w = (width + 3) / 4;
-	int h = (height + 3) / 4;
-	int alphaTable[16];
-	int i;
-	for(i = 0; i<h; i++) {
-		int j;
-		for (j = 0; j<w; j++) {
-			// create alpha table(4bit to 8bit)
-			int k;
-			for (k = 0; k<4; k++) {
-				int a0 = (buffer[index++] & 0xFF);
-				int a1 = (buffer[index++] & 0xFF);
-				// 4bit alpha to 8bit alpha
-				alphaTable[4 * k + 0] = 17 * ((a0 & 0xF0) >> 4);
-				alphaTable[4 * k + 1] = 17 * (a0 & 0x0F);
-				alphaTable[4 * k + 2] = 17 * ((a1 & 0xF0) >> 4);
-				alphaTable[4 * k + 3] = 17 * (a1 & 0x0F);
-			}
-			int c0 = (buffer[index] & 0xFF) | (buffer[index + 1] & 0xFF) << 8; index += 2;
-			int c1 = (buffer[index] & 0xFF) | (buffer[index + 1] & 0xFF) << 8; index += 2;
-			for (k = 0; k<4; k++) {
-				if (4 * i + k >= height) break;
-				int t0 = (buffer[index] & 0x03);
-				int t1 = (buffer[index] & 0x0C) >> 2;
-				int t2 = (buffer[index] & 0x30) >> 4;
-				int t3 = (buffer[index++] & 0xC0) >> 6;
-				pixels[4 * width*i + 4 * j + width*k + 0] = ddsGetDXTColor(c0, c1, alphaTable[4 * k + 0], t0, order);
-				if (4 * j + 1 >= width) continue;
-				pixels[4 * width*i + 4 * j + width*k + 1] = ddsGetDXTColor(c0, c1, alphaTable[4 * k + 1], t1, order);
-				if (4 * j + 2 >= width) continue;
-				pixels[4 * width*i + 4 * j + width*k + 2] = ddsGetDXTColor(c0, c1, alphaTable[4 * k + 2], t2, order);
-				if (4 * j + 3 >= width) continue;
-				pixels[4 * width*i + 4 * j + width*k + 3] = ddsGetDXTColor(c0, c1, alphaTable[4 * k + 3], t3, order);
-			}
-		}
-	}
-	return pixels;
+	return dxtDecode(DXT_FORMAT_DXT3, width, height, buffer + offset, order);
 }
 
 int *ddsDecodeDXT4(int width, int height, int offset, const unsigned char *buffer, const DDS_ORDER *order) {
@@ -357,56 +288,7 @@ int *ddsDecodeDXT4(int width, int height, int offset, const unsigned char *buffe
 }
 
 int *ddsDecodeDXT5(int width, int height, int offset, const unsigned char *buffer, const DDS_ORDER *order) {
-	int *pixels = (int *)ddsMalloc(4 * width*height);
-	int index = offset;
-	int w = (width + 3) / 4;
-	int h = (height + 3) / 4;
-	int alphaTable[16];
-	int i;
-	for(i = 0; i<h; i++) {
-		int j;
-		for (j = 0; j<w; j++) {
-			// create alpha table
-			int a0 = (buffer[index++] & 0xFF);
-			int a1 = (buffer[index++] & 0xFF);
-			int b0 = (buffer[index] & 0xFF) | (buffer[index + 1] & 0xFF) << 8 | (buffer[index + 2] & 0xFF) << 16; index += 3;
-			int b1 = (buffer[index] & 0xFF) | (buffer[index + 1] & 0xFF) << 8 | (buffer[index + 2] & 0xFF) << 16; index += 3;
-			alphaTable[0] = b0 & 0x07;
-			alphaTable[1] = (b0 >> 3) & 0x07;
-			alphaTable[2] = (b0 >> 6) & 0x07;
-			alphaTable[3] = (b0 >> 9) & 0x07;
-			alphaTable[4] = (b0 >> 12) & 0x07;
-			alphaTable[5] = (b0 >> 15) & 0x07;
-			alphaTable[6] = (b0 >> 18) & 0x07;
-			alphaTable[7] = (b0 >> 21) & 0x07;
-			alphaTable[8] = b1 & 0x07;
-			alphaTable[9] = (b1 >> 3) & 0x07;
-			alphaTable[10] = (b1 >> 6) & 0x07;
-			alphaTable[11] = (b1 >> 9) & 0x07;
-			alphaTable[12] = (b1 >> 12) & 0x07;
-			alphaTable[13] = (b1 >> 15) & 0x07;
-			alphaTable[14] = (b1 >> 18) & 0x07;
-			alphaTable[15] = (b1 >> 21) & 0x07;
-			int c0 = (buffer[index] & 0xFF) | (buffer[index + 1] & 0xFF) << 8; index += 2;
-			int c1 = (buffer[index] & 0xFF) | (buffer[index + 1] & 0xFF) << 8; index += 2;
-			int k;
-			for (k = 0; k<4; k++) {
-				if (4 * i + k >= height) break;
-				int t0 = (buffer[index] & 0x03);
-				int t1 = (buffer[index] & 0x0C) >> 2;
-				int t2 = (buffer[index] & 0x30) >> 4;
-				int t3 = (buffer[index++] & 0xC0) >> 6;
-				pixels[4 * width*i + 4 * j + width*k + 0] = ddsGetDXTColor(c0, c1, ddsGetDXT5Alpha(a0, a1, alphaTable[4 * k + 0]), t0, order);
-				if (4 * j + 1 >= width) continue;
-				pixels[4 * width*i + 4 * j + width*k + 1] = ddsGetDXTColor(c0, c1, ddsGetDXT5Alpha(a0, a1, alphaTable[4 * k + 1]), t1, order);
-				if (4 * j + 2 >= width) continue;
-				pixels[4 * width*i + 4 * j + width*k + 2] = ddsGetDXTColor(c0, c1, ddsGetDXT5Alpha(a0, a1, alphaTable[4 * k + 2]), t2, order);
-				if (4 * j + 3 >= width) continue;
-				pixels[4 * width*i + 4 * j + width*k + 3] = ddsGetDXTColor(c0, c1, ddsGetDXT5Alpha(a0, a1, alphaTable[4 * k + 3]), t3, order);
-			}
-		}
-	}
-	return pixels;
+	return dxtDecode(DXT_FORMAT_DXT5, width, height, buffer + offset, order);
 }
 
 int *ddsReadA1R5G5B5(int width, int height, int offset, const unsigned char *buffer, const DDS_ORDER *order) {
@@ -554,61 +436,4 @@ int *ddsReadX8R8G8B8(int width, int height, int offset, const unsigned char *buf
 	return pixels;
 }
 
-int ddsGetDXTColor(int c0, int c1, int a, int t, const DDS_ORDER *order) {
-	switch (t) {
-	case 0: return ddsGetDXTColor1(c0, a, order);
-	case 1: return ddsGetDXTColor1(c1, a, order);
-	case 2: return (c0 > c1) ? ddsGetDXTColor2_1(c0, c1, a, order) : ddsGetDXTColor1_1(c0, c1, a, order);
-	case 3: return (c0 > c1) ? ddsGetDXTColor2_1(c1, c0, a, order) : 0;
-	}
-	return 0;
-}
-
-int ddsGetDXTColor2_1(int c0, int c1, int a, const DDS_ORDER *order) {
-	// 2*c0/3 + c1/3
-	int r = (2 * BIT5[(c0 & 0xFC00) >> 11] + BIT5[(c1 & 0xFC00) >> 11]) / 3;
-	int g = (2 * BIT6[(c0 & 0x07E0) >> 5] + BIT6[(c1 & 0x07E0) >> 5]) / 3;
-	int b = (2 * BIT5[c0 & 0x001F] + BIT5[c1 & 0x001F]) / 3;
-	return (a << order->alphaShift) | (r << order->redShift) | (g << order->greenShift) | (b << order->blueShift);
-}
-
-int ddsGetDXTColor1_1(int c0, int c1, int a, const DDS_ORDER *order) {
-	// (c0+c1) / 2
-	int r = (BIT5[(c0 & 0xFC00) >> 11] + BIT5[(c1 & 0xFC00) >> 11]) / 2;
-	int g = (BIT6[(c0 & 0x07E0) >> 5] + BIT6[(c1 & 0x07E0) >> 5]) / 2;
-	int b = (BIT5[c0 & 0x001F] + BIT5[c1 & 0x001F]) / 2;
-	return (a << order->alphaShift) | (r << order->redShift) | (g << order->greenShift) | (b << order->blueShift);
-}
-
-int ddsGetDXTColor1(int c, int a, const DDS_ORDER *order) {
-	int r = BIT5[(c & 0xFC00) >> 11];
-	int g = BIT6[(c & 0x07E0) >> 5];
-	int b = BIT5[(c & 0x001F)];
-	return (a << order->alphaShift) | (r << order->redShift) | (g << order->greenShift) | (b << order->blueShift);
-}
-
-int ddsGetDXT5Alpha(int a0, int a1, int t) {
-	if (a0 > a1) switch (t) {
-	case 0: return a0;
-	case 1: return a1;
-	case 2: return (6 * a0 + a1) / 7;
-	case 3: return (5 * a0 + 2 * a1) / 7;
-	case 4: return (4 * a0 + 3 * a1) / 7;
-	case 5: return (3 * a0 + 4 * a1) / 7;
-	case 6: return (2 * a0 + 5 * a1) / 7;
-	case 7: return (a0 + 6 * a1) / 7;
-	}
-	else switch (t) {
-	case 0: return a0;
-	case 1: return a1;
-	case 2: return (4 * a0 + a1) / 5;
-	case 3: return (3 * a0 + 2 * a1) / 5;
-	case 4: return (2 * a0 + 3 * a1) / 5;
-	case 5: return (a0 + 4 * a1) / 5;
-	case 6: return 0;
-	case 7: return 255;
-	}
-	return 0;
-}
-
 /* EOF */
@@ -0,0 +1,542 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <ppu-types.h>
+#include <sys/thread.h>
+#include <sys/mutex.h>
+
+#include "mgz_io.h"
+#include "walk.h"
+#include "delete.h"
+
+// paths handed to a worker at once
+#define DELETE_BLOCK_SIZE		0x4000
+// blocks listed ahead of the workers
+#define DELETE_QUEUE_MAX		64
+// the tree is listed again when entries were missed (removed while their folder was read)
+#define DELETE_PASSES_MAX		3
+
+// devices waiting for the background thread
+#define DELETE_PURGE_MAX		8
+#define DELETE_ROOT_SIZE		64
+
+extern u64 get_usec();
+
+typedef struct delete_block
+{
+	struct delete_block *next;
+	u32 number;
+	u32 used;
+	char data[DELETE_BLOCK_SIZE];
+} delete_block;
+
+typedef struct
+{
+	u8 *cancel;
+	u32 workers;
+	delete_block *block;		// files being listed
+	delete_block *queue;		// files waiting for a worker
+	delete_block *queue_last;
+	u32 queued;
+	delete_block *dirs;			// folders, in the order they're removed
+	delete_block *dirs_last;
+	u8 listed;
+	u32 files;
+	u32 dirs_number;
+	u32 failed;
+	sys_lwmutex_t lock;
+} delete_job;
+
+static u8 canceled(delete_job *job)
+{
+	return job->cancel && *job->cancel;
+}
+
+static delete_block *block_new()
+{
+	delete_block *b = (delete_block *) malloc(sizeof(delete_block));
+	if(b == NULL) return NULL;
+
+	b->next = NULL;
+	b->number = 0;
+	b->used = 0;
+
+	return b;
+}
+
+static u8 block_fits(delete_block *b, u32 len)
+{
+	return b->used + len + 1 <= DELETE_BLOCK_SIZE;
+}
+
+static void block_add(delete_block *b, char *path, u32 len)
+{
+	memcpy(&b->data[b->used], path, len + 1);
+	b->used += len + 1;
+	b->number++;
+}
+
+static void blocks_free(delete_block *b)
+{
+	while(b) {
+		delete_block *next = b->next;
+		free(b);
+		b = next;
+	}
+}
+
+static void remove_file(char *path, u32 *files, u32 *failed)
+{
+	if(unlink(path) == 0) (*files)++;
+	else (*failed)++;
+}
+
+// hand the block being listed to the workers
+static void queue_block(delete_job *job)
+{
+	delete_block *b = job->block;
+
+	job->block = NULL;
+	if(b == NULL || b->number == 0) {
+		free(b);
+		return;
+	}
+
+	// the listing doesn't get too far ahead of the workers
+	while(1) {
+		sysLwMutexLock(&job->lock, 0);
+		if(job->queued < DELETE_QUEUE_MAX || canceled(job)) break;
+		sysLwMutexUnlock(&job->lock);
+		usleep(1000);
+	}
+	if(job->queue_last) job->queue_last->next = b;
+	else job->queue = b;
+	job->queue_last = b;
+	job->queued++;
+	sysLwMutexUnlock(&job->lock);
+}
+
+static int list_file(walk_entry *e, void *arg)
+{
+	delete_job *job = (delete_job *) arg;
+	u32 len = strlen(e->path);
+
+	if(job->workers == 1) {
+		remove_file(e->path, &job->files, &job->failed);
+		return WALK_CONTINUE;
+	}
+	// no file system takes such a path, it's left to fail the last check of delete_tree
+	if(DELETE_BLOCK_SIZE <= len) return WALK_CONTINUE;
+
+	if(job->block && block_fits(job->block, len) == 0) queue_block(job);
+	if(job->block == NULL) {
+		job->block = block_new();
+		if(job->block == NULL) return WALK_STOP;
+	}
+	block_add(job->block, e->path, len);
+
+	return WALK_CONTINUE;
+}
+
+static int list_dir(walk_entry *e, void *arg)
+{
+	delete_job *job = (delete_job *) arg;
+	u32 len = strlen(e->path);
+
+	// nothing is waiting in the queue, the folder is already empty
+	if(job->workers == 1) {
+		if(rmdir(e->path) == 0) job->dirs_number++;
+		else job->failed++;
+		return WALK_CONTINUE;
+	}
+	if(DELETE_BLOCK_SIZE <= len) return WALK_CONTINUE;
+
+	if(job->dirs_last == NULL || block_fits(job->dirs_last, len) == 0) {
+		delete_block *b = block_new();
+		if(b == NULL) return WALK_STOP;
+		if(job->dirs_last) job->dirs_last->next = b;
+		else job->dirs = b;
+		job->dirs_last = b;
+	}
+	block_add(job->dirs_last, e->path, len);
+
+	return WALK_CONTINUE;
+}
+
+static void delete_run(delete_job *job)
+{
+	u32 files = 0;
+	u32 failed = 0;
+
+	while(1) {
+		sysLwMutexLock(&job->lock, 0);
+		delete_block *b = job->queue;
+		if(b == NULL) {
+			u8 listed = job->listed;
+			sysLwMutexUnlock(&job->lock);
+			if(listed) break;
+			usleep(1000);
+			continue;
+		}
+		job->queue = b->next;
+		if(job->queue == NULL) job->queue_last = NULL;
+		job->queued--;
+		sysLwMutexUnlock(&job->lock);
+
+		if(canceled(job) == 0) {
+			char *path = b->data;
+			u32 i;
+			for(i=0; i < b->number; i++) {
+				remove_file(path, &files, &failed);
+				path += strlen(path) + 1;
+			}
+		}
+		free(b);
+	}
+
+	sysLwMutexLock(&job->lock, 0);
+	job->files += files;
+	job->failed += failed;
+	sysLwMutexUnlock(&job->lock);
+}
+
+static void delete_thread(void *data)
+{
+	delete_run((delete_job *) data);
+
+	sysThreadExit(0);
+}
+
+// One listing of the tree, the files are removed while it's listed and the folders at the end
+static void delete_pass(delete_job *job, char *path)
+{
+	sys_ppu_thread_t id[DELETE_WORKERS_MAX];
+	u8 started[DELETE_WORKERS_MAX];
+	walk_visitor v;
+	u64 thread_ret;
+	u32 i;
+
+	memset(&v, 0, sizeof(walk_visitor));
+	v.file = list_file;
+	v.leave = list_dir;
+	v.arg = job;
+	v.cancel = job->cancel;
+
+	if(job->workers == 1) {
+		walk(path, &v);
+		return;
+	}
+
+	sys_lwmutex_attr_t attr = {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""};
+	sysLwMutexCreate(&job->lock, &attr);
+
+	job->listed = NO;
+	u32 started_number = 0;
+	for(i=0; i<job->workers; i++) {
+		started[i] = (sysThreadCreate(&id[i], delete_thread, (void *) job, 1000, 0x4000, THREAD_JOINABLE, "delete") == 0);
+		if(started[i]) started_number++;
+	}
+	
+	// nothing would empty the queue while it's listed
+	if(started_number == 0) {
+		sysLwMutexDestroy(&job->lock);
+		job->workers = 1;
+		walk(path, &v);
+		return;
+	}
+
+	walk(path, &v);
+	queue_block(job);
+
+	sysLwMutexLock(&job->lock, 0);
+	job->listed = YES;
+	sysLwMutexUnlock(&job->lock);
+
+	// the caller helps to empty the queue
+	delete_run(job);
+
+	for(i=0; i<job->workers; i++) {
+		if(started[i]) sysThreadJoin(id[i], &thread_ret);
+	}
+
+	sysLwMutexDestroy(&job->lock);
+
+	// the folders were kept in the order of 'leave', the content before the folder
+	delete_block *b;
+	for(b = job->dirs; b != NULL && canceled(job) == 0; b = b->next) {
+		char *dir = b->data;
+		for(i=0; i < b->number; i++) {
+			if(rmdir(dir) == 0) job->dirs_number++;
+			else job->failed++;
+			dir += strlen(dir) + 1;
+		}
+	}
+	blocks_free(job->dirs);
+	job->dirs = NULL;
+	job->dirs_last = NULL;
+}
+
+int delete_tree(char *path, u32 workers, u8 *cancel, delete_stats *stats)
+{
+	delete_job job;
+	struct stat st;
+	int ret = DELETE_OK;
+
+	u64 start = get_usec();
+
+	memset(&job, 0, sizeof(delete_job));
+	job.cancel = cancel;
+
+	if(workers == 0) workers = 1;
+	if(workers > DELETE_WORKERS_MAX) workers = DELETE_WORKERS_MAX;
+	u32 fs_threads = MGZ_fs_threads(path);
+	if(fs_threads < workers) workers = fs_threads;
+	job.workers = workers;
+
+	u32 pass = 0;
+	if(stat(path, &st) == 0) {
+		if(!S_ISDIR(st.st_mode)) {
+			remove_file(path, &job.files, &job.failed);
+			pass = 1;
+		} else
+		while(pass < DELETE_PASSES_MAX) {
+			pass++;
+			delete_pass(&job, path);
+			if(canceled(&job)) break;
+			if(stat(path, &st) != 0) break;
+		}
+
+		if(canceled(&job)) ret = DELETE_CANCELED; else
+		if(stat(path, &st) == 0) ret = DELETE_ERROR;
+	}
+
+	if(stats) {
+		memset(stats, 0, sizeof(delete_stats));
+		stats->files = job.files;
+		stats->dirs = job.dirs_number;
+		stats->failed = job.failed;
+		stats->workers = job.workers;
+		stats->passes = pass;
+		stats->usec = get_usec() - start;
+		if(stats->usec) stats->files_per_sec = (u64) job.files * 1000000 / stats->usec;
+	}
+
+	return ret;
+}
+
+//*******************************************************************************************
+// Trash
+//*******************************************************************************************
+
+static sys_lwmutex_t purge_lock;
+static u8 purge_lock_init = NO;
+static sys_ppu_thread_t purge_id;
+static u8 purge_started = NO;
+static u8 purge_running = NO;
+static u8 purge_stop = NO;
+static char purge_roots[DELETE_PURGE_MAX][DELETE_ROOT_SIZE];
+static u32 purge_number = 0;
+static u32 trash_counter = 0;
+
+static void purge_lock_get()
+{
+	if(purge_lock_init == NO) {
+		sys_lwmutex_attr_t attr = {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""};
+		sysLwMutexCreate(&purge_lock, &attr);
+		purge_lock_init = YES;
+	}
+	sysLwMutexLock(&purge_lock, 0);
+}
+
+// "/dev_usb000/GAMES/X" -> "/dev_usb000"
+static char *device_root(char *path, char *root)
+{
+	u32 len = (path[0] == '/') ? 1 : 0;
+
+	while(path[len] != 0 && path[len] != '/') len++;
+	if(DELETE_ROOT_SIZE <= len) return NULL;
+
+	memcpy(root, path, len);
+	root[len] = 0;
+
+	return root;
+}
+
+// same as device_root, NULL when there's nothing after the mount point
+static char *trash_root(char *path, char *root)
+{
+	u32 len = (path[0] == '/') ? 1 : 0;
+
+	while(path[len] != 0 && path[len] != '/') len++;
+	if(path[len] == 0 || path[len+1] == 0) return NULL;
+
+	return device_root(path, root);
+}
+
+// first entry of the trash, NULL when it's empty
+static char *trash_entry(char *trash)
+{
+	struct dirent *dir;
+	char *entry = NULL;
+
+	DIR *d = opendir(trash);
+	if(d == NULL) return NULL;
+
+	while((dir = readdir(d))) {
+		if(!strcmp(dir->d_name, ".") || !strcmp(dir->d_name, "..")) continue;
+
+		entry = (char *) malloc(strlen(trash) + strlen(dir->d_name) + 2);
+		if(entry) sprintf(entry, "%s/%s", trash, dir->d_name);
+		break;
+	}
+	closedir(d);
+
+	return entry;
+}
+
+static void purge_thread(void *data)
+{
+	char root[DELETE_ROOT_SIZE];
+	char trash[DELETE_ROOT_SIZE + 16];
+
+	while(1) {
+		purge_lock_get();
+		if(purge_stop || purge_number == 0) {
+			purge_running = NO;
+			sysLwMutexUnlock(&purge_lock);
+			break;
+		}
+		purge_number--;
+		strcpy(root, purge_roots[purge_number]);
+		sysLwMutexUnlock(&purge_lock);
+
+		// the trash folder itself stays, delete_trash can rename into it at any time
+		sprintf(trash, "%s/%s", root, DELETE_TRASH);
+		while(purge_stop == NO) {
+			char *entry = trash_entry(trash);
+			if(entry == NULL) break;
+			int ret = delete_tree(entry, 1, &purge_stop, NULL);
+			free(entry);
+			if(ret == DELETE_ERROR) break;
+		}
+	}
+
+	sysThreadExit(0);
+}
+
+static void purge_start(char *root)
+{
+	u64 thread_ret;
+	u32 i;
+
+	purge_lock_get();
+
+	for(i=0; i<purge_number; i++) {
+		if(strcmp(purge_roots[i], root) == 0) break;
+	}
+	if(i == purge_number && purge_number < DELETE_PURGE_MAX) {
+		strcpy(purge_roots[purge_number], root);
+		purge_number++;
+	}
+
+	if(purge_running == NO) {
+		// the previous thread is over, it only has to be joined
+		if(purge_started) sysThreadJoin(purge_id, &thread_ret);
+		purge_stop = NO;
+		purge_started = (sysThreadCreate(&purge_id, purge_thread, NULL, 1500, 0x4000, THREAD_JOINABLE, "delete_purge") == 0);
+		purge_running = purge_started;
+	}
+
+	sysLwMutexUnlock(&purge_lock);
+}
+
+void delete_purge_start(char *path)
+{
+	char root[DELETE_ROOT_SIZE];
+
+	if(trash_root(path, root) == NULL) return;
+
+	purge_start(root);
+}
+
+void delete_purge_resume(char *path)
+{
+	char root[DELETE_ROOT_SIZE];
+	char trash[DELETE_ROOT_SIZE + 16];
+
+	// delete_trash never uses the trash of an exFAT device
+	if(MGZ_fs_type(path) == MGZ_FS_EXFAT) return;
+	if(device_root(path, root) == NULL) return;
+
+	sprintf(trash, "%s/%s", root, DELETE_TRASH);
+	char *entry = trash_entry(trash);
+	if(entry == NULL) return;
+	free(entry);
+
+	purge_start(root);
+}
+
+void delete_purge_stop()
+{
+	u64 thread_ret;
+
+	purge_lock_get();
+	if(purge_started == NO) {
+		sysLwMutexUnlock(&purge_lock);
+		return;
+	}
+	purge_stop = YES;
+	sysLwMutexUnlock(&purge_lock);
+
+	sysThreadJoin(purge_id, &thread_ret);
+
+	purge_lock_get();
+	purge_started = NO;
+	purge_running = NO;
+	purge_number = 0;
+	purge_stop = NO;
+	sysLwMutexUnlock(&purge_lock);
+}
+
+u8 delete_purge_busy()
+{
+	purge_lock_get();
+	u8 running = purge_running;
+	sysLwMutexUnlock(&purge_lock);
+
+	return running;
+}
+
+int delete_trash(char *path, delete_stats *stats)
+{
+	char root[DELETE_ROOT_SIZE];
+	char trash[DELETE_ROOT_SIZE + 48];
+
+	// FatFs isn't reentrant, the background thread can't work while the device is used
+	if(MGZ_fs_type(path) == MGZ_FS_EXFAT || trash_root(path, root) == NULL) {
+		return delete_tree(path, DELETE_WORKERS_MAX, NULL, stats);
+	}
+
+	sprintf(trash, "%s/%s", root, DELETE_TRASH);
+	mkdir(trash, 0777);
+
+	purge_lock_get();
+	sprintf(trash, "%s/%s/%llX_%u", root, DELETE_TRASH, (unsigned long long) get_usec(), trash_counter++);
+	sysLwMutexUnlock(&purge_lock);
+
+	if(rename(path, trash) != 0) {
+		return delete_tree(path, DELETE_WORKERS_MAX, NULL, stats);
+	}
+
+	if(stats) {
+		memset(stats, 0, sizeof(delete_stats));
+		stats->trashed = YES;
+	}
+
+	delete_purge_start(path);
+
+	return DELETE_OK;
+}
@@ -0,0 +1,53 @@
+#ifndef __DELETE_H__
+#define __DELETE_H__
+
+#include <ppu-types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DELETE_OK				0
+#define DELETE_ERROR			1	// something couldn't be removed
+#define DELETE_CANCELED			2
+
+#define DELETE_WORKERS_MAX		4
+
+// folder of each device where delete_trash moves what it removes
+#define DELETE_TRASH			".mgz_trash"
+
+typedef struct
+{
+	u32 files;			// removed
+	u32 dirs;
+	u32 failed;			// unlink or rmdir that failed
+	u32 workers;		// threads that removed the files
+	u32 passes;			// listings of the tree, more than 1 when entries were missed
+	u64 usec;
+	u32 files_per_sec;
+	u8 trashed;			// delete_trash : moved to the trash, removed in background
+} delete_stats;
+
+// Remove 'path' and its content. The tree is listed once while 'workers' threads (limited by what the file
+// system allows, see MGZ_fs_threads) unlink the files, the folders are removed bottom-up at the end.
+// 'cancel' and 'stats' are optional.
+int delete_tree(char *path, u32 workers, u8 *cancel, delete_stats *stats);
+
+// Fast mode : 'path' is renamed into the trash folder of its device and a background thread removes it.
+// On exFAT (FatFs can't be used by two threads) or when the rename fails, it's delete_tree.
+int delete_trash(char *path, delete_stats *stats);
+
+// Remove the content of the trash of the device of 'path' in background
+void delete_purge_start(char *path);
+// Same as delete_purge_start when the trash of the device of 'path' isn't empty, called when the devices are listed
+void delete_purge_resume(char *path);
+// Stop the background thread, what's left in the trash is removed when the devices are listed again.
+// Called before the devices are unmounted and before exit.
+void delete_purge_stop();
+u8 delete_purge_busy();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DELETE_H__ */
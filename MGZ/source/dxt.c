@@ -0,0 +1,188 @@
+#include <string.h>
+#include <ppu-types.h>
+#include <sys/thread.h>
+
+#include "dxt.h"
+
+// textures with more pixels than this are split between the caller and a worker thread
+#define DXT_THREAD_PIXELS	(512*512)
+
+static const unsigned int BIT5[] = { 0, 8, 16, 25, 33, 41, 49, 58, 66, 74, 82, 90, 99, 107, 115, 123, 132, 140, 148, 156, 165, 173, 181, 189, 197, 206, 214, 222, 230, 239, 247, 255 };
+static const unsigned int BIT6[] = { 0, 4, 8, 12, 16, 20, 24, 28, 32, 36, 40, 45, 49, 53, 57, 61, 65, 69, 73, 77, 81, 85, 89, 93, 97, 101, 105, 109, 113, 117, 121, 125, 130, 134, 138, 142, 146, 150, 154, 158, 162, 166, 170, 174, 178, 182, 186, 190, 194, 198, 202, 206, 210, 215, 219, 223, 227, 231, 235, 239, 243, 247, 251, 255 };
+
+typedef struct
+{
+	int format;
+	int width;
+	int height;
+	const unsigned char *blocks;
+	const DDS_ORDER *order;
+	unsigned int *pixels;
+	int first_row; // block rows
+	int last_row;
+} dxt_job;
+
+static int dxt_block_size(int format)
+{
+	return format == DXT_FORMAT_DXT1 ? 8 : 16;
+}
+
+// color part of a block : the 4 colors are built once per block, keep[] clears
+// the transparent color of the 3 colors mode (alpha included)
+static void dxt_palette(const unsigned char *b, unsigned int *pal, unsigned int *keep, const DDS_ORDER *order)
+{
+	unsigned int c0 = b[0] | b[1] << 8;
+	unsigned int c1 = b[2] | b[3] << 8;
+
+	unsigned int r0 = BIT5[c0 >> 11], g0 = BIT6[(c0 >> 5) & 0x3F], b0 = BIT5[c0 & 0x1F];
+	unsigned int r1 = BIT5[c1 >> 11], g1 = BIT6[(c1 >> 5) & 0x3F], b1 = BIT5[c1 & 0x1F];
+
+	pal[0] = r0 << order->redShift | g0 << order->greenShift | b0 << order->blueShift;
+	pal[1] = r1 << order->redShift | g1 << order->greenShift | b1 << order->blueShift;
+	keep[0] = keep[1] = keep[2] = keep[3] = 0xFFFFFFFF;
+
+	if(c0 > c1) {
+		pal[2] = ((2*r0 + r1)/3) << order->redShift | ((2*g0 + g1)/3) << order->greenShift | ((2*b0 + b1)/3) << order->blueShift;
+		pal[3] = ((r0 + 2*r1)/3) << order->redShift | ((g0 + 2*g1)/3) << order->greenShift | ((b0 + 2*b1)/3) << order->blueShift;
+	} else {
+		pal[2] = ((r0 + r1)/2) << order->redShift | ((g0 + g1)/2) << order->greenShift | ((b0 + b1)/2) << order->blueShift;
+		pal[3] = 0;
+		keep[3] = 0;
+	}
+}
+
+// decode one block into a 4x4 tile
+static void dxt_block(int format, const unsigned char *b, unsigned int *tile, const DDS_ORDER *order)
+{
+	unsigned int pal[4], keep[4];
+	unsigned int alpha[16];
+	unsigned int shift = order->alphaShift;
+	int k;
+
+	if(format == DXT_FORMAT_DXT1) {
+		for(k = 0; k < 16; k++) alpha[k] = 0xFFu << shift;
+	} else
+	if(format == DXT_FORMAT_DXT3) {
+		// 4 bits per texel, first texel in the low nibble
+		for(k = 0; k < 8; k++) {
+			alpha[2*k]   = (17 * (b[k] & 0x0F)) << shift;
+			alpha[2*k+1] = (17 * (b[k] >> 4)) << shift;
+		}
+		b += 8;
+	} else {
+		unsigned int a0 = b[0];
+		unsigned int a1 = b[1];
+		unsigned int table[8];
+		unsigned int bits0 = b[2] | b[3] << 8 | b[4] << 16;
+		unsigned int bits1 = b[5] | b[6] << 8 | b[7] << 16;
+
+		table[0] = a0;
+		table[1] = a1;
+		if(a0 > a1) {
+			for(k = 2; k < 8; k++) table[k] = ((8-k)*a0 + (k-1)*a1) / 7;
+		} else {
+			for(k = 2; k < 6; k++) table[k] = ((6-k)*a0 + (k-1)*a1) / 5;
+			table[6] = 0;
+			table[7] = 255;
+		}
+		for(k = 0; k < 8; k++) {
+			alpha[k]   = table[(bits0 >> (3*k)) & 7] << shift;
+			alpha[k+8] = table[(bits1 >> (3*k)) & 7] << shift;
+		}
+		b += 8;
+	}
+
+	dxt_palette(b, pal, keep, order);
+
+	for(k = 0; k < 4; k++) {
+		unsigned int t = b[4+k];
+		tile[4*k+0] = (pal[t & 3] | alpha[4*k+0]) & keep[t & 3];
+		tile[4*k+1] = (pal[(t >> 2) & 3] | alpha[4*k+1]) & keep[(t >> 2) & 3];
+		tile[4*k+2] = (pal[(t >> 4) & 3] | alpha[4*k+2]) & keep[(t >> 4) & 3];
+		tile[4*k+3] = (pal[t >> 6] | alpha[4*k+3]) & keep[t >> 6];
+	}
+}
+
+static void dxt_decode_rows(dxt_job *job)
+{
+	int width = job->width;
+	int height = job->height;
+	int w = (width + 3) / 4;
+	int block_size = dxt_block_size(job->format);
+	unsigned int tile[16];
+	int i, j, k;
+
+	for(i = job->first_row; i < job->last_row; i++) {
+		const unsigned char *b = job->blocks + i * w * block_size;
+		unsigned int *row = job->pixels + 4 * i * width;
+		int rows = height - 4*i < 4 ? height - 4*i : 4;
+
+		for(j = 0; j < w; j++, b += block_size) {
+			unsigned int *dst = row + 4*j;
+
+			dxt_block(job->format, b, tile, job->order);
+
+			if(rows == 4 && 4*j + 4 <= width) {
+				// whole tile : 4 rows of 16 bytes
+				for(k = 0; k < 4; k++, dst += width) {
+					dst[0] = tile[4*k+0];
+					dst[1] = tile[4*k+1];
+					dst[2] = tile[4*k+2];
+					dst[3] = tile[4*k+3];
+				}
+			} else {
+				int cols = width - 4*j < 4 ? width - 4*j : 4;
+				for(k = 0; k < rows; k++, dst += width) {
+					memcpy(dst, &tile[4*k], cols * 4);
+				}
+			}
+		}
+	}
+}
+
+static void dxt_thread(void *arg)
+{
+	dxt_decode_rows((dxt_job *) arg);
+	sysThreadExit(0);
+}
+
+int *dxtDecode(int format, int width, int height, const unsigned char *blocks, const DDS_ORDER *order)
+{
+	dxt_job job[2];
+	sys_ppu_thread_t id;
+	u64 ret;
+	int h = (height + 3) / 4;
+
+	if(width <= 0 || height <= 0) return NULL;
+
+	unsigned int *pixels = (unsigned int *) ddsMalloc(4 * width * height);
+	if(pixels == NULL) return NULL;
+
+	job[0].format = format;
+	job[0].width = width;
+	job[0].height = height;
+	job[0].blocks = blocks;
+	job[0].order = order;
+	job[0].pixels = pixels;
+	job[0].first_row = 0;
+	job[0].last_row = h;
+
+	if(width * height < DXT_THREAD_PIXELS || h < 2) {
+		dxt_decode_rows(&job[0]);
+		return (int *) pixels;
+	}
+
+	job[1] = job[0];
+	job[0].last_row = h / 2;
+	job[1].first_row = h / 2;
+
+	if(sysThreadCreate(&id, dxt_thread, (void *) &job[0], 1000, 0x4000, THREAD_JOINABLE, (char *) "dxt_decode") != 0) {
+		dxt_decode_rows(&job[0]);
+		dxt_decode_rows(&job[1]);
+		return (int *) pixels;
+	}
+	dxt_decode_rows(&job[1]);
+	sysThreadJoin(id, &ret);
+
+	return (int *) pixels;
+}
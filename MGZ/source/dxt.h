@@ -0,0 +1,22 @@
+#ifndef __DXT_H__
+#define __DXT_H__
+
+#include "dds_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DXT_FORMAT_DXT1		1
+#define DXT_FORMAT_DXT3		3
+#define DXT_FORMAT_DXT5		5
+
+// Decode the first width*height texels of a block stream (4x4 blocks, row by row).
+// Returns a width*height array of pixels in the given order, allocated with ddsMalloc.
+int *dxtDecode(int format, int width, int height, const unsigned char *blocks, const DDS_ORDER *order);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DXT_H__ */
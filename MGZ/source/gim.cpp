@@ -17,6 +17,7 @@
 
 extern "C" int compressGIMBuffer(void* gim_buffer, size_t gim_buffer_size, void* compressed_buffer, size_t compressed_buffer_size);
 extern "C" int uncompressGIMBuffer(void* compressed_buffer, size_t compressed_buffer_size, void** gim_buffer);
+extern "C" void freeGIMBuffer(void* gim_buffer);
 extern "C" int gimCompression(char* read_filename, char* write_filename, gimCompressionDirection direction);
 extern "C" void print_load(char *format, ...);
 
@@ -50,6 +51,11 @@ int compressGIMBuffer(void* gim_buffer, size_t gim_buffer_size, void* compressed
   return strm.total_out;
 }
 
+void freeGIMBuffer(void* gim_buffer)
+{
+  delete[](Bytef*)gim_buffer;
+}
+
 int uncompressGIMBuffer(void* compressed_buffer, size_t compressed_buffer_size, void** gim_buffer)
 {  
   z_stream strm;
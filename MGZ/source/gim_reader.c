@@ -0,0 +1,351 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ppu-types.h>
+
+#include "dxt.h"
+#include "gim_reader.h"
+
+// (https://www.psdevwiki.com/ps3/Graphic_Image_Map_(GIM))
+// the PS3 files are big endian (".GIM"), the PSP ones little endian ("MIG.")
+
+#define GIM_BLOCK_IMAGE					4
+#define GIM_BLOCK_PALETTE				5
+
+#define GIM_IMAGE_FORMAT_RGBA5650		0x00	//(16 bit no alpha)
+#define GIM_IMAGE_FORMAT_RGBA5551		0x01	//(16 bit sharp alpha)
+#define GIM_IMAGE_FORMAT_RGBA4444		0x02	//(16 bit gradient alpha)
+#define GIM_IMAGE_FORMAT_RGBA8888		0x03	//(32 bit gradient alpha)
+#define GIM_IMAGE_FORMAT_INDEX4			0x04	//(16 colors)
+#define GIM_IMAGE_FORMAT_INDEX8			0x05	//(256 colors)
+#define GIM_IMAGE_FORMAT_INDEX16		0x06
+#define GIM_IMAGE_FORMAT_INDEX32		0x07
+#define GIM_IMAGE_FORMAT_DXT1			0x08	//(no alpha)
+#define GIM_IMAGE_FORMAT_DXT3			0x09	//(sharp alpha)
+#define GIM_IMAGE_FORMAT_DXT5			0x0A	//(gradient alpha)
+#define GIM_IMAGE_FORMAT_DXT1EXT		0x108
+#define GIM_IMAGE_FORMAT_DXT3EXT		0x109
+#define GIM_IMAGE_FORMAT_DXT5EXT		0x10A
+
+#define GIM_PIXEL_ORDER_NORMAL			0x0
+#define GIM_PIXEL_ORDER_FAST			0x1
+
+// swizzled pictures are made of tiles of 16 bytes * 8 rows
+#define GIM_TILE_WIDTH					16
+#define GIM_TILE_HEIGHT					8
+
+#define GIM_PALETTE_MAX					0x10000
+
+typedef struct
+{
+	const u8 *buffer;
+	u32 size;
+	u8 le;
+
+	u32 format;
+	u32 order;
+	u32 width;
+	u32 height;
+	u32 bpp;
+	u32 pitch;		// bytes per row in the file
+	u32 rows;		// rows in the file
+	const u8 *pixels;
+
+	u32 pal_format;
+	u32 pal_count;
+	const u8 *pal_pixels;
+} gim_image;
+
+static const u8 BIT4[16] = { 0, 17, 34, 51, 68, 85, 102, 119, 136, 153, 170, 187, 204, 221, 238, 255 };
+static const u8 BIT5[32] = { 0, 8, 16, 25, 33, 41, 49, 58, 66, 74, 82, 90, 99, 107, 115, 123, 132, 140, 148, 156, 165, 173, 181, 189, 197, 206, 214, 222, 230, 239, 247, 255 };
+static const u8 BIT6[64] = { 0, 4, 8, 12, 16, 20, 24, 28, 32, 36, 40, 45, 49, 53, 57, 61, 65, 69, 73, 77, 81, 85, 89, 93, 97, 101, 105, 109, 113, 117, 121, 125, 130, 134, 138, 142, 146, 150, 154, 158, 162, 166, 170, 174, 178, 182, 186, 190, 194, 198, 202, 206, 210, 215, 219, 223, 227, 231, 235, 239, 243, 247, 251, 255 };
+
+static u32 rd16(const gim_image *img, const u8 *p)
+{
+	return img->le ? (p[0] | p[1] << 8) : (p[0] << 8 | p[1]);
+}
+
+static u32 rd32(const gim_image *img, const u8 *p)
+{
+	return img->le ? (p[0] | p[1] << 8 | p[2] << 16 | (u32) p[3] << 24) : ((u32) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]);
+}
+
+static u32 gim_format_bpp(u32 format)
+{
+	switch(format)
+	{
+		case GIM_IMAGE_FORMAT_RGBA5650:
+		case GIM_IMAGE_FORMAT_RGBA5551:
+		case GIM_IMAGE_FORMAT_RGBA4444:
+		case GIM_IMAGE_FORMAT_INDEX16:
+			return 16;
+		case GIM_IMAGE_FORMAT_RGBA8888:
+		case GIM_IMAGE_FORMAT_INDEX32:
+			return 32;
+		case GIM_IMAGE_FORMAT_INDEX4:
+			return 4;
+		case GIM_IMAGE_FORMAT_INDEX8:
+			return 8;
+	}
+	return 0;
+}
+
+static int gim_is_dxt(u32 format)
+{
+	return GIM_IMAGE_FORMAT_DXT1 <= (format & 0xFF) && (format & 0xFF) <= GIM_IMAGE_FORMAT_DXT5 && (format & ~0x1FF) == 0;
+}
+
+// image data header of an image or palette block : format, order, width, height, bpp
+// and pitch_align from 0x04, offset of the pixels at 0x1C
+static int gim_read_image(gim_image *img, u32 pos, u32 end, u32 *format, u32 *order, u32 *width, u32 *height, u32 *pitch, u32 *rows, const u8 **pixels)
+{
+	const u8 *h = img->buffer + pos;
+
+	if(end < pos || end - pos < 0x24) return -1;
+
+	*format = rd16(img, h + 0x04);
+	*order = rd16(img, h + 0x06);
+	*width = rd16(img, h + 0x08);
+	*height = rd16(img, h + 0x0A);
+	u32 bpp = gim_format_bpp(*format);
+	u32 pitch_align = rd16(img, h + 0x0E);
+	u32 start = rd32(img, h + 0x1C);
+
+	if(*width == 0 || *height == 0) return -1;
+
+	if(gim_is_dxt(*format)) {
+		*pitch = (*width + 3) / 4 * ((*format & 0xFF) == GIM_IMAGE_FORMAT_DXT1 ? 8 : 16);
+		*rows = (*height + 3) / 4;
+	} else {
+		if(bpp == 0) return -1;
+		if(pitch_align == 0) pitch_align = 1;
+		*pitch = (*width * bpp + 7) / 8;
+		*pitch = (*pitch + pitch_align - 1) / pitch_align * pitch_align;
+		*rows = *height;
+		if(*order == GIM_PIXEL_ORDER_FAST) {
+			if(*pitch % GIM_TILE_WIDTH) *pitch += GIM_TILE_WIDTH - *pitch % GIM_TILE_WIDTH;
+			*rows = (*height + GIM_TILE_HEIGHT - 1) / GIM_TILE_HEIGHT * GIM_TILE_HEIGHT;
+		}
+	}
+
+	if(end - pos < start || (u64) *pitch * *rows > end - pos - start) return -1;
+
+	*pixels = h + start;
+
+	return 0;
+}
+
+static int gim_parse(gim_image *img, const u8 *buffer, u32 size)
+{
+	u32 pos = 16;
+	u8 image = 0;
+
+	memset(img, 0, sizeof(gim_image));
+	img->buffer = buffer;
+	img->size = size;
+
+	if(size < 16) return -1;
+	if(memcmp(buffer, ".GIM", 4) == 0) img->le = 0;
+	else
+	if(memcmp(buffer, "MIG.", 4) == 0) img->le = 1;
+	else return -1;
+
+	// the containers go to their first child, the other blocks to the next one
+	while(pos + 16 <= size) {
+		u32 id = rd16(img, buffer + pos);
+		u32 block_size = rd32(img, buffer + pos + 4);
+		u32 next = rd32(img, buffer + pos + 8);
+		u32 data = rd32(img, buffer + pos + 12);
+		u32 end = block_size <= size - pos ? pos + block_size : size;
+
+		if(id == GIM_BLOCK_IMAGE && image == 0) {
+			if(data > size - pos) return -1;
+			if(gim_read_image(img, pos + data, end, &img->format, &img->order, &img->width, &img->height, &img->pitch, &img->rows, &img->pixels) != 0) return -1;
+			img->bpp = gim_format_bpp(img->format);
+			image = 1;
+		} else
+		if(id == GIM_BLOCK_PALETTE && img->pal_pixels == NULL) {
+			u32 order, height, pitch, rows;
+			if(data <= size - pos && gim_read_image(img, pos + data, end, &img->pal_format, &order, &img->pal_count, &height, &pitch, &rows, &img->pal_pixels) == 0) {
+				if(img->pal_format > GIM_IMAGE_FORMAT_RGBA8888) img->pal_pixels = NULL;
+			}
+		}
+
+		if(image && (img->pal_pixels || img->format < GIM_IMAGE_FORMAT_INDEX4 || GIM_IMAGE_FORMAT_INDEX32 < img->format)) break;
+
+		if(next == 0 || next > size - pos) break;
+		pos += next;
+	}
+
+	if(image == 0) return -1;
+
+	// an indexed picture needs its palette
+	if(GIM_IMAGE_FORMAT_INDEX4 <= img->format && img->format <= GIM_IMAGE_FORMAT_INDEX32 && img->pal_pixels == NULL) return -1;
+
+	return 0;
+}
+
+int gimGetInfo(const u8 *buffer, u32 size, u32 *width, u32 *height)
+{
+	gim_image img;
+
+	if(gim_parse(&img, buffer, size) != 0) return -1;
+
+	*width = img.width;
+	*height = img.height;
+
+	return 0;
+}
+
+// *** pixel kernels : n pixels from src to ARGB ***
+
+static void gim_conv_5650(const gim_image *img, const u8 *src, u8 *dst, u32 n, const u8 *pal)
+{
+	for(; n; n--, src += 2, dst += 4) {
+		u32 v = rd16(img, src);
+		dst[0] = 0xFF;
+		dst[1] = BIT5[v & 0x1F];
+		dst[2] = BIT6[(v >> 5) & 0x3F];
+		dst[3] = BIT5[v >> 11];
+	}
+}
+
+static void gim_conv_5551(const gim_image *img, const u8 *src, u8 *dst, u32 n, const u8 *pal)
+{
+	for(; n; n--, src += 2, dst += 4) {
+		u32 v = rd16(img, src);
+		dst[0] = v & 0x8000 ? 0xFF : 0;
+		dst[1] = BIT5[v & 0x1F];
+		dst[2] = BIT5[(v >> 5) & 0x1F];
+		dst[3] = BIT5[(v >> 10) & 0x1F];
+	}
+}
+
+static void gim_conv_4444(const gim_image *img, const u8 *src, u8 *dst, u32 n, const u8 *pal)
+{
+	for(; n; n--, src += 2, dst += 4) {
+		u32 v = rd16(img, src);
+		dst[0] = BIT4[v >> 12];
+		dst[1] = BIT4[v & 0xF];
+		dst[2] = BIT4[(v >> 4) & 0xF];
+		dst[3] = BIT4[(v >> 8) & 0xF];
+	}
+}
+
+static void gim_conv_8888(const gim_image *img, const u8 *src, u8 *dst, u32 n, const u8 *pal)
+{
+	for(; n; n--, src += 4, dst += 4) {
+		dst[0] = src[3];
+		dst[1] = src[0];
+		dst[2] = src[1];
+		dst[3] = src[2];
+	}
+}
+
+// the palettes are expanded to ARGB once, out of range indexes are transparent
+
+static void gim_conv_index4(const gim_image *img, const u8 *src, u8 *dst, u32 n, const u8 *pal)
+{
+	// first pixel in the low nibble
+	for(; n >= 2; n -= 2, src++, dst += 8) {
+		memcpy(dst, pal + (*src & 0xF) * 4, 4);
+		memcpy(dst + 4, pal + (*src >> 4) * 4, 4);
+	}
+	if(n) memcpy(dst, pal + (*src & 0xF) * 4, 4);
+}
+
+static void gim_conv_index8(const gim_image *img, const u8 *src, u8 *dst, u32 n, const u8 *pal)
+{
+	for(; n; n--, src++, dst += 4) memcpy(dst, pal + *src * 4, 4);
+}
+
+static void gim_conv_index16(const gim_image *img, const u8 *src, u8 *dst, u32 n, const u8 *pal)
+{
+	for(; n; n--, src += 2, dst += 4) memcpy(dst, pal + rd16(img, src) * 4, 4);
+}
+
+static void gim_conv_index32(const gim_image *img, const u8 *src, u8 *dst, u32 n, const u8 *pal)
+{
+	for(; n; n--, src += 4, dst += 4) {
+		u32 i = rd32(img, src);
+		if(i < GIM_PALETTE_MAX) memcpy(dst, pal + i * 4, 4);
+		else memset(dst, 0, 4);
+	}
+}
+
+typedef void (*gim_conv)(const gim_image *img, const u8 *src, u8 *dst, u32 n, const u8 *pal);
+
+static const gim_conv gim_convs[8] = { gim_conv_5650, gim_conv_5551, gim_conv_4444, gim_conv_8888,
+                                       gim_conv_index4, gim_conv_index8, gim_conv_index16, gim_conv_index32 };
+
+static u8 *gim_palette(const gim_image *img)
+{
+	u32 entries = img->format == GIM_IMAGE_FORMAT_INDEX4 ? 16 : img->format == GIM_IMAGE_FORMAT_INDEX8 ? 256 : GIM_PALETTE_MAX;
+
+	u8 *pal = (u8 *) malloc(entries * 4);
+	if(pal == NULL) return NULL;
+
+	memset(pal, 0, entries * 4);
+	gim_convs[img->pal_format](img, img->pal_pixels, pal, img->pal_count < entries ? img->pal_count : entries, NULL);
+
+	return pal;
+}
+
+static int gim_decode_dxt(const gim_image *img, u8 *dst, u32 pitch)
+{
+	// the DXT blocks of the PSP files aren't in the DDS layout
+	if(img->le) return -1;
+
+	int format = (img->format & 0xFF) == GIM_IMAGE_FORMAT_DXT1 ? DXT_FORMAT_DXT1 :
+	             (img->format & 0xFF) == GIM_IMAGE_FORMAT_DXT3 ? DXT_FORMAT_DXT3 : DXT_FORMAT_DXT5;
+
+	u8 *argb = (u8 *) dxtDecode(format, img->width, img->height, img->pixels, DDS_READER_ARGB);
+	if(argb == NULL) return -1;
+
+	u32 y;
+	for(y = 0; y < img->height; y++) memcpy(dst + y * pitch, argb + y * img->width * 4, img->width * 4);
+
+	ddsFree(argb);
+
+	return 0;
+}
+
+int gimDecode(const u8 *buffer, u32 size, u8 *dst, u32 pitch)
+{
+	gim_image img;
+	u8 *pal = NULL;
+	u32 x, y;
+
+	if(gim_parse(&img, buffer, size) != 0) return -1;
+	if(pitch < img.width * 4) return -1;
+
+	if(gim_is_dxt(img.format)) return gim_decode_dxt(&img, dst, pitch);
+
+	if(img.pal_pixels) {
+		pal = gim_palette(&img);
+		if(pal == NULL) return -1;
+	}
+
+	gim_conv conv = gim_convs[img.format];
+
+	if(img.order != GIM_PIXEL_ORDER_FAST) {
+		for(y = 0; y < img.height; y++) conv(&img, img.pixels + y * img.pitch, dst + y * pitch, img.width, pal);
+	} else {
+		// each row of a tile holds 'n' pixels, the tiles of a band of 8 rows follow each other
+		u32 n = GIM_TILE_WIDTH * 8 / img.bpp;
+		u32 tiles = img.pitch / GIM_TILE_WIDTH;
+
+		for(y = 0; y < img.height; y++) {
+			const u8 *band = img.pixels + (y / GIM_TILE_HEIGHT) * tiles * GIM_TILE_WIDTH * GIM_TILE_HEIGHT;
+			const u8 *src = band + (y % GIM_TILE_HEIGHT) * GIM_TILE_WIDTH;
+			u8 *row = dst + y * pitch;
+
+			for(x = 0; x < img.width; x += n, src += GIM_TILE_WIDTH * GIM_TILE_HEIGHT) {
+				conv(&img, src, row + x * 4, img.width - x < n ? img.width - x : n, pal);
+			}
+		}
+	}
+
+	free(pal);
+
+	return 0;
+}
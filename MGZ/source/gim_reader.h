@@ -0,0 +1,22 @@
+#ifndef __GIM_READER_H__
+#define __GIM_READER_H__
+
+#include <ppu-types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size of the first image of a GIM (PS3 big endian or PSP little endian), returns 0 on success.
+int gimGetInfo(const u8 *buffer, u32 size, u32 *width, u32 *height);
+
+// Decode the first image of a GIM in ARGB, 'pitch' bytes per row (width*4 at least).
+// RGBA5650/5551/4444/8888, INDEX4/8/16/32 and DXT1/3/5, normal or swizzled (fast) pixel order.
+// Returns 0 on success.
+int gimDecode(const u8 *buffer, u32 size, u8 *dst, u32 pitch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GIM_READER_H__ */
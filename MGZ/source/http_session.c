@@ -0,0 +1,614 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <ppu-types.h>
+#include <sys/thread.h>
+#include <sys/mutex.h>
+#include <sysmodule/sysmodule.h>
+#include <net/net.h>
+#include <http/http.h>
+#include <http/https.h>
+#include <ssl/ssl.h>
+
+#include "http_session.h"
+
+#define SUCCESS 	1
+#define FAILED	 	0
+
+#define HTTP_POOL_SIZE		0x10000
+#define SSL_POOL_SIZE		0x40000
+
+// data received or sent at once by a client
+#define HTTP_BUFFER_SIZE	0x10000
+
+// a kept connection can be closed by the server : the request is sent again once with a new client
+#define HTTP_RETRY			1
+
+extern void print_load(char *format, ...);
+extern u64 get_usec();
+
+//====================================|
+// DigiCert High Assurance EV Root CA |
+//====================================|
+static char github_cert[] __attribute__((aligned(64))) =
+	"-----BEGIN CERTIFICATE-----\n"
+	"MIIDxTCCAq2gAwIBAgIQAqxcJmoLQJuPC3nyrkYldzANBgkqhkiG9w0BAQUFADBs\n"
+	"MQswCQYDVQQGEwJVUzEVMBMGA1UEChMMRGlnaUNlcnQgSW5jMRkwFwYDVQQLExB3\n"
+	"d3cuZGlnaWNlcnQuY29tMSswKQYDVQQDEyJEaWdpQ2VydCBIaWdoIEFzc3VyYW5j\n"
+	"ZSBFViBSb290IENBMB4XDTA2MTExMDAwMDAwMFoXDTMxMTExMDAwMDAwMFowbDEL\n"
+	"MAkGA1UEBhMCVVMxFTATBgNVBAoTDERpZ2lDZXJ0IEluYzEZMBcGA1UECxMQd3d3\n"
+	"LmRpZ2ljZXJ0LmNvbTErMCkGA1UEAxMiRGlnaUNlcnQgSGlnaCBBc3N1cmFuY2Ug\n"
+	"RVYgUm9vdCBDQTCCASIwDQYJKoZIhvcNAQEBBQADggEPADCCAQoCggEBAMbM5XPm\n"
+	"+9S75S0tMqbf5YE/yc0lSbZxKsPVlDRnogocsF9ppkCxxLeyj9CYpKlBWTrT3JTW\n"
+	"PNt0OKRKzE0lgvdKpVMSOO7zSW1xkX5jtqumX8OkhPhPYlG++MXs2ziS4wblCJEM\n"
+	"xChBVfvLWokVfnHoNb9Ncgk9vjo4UFt3MRuNs8ckRZqnrG0AFFoEt7oT61EKmEFB\n"
+	"Ik5lYYeBQVCmeVyJ3hlKV9Uu5l0cUyx+mM0aBhakaHPQNAQTXKFx01p8VdteZOE3\n"
+	"hzBWBOURtCmAEvF5OYiiAhF8J2a3iLd48soKqDirCmTCv2ZdlYTBoSUeh10aUAsg\n"
+	"EsxBu24LUTi4S8sCAwEAAaNjMGEwDgYDVR0PAQH/BAQDAgGGMA8GA1UdEwEB/wQF\n"
+	"MAMBAf8wHQYDVR0OBBYEFLE+w2kD+L9HAdSYJhoIAu9jZCvDMB8GA1UdIwQYMBaA\n"
+	"FLE+w2kD+L9HAdSYJhoIAu9jZCvDMA0GCSqGSIb3DQEBBQUAA4IBAQAcGgaX3Nec\n"
+	"nzyIZgYIVyHbIUf4KmeqvxgydkAQV8GK83rZEWWONfqe/EW1ntlMMUu4kehDLI6z\n"
+	"eM7b41N5cdblIZQB2lWHmiRk9opmzN6cN82oNLFpmyPInngiK3BD41VHMWEZ71jF\n"
+	"hS9OMPagMRYjyOfiZRYzy78aG6A9+MpeizGLYAiJLQwGXFK3xPkKmNEVX58Svnw2\n"
+	"Yzi9RKR/5CYrCsSXaQ3pjOLAEFe4yHYSkVXySGnYvCoCWw9E1CAx2/S6cCZdkGCe\n"
+	"vEsXCS+0yx5DaMkHJ8HSXPfqIbloEpw8nL+e/IBcm2PN7EeqJSdnoDfzAIJ9VNep\n"
+	"+OkuE6N36B9K\n"
+	"-----END CERTIFICATE-----\n";
+
+typedef struct
+{
+	httpClientId id;
+	u8 used;
+	u8 https;		// created after httpsInit
+	u8 *buffer;
+} http_client;
+
+static struct
+{
+	u8 module_net_loaded;
+	u8 module_http_loaded;
+	u8 module_https_loaded;
+	u8 module_ssl_loaded;
+
+	u8 net_init;
+	u8 http_init;
+	u8 ssl_init;
+	u8 https_init;
+
+	void *http_pool;
+	void *ssl_pool;
+	void *cert_buffer;
+	httpsData caList[2];
+
+	http_client clients[HTTP_CLIENTS_MAX];
+} session;
+
+static sys_lwmutex_t session_lock;
+static u8 session_lock_init = 0;
+
+static u8 session_init_https()
+{
+	s32 cert_size=0;
+	int ret;
+
+	ret = sysModuleLoad(SYSMODULE_HTTPS);
+	if (ret < 0) {
+		print_load("Error : sysModuleLoad(SYSMODULE_HTTPS) failed (%x)", ret);
+		return FAILED;
+	} else session.module_https_loaded=1;
+
+	ret = sysModuleLoad(SYSMODULE_SSL);
+	if (ret < 0) {
+		print_load("Error : sysModuleLoad(SYSMODULE_SSL) failed (%x)", ret);
+		return FAILED;
+	} else session.module_ssl_loaded=1;
+
+	session.ssl_pool = malloc(SSL_POOL_SIZE);
+	if (session.ssl_pool == NULL) {
+		print_load("Error : out of memory (ssl_pool)");
+		return FAILED;
+	}
+
+	ret = sslInit(session.ssl_pool, SSL_POOL_SIZE);
+	if (ret < 0) {
+		print_load("Error : sslInit failed (%x)", ret);
+		return FAILED;
+	} else session.ssl_init=1;
+
+	ret = sslCertificateLoader(SSL_LOAD_CERT_ALL, NULL, 0, &cert_size);
+	if (ret < 0) {
+		print_load("Error : sslCertificateLoader failed (%x)", ret);
+		return FAILED;
+	}
+
+	session.cert_buffer = malloc(cert_size);
+	if (session.cert_buffer==NULL) {
+		print_load("Error : out of memory (cert_buffer)");
+		return FAILED;
+	}
+
+	ret = sslCertificateLoader(SSL_LOAD_CERT_ALL, session.cert_buffer, cert_size, NULL);
+	if (ret < 0) {
+		print_load("Error : sslCertificateLoader failed (%x)", ret);
+		return FAILED;
+	}
+
+	session.caList[0].ptr = session.cert_buffer;
+	session.caList[0].size = cert_size;
+
+	session.caList[1].ptr = github_cert;
+	session.caList[1].size = sizeof(github_cert);
+
+	ret = httpsInit(2, session.caList);
+	if (ret < 0) {
+		print_load("Error : httpsInit failed (%x)", ret);
+		return FAILED;
+	} else session.https_init=1;
+
+	return SUCCESS;
+}
+
+static u8 session_init(u8 https)
+{
+	int ret;
+
+	if(session.module_net_loaded == 0) {
+		ret = sysModuleLoad(SYSMODULE_NET);
+		if (ret < 0) {
+			print_load("Error : sysModuleLoad(SYSMODULE_NET) failed (%x)", ret);
+			return FAILED;
+		} else session.module_net_loaded=1;
+	}
+
+	if(session.net_init == 0) {
+		ret = netInitialize();
+		if (ret < 0) {
+			print_load("Error : netInitialize failed (%x)", ret);
+			return FAILED;
+		} else session.net_init=1;
+	}
+
+	if(session.module_http_loaded == 0) {
+		ret = sysModuleLoad(SYSMODULE_HTTP);
+		if (ret < 0) {
+			print_load("Error : sysModuleLoad(SYSMODULE_HTTP) failed (%x)", ret);
+			return FAILED;
+		} else session.module_http_loaded=1;
+	}
+
+	if(session.http_init == 0) {
+		if(session.http_pool == NULL) session.http_pool = malloc(HTTP_POOL_SIZE);
+		if (session.http_pool == NULL) {
+			print_load("Error : out of memory (http_pool)");
+			return FAILED;
+		}
+
+		ret = httpInit(session.http_pool, HTTP_POOL_SIZE);
+		if (ret < 0) {
+			print_load("Error : httpInit failed (%x)", ret);
+			return FAILED;
+		} else session.http_init=1;
+	}
+
+	// a failed SSL init is tried again by the next https request
+	if(https && session.https_init == 0) {
+		if(session_init_https() == FAILED) {
+			if(session.ssl_init) sslEnd();
+			if(session.module_https_loaded) sysModuleUnload(SYSMODULE_HTTPS);
+			if(session.module_ssl_loaded) sysModuleUnload(SYSMODULE_SSL);
+			if(session.ssl_pool) free(session.ssl_pool);
+			if(session.cert_buffer) free(session.cert_buffer);
+			session.ssl_init = session.module_https_loaded = session.module_ssl_loaded = 0;
+			session.ssl_pool = session.cert_buffer = NULL;
+			return FAILED;
+		}
+	}
+
+	return SUCCESS;
+}
+
+u8 http_session_start(u8 https)
+{
+	if(session_lock_init == 0) {
+		sys_lwmutex_attr_t attr = {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""};
+		sysLwMutexCreate(&session_lock, &attr);
+		session_lock_init = 1;
+	}
+
+	sysLwMutexLock(&session_lock, 0);
+	u8 ret = session_init(https);
+	sysLwMutexUnlock(&session_lock);
+
+	return ret;
+}
+
+void http_session_end()
+{
+	int i;
+
+	if(session_lock_init == 0) return;
+
+	sysLwMutexLock(&session_lock, 0);
+
+	for(i=0; i<HTTP_CLIENTS_MAX; i++) {
+		if(session.clients[i].id) httpDestroyClient(session.clients[i].id);
+		if(session.clients[i].buffer) free(session.clients[i].buffer);
+	}
+
+	if(session.https_init) httpsEnd();
+	if(session.ssl_init) sslEnd();
+	if(session.http_init) httpEnd();
+	if(session.net_init) netDeinitialize();
+
+	if(session.module_http_loaded) sysModuleUnload(SYSMODULE_HTTP);
+	if(session.module_https_loaded) sysModuleUnload(SYSMODULE_HTTPS);
+	if(session.module_net_loaded) sysModuleUnload(SYSMODULE_NET);
+	if(session.module_ssl_loaded) sysModuleUnload(SYSMODULE_SSL);
+
+	if(session.http_pool) free(session.http_pool);
+	if(session.ssl_pool) free(session.ssl_pool);
+	if(session.cert_buffer) free(session.cert_buffer);
+
+	memset(&session, 0, sizeof(session));
+
+	sysLwMutexUnlock(&session_lock);
+}
+
+// a free client, kept from a previous request if possible
+static http_client *client_get(u8 https)
+{
+	http_client *c = NULL;
+	int i;
+
+	sysLwMutexLock(&session_lock, 0);
+
+	for(i=0; i<HTTP_CLIENTS_MAX; i++) {
+		if(session.clients[i].used || session.clients[i].id == 0) continue;
+		if(https && session.clients[i].https == 0) continue;
+		c = &session.clients[i];
+		break;
+	}
+
+	if(c == NULL) {
+		for(i=0; i<HTTP_CLIENTS_MAX; i++) {
+			if(session.clients[i].used) continue;
+			c = &session.clients[i];
+			if(c->id) httpDestroyClient(c->id);
+			c->id = 0;
+			if(httpCreateClient(&c->id) < 0) {
+				print_load("Error : httpCreateClient failed");
+				c->id = 0;
+				c = NULL;
+			} else c->https = session.https_init;
+			break;
+		}
+	}
+
+	if(c != NULL && c->buffer == NULL) {
+		c->buffer = (u8 *) malloc(HTTP_BUFFER_SIZE);
+		if(c->buffer == NULL) c = NULL;
+	}
+
+	if(c != NULL) c->used = 1;
+
+	sysLwMutexUnlock(&session_lock);
+
+	return c;
+}
+
+// 'broken' : the connection is closed
+static void client_put(http_client *c, u8 broken)
+{
+	sysLwMutexLock(&session_lock, 0);
+	if(broken && c->id) {
+		httpDestroyClient(c->id);
+		c->id = 0;
+	}
+	c->used = 0;
+	sysLwMutexUnlock(&session_lock);
+}
+
+static int client_request(http_client *c, char *url, char *dst, char *src, http_progress progress, void *arg, u8 *broken)
+{
+	int ret, httpCode = 0;
+	httpUri uri;
+	httpTransId httpTrans = 0;
+	void *uri_pool = NULL;
+	FILE *fp = NULL;
+	s32 size = 0;
+	u64 length = 0;
+	u64 done = 0;
+
+	*broken = 0;
+
+	//URI
+	ret = httpUtilParseUri(&uri, url, NULL, 0, &size);
+	if (ret < 0) {
+		print_load("Error : httpUtilParseUri() failed (%x)", ret);
+		return HTTP_FAILED;
+	}
+
+	uri_pool = malloc(size);
+	if (uri_pool == NULL) {
+		print_load("Error : out of memory (uri_pool)");
+		return HTTP_FAILED;
+	}
+
+	ret = httpUtilParseUri(&uri, url, uri_pool, size, 0);
+	if (ret < 0) {
+		print_load("Error : httpUtilParseUri() failed (%x), %s", ret, url);
+		ret = HTTP_FAILED;
+		goto end;
+	}
+
+	ret = httpCreateTransaction(&httpTrans, c->id, src ? HTTP_METHOD_POST : HTTP_METHOD_GET, &uri);
+	if (ret < 0) {
+		print_load("Error : httpCreateTransaction() failed (%x)", ret);
+		httpTrans = 0;
+		*broken = 1;
+		ret = HTTP_FAILED;
+		goto end;
+	}
+
+	//SEND REQUEST
+	if(src) {
+		struct stat s;
+		s32 nSent = 0;
+
+		if(stat(src, &s) != 0) {
+			print_load("Error : %s doesn't exist", src);
+			ret = HTTP_FAILED;
+			goto end;
+		}
+		length = s.st_size;
+
+		ret = httpRequestSetContentLength(httpTrans, length);
+		if(ret < 0) {
+			print_load("Error : httpRequestSetContentLength() failed (%x)", ret);
+			ret = HTTP_FAILED;
+			goto end;
+		}
+
+		fp = fopen(src, "rb");
+		if(fp == NULL) {
+			print_load("Error : fopen() failed : %s", src);
+			ret = HTTP_FAILED;
+			goto end;
+		}
+
+		while(done < length) {
+			u32 toSend = HTTP_BUFFER_SIZE;
+			if(length - done < toSend) toSend = length - done;
+
+			if(fread(c->buffer, 1, toSend, fp) != toSend) {
+				print_load("Error : fread() failed : %s", src);
+				ret = HTTP_FAILED;
+				goto end;
+			}
+
+			ret = httpSendRequest(httpTrans, (void *) c->buffer, toSend, &nSent);
+			if(ret < 0) {
+				print_load("Error : httpSendRequest() failed (%x), %s", ret, url);
+				*broken = 1;
+				ret = HTTP_FAILED;
+				goto end;
+			}
+			done += toSend;
+
+			if(progress && progress(done, length, arg) == 0) {
+				*broken = 1;
+				ret = HTTP_CANCELED;
+				goto end;
+			}
+		}
+		fclose(fp);
+		fp = NULL;
+	} else {
+		ret = httpSendRequest(httpTrans, NULL, 0, NULL);
+		if (ret < 0) {
+			print_load("Error : httpSendRequest() failed (%x), %s", ret, url);
+			*broken = 1;
+			ret = HTTP_FAILED;
+			goto end;
+		}
+	}
+
+	ret = httpResponseGetStatusCode(httpTrans, &httpCode);
+	if (ret < 0) {
+		print_load("Error : httpResponseGetStatusCode() failed (%x)", ret);
+		*broken = 1;
+		ret = HTTP_FAILED;
+		goto end;
+	}
+	ret = httpCode;
+
+	// the content isn't read : the connection can't be used again
+	if(dst == NULL || httpCode >= 400) {
+		*broken = 1;
+		goto end;
+	}
+
+	//TRANSFERT
+	httpResponseGetContentLength(httpTrans, &length);
+
+	fp = fopen(dst, "wb");
+	if(fp == NULL) {
+		print_load("Error : fopen() failed : %s", dst);
+		*broken = 1;
+		ret = HTTP_FAILED;
+		goto end;
+	}
+
+	done = 0;
+	while(1) {
+		s32 nRecv = 0;
+		if(httpRecvResponse(httpTrans, (void *) c->buffer, HTTP_BUFFER_SIZE, &nRecv) < 0) {
+			print_load("Error : httpRecvResponse() failed, %s", url);
+			*broken = 1;
+			ret = HTTP_FAILED;
+			break;
+		}
+		if(nRecv <= 0) break;
+
+		if(fwrite(c->buffer, 1, nRecv, fp) != nRecv) {
+			print_load("Error : fwrite() failed : %s", dst);
+			*broken = 1;
+			ret = HTTP_FAILED;
+			break;
+		}
+		done += nRecv;
+
+		if(progress && progress(done, length, arg) == 0) {
+			*broken = 1;
+			ret = HTTP_CANCELED;
+			break;
+		}
+	}
+
+	fclose(fp);
+	fp = NULL;
+	if(ret < 0) unlink(dst);
+
+end:
+	if(fp) fclose(fp);
+	if(httpTrans) httpDestroyTransaction(httpTrans);
+	free(uri_pool);
+
+	return ret;
+}
+
+static int http_request(char *url, char *dst, char *src, http_progress progress, void *arg)
+{
+	u8 https = strncmp(url, "https", 5) == 0;
+	u8 broken = 0;
+	int ret = HTTP_FAILED;
+	int try;
+
+	if(http_session_start(https) == FAILED) return HTTP_FAILED;
+
+	for(try = 0; try <= HTTP_RETRY; try++) {
+		http_client *c;
+
+		// every client is busy with another transfer
+		while((c = client_get(https)) == NULL) usleep(10000);
+
+		ret = client_request(c, url, dst, src, progress, arg, &broken);
+
+		client_put(c, broken);
+
+		if(ret != HTTP_FAILED || broken == 0) break;
+	}
+
+	return ret;
+}
+
+int http_get(char *url, char *dst, http_progress progress, void *arg)
+{
+	return http_request(url, dst, NULL, progress, arg);
+}
+
+int http_status(char *url)
+{
+	return http_request(url, NULL, NULL, NULL, NULL);
+}
+
+int http_post_file(char *url, char *src, http_progress progress, void *arg)
+{
+	return http_request(url, NULL, src, progress, arg);
+}
+
+typedef struct
+{
+	http_job *jobs;
+	u32 number;
+	u32 next;
+	u32 done;
+	u32 ok;
+	u8 cancel;
+	http_progress progress;
+	void *arg;
+	sys_lwmutex_t lock;
+} http_queue;
+
+static void http_queue_run(http_queue *q)
+{
+	while(1) {
+		u32 i;
+
+		sysLwMutexLock(&q->lock, 0);
+		if(q->cancel || q->number <= q->next) {
+			sysLwMutexUnlock(&q->lock);
+			break;
+		}
+		i = q->next++;
+		sysLwMutexUnlock(&q->lock);
+
+		q->jobs[i].ret = http_get(q->jobs[i].url, q->jobs[i].dst, NULL, NULL);
+
+		sysLwMutexLock(&q->lock, 0);
+		q->done++;
+		if(0 < q->jobs[i].ret && q->jobs[i].ret < 400) q->ok++;
+		if(q->progress && q->progress(q->done, q->number, q->arg) == 0) q->cancel = 1;
+		sysLwMutexUnlock(&q->lock);
+	}
+}
+
+static void http_queue_thread(void *data)
+{
+	http_queue_run((http_queue *) data);
+
+	sysThreadExit(0);
+}
+
+u32 http_get_queue(http_job *jobs, u32 number, u32 workers, http_progress progress, void *arg)
+{
+	sys_ppu_thread_t id[HTTP_CLIENTS_MAX];
+	u8 started[HTTP_CLIENTS_MAX];
+	http_queue q;
+	u64 ret;
+	u32 i;
+
+	if(number == 0) return 0;
+
+	for(i=0; i<number; i++) jobs[i].ret = HTTP_CANCELED;
+
+	// the session is loaded once before the workers need it
+	if(http_session_start(strncmp(jobs[0].url, "https", 5) == 0) == FAILED) return 0;
+
+	memset(&q, 0, sizeof(http_queue));
+	q.jobs = jobs;
+	q.number = number;
+	q.progress = progress;
+	q.arg = arg;
+
+	sys_lwmutex_attr_t attr = {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""};
+	sysLwMutexCreate(&q.lock, &attr);
+
+	if(workers == 0) workers = 1;
+	if(workers > HTTP_CLIENTS_MAX) workers = HTTP_CLIENTS_MAX;
+	if(workers > number) workers = number;
+
+	u64 start = get_usec();
+
+	// the caller is the first worker
+	for(i=1; i<workers; i++) {
+		started[i] = (sysThreadCreate(&id[i], http_queue_thread, (void *) &q, 1000, 0x4000, THREAD_JOINABLE, "http_queue") == 0);
+	}
+
+	http_queue_run(&q);
+
+	for(i=1; i<workers; i++) {
+		if(started[i]) sysThreadJoin(id[i], &ret);
+	}
+
+	sysLwMutexDestroy(&q.lock);
+
+	u64 time = get_usec() - start;
+	if(time == 0) time = 1;
+	print_load("Downloaded %d/%d files in %d ms (%d.%02d requests/s)", q.ok, number, (int) (time / 1000),
+				(int) (q.done * 1000000 / time), (int) (q.done * 100000000 / time % 100));
+
+	return q.ok;
+}
@@ -0,0 +1,50 @@
+#ifndef __HTTP_SESSION_H__
+#define __HTTP_SESSION_H__
+
+#include <ppu-types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// clients kept connected between the requests (keep-alive), it's also the max number of concurrent transfers
+#define HTTP_CLIENTS_MAX	4
+
+// returned instead of a HTTP status code
+#define HTTP_FAILED			-1
+#define HTTP_CANCELED		-2
+
+// called while the data is transfered, returns 0 to cancel
+typedef u8 (*http_progress)(u64 done, u64 total, void *arg);
+
+typedef struct
+{
+	char *url;
+	char *dst;
+	int ret;		// HTTP status code or HTTP_FAILED/HTTP_CANCELED
+} http_job;
+
+// The modules, the pools and the certificates are loaded by the first request and kept until http_session_end.
+// The SSL part is only loaded by the first https request.
+u8 http_session_start(u8 https);
+void http_session_end();
+
+// GET saved in 'dst' (only if the status code is < 400), returns the status code
+int http_get(char *url, char *dst, http_progress progress, void *arg);
+
+// GET without reading the content, returns the status code
+int http_status(char *url);
+
+// POST of the file 'src', returns the status code
+int http_post_file(char *url, char *src, http_progress progress, void *arg);
+
+// GET of every job with 'workers' clients at once, the caller is one of them.
+// 'progress' is called after each job with the number of jobs done.
+// Returns the number of files downloaded.
+u32 http_get_queue(http_job *jobs, u32 number, u32 workers, http_progress progress, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HTTP_SESSION_H__ */
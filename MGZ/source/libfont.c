@@ -8,6 +8,7 @@
 #include <stdarg.h> 
 #include "libfont2.h"
 #include "ttf_render.h"
+#include "quad_batch.h"
 
 struct t_font_description
 {
@@ -361,6 +362,65 @@ float GetFontWidth()
 
 #define MOD_FLOAT(x,y) (((float)(((u32) (x)) % y)) / (float) y)
 
+// chars are stored one under the other : a group of chars is used as one texture
+// (4096 lines max) so the string is drawn in few batches
+static int batch_char(float x, float y, float z, u8 chr)
+{
+    struct t_font_description *font = &font_datas.fonts[font_datas.current_font];
+    float dx  = font_datas.sx, dy = font_datas.sy;
+    float dx2 = (font_datas.sx * font->fw[chr]) / font->w;
+    float dy2 = (float) (font_datas.sy * font->bh) / (float) font->h;
+    int bpp = (font->color_format == TINY3D_TEX_FORMAT_A8R8G8B8) ? 4 : 2;
+    qb_texture tex;
+
+    if(font_datas.enable_doubletextures) return 0;
+    if(font->rsx_bytes_per_char != (u32) (font->w * bpp * font->h)) return 0;
+
+    if(font_datas.bkcolor) {
+        tex.offset = font_datas.rsx_text_bk_offset;
+        tex.width = tex.height = 8;
+        tex.stride = 8 * 2;
+        tex.format = TINY3D_TEX_FORMAT_A4R4G4B4;
+
+        QB_Quad(&tex, x, y, z, dx2, dy2, font_datas.bkcolor, 0.0f, 0.0f, 0.0f, 0.0f);
+    }
+
+    y += (float) (font->fy[chr] * font_datas.sy) / (float) (font->h);
+
+    if(chr > font->last_char) return 1;
+
+    int per_group = 4096 / font->h;
+    int n = chr - font->first_char;
+    int group = n - n % per_group;
+    int count = font->last_char - font->first_char + 1 - group;
+
+    if(count > per_group) count = per_group;
+
+    tex.offset = font->rsx_text_offset + font->rsx_bytes_per_char * group;
+    tex.width = font->w;
+    tex.height = font->h * count;
+    tex.stride = font->w * bpp;
+    tex.format = font->color_format;
+
+    float v0 = (float) (n - group) / (float) count;
+
+    QB_Quad(&tex, x, y, z, dx, dy, font_datas.color, 0.0f, v0, 0.95f, v0 + 0.95f / (float) count);
+
+    return 1;
+}
+
+static void draw_char(float x, float y, float z, u8 chr)
+{
+    if(font_datas.number_of_fonts <= 0) return;
+
+    if(chr < font_datas.fonts[font_datas.current_font].first_char) return;
+
+    if(batch_char(x, y, z, chr)) return;
+
+    QB_Flush();
+    DrawChar(x, y, z, chr);
+}
+
 void DrawChar(float x, float y, float z, u8 chr)
 {
     float dx  = font_datas.sx, dy = font_datas.sy;
@@ -562,11 +622,13 @@ float DrawString(float x, float y, char *str)
             }
         }
 
-        DrawChar(x, y, font_datas.Z, (u8) *str);
+        draw_char(x, y, font_datas.Z, (u8) *str);
         x += font_datas.sx * font_datas.fonts[font_datas.current_font].fw[((u8)*str)] / font_datas.fonts[font_datas.current_font].w;
         str++; 
     }
 
+    QB_Flush();
+
     font_datas.X = x; font_datas.Y = y;
 
     return x;
@@ -648,12 +710,14 @@ float DrawFormatString(float x, float y, char *format, ...)
             }
         }
 
-        DrawChar(x, y, font_datas.Z, (u8) *str);
+        draw_char(x, y, font_datas.Z, (u8) *str);
        
         x += font_datas.sx * font_datas.fonts[font_datas.current_font].fw[((u8)*str)] / font_datas.fonts[font_datas.current_font].w;
         str++;
     }
 
+    QB_Flush();
+
     font_datas.X = x; font_datas.Y = y;
 
     return x;
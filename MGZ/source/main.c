@@ -16,6 +16,7 @@
 #include <sys/file.h>
 #include <sys/memory.h>
 #include <sys/thread.h>
+#include <sys/mutex.h>
 #include <sys/process.h>
 #include <sys/systime.h>
 #include <sys/types.h>
@@ -55,6 +56,9 @@
 #include "np.h"
 #include "self.h"
 #include "rvk.h"
+#include "http_session.h"
+#include "zip_extract.h"
+#include "archive.h"
 #include "frontend.h"
 
 #include <MagickWand/MagickWand.h>
@@ -67,9 +71,14 @@
 #include "fflib.h"
 #include "exFAT.h"
 #include "mgz_io.h"
+#include "walk.h"
+#include "delete.h"
 
 #include "tga_reader.h"
 #include "dds_reader.h"
+#include "dxt.h"
+#include "gim_reader.h"
+#include "apng.h"
 #include "makepng.h"
 
 #include "cobra.h"
@@ -83,6 +92,8 @@
 #include "zlib.h"
 #include "ttf_render.h"
 #include "libfont2.h"
+#include "quad_batch.h"
+#include "redraw.h"
 #include "iso.h"
 #include "osk_input.h"
 
@@ -93,10 +104,6 @@
 #include "jsx.h"
 #include "cxml.h"
 
-#include "unrar.h"
-#include "7zExtractor.h"
-#include "minitar.h"
-
 #include "md5.h"
 #include "sha1.h"
 #include "ird_iso.h"
@@ -537,6 +544,7 @@ static u8 UI_position = XMB;
 static u8 XMB_priority = NO;
 static u8 Show_Help = YES;
 static u8 Use_SideMenu = NO;
+static u8 Fast_Delete = NO;
 static u8 Show_COVER = NO;
 static u8 Show_PIC1 = NO;
 static u8 Show_GameCase = NO;
@@ -1718,6 +1726,8 @@ static char *STR_EXTRACT_QRC=NULL;
 #define STR_EXTRACT_QRC_DEFAULT				"Extract QRC"
 static char *STR_EXTRACT_HERE=NULL;
 #define STR_EXTRACT_HERE_DEFAULT			"Extract here"
+static char *STR_ARCHIVE_CONTENT=NULL;
+#define STR_ARCHIVE_CONTENT_DEFAULT			"Archive content"
 static char *STR_CONVERT_JSX_JS=NULL;
 #define STR_CONVERT_JSX_JS_DEFAULT			"Convert JSX to JS"
 static char *STR_CONVERT_VAG_WAV=NULL;
@@ -2171,6 +2181,11 @@ void close_SETTINGS();
 void TranslateTo(float *value, float target);
 void remove_GAMELIST(s64 pos);
 void Draw_MemMonitor();
+void update_fps();
+float get_fps();
+u64 get_usec();
+void Redraw_Input();
+void free_APNG();
 void DrawLoadingIcon();
 void Draw_filter();
 void ReloadTheme(u8 i);
@@ -2190,6 +2205,7 @@ u8 is_float_window();
 int move_bdemubackup_to_origin(char *device_path);
 s8 bmpLoadFromBuffer(const void *buffer, int file_size, imgData *data);
 s8 MagickLoadFromBuffer(const void *buffer, int file_size, imgData *data);
+s8 jpgLoadScaled(char *path, const void *buffer, int file_size, u32 max_size, imgData *data);
 u8 make_png(char *outfile, imgData data);
 char *GetTimeStr(u64 secTime);
 char *sprintf_malloc(char *format, ...);
@@ -2373,6 +2389,9 @@ void cls()
 				TINY3D_BLEND_FUNC_DST_RGB_ONE_MINUS_SRC_ALPHA | TINY3D_BLEND_FUNC_DST_ALPHA_ZERO,
 				TINY3D_BLEND_RGB_FUNC_ADD | TINY3D_BLEND_ALPHA_FUNC_ADD);
 	reset_ttf_frame();
+	QB_NewFrame();
+	Redraw_NewFrame();
+	update_fps();
 }
 
 void Init_Graph()
@@ -2879,9 +2898,7 @@ void Draw_title(float x, float y, char *str)
 
 u8 is_ntfs(char *path)
 {
-	u8 n=0;
-	if(path[0] == '/') n=1;
-	if( strncmp(&path[n], "ntfs", 4) == 0) return YES;
+	if( MGZ_fs_type(path) == MGZ_FS_NTFS) return YES;
 	
 	return NO;
 }
@@ -3018,8 +3035,73 @@ s8 tgaLoadFromFile(char *imgPath, imgData *data)
 	return ret;
 }
 
+typedef struct
+{
+	u32 version;
+	u32 size;
+	u32 numTexture;
+} gtf_file_header;
+
+typedef struct
+{
+	u32 id;
+	u32 offsetToTex;
+	u32 textureSize;
+	u8 format;
+	u8 mipmap;
+	u8 dimension;
+	u8 cubemap;
+	u32 remap;
+	u16 width;
+	u16 height;
+	u16 depth;
+	u8 location;
+	u8 padding;
+	u32 pitch;
+	u32 offset;
+} gtf_texture_attribute;
+
+#define GTF_TEXTURE_LN						0x20
+#define GTF_TEXTURE_UN						0x40
+#define GTF_TEXTURE_COMPRESSED_DXT1			0x86
+#define GTF_TEXTURE_COMPRESSED_DXT23		0x87
+#define GTF_TEXTURE_COMPRESSED_DXT45		0x88
+#define GTF_TEXTURE_DIMENSION_3				3
+
 s8 gtfLoadFromBuffer(const void *buffer, int file_size, imgData *data)
 {
+	u8 *buff = (u8 *) buffer;
+	
+	// the first mipmap of a 2D DXT texture is stored as plain blocks : decode it in place
+	if( sizeof(gtf_file_header) + sizeof(gtf_texture_attribute) <= file_size ) {
+		gtf_file_header header;
+		gtf_texture_attribute attr;
+		int format = 0;
+		
+		memcpy(&header, buff, sizeof(gtf_file_header));
+		memcpy(&attr, buff + sizeof(gtf_file_header), sizeof(gtf_texture_attribute));
+		
+		switch(attr.format & ~(GTF_TEXTURE_LN | GTF_TEXTURE_UN)) {
+			case GTF_TEXTURE_COMPRESSED_DXT1:  format = DXT_FORMAT_DXT1; break;
+			case GTF_TEXTURE_COMPRESSED_DXT23: format = DXT_FORMAT_DXT3; break;
+			case GTF_TEXTURE_COMPRESSED_DXT45: format = DXT_FORMAT_DXT5; break;
+		}
+		
+		u32 size = ((attr.width + 3) / 4) * ((attr.height + 3) / 4) * (format == DXT_FORMAT_DXT1 ? 8 : 16);
+		
+		if( header.numTexture != 0 && attr.id == 0 && format != 0 && attr.dimension != GTF_TEXTURE_DIMENSION_3
+		&&  attr.offsetToTex + size <= file_size )
+		{
+			(*data).bmp_out = dxtDecode(format, attr.width, attr.height, buff + attr.offsetToTex, DDS_READER_ARGB);
+			if( (*data).bmp_out == NULL) return -1;
+			
+			(*data).width = attr.width;
+			(*data).height = attr.height;
+			(*data).pitch = attr.width*4;
+			
+			return 0;
+		}
+	}
 	
 	uint8_t *dds_buffer=NULL;
 	uint32_t dds_size=0;
@@ -3035,168 +3117,15 @@ s8 gtfLoadFromBuffer(const void *buffer, int file_size, imgData *data)
 	return ret;
 }
 
-// (https://www.psdevwiki.com/ps3/Graphic_Image_Map_(GIM))
-typedef struct      
-{
-	u32 signature; // PS3 : ".GIM"
-	u32 version;
-	u32 format_style;
-	u32 unk;  
-} gim_file_header;
-
-
-// block_id
-#define GIM_BLOCK_ROOT     2
-#define GIM_BLOCK_PICTURE  3
-#define GIM_BLOCK_IMAGE    4
-#define GIM_BLOCK_PALETTE  5
-#define GIM_BLOCK_FILEINFO 0xFF
-
-typedef struct
-{
-	u16 id;
-	u16 unk;
-	u32 size;       
-	u32	header_next;       
-	u32 data_offset;     
-} gim_block_header;
- 
-#define GIM_IMAGE_FORMAT_RGBA5650 		0x00 	//(16 bit no alpha)
-#define GIM_IMAGE_FORMAT_RGBA5551 		0x01 	//(16 bit sharp alpha)
-#define GIM_IMAGE_FORMAT_RGBA4444 		0x02 	//(16 bit gradient alpha)
-#define GIM_IMAGE_FORMAT_RGBA8888 		0x03 	//(32 bit gradient alpha)
-#define GIM_IMAGE_FORMAT_INDEX4 		0x04 	//(16 colors)
-#define GIM_IMAGE_FORMAT_INDEX8 		0x05 	//(256 colors)
-#define GIM_IMAGE_FORMAT_INDEX16 		0x06 	//(16 colors with alpha ?)
-#define GIM_IMAGE_FORMAT_INDEX32 		0x07 	//(256 colors with alpha ?)
-#define GIM_IMAGE_FORMAT_DXT1 			0x08 	//(no alpha)
-#define GIM_IMAGE_FORMAT_DXT3 			0x09 	//(sharp alpha)
-#define GIM_IMAGE_FORMAT_DXT5 			0x0A 	//(gradient alpha)
-#define GIM_IMAGE_FORMAT_DXT1EXT	    0x108
-#define GIM_IMAGE_FORMAT_DXT3EXT	    0x109
-#define GIM_IMAGE_FORMAT_DXT5EXT		0x10A
-
-#define GIM_PIXEL_ORDER_NORMAL			0x0
-#define GIM_PIXEL_ORDER_FAST			0x1
-
-typedef struct
-{
-	u16 data_lenght;
-	u16 b45_unk1;
-	u16 image_format;       
-	u16	pixel_order;       
-	u16 width;
-	u16 height;
-	u16 bpp;
-	u16 pitch_align;
-	u16 height_align;
-	u16 b45_unk2;
-	u32 b45_unk3;
-	u32 index_start; // relative offset of block_image_index
-	u32 pixels_start;
-	u32 pixels_end;
-	u32 plane_mask;
-	u16 level_type;
-	u16 level_count;
-	u16 frame_type;
-	u16 frame_count;
-} gim_block_image_data;
-
-u8 get_pad(u32 align, u32 size)
-{
-	return (~size + 1) & (align - 1);
-}
-
 s8 gimLoadFromBuffer(const void *buffer, int file_size, imgData *data)
 {
-	u8 *buff = (u8 *) buffer;
-	
-	//print_load("gim signature");
-	gim_file_header file_header;
-	memcpy(&file_header, buff, sizeof(gim_file_header));
-	if(file_header.signature != 0x2E47494D ) {
-		//print_load("bad magic gimLoadFromBuffer");
-		return -1;
-	}
-	
-	gim_block_header block;
-	
-	u32 pos = sizeof(gim_file_header);
-	
-	//print_load("Search GIM_BLOCK_IMAGE");
-		
-	while(1) {	
-		memcpy(&block, buff + pos, sizeof(gim_block_header));
-		
-		//print_load("* block offset 0x%X, block.id 0x%X", pos, block.id);
-		if( block.id == GIM_BLOCK_IMAGE ) {
-			pos += block.data_offset;
-			break;
-		}
-		pos += block.header_next;
-		
-		if( pos > file_size) {
-			//print_load("GIM_BLOCK_IMAGE not found");
-			return -1;
-		}
-	}
+	u32 width, height;
 	
-	gim_block_image_data image_data;
-	memcpy(&image_data, buff + pos, sizeof(gim_block_image_data));
+	if( gimGetInfo((const u8 *) buffer, file_size, &width, &height) != 0 ) return -1;
 	
-	if( image_data.image_format != GIM_IMAGE_FORMAT_RGBA8888) {
-		//print_load("Unsupported format %X", image_data.image_format);
-		return -1;
-	}
-	/*
-	if( DEBUG ) {
-		sprintf(picture_viewer_info,
-		"data_lenght   0x%02X\n"
-		"b45_unk1      0x%04X\n"
-		"image_format; 0x%04X\n"
-		"pixel_order;  0x%04X\n"     
-		"width;        0x%04X\n"
-		"height;       0x%04X\n"
-		"bpp           0x%04X\n"
-		"pitch_align;  0x%04X\n"
-		"height_align; 0x%04X\n"
-		"b45_unk2      0x%04X\n"
-		"b45_unk3      0x%08X\n"
-		"index_start;  0x%08X\n"
-		"pixels_start; 0x%08X\n"
-		"pixels_end;   0x%08X\n"
-		"plane_mask;   0x%08X\n"
-		"level_type;   0x%04X\n"
-		"level_count;  0x%04X\n"
-		"frame_type;   0x%04X\n"
-		"frame_count;  0x%04X\n",
-		image_data.data_lenght,
-		image_data.b45_unk1,
-		image_data.image_format,
-		image_data.pixel_order,
-		image_data.width,   
-		image_data.height,     
-		image_data.bpp,        
-		image_data.pitch_align,
-		image_data.height_align,
-		image_data.b45_unk2,
-		image_data.b45_unk3,
-		image_data.index_start,
-		image_data.pixels_start,
-		image_data.pixels_end, 
-		image_data.plane_mask, 
-		image_data.level_type, 
-		image_data.level_count,
-		image_data.frame_type,
-		image_data.frame_count);
-	}
-	*/
-	
-	u8 *rgba = buff + pos + image_data.pixels_start;
-		
-	(*data).width=image_data.width;
-	(*data).height=image_data.height;
-	(*data).pitch=(*data).width*4;
+	(*data).width = width;
+	(*data).height = height;
+	(*data).pitch = width*4;
 	
 	(*data).bmp_out = (u8 *) malloc((*data).pitch * (*data).height);
 	if( (*data).bmp_out == NULL) {
@@ -3204,27 +3133,14 @@ s8 gimLoadFromBuffer(const void *buffer, int file_size, imgData *data)
 		return -1;
 	}
 	
-	u8 pad = get_pad(image_data.pitch_align, image_data.width * image_data.bpp/8);
-	
-	s64 i = 0;
-	s64 k = 0;
-	s64 j = 0;
-	for (i = 0; i<(*data).height ; i++) {
-		k=i*(*data).width;
-		for (j=k; j < k+(*data).width; j++) {	
-			u8 ARGB[4]={0};
-			ARGB[0] = rgba[j*4 + i*pad + 3];
-			ARGB[1] = rgba[j*4 + i*pad   ];
-			ARGB[2] = rgba[j*4 + i*pad + 1];
-			ARGB[3] = rgba[j*4 + i*pad + 2];
-			memcpy((*data).bmp_out + j*4, ARGB, 4);
-		}
+	if( gimDecode((const u8 *) buffer, file_size, (*data).bmp_out, (*data).pitch) != 0 ) {
+		FREE((*data).bmp_out);
+		return -1;
 	}
 	
 	return 0;
 }
 
-
 s8 webpLoadFromBuffer(const void *buffer, int file_size, imgData *data)
 {
 
@@ -3301,101 +3217,207 @@ error:
 	return -1;
 }
 
-u8 imgLoadFromFile(char *imgPath, imgData *out, u8 gray)
+#define IMG_FORMAT_UNK		0
+#define IMG_FORMAT_PNG		1
+#define IMG_FORMAT_JPG		2
+#define IMG_FORMAT_DDS		3
+#define IMG_FORMAT_TGA		4
+#define IMG_FORMAT_BMP		5
+#define IMG_FORMAT_GIM		6
+#define IMG_FORMAT_WEBP		7
+#define IMG_FORMAT_GTF		8
+#define IMG_FORMAT_TIFF		9
+#define IMG_FORMAT_NUMBER	10
+
+static char *img_format_name[IMG_FORMAT_NUMBER] = {"magick", "png", "jpg", "dds", "tga", "bmp", "gim", "webp", "gtf", "tiff"};
+static u32 img_decode_count[IMG_FORMAT_NUMBER] = {0};
+static u64 img_decode_time[IMG_FORMAT_NUMBER] = {0}; // ms
+
+// TGA and GTF don't have a magic number, the extension is used for them
+u8 GetImageFormat(const u8 *magic, int size, char *path)
+{
+	if( 4 <= size && memcmp(magic, "\x89PNG", 4) == 0 ) return IMG_FORMAT_PNG;
+	if( 3 <= size && magic[0] == 0xFF && magic[1] == 0xD8 && magic[2] == 0xFF ) return IMG_FORMAT_JPG;
+	if( 4 <= size && memcmp(magic, "DDS ", 4) == 0 ) return IMG_FORMAT_DDS;
+	if( 2 <= size && memcmp(magic, "BM", 2) == 0 ) return IMG_FORMAT_BMP;
+	if( 4 <= size && (memcmp(magic, ".GIM", 4) == 0 || memcmp(magic, "MIG.", 4) == 0) ) return IMG_FORMAT_GIM;
+	if( 12 <= size && memcmp(magic, "RIFF", 4) == 0 && memcmp(magic+8, "WEBP", 4) == 0 ) return IMG_FORMAT_WEBP;
+	if( 4 <= size && (memcmp(magic, "II*\0", 4) == 0 || memcmp(magic, "MM\0*", 4) == 0) ) return IMG_FORMAT_TIFF;
+	
+	char *ext = get_ext(path);
+	if( !strcasecmp(ext, ".tga") ) return IMG_FORMAT_TGA;
+	if( !strcasecmp(ext, ".gtf") ) return IMG_FORMAT_GTF;
+	
+	return IMG_FORMAT_UNK;
+}
+
+// box filter by the smallest integer factor that fits the picture in max_size bytes
+void imgDownscale(imgData *data, u32 max_size)
 {
-	//memset(picture_viewer_info, 0, sizeof(picture_viewer_info));
+	u32 f = 1;
 	
-	int file_size = 0;
+	if( max_size == 0 || (*data).pitch * (*data).height <= max_size) return;
 	
-	out->bmp_out = NULL;
-		
-	char *buff = LoadFile((char *) imgPath, &file_size);
-	if(buff==NULL) return FAILED;
+	while( ((*data).width/f) * ((*data).height/f) * 4 > max_size) f++;
+	
+	u32 w = (*data).width / f;
+	u32 h = (*data).height / f;
+	if( w == 0 || h == 0 ) return;
+	
+	u8 *out = (u8 *) malloc(w * h * 4);
+	if( out == NULL ) return;
 	
+	u8 *in = (u8 *) (*data).bmp_out;
+	u32 x, y, i, j, c;
+	for(y=0; y<h; y++) {
+		for(x=0; x<w; x++) {
+			u32 sum[4] = {0};
+			for(j=0; j<f; j++) {
+				u8 *p = in + (y*f + j) * (*data).pitch + x*f*4;
+				for(i=0; i<f; i++, p+=4) {
+					for(c=0; c<4; c++) sum[c] += p[c];
+				}
+			}
+			for(c=0; c<4; c++) out[(y*w + x)*4 + c] = sum[c] / (f*f);
+		}
+	}
+	
+	free((*data).bmp_out);
+	(*data).bmp_out = out;
+	(*data).width = w;
+	(*data).height = h;
+	(*data).pitch = w*4;
+}
+
+// ImageMagick isn't thread safe, the workers of convert_to_png_batch take turns on it
+static sys_lwmutex_t magick_lock;
+static u8 magick_lock_init = NO;
+// img_decode_count/time, updated by the same workers
+static sys_lwmutex_t img_stats_lock;
+static u8 img_stats_lock_init = NO;
+
+// pictures decoded since the start, per format
+void print_img_decode_stats()
+{
+	int i;
+	
+	if( img_stats_lock_init ) sysLwMutexLock(&img_stats_lock, 0);
+	for(i=0; i<IMG_FORMAT_NUMBER; i++) {
+		if( img_decode_count[i] == 0 ) continue;
+		print_load("%s : %d pictures decoded in %d ms", img_format_name[i], img_decode_count[i], (int) img_decode_time[i]);
+	}
+	if( img_stats_lock_init ) sysLwMutexUnlock(&img_stats_lock);
+}
+
+// max_size : maximum size in bytes of the decoded picture, 0 for no limit
+u8 imgLoadFromFileScaled(char *imgPath, imgData *out, u8 gray, u32 max_size)
+{
+	int file_size = 0;
+	char *buff = NULL;
+	u8 magic[16];
 	int ret=-1;
 	imgData tp;
-	char *ext = get_ext(imgPath);
-	if( !strcasecmp(ext, ".png") ) {
-		ret = pngLoadFromBuffer((const void *) buff, file_size, (pngData *) &tp);
-	} else 
-	if( !strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".jpeg") || !strcasecmp(ext, ".jpe")) {
-		ret = jpgLoadFromBuffer((const void *) buff, file_size, (jpgData *) &tp);
-	} else 
-	if( !strcasecmp(ext, ".dds") ) {
-		ret = ddsLoadFromBuffer((const void *) buff, file_size, (imgData *) &tp);
-	} else 
-	if( !strcasecmp(ext, ".tga") ) {
-		ret = tgaLoadFromBuffer((const void *) buff, file_size, (imgData *) &tp);
-	} else 
-	if( !strcasecmp(ext, ".bmp") ) {
-		ret = bmpLoadFromBuffer((const void *) buff, file_size, (imgData *) &tp);
-	} else
-	if( !strcasecmp(ext, ".gim") ) {
-		ret = gimLoadFromBuffer((const void *) buff, file_size, (imgData *) &tp);
-	} else 
-	if( !strcasecmp(ext, ".webp") ) {
-		ret = webpLoadFromBuffer((const void *) buff, file_size, (imgData *) &tp);
-	} else
-	if( !strcasecmp(ext, ".gtf")) {
-		ret = gtfLoadFromBuffer((const void *) buff, file_size, (imgData *) &tp);
+	u64 sec_s, nsec_s, sec_e, nsec_e;
+	
+	out->bmp_out = NULL;
+	memset(&tp, 0, sizeof(imgData));
+	
+	FILE *f = fopen(imgPath, "rb");
+	if(f==NULL) return FAILED;
+	int n = fread(magic, 1, sizeof(magic), f);
+	fclose(f);
+	
+	u8 format = GetImageFormat(magic, n, imgPath);
+	
+	sysGetCurrentTime(&sec_s, &nsec_s);
+	
+	// both decoders read the file by themselves, jpg can also be downscaled while decoding
+	if( format == IMG_FORMAT_JPG && strncmp(imgPath, "/dev_", 5) == 0 ) {
+		ret = jpgLoadScaled(imgPath, NULL, 0, max_size, &tp);
 	} else
-	if( !strcasecmp(ext, ".tiff") || !strcasecmp(ext, ".tif") ) {
-		ret = tiffLoadFromFile(imgPath, (imgData *) &tp);
+	if( format == IMG_FORMAT_TIFF ) {
+		ret = tiffLoadFromFile(imgPath, &tp);
 	}
 	
 	if( ret != 0 ) {
-		ret = MagickLoadFromBuffer((const void *) buff, file_size, (imgData *) &tp);
+		buff = LoadFile((char *) imgPath, &file_size);
+		if(buff==NULL) return FAILED;
+		
+		switch(format)
+		{
+			case IMG_FORMAT_PNG:
+				ret = pngLoadFromBuffer((const void *) buff, file_size, (pngData *) &tp);
+				break;
+			case IMG_FORMAT_JPG:
+				ret = jpgLoadScaled(NULL, (const void *) buff, file_size, max_size, &tp);
+				if( ret != 0 ) ret = jpgLoadFromBuffer((const void *) buff, file_size, (jpgData *) &tp);
+				break;
+			case IMG_FORMAT_DDS:
+				ret = ddsLoadFromBuffer((const void *) buff, file_size, &tp);
+				break;
+			case IMG_FORMAT_TGA:
+				ret = tgaLoadFromBuffer((const void *) buff, file_size, &tp);
+				break;
+			case IMG_FORMAT_BMP:
+				ret = bmpLoadFromBuffer((const void *) buff, file_size, &tp);
+				break;
+			case IMG_FORMAT_GIM:
+				ret = gimLoadFromBuffer((const void *) buff, file_size, &tp);
+				break;
+			case IMG_FORMAT_WEBP:
+				ret = webpLoadFromBuffer((const void *) buff, file_size, &tp);
+				break;
+			case IMG_FORMAT_GTF:
+				ret = gtfLoadFromBuffer((const void *) buff, file_size, &tp);
+				break;
+		}
+		
+		if( ret != 0 ) {
+			format = IMG_FORMAT_UNK;
+			if( magick_lock_init ) sysLwMutexLock(&magick_lock, 0);
+			ret = MagickLoadFromBuffer((const void *) buff, file_size, &tp);
+			if( magick_lock_init ) sysLwMutexUnlock(&magick_lock);
+		}
+		
+		FREE(buff);
 	}
 	
-	FREE(buff);
+	if( ret != 0 || tp.bmp_out == NULL ) return FAILED;
 	
-	if( ret != 0 ) return FAILED;
+	sysGetCurrentTime(&sec_e, &nsec_e);
+	u64 ms = (sec_e - sec_s) * 1000 + nsec_e / 1000000 - nsec_s / 1000000;
+	if( img_stats_lock_init ) sysLwMutexLock(&img_stats_lock, 0);
+	img_decode_count[format]++;
+	img_decode_time[format] += ms;
+	if( img_stats_lock_init ) sysLwMutexUnlock(&img_stats_lock);
 	
-	out->height = tp.height;
-	out->width = tp.width;
-	out->pitch = tp.pitch;
-	out->bmp_out = (u8 *) malloc(tp.pitch*tp.height+1);
+	imgDownscale(&tp, max_size);
 	
 	if( gray ) {
-					
 		u64 d;
-
-		// L8
-		// out->height = tp.height;
-		// out->width = tp.width;
-		// out->pitch = tp.pitch/4;
-		// out->bmp_out = (u8 *) malloc(tp.pitch*tp.height/4+1);
-
-		// for(d=0; d< tp.pitch*tp.height; d+=4) {
-			// u8 ARGB[4];
-			// memcpy(&ARGB, tp.bmp_out+d, 4);
-			// u8 Y = (0.299*ARGB[1] + 0.587*ARGB[2] + 0.114*ARGB[3])*((float) (ARGB[0]/0xFF));
-			// memcpy(out->bmp_out + d/4, &Y, 1);
-		// }
-		
+		u8 *ARGB = (u8 *) tp.bmp_out;
 		for(d=0; d< tp.pitch*tp.height; d+=4) {
-			u8 ARGB[4];
-			memcpy(&ARGB, tp.bmp_out+d, 4);
-			u8 Y = (0.299*ARGB[1] + 0.587*ARGB[2] + 0.114*ARGB[3]);
-			
-			u8 new_ARGB[4]={0};
-			new_ARGB[0] = ARGB[0];
-			new_ARGB[1] = Y;
-			new_ARGB[2] = Y;
-			new_ARGB[3] = Y;
-			
-			memcpy(out->bmp_out + d, new_ARGB, 4);
+			u8 Y = (0.299*ARGB[d+1] + 0.587*ARGB[d+2] + 0.114*ARGB[d+3]);
+			ARGB[d+1] = Y;
+			ARGB[d+2] = Y;
+			ARGB[d+3] = Y;
 		}
-		
-	} else {
-		memcpy(out->bmp_out, tp.bmp_out, tp.pitch*tp.height);
 	}
-
-	free(tp.bmp_out);
+	
+	// the decoded buffer is given as is
+	out->height = tp.height;
+	out->width = tp.width;
+	out->pitch = tp.pitch;
+	out->bmp_out = tp.bmp_out;
 	
 	return SUCCESS;
 }
 
+u8 imgLoadFromFile(char *imgPath, imgData *out, u8 gray)
+{
+	return imgLoadFromFileScaled(imgPath, out, gray, 0);
+}
+
 
 u8 convert_to_png(char *src, char *dst)
 {
@@ -3410,6 +3432,154 @@ u8 convert_to_png(char *src, char *dst)
 	return SUCCESS;
 }
 
+// *** batch conversion to PNG ***
+// Each worker decodes a picture and encodes it with its own PNG writer, so the deflate
+// state and the row buffers are allocated once per worker. Before decoding, a worker reserves
+// an estimate of the decoded size (the real size once it's known) and doesn't start a new
+// picture while the reservations would exceed the memory budget.
+
+#define CONVERT_PNG_THREADS		2
+#define CONVERT_PNG_MEM_MAX		0x4000000
+// decoded size estimated from the size of the file
+#define CONVERT_PNG_MEM_RATIO	8
+
+typedef struct
+{
+	char **src;
+	char **dst;
+	u32 number;
+	u32 next;
+	
+	int level;
+	u8 filter;
+	
+	u32 mem_used;
+	u32 done;
+	u64 pixels;
+	
+	sys_lwmutex_t lock;
+} convert_png_pool;
+
+static void convert_png_work(convert_png_pool *pool)
+{
+	makepng_writer *w = makepng_new(pool->level, pool->filter);
+	
+	while(1) {
+		sysLwMutexLock(&pool->lock, 0);
+		if( pool->number <= pool->next ) {
+			sysLwMutexUnlock(&pool->lock);
+			break;
+		}
+		u32 i = pool->next;
+		u32 size = CONVERT_PNG_MEM_MAX;
+		struct stat st;
+		if( stat(pool->src[i], &st) == 0 && st.st_size < CONVERT_PNG_MEM_MAX / CONVERT_PNG_MEM_RATIO ) size = st.st_size * CONVERT_PNG_MEM_RATIO;
+		// alone, a picture can still go over the budget
+		if( pool->mem_used != 0 && CONVERT_PNG_MEM_MAX < pool->mem_used + size ) {
+			sysLwMutexUnlock(&pool->lock);
+			usleep(2000);
+			continue;
+		}
+		pool->next++;
+		pool->mem_used += size;
+		sysLwMutexUnlock(&pool->lock);
+		
+		imgData pic;
+		u8 ret = FAILED;
+		
+		if( w != NULL && imgLoadFromFile(pool->src[i], &pic, NO) == SUCCESS ) {
+			sysLwMutexLock(&pool->lock, 0);
+			pool->mem_used -= size;
+			size = pic.pitch * pic.height;
+			pool->mem_used += size;
+			sysLwMutexUnlock(&pool->lock);
+			
+			ret = makepng_save(w, pool->dst[i], pic);
+			FREE(pic.bmp_out);
+			
+			sysLwMutexLock(&pool->lock, 0);
+			if( ret == SUCCESS ) {
+				pool->done++;
+				pool->pixels += pic.width * pic.height;
+			}
+			sysLwMutexUnlock(&pool->lock);
+		}
+		
+		sysLwMutexLock(&pool->lock, 0);
+		pool->mem_used -= size;
+		sysLwMutexUnlock(&pool->lock);
+		
+		if( ret == FAILED ) print_load("Error : failed to convert %s", pool->src[i]);
+	}
+	
+	makepng_free(w);
+}
+
+static void convert_png_thread(void *arg)
+{
+	convert_png_work((convert_png_pool *) arg);
+	sysThreadExit(0);
+}
+
+// level and filter : see makepng.h, returns the number of pictures converted
+u32 convert_to_png_batch(char **src, char **dst, u32 number, int level, u8 filter)
+{
+	static const sys_lwmutex_attr_t attr = {
+		SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""
+	};
+	sys_ppu_thread_t id[CONVERT_PNG_THREADS];
+	u8 started[CONVERT_PNG_THREADS];
+	convert_png_pool pool;
+	u64 ret;
+	int i;
+	
+	if( number == 0 ) return 0;
+	
+	memset(&pool, 0, sizeof(pool));
+	pool.src = src;
+	pool.dst = dst;
+	pool.number = number;
+	pool.level = level;
+	pool.filter = filter;
+	sysLwMutexCreate(&pool.lock, &attr);
+	
+	if( magick_lock_init == NO ) {
+		sysLwMutexCreate(&magick_lock, &attr);
+		magick_lock_init = YES;
+	}
+	if( img_stats_lock_init == NO ) {
+		sysLwMutexCreate(&img_stats_lock, &attr);
+		img_stats_lock_init = YES;
+	}
+	
+	// FatFs (exFAT) and libntfs can't be used by several threads at once
+	int threads = CONVERT_PNG_THREADS;
+	if( MGZ_fs_threads(src[0]) < threads ) threads = MGZ_fs_threads(src[0]);
+	if( MGZ_fs_threads(dst[0]) < threads ) threads = MGZ_fs_threads(dst[0]);
+	
+	u64 start = get_usec();
+	
+	// the caller is one of the workers
+	for(i=1; i<threads; i++) {
+		started[i] = (sysThreadCreate(&id[i], convert_png_thread, (void *) &pool, 1000, 0x10000, THREAD_JOINABLE, "convert_png") == 0);
+	}
+	
+	convert_png_work(&pool);
+	
+	for(i=1; i<threads; i++) {
+		if(started[i]) sysThreadJoin(id[i], &ret);
+	}
+	
+	sysLwMutexDestroy(&pool.lock);
+	
+	u64 ms = (get_usec() - start) / 1000;
+	if( ms == 0 ) ms = 1;
+	print_load("%d/%d pictures converted in %d ms : %d Kpixels/s", pool.done, number, (int) ms, (int) (pool.pixels / ms));
+	print_img_decode_stats();
+	
+	return pool.done;
+}
+
 //*******************************************************
 // SCREENSHOT
 //******************************************************
@@ -3643,18 +3813,70 @@ print_head("Writing bitmap data...");
 	return SUCCESS;
 }
 
+// The frame buffer is copied then encoded by a thread with a fast PNG mode (zlib level 1,
+// up filter), the UI doesn't wait for the file to be written.
+
+typedef struct
+{
+	u8 *mem;
+	imgData pic;
+	char path[128];
+	u64 start;
+} screenshot_job;
+
+static screenshot_job screenshot;
+static sys_ppu_thread_t screenshot_id;
+static u8 screenshot_started = NO;
+static volatile u8 screenshot_busy = NO;
+
+static void ScreenShot_write()
+{
+	u64 encode = get_usec();
+	
+	makepng_writer *w = makepng_new(1, MAKEPNG_FILTER_UP);
+	u8 ret = makepng_save_rgb(w, screenshot.path, screenshot.pic);
+	makepng_free(w);
+	
+	FREE(screenshot.mem);
+	
+	if( ret == SUCCESS ) {
+		SetFilePerms(screenshot.path);
+		u64 end = get_usec();
+		print_load("Screenshot %s : %d ms (encoding %d ms)", screenshot.path, (int) ((end - screenshot.start) / 1000), (int) ((end - encode) / 1000));
+	} else {
+		print_load("Error : failed to write %s", screenshot.path);
+	}
+	
+	screenshot_busy = NO;
+}
+
+static void ScreenShot_thread(void *unused)
+{
+	ScreenShot_write();
+	sysThreadExit(0);
+}
+
 void ScreenShot()
 {
+	u64 ret;
+	
 	if( ComboNewPad(BUTTON_L2, BUTTON_R2) == NO ) return;
 
 	if(Video_currentBuffer==NO) return;
 	
-	u8 *mem = malloc(Video_Resolution.width*Video_Resolution.height*4 + 1);
-	memcpy(mem, Video_buffer[1], Video_Resolution.width*Video_Resolution.height*4);
+	// the previous one is still being written
+	if( screenshot_busy ) return;
+	if( screenshot_started ) {
+		sysThreadJoin(screenshot_id, &ret);
+		screenshot_started = NO;
+	}
 	
-	if( DEBUG ) start_loading();
+	screenshot.start = get_usec();
+	
+	screenshot.mem = malloc(Video_Resolution.width*Video_Resolution.height*4);
+	if( screenshot.mem == NULL ) return;
+	memcpy(screenshot.mem, Video_buffer[1], Video_Resolution.width*Video_Resolution.height*4);
 	
-	print_load("Get size scaled...");
 	double sx = (double) Video_Resolution.width;
 	double sy = (double) Video_Resolution.height;
 	double psx = (double) (1000 + videoscale_x)/1000.0;
@@ -3665,20 +3887,27 @@ void ScreenShot()
 	u32 x = (u32) (((u32)sx - w) / 2);
 	u32 y = (u32) (((u32)sy - h) / 2);
 	
+	screenshot.pic.bmp_out = screenshot.mem + (y * Video_Resolution.width + x) * 4;
+	screenshot.pic.pitch = Video_Resolution.width * 4;
+	screenshot.pic.width = w;
+	screenshot.pic.height = h;
+	
 	mkdir("/dev_hdd0/photo", 0777);
 	
-	char ScreenShotPath[128];
 	int o;
 	for(o=0; o<1000; o++) {
-		sprintf(ScreenShotPath, "/dev_hdd0/photo/ManaGunZ_%03d.bmp", o);
-		if(path_info(ScreenShotPath) == _NOT_EXIST) break;
+		sprintf(screenshot.path, "/dev_hdd0/photo/ManaGunZ_%03d.png", o);
+		if(path_info(screenshot.path) == _NOT_EXIST) break;
 	}
 	
-	SaveBMP(ScreenShotPath, mem, x, y, w, h);
+	screenshot_busy = YES;
+	if( sysThreadCreate(&screenshot_id, ScreenShot_thread, NULL, 1500, 0x4000, THREAD_JOINABLE, "screenshot") == 0 ) {
+		screenshot_started = YES;
+		return;
+	}
 	
-	FREE(mem);
-
-	end_loading();
+	// no thread, write it here
+	ScreenShot_write();
 }
 
 //*******************************************************
@@ -4052,6 +4281,8 @@ void Load_FM()
 		start_loading();
 	}
 
+	free_APNG();
+	
 	texture_pointer = texture_mem + TEXTURE_POINTER_TMP;
 	
 	memset(&TMP_PIC, 0, sizeof(TMP_PIC));
@@ -4080,6 +4311,89 @@ static void jpg_free(void *ptr,void *usrdata)
 	free(ptr);
 }
 
+// decode a jpg from a file (path) or from memory, the IDCT is scaled down by 2, 4 or 8
+// so that the picture fits in max_size bytes (0 : no limit)
+s8 jpgLoadScaled(char *path, const void *buffer, int file_size, u32 max_size, imgData *data)
+{
+	jpgDecSource source;
+	jpgDecInfo DecInfo;
+	jpgDecInParam inParam;
+	jpgDecOutParam outParam;
+	jpgDecDataCtrlParam dCtrlParam;
+	jpgDecDataInfo dInfo;
+	jpgDecThreadInParam InThdParam;
+	jpgDecThreadOutParam OutThdParam;
+	s32 mHandle,sHandle,ret;
+	u32 space_allocated;
+	
+	(*data).bmp_out = NULL;
+	
+	memset(&source,0,sizeof(jpgDecSource));
+	if( path != NULL ) {
+		source.stream = JPGDEC_FILE;
+		source.file_name = __get_addr32(path);
+	} else {
+		source.stream = JPGDEC_BUFFER;
+		source.stream_ptr = __get_addr32(buffer);
+		source.stream_size = file_size;
+	}
+	source.enable = JPGDEC_DISABLE;
+	
+	InThdParam.enable = 0;
+	InThdParam.ppu_prio = 512;
+	InThdParam.spu_prio = 200;
+	InThdParam.malloc_func = __get_addr32(__get_opd32(jpg_malloc));
+	InThdParam.malloc_arg = 0; // no args
+	InThdParam.free_func = __get_addr32(__get_opd32(jpg_free));
+	InThdParam.free_arg = 0; // no args
+	
+	ret = jpgDecCreate(&mHandle,&InThdParam,&OutThdParam);
+	if(ret!=0) return -1;
+	
+	ret = jpgDecOpen(mHandle,&sHandle,&source,&space_allocated);
+	if(ret!=0) goto destroy;
+	
+	ret = jpgDecReadHeader(mHandle,sHandle,&DecInfo);
+	if(ret!=0) goto close;
+	
+	u32 scale = 1;
+	if( max_size != 0 ) {
+		while( scale < 8 && ((DecInfo.width + scale - 1)/scale) * ((DecInfo.height + scale - 1)/scale) * 4 > max_size ) scale *= 2;
+	}
+	
+	memset(&inParam, 0, sizeof(jpgDecInParam));
+	inParam.cmd_ptr = 0;
+	inParam.down_scale = scale;
+	inParam.quality = JPGDEC_LOW_QUALITY;
+	inParam.mode = JPGDEC_TOP_TO_BOTTOM;
+	inParam.space = JPGDEC_ARGB;
+	inParam.alpha = 0xFF;
+	
+	ret = jpgDecSetParameter(mHandle,sHandle,&inParam,&outParam);
+	if(ret!=0) goto close;
+	
+	(*data).width = outParam.width;
+	(*data).height = outParam.height;
+	(*data).pitch = outParam.width*4;
+	(*data).bmp_out = malloc((*data).pitch * (*data).height);
+	if((*data).bmp_out == NULL) {
+		ret = -1;
+		goto close;
+	}
+	
+	dCtrlParam.output_bytes_per_line = (*data).pitch;
+	ret = jpgDecDecodeData(mHandle,sHandle,(*data).bmp_out,&dCtrlParam,&dInfo);
+	if(ret==0 && dInfo.status!=JPGDEC_STATUS_FINISH) ret = -1;
+	if(ret!=0) FREE((*data).bmp_out);
+	
+close:
+	jpgDecClose(mHandle,sHandle);
+destroy:
+	jpgDecDestroy(mHandle);
+	
+	return ret==0 ? 0 : -1;
+}
+
 u8 GetInfo_JPG(char *path, u32 *w, u32 *h) 
 {
 	jpgDecSource source;
@@ -4296,7 +4610,7 @@ u8 Have_GAMEPIC(int game_pos)
 	return ret;
 }
 
-u8 Read_PS1BACK(int game_pos, imgData *DataPic)
+u8 Read_PS1BACK(int game_pos, imgData *DataPic, u32 max_size)
 {
 	u8 is_PS1 = (list_game_platform[game_pos] == ISO_PS1 || list_game_platform[game_pos] == JB_PS1);
 	
@@ -4313,18 +4627,18 @@ u8 Read_PS1BACK(int game_pos, imgData *DataPic)
 	char temp[128];
 	
 	sprintf(temp, "/dev_hdd0/game/%s/USRDIR/covers/3D/%s.JPG", ManaGunZ_id, list_game_ID[game_pos]);
-	if(imgLoadFromFile(temp, DataPic, NO) == SUCCESS) return SUCCESS;
+	if(imgLoadFromFileScaled(temp, DataPic, NO, max_size) == SUCCESS) return SUCCESS;
 	sprintf(temp, "/dev_hdd0/game/%s/USRDIR/covers/3D/%s.jpg", ManaGunZ_id, list_game_ID[game_pos]);
-	if(imgLoadFromFile(temp, DataPic, NO) == SUCCESS) return SUCCESS;
+	if(imgLoadFromFileScaled(temp, DataPic, NO, max_size) == SUCCESS) return SUCCESS;
 	sprintf(temp, "/dev_hdd0/game/%s/USRDIR/covers/3D/%s.PNG", ManaGunZ_id, list_game_ID[game_pos]);
-	if(imgLoadFromFile(temp, DataPic, NO) == SUCCESS) return SUCCESS;
+	if(imgLoadFromFileScaled(temp, DataPic, NO, max_size) == SUCCESS) return SUCCESS;
 	sprintf(temp, "/dev_hdd0/game/%s/USRDIR/covers/3D/%s.png", ManaGunZ_id, list_game_ID[game_pos]);
-	if(imgLoadFromFile(temp, DataPic, NO) == SUCCESS) return SUCCESS;
+	if(imgLoadFromFileScaled(temp, DataPic, NO, max_size) == SUCCESS) return SUCCESS;
 
 	return FAILED;
 }
 
-u8 Read_GAMEPIC_COVER3D(int game_pos, imgData *DataPic)
+u8 Read_GAMEPIC_COVER3D(int game_pos, imgData *DataPic, u32 max_size)
 {
 	
 	if( !(list_game_havepic[game_pos] & GAMEPIC_COVER3D) ) return FAILED;
@@ -4335,7 +4649,7 @@ u8 Read_GAMEPIC_COVER3D(int game_pos, imgData *DataPic)
 		char *COVER3D_path = GetPath_GAMEPIC_COVER3D(game_pos, n);
 		if( COVER3D_path == NULL) break;
 		
-		int ret = imgLoadFromFile(COVER3D_path, DataPic, NO);
+		int ret = imgLoadFromFileScaled(COVER3D_path, DataPic, NO, max_size);
 		FREE(COVER3D_path);
 		
 		if(ret == SUCCESS) return SUCCESS;
@@ -4349,7 +4663,7 @@ u8 Read_GAMEPIC_COVER3D(int game_pos, imgData *DataPic)
 		char *COVER3D_path = GetPath_GAMEPIC_UNK(game_pos, n);
 		if( COVER3D_path == NULL) break;
 		
-		int ret = imgLoadFromFile(COVER3D_path, DataPic, NO);
+		int ret = imgLoadFromFileScaled(COVER3D_path, DataPic, NO, max_size);
 		FREE(COVER3D_path);
 		
 		if(ret == SUCCESS) return SUCCESS;
@@ -4360,7 +4674,7 @@ u8 Read_GAMEPIC_COVER3D(int game_pos, imgData *DataPic)
 	return FAILED;
 }
 
-u8 Read_GAMEPIC_COVER2D(int game_pos, imgData *DataPic)
+u8 Read_GAMEPIC_COVER2D(int game_pos, imgData *DataPic, u32 max_size)
 {
 	if( !(list_game_havepic[game_pos] & GAMEPIC_COVER2D) ) return FAILED;
 	
@@ -4370,7 +4684,7 @@ u8 Read_GAMEPIC_COVER2D(int game_pos, imgData *DataPic)
 		char *COVER2D_path = GetPath_GAMEPIC_COVER2D(game_pos, n);
 		if( COVER2D_path == NULL) break;
 		
-		int ret = imgLoadFromFile(COVER2D_path, DataPic, NO);
+		int ret = imgLoadFromFileScaled(COVER2D_path, DataPic, NO, max_size);
 		FREE(COVER2D_path);
 		
 		if(ret == SUCCESS) return SUCCESS;
@@ -4384,7 +4698,7 @@ u8 Read_GAMEPIC_COVER2D(int game_pos, imgData *DataPic)
 		char *COVER2D_path = GetPath_GAMEPIC_UNK(game_pos, n);
 		if( COVER2D_path == NULL) break;
 		
-		int ret = imgLoadFromFile(COVER2D_path, DataPic, NO);
+		int ret = imgLoadFromFileScaled(COVER2D_path, DataPic, NO, max_size);
 		FREE(COVER2D_path);
 		
 		if(ret == SUCCESS) return SUCCESS;
@@ -4395,7 +4709,7 @@ u8 Read_GAMEPIC_COVER2D(int game_pos, imgData *DataPic)
 	return FAILED;
 }
 
-u8 Read_GAMEPIC_ICON0(int game_pos, imgData *DataPic)
+u8 Read_GAMEPIC_ICON0(int game_pos, imgData *DataPic, u32 max_size)
 {
 	char temp[512];
 	
@@ -4405,25 +4719,25 @@ u8 Read_GAMEPIC_ICON0(int game_pos, imgData *DataPic)
 		int size;
 		char *mem = LoadFileFromISO(NO, list_game_path[game_pos], "/PS3_GAME/ICON0.PNG", &size);
 		if(mem==NULL) return FAILED;
-		if(pngLoadFromBuffer((const void *) mem, size, (pngData *) DataPic) == 0)  {free(mem); return SUCCESS;}
+		if(pngLoadFromBuffer((const void *) mem, size, (pngData *) DataPic) == 0)  {free(mem); imgDownscale(DataPic, max_size); return SUCCESS;}
 	} else
 	if(list_game_platform[game_pos] == ISO_PSP) {
 		int size;
 		char *mem = LoadFileFromISO(NO, list_game_path[game_pos], "/PSP_GAME/ICON0.PNG", &size);
 		if(mem==NULL) return FAILED;
-		if(pngLoadFromBuffer((const void *) mem, size, (pngData *) DataPic) == 0) {free(mem); return SUCCESS;}
+		if(pngLoadFromBuffer((const void *) mem, size, (pngData *) DataPic) == 0) {free(mem); imgDownscale(DataPic, max_size); return SUCCESS;}
 	} else	
 	if(list_game_platform[game_pos] == JB_PS3 || list_game_platform[game_pos] == BDVD) {
 		sprintf(temp, "%s/PS3_GAME/PKGDIR/ICON0.PNG", list_game_path[game_pos]);
-		if(imgLoadFromFile(temp, DataPic, NO) == SUCCESS) return SUCCESS;
+		if(imgLoadFromFileScaled(temp, DataPic, NO, max_size) == SUCCESS) return SUCCESS;
 		sprintf(temp, "%s/PS3_GAME/ICON0.PNG", list_game_path[game_pos]);
-		if(imgLoadFromFile(temp, DataPic, NO) == SUCCESS) return SUCCESS;
+		if(imgLoadFromFileScaled(temp, DataPic, NO, max_size) == SUCCESS) return SUCCESS;
 	} else
 	if(list_game_platform[game_pos] == JB_PSP) {
 		sprintf(temp, "%s/PSP_GAME/PKGDIR/ICON0.PNG", list_game_path[game_pos]);
-		if(imgLoadFromFile(temp, DataPic, NO) == SUCCESS) return SUCCESS;
+		if(imgLoadFromFileScaled(temp, DataPic, NO, max_size) == SUCCESS) return SUCCESS;
 		sprintf(temp, "%s/PSP_GAME/ICON0.PNG", list_game_path[game_pos]);
-		if(imgLoadFromFile(temp, DataPic, NO) == SUCCESS) return SUCCESS;
+		if(imgLoadFromFileScaled(temp, DataPic, NO, max_size) == SUCCESS) return SUCCESS;
 	} else
 	if(list_game_platform[game_pos] == ISO_PS2 || list_game_platform[game_pos] == ISO_PS1) {
 		
@@ -4433,7 +4747,7 @@ u8 Read_GAMEPIC_ICON0(int game_pos, imgData *DataPic)
 			char *GAMEPIC_path = GetPath_GAMEPIC_UNK(game_pos, n);
 			if( GAMEPIC_path == NULL) break;
 			
-			int ret = imgLoadFromFile(GAMEPIC_path, DataPic, NO);
+			int ret = imgLoadFromFileScaled(GAMEPIC_path, DataPic, NO, max_size);
 			FREE(GAMEPIC_path);
 			
 			if(ret == SUCCESS) return SUCCESS;
@@ -4445,7 +4759,7 @@ u8 Read_GAMEPIC_ICON0(int game_pos, imgData *DataPic)
 	return FAILED;
 }
 
-u8 Read_GAMEPIC(int game_pos, imgData *DataPic)
+u8 Read_GAMEPIC(int game_pos, imgData *DataPic, u32 max_size)
 {
 	
 	if(list_game_havepic[game_pos] == GAMEPIC_NONE) return FAILED;
@@ -4453,28 +4767,28 @@ u8 Read_GAMEPIC(int game_pos, imgData *DataPic)
 	if(UI_position==FLOW) {
 		
 		if(FLOW_3D) {
-			if( Read_GAMEPIC_COVER3D(game_pos, DataPic) == SUCCESS) return SUCCESS;
+			if( Read_GAMEPIC_COVER3D(game_pos, DataPic, max_size) == SUCCESS) return SUCCESS;
 		} 
 			
 		if(FLOW_3D || Show_COVER) {
-			if( Read_GAMEPIC_COVER2D(game_pos, DataPic) == SUCCESS) return SUCCESS;
+			if( Read_GAMEPIC_COVER2D(game_pos, DataPic, max_size) == SUCCESS) return SUCCESS;
 		}
 		
-		if( Read_GAMEPIC_ICON0(game_pos, DataPic) == SUCCESS) return SUCCESS;
+		if( Read_GAMEPIC_ICON0(game_pos, DataPic, max_size) == SUCCESS) return SUCCESS;
 		
 	} else
 	if(UI_position==LIST) {
 		if(Show_ICON0) {
-			if( Read_GAMEPIC_ICON0(game_pos, DataPic) == SUCCESS) return SUCCESS;
+			if( Read_GAMEPIC_ICON0(game_pos, DataPic, max_size) == SUCCESS) return SUCCESS;
 		}
 		if(Show_COVER) {
-			if( Read_GAMEPIC_COVER2D(game_pos, DataPic) == SUCCESS) return SUCCESS;
+			if( Read_GAMEPIC_COVER2D(game_pos, DataPic, max_size) == SUCCESS) return SUCCESS;
 		}
 	} else {
-		if( Read_GAMEPIC_ICON0(game_pos, DataPic) == SUCCESS) return SUCCESS;
+		if( Read_GAMEPIC_ICON0(game_pos, DataPic, max_size) == SUCCESS) return SUCCESS;
 		
 		if(Show_COVER) {
-			if( Read_GAMEPIC_COVER2D(game_pos, DataPic) == SUCCESS) return SUCCESS;
+			if( Read_GAMEPIC_COVER2D(game_pos, DataPic, max_size) == SUCCESS) return SUCCESS;
 		}	
 	}
 	
@@ -4609,7 +4923,8 @@ void Load_GAMEPIC()
 		slot = VRAM_NewSlot(gamepos);
 		if( slot == -1)  break;
 		
-		if( Read_GAMEPIC(gamepos, &GAMEPIC[slot]) == FAILED ) goto next;
+		// pictures are scaled down to fit in their slot
+		if( Read_GAMEPIC(gamepos, &GAMEPIC[slot], TEXTURE_GAMEPIC_SIZE_MAX*4) == FAILED ) goto next;
 		
 		GAMEPIC_SLOT_POS[slot] = gamepos;
 		texture_pointer = texture_mem + TEXTURE_POINTER_GAMEPIC(slot);	
@@ -4618,7 +4933,8 @@ void Load_GAMEPIC()
 		GAMEPIC_offset[slot] = tiny3d_TextureOffset(texture_pointer);
 				
 		PS1BACK_offset[slot] = 0;
-		if( Read_PS1BACK(gamepos, &PS1BACK[slot]) == FAILED) goto next;
+		if( TEXTURE_GAMEPIC_SIZE_MAX <= TEXTURE_GAMEPIC_SIZE(slot) ) goto next;
+		if( Read_PS1BACK(gamepos, &PS1BACK[slot], (TEXTURE_GAMEPIC_SIZE_MAX - TEXTURE_GAMEPIC_SIZE(slot))*4) == FAILED) goto next;
 		texture_pointer = texture_mem + TEXTURE_POINTER_GAMEPIC(slot) + TEXTURE_GAMEPIC_SIZE(slot);
 		memcpy(texture_pointer, PS1BACK[slot].bmp_out, PS1BACK[slot].pitch * PS1BACK[slot].height);
 		free(PS1BACK[slot].bmp_out);
@@ -5350,15 +5666,9 @@ enum {
 	APNG_BLEND_OP_OVER   = 1,
 };
 
-u32 APNG_num_frames;
-pngData APNG[MAX_FRAME];
-fcTL_data APNG_data[MAX_FRAME];
-u32 APNG_offset[MAX_FRAME];
-u32 APNG_frame=0;
-
-fcTL_data BG_data[MAX_FRAME];
-u32 BG_frame=0;
-u32 BG_num_frames;
+// frames decoded on demand by apng.c
+apng_stream *APNG_stream = NULL;
+apng_stream *BG_stream = NULL;
 
 static u64 time_s[5]={0};
 static u64 time_e[5]={0};
@@ -5408,11 +5718,6 @@ u8 is_apng(char *file)
 	chunk_header ch;
 	u64 pos=0;
 	
-	memset(APNG_data, 0, sizeof(APNG_data));
-	memset(APNG, 0, sizeof(APNG));
-	memset(APNG_offset, 0, sizeof(APNG_offset));
-	APNG_num_frames = 0;
-	
 	f=fopen(file, "rb");
 	if(f==NULL) return NO;
 	
@@ -5448,179 +5753,33 @@ u8 is_apng(char *file)
 	return NO;
 }
 
-u8 Load_APNG(char* filename)
+void free_APNG()
 {
-	u64 magic;
-	u32 pos;
-	chunk_header ch;
-	
-	u8 IEND_[0xC] = {0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82};
-	
-	u8 Frame_Header[0x29];
-	acTL_data ad;
+	APNG_Close(APNG_stream);
+	APNG_stream = NULL;
+}
 
-	texture_pointer = texture_mem + TEXTURE_POINTER_TMP;	
-	
-	memset(APNG_data, 0, sizeof(APNG_data));
-	memset(APNG, 0, sizeof(APNG));
-	memset(APNG_offset, 0, sizeof(APNG_offset));
-	APNG_num_frames = 0;
+u8 Load_APNG(char* filename)
+{
+	free_APNG();
 	
 	print_load("Loading %s", filename);
 	
-	int size;
-	u8 *data = (u8*) LoadFile(filename, &size);
-	if(data==NULL) {
-		print_load("Error :  failed to load file");
-		return NO;
-	}
+	u64 start = get_usec();
 	
-	memcpy(&magic, data, 8);
+	texture_pointer = texture_mem + TEXTURE_POINTER_TMP;
 	
-	if(magic != MAGIC_PNG) { 
-		print_load("Error :  bad magic");
-		free(data);
+	APNG_stream = APNG_Open(filename, texture_pointer, TEXTURE_TMP_SIZE_MAX * 4, NO);
+	if(APNG_stream == NULL) {
+		print_load("Error : failed to load APNG");
 		return NO;
 	}
 	
-	memcpy(Frame_Header, data, 0x21);
+	texture_pointer += APNG_TextureSize(APNG_stream) / 4;
 	
-	memcpy(&ch, data+0x21, 0x8);
-	
-	pos=0x21+8;
-	
-	while (ch.type != acTL)  
-	{
-		pos += ch.length + 4; // ignore CRC
-		memcpy(&ch, data+pos, 8); pos+=8;
-		
-		if(ch.type == IDAT) {
-			print_load("Error : no actl");
-			return NO;
-		}
-	}
-	
-	memcpy(&ad, data+pos, ch.length); pos+=ch.length;
-	
-	APNG_num_frames = ad.num_frames;
-
-	pos += 4; // ignore CRC
+	print_load("APNG %dx%d, %d frames, %d Ko of texture, loaded in %d ms", APNG_Width(APNG_stream), APNG_Height(APNG_stream), 
+		APNG_NumFrames(APNG_stream), APNG_TextureSize(APNG_stream) / 1024, (int) ((get_usec() - start) / 1000));
 	
-	u32 i;
-	
-	for(i=0; i<ad.num_frames; i++) {
-		
-		memcpy(&ch, data+pos, 8); pos+=8;
-		
-		while (ch.type != fcTL)
-		{
-			pos += ch.length + 4; // ignore CRC
-			memcpy(&ch, data+pos, 8); pos+=8;
-		}
-		memcpy(&APNG_data[i], data+pos, ch.length); pos+=ch.length;
-		
-		*(u32 *) &Frame_Header[0x10] = APNG_data[i].width;
-		*(u32 *) &Frame_Header[0x14] = APNG_data[i].height;
-		*(u32 *) &Frame_Header[0x25] = IDAT;
-		
-		pos += 4; // ignore CRC
-		memcpy(&ch, data+pos, 8); pos+=8;
-		
-		while (ch.type != IDAT && ch.type != fdAT)
-		{	
-			pos += ch.length + 4; // ignore CRC
-			memcpy(&ch, data+pos, 8); pos+=8;
-		}
-		
-		u32 n_AT=0;
-		u32 tot_size=0;
-		u32 chunk_size[1024]={0};
-		u32 first_pos = pos - 8;
-		
-	next:
-		if(ch.type == IDAT) {
-			tot_size+=ch.length;
-			chunk_size[n_AT]=ch.length;
-			n_AT++;
-			
-			pos += ch.length + 4; // ignore CRC 
-			memcpy(&ch, data+pos, 8); pos+=8;
-						
-			goto next;
-		} else 
-		if(ch.type == fdAT) {
-			tot_size+=ch.length - 4; // ignore sequence
-			chunk_size[n_AT]=ch.length - 4;
-			n_AT++;
-			
-			pos += ch.length + 4; // ignore CRC 
-			memcpy(&ch, data+pos, 8); pos+=8;
-			
-			goto next;
-		} else {
-			memcpy(&ch, data+first_pos, 8); pos = first_pos + 8;
-		}
-		
-		*(u32 *) &Frame_Header[0x21] = tot_size;
-		
-		u32 ihdr_crc = crc32(0L, Z_NULL, 0);
-		ihdr_crc = crc32(ihdr_crc, (const unsigned char*)Frame_Header+0xC, 0x11);
-		memcpy(Frame_Header+0x1D, &ihdr_crc, 4);
-		
-		u8 *frame = (u8 *) malloc(0x29 + tot_size + 4 + 0xC);
-		if(frame==NULL) {
-			print_load("Error : failed to malloc");
-			free(data);
-			return NO;
-		}
-		
-		memcpy(frame, &Frame_Header, 0x29);
-		
-		u32 j, cur_size=0;
-		for(j=0; j<n_AT; j++) {
-			if(ch.type == IDAT) {
-				memcpy(frame + 0x29 + cur_size, data+pos, chunk_size[j]); pos+=chunk_size[j]+4; // ignore CRC
-				memcpy(&ch, data+pos, 8); pos+=8;
-			} else
-			if(ch.type == fdAT) {
-				pos += 4; // ignore sequence_number
-				memcpy(frame + 0x29 + cur_size, data+pos, chunk_size[j]); pos+=chunk_size[j]+4; // ignore CRC
-				memcpy(&ch, data+pos, 8); pos+=8;
-			}
-			cur_size+=chunk_size[j];
-		}
-		pos -= 8;	
-		
-		u32 crc = crc32(0L, Z_NULL, 0);
-		crc = crc32(crc, (const unsigned char*)frame+0x25, 4 + tot_size);
-		memcpy(frame+0x29+tot_size, &crc, 4);
-		
-		memcpy(frame+0x29+tot_size+4, IEND_, 0xC);
-		
-		//FILE* x;
-		//char frame_path[128];
-		//mkdir("/dev_hdd0/frames", 0777);
-		//sprintf(frame_path, "/dev_hdd0/frames/frame_%d.png", i);
-		//x = fopen(frame_path, "wb");
-		//fwrite(frame, 1, 0x29 + tot_size + 4 + 0xC, x);
-		//fclose(x);
-		
-		pngLoadFromBuffer((const void *) frame, 0x29 + tot_size + 4 + 0xC, &APNG[i]);
-		
-		free(frame);
-		
-		if(APNG[i].bmp_out) {
-			memcpy(texture_pointer, APNG[i].bmp_out, APNG[i].pitch * APNG[i].height);
-			free(APNG[i].bmp_out);
-			APNG_offset[i] = tiny3d_TextureOffset(texture_pointer);
-			texture_pointer += ((APNG[i].pitch * APNG[i].height + 15) & ~15) / 4;
-		}
-	}
-	
-	free(data);
-	
-	init_timer(0);
-
 	return YES;
 }
 
@@ -5812,296 +5971,80 @@ u8 Load_APNG(char* filename)
 
 void Draw_APNG()
 {
-	
-	if(time_s[0]==0) start_timer(0);
-	
 	SetFontZ(0);
 	
 	Draw_Box(0, 0, 0, 0, 848, 512, 0x00000080, NO); // DARK 50%
 	
+	u32 next;
+	u32 offset = APNG_Update(APNG_stream, get_usec(), &next);
 	
-	if(APNG_frame >= APNG_num_frames) APNG_frame = 0;
+	Redraw_Animate(next);
 	
-	if(APNG_offset[APNG_frame] != 0) {
-		tiny3d_SetTexture(0, APNG_offset[APNG_frame], APNG[APNG_frame].width, APNG[APNG_frame].height, APNG[APNG_frame].pitch, TINY3D_TEX_FORMAT_A8R8G8B8, TEXTURE_LINEAR);
+	if(offset != 0) {
+		u32 width = APNG_Width(APNG_stream);
+		u32 height = APNG_Height(APNG_stream);
+		
+		tiny3d_SetTexture(0, offset, width, height, width * 4, TINY3D_TEX_FORMAT_A8R8G8B8, TEXTURE_LINEAR);
 		
 		float x0, y0, w0, h0;
-		float xf, yf, wf, hf;
-		float r;		
 		
-		if( APNG[0].width > 748) {
-			r = 748 / (float) APNG[0].width;
+		if( width > 748) {
 			w0 = 748;
-			h0 = (float) APNG[0].height * r;
-			wf = (float) APNG[APNG_frame].width * r;
-			hf = (float) APNG[APNG_frame].height * r;
+			h0 = (float) height * 748 / (float) width;
 		} else 
-		if (APNG[0].height > 412) {
-			r = 412 / (float) APNG[0].height;
+		if (height > 412) {
 			h0 = 412;
-			w0 = (float) APNG[0].width * r;
-			wf = (float) APNG[APNG_frame].width * r;
-			hf = (float) APNG[APNG_frame].height * r;
+			w0 = (float) width * 412 / (float) height;
 		} else {
-			w0 = (float) APNG[0].width;
-			h0 = (float) APNG[0].height;
-			wf = (float) APNG[APNG_frame].width;
-			hf = (float) APNG[APNG_frame].height;
+			w0 = (float) width;
+			h0 = (float) height;
 		}
 		x0 = (848 - w0) / 2;
 		y0 = (512 - h0) / 2;
-		xf = x0 + (float) APNG_data[APNG_frame].x_offset;
-		yf = y0 + (float) APNG_data[APNG_frame].y_offset;
 		
-		Draw_Box(xf, yf, 0, 0, wf, hf, WHITE, YES);
+		Draw_Box(x0, y0, 0, 0, w0, h0, WHITE, YES);
 	}
 	
 	Draw_Box(0, 460, 0, 0, 848, 20, BLACK, NO);
 	FontColor(WHITE);
 	DrawStringFromCenterX(424, 462 , &strrchr(TMP_PIC_path, '/')[1]);
-	
-	if(APNG_data[APNG_frame].delay_den == 0) APNG_data[APNG_frame].delay_den=100;
-	//usleep((float) APNG_data[APNG_frame].delay_num * 1000000 / (float) APNG_data[APNG_frame].delay_den);
-	
-	if( get_time(0) > (APNG_data[APNG_frame].delay_num * 1000 / APNG_data[APNG_frame].delay_den) ) {
-		start_timer(0);
-		APNG_frame++;
-	}
-	
 }
 
-void Load_ANIMATED_BG(char* filename)
+void free_ABG()
 {
-	FILE* f;
-	u64 magic;
-	u32 pos;
-	chunk_header ch;
-	
-	u8 IEND_[0xC] = {0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4E, 0x44, 0xAE, 0x42, 0x60, 0x82};
-	
-	u8 Frame_Header[0x29];
-	acTL_data ad;
-	
-	memset(BG_data, 0, sizeof(BG_data));
-	memset(BG, 0, sizeof(BG));
-	memset(BG_offset, 0, sizeof(BG_offset));
-	BG_num_frames = 0;
-	
-	prog_bar2_value=0;
-	
-	f = fopen(filename, "rb");
-
-	if(f==NULL) {
-		//print_load("Error :  failed to open file");
-		return;
-	}
-	
-	fread(&magic, 1, 8, f);
-	
-	if(magic != MAGIC_PNG) { 
-		//print_load("Error :  bad magic"); 
-		fclose(f); return;
-	}
-	
-	fseek(f, 0, SEEK_SET);
-	fread(&Frame_Header, 1, 0x21, f);
-	
-	fread(&ch, 1, 8, f);
-		
-	while (ch.type != acTL)  
-	{
-		pos = ftell(f) + ch.length + 4; // ignore CRC
-		fseek(f, pos, SEEK_SET);
-		fread(&ch, 1, 8, f);
-		
-		if(ch.type == IDAT) {
-			//print_load("Error : no actl");
-			fclose(f);
-			return;
-		} // not GRID_ANIMATED
-	}
-
-	fread(&ad, 1, ch.length, f);
-	
-	BG_num_frames = ad.num_frames;
+	APNG_Close(BG_stream);
+	BG_stream = NULL;
+}
 
-	pos = ftell(f) + 4; // ignore CRC
-	fseek(f, pos, SEEK_SET);
-	u32 i;
-	
-	for(i=0; i<ad.num_frames; i++) {
-		prog_bar2_value=i*100/ad.num_frames;
-		fread(&ch, 1, 8, f);
-		
-		while (ch.type != fcTL)
-		{
-			pos = ftell(f) + ch.length + 4; // ignore CRC
-			fseek(f, pos, SEEK_SET);
-			fread(&ch, 1, 8, f);
-		}
-		fread(&BG_data[i], 1, ch.length, f);
-		
-		*(u32 *) &Frame_Header[0x10] = BG_data[i].width;
-		*(u32 *) &Frame_Header[0x14] = BG_data[i].height;
-		*(u32 *) &Frame_Header[0x25] = IDAT;
-		
-		pos = ftell(f) + 4; // ignore CRC
-		fseek(f, pos, SEEK_SET);
-		
-		fread(&ch, 1, 8, f);
-		
-		while (ch.type != IDAT && ch.type != fdAT)
-		{	
-			pos = ftell(f) + ch.length + 4; // ignore CRC
-			fseek(f, pos, SEEK_SET);
-			fread(&ch, 1, 8, f);
-		}
-		
-		u32 n_AT=0;
-		u32 tot_size=0;
-		u32 chunk_size[1024]={0};
-		u32 first_pos = ftell(f) - 8;
-		
-	next:
-		if(ch.type == IDAT) {
-			tot_size+=ch.length;
-			chunk_size[n_AT]=ch.length;
-			n_AT++;
-			
-			pos = ftell(f) + ch.length + 4; // ignore CRC 
-			fseek(f, pos, SEEK_SET);
-			fread(&ch, 1, 8, f);
-			
-			goto next;
-		} else 
-		if(ch.type == fdAT) {
-			tot_size+=ch.length - 4; // ignore sequence
-			chunk_size[n_AT]=ch.length - 4;
-			n_AT++;
-			
-			pos = ftell(f) + ch.length + 4; // ignore CRC
-			fseek(f, pos, SEEK_SET);
-			fread(&ch, 1, 8, f);
-			
-			goto next;
-		} else {
-			fseek(f, first_pos, SEEK_SET); 
-			fread(&ch, 1, 8, f);
-		}
-		
-		*(u32 *) &Frame_Header[0x21] = tot_size;
-		
-		u32 ihdr_crc = crc32(0L, Z_NULL, 0);
-		ihdr_crc = crc32(ihdr_crc, (const unsigned char*)Frame_Header+0xC, 0x11);
-		memcpy(Frame_Header+0x1D, &ihdr_crc, 4);
-		
-		u8 *frame = (u8 *) malloc(0x29 + tot_size + 4 + 0xC);
-		if(frame==NULL) {
-			//print_load("Error : failed to malloc");
-			return;
-		}
-		
-		memcpy(frame, &Frame_Header, 0x29);
-		
-		u32 j, cur_size=0;
-		for(j=0; j<n_AT; j++) {
-			if(ch.type == IDAT) {
-				fread(frame + 0x29 + cur_size, 1, chunk_size[j], f);
-				pos = ftell(f) + 4; // ignore CRC
-				fseek(f, pos, SEEK_SET);
-				fread(&ch, 1, 8, f);
-			} else
-			if(ch.type == fdAT) {
-				pos = ftell(f) + 4; // ignore sequence_number
-				fseek(f, pos, SEEK_SET);
-				fread(frame + 0x29 + cur_size, 1, chunk_size[j], f);
-				pos = ftell(f) + 4; // ignore CRC
-				fseek(f, pos, SEEK_SET);
-				fread(&ch, 1, 8, f);
-			}
-			cur_size+=chunk_size[j];
-		}
-		pos = ftell(f) - 8;
-		fseek(f, pos, SEEK_SET);
-		
-		
-		u32 crc = crc32(0L, Z_NULL, 0);
-		crc = crc32(crc, (const unsigned char*)frame+0x25, 4 + tot_size);
-		memcpy(frame+0x29+tot_size, &crc, 4);
-		
-		memcpy(frame+0x29+tot_size+4, IEND_, 0xC);
-		
-		//FILE* x;
-		//char frame_path[128];
-		//mkdir("/dev_hdd0/frames", 0777);
-		//sprintf(frame_path, "/dev_hdd0/frames/frame_%d.png", i);
-		//x = fopen(frame_path, "wb");
-		//fwrite(frame, 1, 0x29 + tot_size + 4 + 0xC, x);
-		//fclose(x);
-		
-		if( FILTER_BG==ENABLED) {
-			imgData tp;
-			
-			pngLoadFromBuffer((const void *) frame, 0x29 + tot_size + 4 + 0xC, (pngData *) &tp);
-						
-			BG[i].height = tp.height;
-			BG[i].width = tp.width;
-			BG[i].pitch = tp.pitch;
-			BG[i].bmp_out = (u8 *) malloc(tp.pitch*tp.height+1);
-			
-			u64 d;
-			for(d=0; d< tp.pitch*tp.height; d+=4) {
-				u8 ARGB[4];
-				memcpy(&ARGB, tp.bmp_out+d, 4);
-				u8 Y = 0.299*ARGB[1] + 0.587*ARGB[2] + 0.114*ARGB[3];
-				u8 new_ARGB[4]={0};
-				new_ARGB[0]=ARGB[0];
-				new_ARGB[1]=Y;
-				new_ARGB[2]=Y;
-				new_ARGB[3]=Y;
-				memcpy(BG[i].bmp_out + d, new_ARGB, 4);
-			}
-			
-		} else {
-			pngLoadFromBuffer((const void *) frame, 0x29 + tot_size + 4 + 0xC, (pngData *) &BG[i]);
-		}
-		
-		free(frame);
-		
-		if(BG[i].bmp_out) {
-			memcpy(texture_pointer, BG[i].bmp_out, BG[i].pitch * BG[i].height);
-			free(BG[i].bmp_out);
-			BG_offset[i] = tiny3d_TextureOffset(texture_pointer);
-			texture_pointer += ((BG[i].pitch * BG[i].height + 15) & ~15) / 4;
-			TEXTURE_THEME_SIZE += ((BG[i].pitch * BG[i].height + 15) & ~15) / 4;
-		}
-	}
+void Load_ANIMATED_BG(char* filename)
+{
+	free_ABG();
 	
-	init_timer(1);
-	BG_frame=0;
+	// the frames are decoded in a ring of textures at the end of the theme memory
+	u32 used = texture_pointer - (texture_mem + TEXTURE_POINTER_THEME);
+	if(TEXTURE_THEME_SIZE_MAX <= used) return;
 	
-	prog_bar2_value=-1;
+	BG_stream = APNG_Open(filename, texture_pointer, (TEXTURE_THEME_SIZE_MAX - used) * 4, FILTER_BG==ENABLED);
+	if(BG_stream == NULL) return;
 	
-	return;
+	texture_pointer += APNG_TextureSize(BG_stream) / 4;
+	TEXTURE_THEME_SIZE += APNG_TextureSize(BG_stream) / 4;
 }
 
 void Draw_ABG(u32 color)
 {
-	if(time_s[1]==0) start_timer(1);	
+	u32 next;
+	u32 offset = APNG_Update(BG_stream, get_usec(), &next);
 	
-	if(BG_frame >= BG_num_frames) BG_frame = 0;
+	Redraw_Animate(next);
 	
-	if(BG_offset[BG_frame] != 0) {		
-		tiny3d_SetTexture(0, BG_offset[BG_frame], BG[BG_frame].width, BG[BG_frame].height, BG[BG_frame].pitch, TINY3D_TEX_FORMAT_A8R8G8B8, TEXTURE_LINEAR);
+	if(offset != 0) {
+		u32 width = APNG_Width(BG_stream);
+		u32 height = APNG_Height(BG_stream);
+		
+		tiny3d_SetTexture(0, offset, width, height, width * 4, TINY3D_TEX_FORMAT_A8R8G8B8, TEXTURE_LINEAR);
 		Draw_Box(0, 0, 1000, 0, 848, 512, color, YES);
 	}
-	
-	if(BG_data[BG_frame].delay_den == 0) BG_data[BG_frame].delay_den=100;
-	
-	if( get_time(1) > (BG_data[BG_frame].delay_num * 1000 / BG_data[BG_frame].delay_den) ) {
-		start_timer(1);
-		BG_frame++;
-	}
 }
 
 void float_to_fract(float f, uint16_t *num, uint16_t *den)
@@ -6773,6 +6716,7 @@ void update_lang()
 	LANG(STR_EXTRACT_RAF, "STR_EXTRACT_RAF", STR_EXTRACT_RAF_DEFAULT);
 	LANG(STR_EXTRACT_QRC, "STR_EXTRACT_QRC", STR_EXTRACT_QRC_DEFAULT);
 	LANG(STR_EXTRACT_HERE, "STR_EXTRACT_HERE", STR_EXTRACT_HERE_DEFAULT);
+	LANG(STR_ARCHIVE_CONTENT, "STR_ARCHIVE_CONTENT", STR_ARCHIVE_CONTENT_DEFAULT);
 	LANG(STR_CONVERT_JSX_JS, "STR_CONVERT_JSX_JS", STR_CONVERT_JSX_JS_DEFAULT);
 	LANG(STR_CONVERT_VAG_WAV, "STR_CONVERT_VAG_WAV", STR_CONVERT_VAG_WAV_DEFAULT);
 	LANG(STR_CONVERT_GTF_DDS, "STR_CONVERT_GTF_DDS", STR_CONVERT_GTF_DDS_DEFAULT);
@@ -7147,6 +7091,7 @@ u8 GetFromTHM(char *thm, char *file, char *dst)
 }
 
 extern int uncompressGIMBuffer(void* compressed_buffer, size_t compressed_buffer_size, void** gim_buffer);
+extern void freeGIMBuffer(void* gim_buffer);
 int GIM2PNG(char *in, char *out)
 {
 	return gim2png(in, out);
@@ -7160,10 +7105,21 @@ void JSX2JS(char *in, char *out)
 	JSX_to_JS(in, out);
 }
 
-u8 GetFromP3T(char *src, char *file, char *dst)
+// *** P3T reader ***
+// The header and the tree/ID/string tables are loaded with a single read when the
+// theme is opened, the ID table is indexed by name, then only the requested entries
+// are read from the file table.
+
+typedef struct
 {
+	char *name;
+	u32 tree_offset;
+} p3t_id;
 
- // *** header ***
+typedef struct
+{
+	FILE *fp;
+	
 	//u32 magic = 0x50335446;	// 0x00 "P3TF"
 	//u32 version;				// 0x04
 	u32 tree_table_offset;   	// 0x08
@@ -7171,52 +7127,148 @@ u8 GetFromP3T(char *src, char *file, char *dst)
 	u32 ID_table_offset; 		// 0x10
 	u32 ID_table_size;			// 0x14
 	u32 string_table_offset;	// 0x18
-	u32 string_table_size;	// 0x1C
-	//u32 integer_array_offset; // 0x20
-	//u32 integer_array_size; 	// 0x2C
-	//u32 float_Array_offset;	// 0x28
-	//u32 float_array_size;		// 0x2C
+	u32 string_table_size;		// 0x1C
 	u32 file_table_offset;		// 0x30
-	//u32 file_table_size;		// 0x34
-	//u32 unk_table_offset;		// 0x38
-	//u32 unk_table_size;		// 0x3C
 	
-	u32 file_offset;
-	u32 file_size_c;
-	int file_size_d;
-	u8 GRID_ANIMATED = NO;
-	FILE* fp;
+	u8 *tables;					// from 0x40 to the end of the last table
+	u32 tables_size;
 	
-	fp=fopen(src, "rb");
-	if(fp==NULL) {
+	p3t_id *ids;				// sorted by name
+	u32 ids_number;
+} p3t_t;
+
+#define P3T_TABLES_OFFSET	0x40
+#define P3T_TABLES_MAX		0x1000000
+
+static int p3t_id_cmp(const void *a, const void *b)
+{
+	return strcmp(((p3t_id *) a)->name, ((p3t_id *) b)->name);
+}
+
+static u8 *p3t_table(p3t_t *p3t, u32 offset, u32 size)
+{
+	if(offset < P3T_TABLES_OFFSET || offset - P3T_TABLES_OFFSET + size > p3t->tables_size) return NULL;
+	return &p3t->tables[offset - P3T_TABLES_OFFSET];
+}
+
+void p3t_close(p3t_t *p3t)
+{
+	if(p3t == NULL) return;
+	if(p3t->fp) fclose(p3t->fp);
+	FREE(p3t->tables);
+	FREE(p3t->ids);
+	free(p3t);
+}
+
+p3t_t *p3t_open(char *src)
+{
+	u32 header[P3T_TABLES_OFFSET/4];
+	
+	p3t_t *p3t = (p3t_t *) malloc(sizeof(p3t_t));
+	if(p3t == NULL) return NULL;
+	memset(p3t, 0, sizeof(p3t_t));
+	
+	p3t->fp = fopen(src, "rb");
+	if(p3t->fp==NULL) {
 		print_load("Error : can't read file %s", src);
-		return FAILED;
+		p3t_close(p3t);
+		return NULL;
 	}
 	
-	fseek(fp, 0x8, SEEK_SET);
-	fread(&tree_table_offset, sizeof(u32), 1, fp);
-	fread(&tree_table_size, sizeof(u32), 1, fp);
-	fread(&ID_table_offset, sizeof(u32), 1, fp);
-	fread(&ID_table_size, sizeof(u32), 1, fp);
-	fread(&string_table_offset, sizeof(u32), 1, fp);
-	fread(&string_table_size, sizeof(u32), 1, fp);
+	if(fread(header, P3T_TABLES_OFFSET, 1, p3t->fp) != 1) {
+		p3t_close(p3t);
+		return NULL;
+	}
 	
-	fseek(fp, 0x30, SEEK_SET);
-	fread(&file_table_offset, sizeof(u32), 1, fp);
+	p3t->tree_table_offset = header[0x08/4];
+	p3t->tree_table_size = header[0x0C/4];
+	p3t->ID_table_offset = header[0x10/4];
+	p3t->ID_table_size = header[0x14/4];
+	p3t->string_table_offset = header[0x18/4];
+	p3t->string_table_size = header[0x1C/4];
+	p3t->file_table_offset = header[0x30/4];
+	
+	u32 end = p3t->tree_table_offset + p3t->tree_table_size;
+	if(end < p3t->ID_table_offset + p3t->ID_table_size) end = p3t->ID_table_offset + p3t->ID_table_size;
+	if(end < p3t->string_table_offset + p3t->string_table_size) end = p3t->string_table_offset + p3t->string_table_size;
+	
+	if(end <= P3T_TABLES_OFFSET || end - P3T_TABLES_OFFSET > P3T_TABLES_MAX) {
+		print_load("Error : bad P3T tables");
+		p3t_close(p3t);
+		return NULL;
+	}
 	
-//UGLY !
+	// +1 to keep the last string null terminated
+	p3t->tables_size = end - P3T_TABLES_OFFSET;
+	p3t->tables = (u8 *) malloc(p3t->tables_size + 1);
+	if(p3t->tables == NULL) {
+		print_load("Error : failed to malloc P3T tables");
+		p3t_close(p3t);
+		return NULL;
+	}
+	p3t->tables[p3t->tables_size] = 0;
+	
+	if(fread(p3t->tables, p3t->tables_size, 1, p3t->fp) != 1) {
+		print_load("Error : failed to read P3T tables");
+		p3t_close(p3t);
+		return NULL;
+	}
+	
+	// ID table : u32 tree offset followed by a null terminated name
+	u8 *ID_table = p3t_table(p3t, p3t->ID_table_offset, p3t->ID_table_size);
+	if(ID_table) {
+		u32 n=0, max=0;
+		while(n + 4 < p3t->ID_table_size) {
+			if(p3t->ids_number == max) {
+				max += 64;
+				p3t_id *tmp = (p3t_id *) realloc(p3t->ids, max * sizeof(p3t_id));
+				if(tmp == NULL) break;
+				p3t->ids = tmp;
+			}
+			memcpy(&p3t->ids[p3t->ids_number].tree_offset, &ID_table[n], 4);
+			p3t->ids[p3t->ids_number].name = (char *) &ID_table[n+4];
+			p3t->ids_number++;
+			n += 4 + strlen((char *) &ID_table[n+4]) + 1;
+		}
+		if(p3t->ids_number) qsort(p3t->ids, p3t->ids_number, sizeof(p3t_id), p3t_id_cmp);
+	}
+	
+	return p3t;
+}
+
+u8 p3t_get_name(p3t_t *p3t, char *dst)
+{
+	u8 *string_table = p3t_table(p3t, p3t->string_table_offset, p3t->string_table_size);
+	if(string_table == NULL) return FAILED;
+	
+	unsigned int n;
+	for(n=0; n + 5 <= p3t->string_table_size; n++){
+		if(memcmp((char *) &string_table[n], "name\0", 5) == 0) {
+			strcpy((char *) dst, (char *) &string_table[n+5]);
+			return SUCCESS;
+		}
+	}
+	return FAILED;
+}
+
+// read the (compressed) data of an entry of the file table
+static char *p3t_read_file(p3t_t *p3t, char *file, u32 *file_size_c, u8 *GRID_ANIMATED)
+{
+	u32 file_offset=0;
+	
+	*file_size_c = 0;
+	*GRID_ANIMATED = NO;
+	
+	//UGLY !
 	if(strcmp(file, "background") == 0 ) {
-		fseek(fp, string_table_offset, SEEK_SET);
+		u8 *string_table = p3t_table(p3t, p3t->string_table_offset, p3t->string_table_size);
+		if(string_table == NULL) return NULL;
 		
-		u8 *string_table = (u8 *) malloc(string_table_size);
-		
-		fread(string_table, string_table_size, 1, fp);
 		u32 flag=0;
-		u32 temp;
 		unsigned int n;
-		for(n=0; n < string_table_size; n++){
+		for(n=0; n < p3t->string_table_size; n++){
 			if(memcmp((char *) &string_table[n], "anim\0", 5) == 0) {
-				GRID_ANIMATED = YES;
+				*GRID_ANIMATED = YES;
 				flag=n;
 				break;
 			} else
@@ -7225,88 +7277,102 @@ u8 GetFromP3T(char *src, char *file, char *dst)
 				break;
 			}
 		}
-		free(string_table);
-		
-		if(flag == 0) return FAILED;
-		
-		fseek(fp, 0x40, SEEK_SET);
-		
-		for(n=0; n < tree_table_size/4; n++){
-			fread(&temp, sizeof(u32), 1, fp);
-			if(temp==flag) {
-				fread(&temp, sizeof(u32), 1, fp);
-				if(temp==6) {
-					fread(&file_offset, sizeof(u32), 1, fp);
-					fread(&file_size_c, sizeof(u32), 1, fp);
+		if(flag == 0) return NULL;
+		
+		// walk the tree table like a stream of u32
+		u32 *tree = (u32 *) p3t->tables;
+		u32 tree_number = p3t->tables_size/4;
+		u32 temp=0;
+		n=0;
+		while(n < p3t->tree_table_size/4 && n < tree_number) {
+			temp = tree[n++];
+			if(temp==flag && n < tree_number) {
+				temp = tree[n++];
+				if(temp==6 && n + 2 <= tree_number) {
+					file_offset = tree[n];
+					*file_size_c = tree[n+1];
 					break;
 				}
 			}
 		}
-		if(temp != 6) return FAILED;
-	}
-	else if(strcmp(file, "name") == 0) {
-		fseek(fp, string_table_offset, SEEK_SET);
-		
-		u8 *string_table = (u8 *) malloc(string_table_size);
-		fread(string_table, string_table_size, 1, fp);
-		fclose(fp);
-		
-		unsigned int n;
-		for(n=0; n < string_table_size; n++){
-			if(memcmp((char *) &string_table[n], "name\0", 5) == 0) {
-				strcpy((char *) dst, (char *) &string_table[n+5]);
-				free(string_table);
-				return SUCCESS;
-			}
-		}
-		return FAILED;
+		if(temp != 6) return NULL;
 	}
 	else {
-		fseek(fp, ID_table_offset, SEEK_SET);
-		u32 file_tree_table_offset = 0;
-		u8 *ID_table = (u8 *) malloc(ID_table_size);
+		p3t_id key, *id;
+		key.name = file;
+		id = (p3t_id *) bsearch(&key, p3t->ids, p3t->ids_number, sizeof(p3t_id), p3t_id_cmp);
 		
-		fread(ID_table, ID_table_size, 1, fp);
-		
-		unsigned int n;
-		for(n=0; n < ID_table_size; n++){
-			if(memcmp((char *) &ID_table[n], (char *) file, strlen(file)) == 0 && memcmp((char *) &ID_table[n+strlen(file)], "\0", 1) == 0) {
-				memcpy(&file_tree_table_offset, &ID_table[n-4], 4);
-				file_tree_table_offset += tree_table_offset;
-				break;
-			}
-		}
-		
-		free(ID_table);
-		
-		if(file_tree_table_offset<=tree_table_offset) {
-			fclose(fp);
+		u8 *entry = NULL;
+		if(id) entry = p3t_table(p3t, p3t->tree_table_offset + id->tree_offset + 0x24, 8);
+		if(entry == NULL) {
 			print_load("Error : File not found in ID_table");	
-			return FAILED;
+			return NULL;
 		}
-		
-		fseek(fp, file_tree_table_offset + 0x24, SEEK_SET);
-		fread(&file_offset, sizeof(u32), 1, fp);
-		fread(&file_size_c, sizeof(u32), 1, fp);
-		
+		memcpy(&file_offset, &entry[0], 4);
+		memcpy(file_size_c, &entry[4], 4);
 	}
 	
-	file_offset += file_table_offset;
-	
-	fseek(fp, file_offset, SEEK_SET);
-	
-	char *file_data_c = (char *) malloc(file_size_c);
+	char *file_data_c = (char *) malloc(*file_size_c);
 	if(!file_data_c) {
 		print_load("Error : failed to malloc file_size_c");
+		return NULL;
+	}
+	
+	fseek(p3t->fp, p3t->file_table_offset + file_offset, SEEK_SET);
+	if(fread(file_data_c, *file_size_c, 1, p3t->fp) != 1) {
+		print_load("Error : failed to read %s", file);
+		free(file_data_c);
+		return NULL;
+	}
+	
+	return file_data_c;
+}
+
+// compressed GIM -> PNG without going through a temporary .gim file
+u8 p3t_gim_to_png(char *file_data_c, u32 file_size_c, char *dst)
+{
+	void* file_data_d;
+	imgData gimData;
+	
+	int file_size_d = uncompressGIMBuffer(file_data_c, file_size_c, &file_data_d);
+	if(file_size_d <= 0) {
+		print_load("Error : failed to uncompress gim");
 		return FAILED;
 	}
 	
-	fread(file_data_c, file_size_c, 1, fp);
-	fclose(fp);
+	if( gimLoadFromBuffer(file_data_d, file_size_d, &gimData) != 0) {
+		freeGIMBuffer(file_data_d);
+		print_load("Error : to convert gim to png");
+		return FAILED;
+	}
+	freeGIMBuffer(file_data_d);
+	
+	u8 ret = make_png(dst, gimData);
+	free(gimData.bmp_out);
+	
+	if(ret == FAILED) print_load("Error : cannot write file %s", dst);
+	
+	return ret;
+}
 
+u8 p3t_extract(p3t_t *p3t, char *file, char *dst)
+{
+	u32 file_size_c;
+	u8 GRID_ANIMATED;
+	FILE* fp;
+	
+	if(strcmp(file, "name") == 0) return p3t_get_name(p3t, dst);
+	
+	char *file_data_c = p3t_read_file(p3t, file, &file_size_c, &GRID_ANIMATED);
+	if(file_data_c == NULL) return FAILED;
+	
 	if(strcmp(file, "background") == 0) {
 		if(GRID_ANIMATED == NO) {
 			fp=fopen(dst, "wb");
+			if(fp==NULL) {
+				free(file_data_c);
+				return FAILED;
+			}
 			fwrite(file_data_c, file_size_c, 1, fp);
 			fclose(fp);
 			free(file_data_c);
@@ -7353,34 +7419,146 @@ u8 GetFromP3T(char *src, char *file, char *dst)
 				
 			} else free(RAF_data);
 		}
+		return SUCCESS;
 	}
-	else {
-		void* file_data_d;
-		file_size_d = uncompressGIMBuffer(file_data_c, file_size_c, &file_data_d);	
-		free(file_data_c);
-		
-		// .gim to .png
-		char gim[128];
-		strcpy(gim, dst);
-		RemoveExtension(gim);
-		strcat(gim, ".gim");
-		fp=fopen(gim, "wb");
+	
+	u8 ret = p3t_gim_to_png(file_data_c, file_size_c, dst);
+	free(file_data_c);
+	
+	return ret;
+}
 
-		if(fp==NULL) {
-			print_load("Error : cannot write file %s", dst);
-			return FAILED;
-		}
-		fwrite(file_data_d, file_size_d, 1, fp);
-		fclose(fp);
+u8 GetFromP3T(char *src, char *file, char *dst)
+{
+	p3t_t *p3t = p3t_open(src);
+	if(p3t == NULL) return FAILED;
+	
+	u8 ret = p3t_extract(p3t, file, dst);
+	
+	p3t_close(p3t);
+	
+	return ret;
+}
+
+// *** parallel GIM conversion ***
+// the compressed icons are read from the P3T by the caller, the workers only
+// uncompress/decode/encode, so the theme file is never read concurrently.
+
+#define P3T_CONVERT_THREADS	2
+
+typedef struct
+{
+	char *file_data_c;
+	u32 file_size_c;
+	char dst[255];
+	u8 ret;
+} p3t_job;
+
+static p3t_job *p3t_jobs;
+static u32 p3t_jobs_number;
+static u32 p3t_jobs_next;
+static sys_lwmutex_t p3t_jobs_lock;
+
+static void p3t_convert_thread(void *unused)
+{
+	while(1) {
+		sysLwMutexLock(&p3t_jobs_lock, 0);
+		u32 i = p3t_jobs_next++;
+		sysLwMutexUnlock(&p3t_jobs_lock);
 		
-		if( gim2png((char *) gim, (char *) dst) == false) {
-			print_load("Error : to convert gim to png");
-			return FAILED;
-		} 
-		remove(gim);
+		if(p3t_jobs_number <= i) break;
 		
+		p3t_jobs[i].ret = p3t_gim_to_png(p3t_jobs[i].file_data_c, p3t_jobs[i].file_size_c, p3t_jobs[i].dst);
 	}
+	sysThreadExit(0);
+}
 
+void p3t_convert(p3t_job *jobs, u32 jobs_number)
+{
+	static const sys_lwmutex_attr_t attr = {
+		SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""
+	};
+	sys_ppu_thread_t id[P3T_CONVERT_THREADS];
+	u8 started[P3T_CONVERT_THREADS];
+	u64 ret;
+	int i;
+	
+	p3t_jobs = jobs;
+	p3t_jobs_number = jobs_number;
+	p3t_jobs_next = 0;
+	sysLwMutexCreate(&p3t_jobs_lock, &attr);
+	
+	for(i=0; i<P3T_CONVERT_THREADS; i++) {
+		started[i] = (sysThreadCreate(&id[i], p3t_convert_thread, NULL, 1000, 0x10000, THREAD_JOINABLE, "p3t_convert") == 0);
+	}
+	
+	// couldn't start any thread, do it here
+	if(started[0] == NO) {
+		u32 j;
+		for(j=0; j<jobs_number; j++) {
+			jobs[j].ret = p3t_gim_to_png(jobs[j].file_data_c, jobs[j].file_size_c, jobs[j].dst);
+		}
+	}
+	
+	for(i=0; i<P3T_CONVERT_THREADS; i++) {
+		if(started[i]) sysThreadJoin(id[i], &ret);
+	}
+	
+	sysLwMutexDestroy(&p3t_jobs_lock);
+}
+
+// *** theme name cache ***
+// GetThemes is called at each device hotplug, the name of a P3T is only parsed
+// again if the file changed.
+
+#define P3T_NAME_CACHE_MAX	MAX_THEME
+
+typedef struct
+{
+	char path[255];
+	u64 size;
+	time_t mtime;
+	char name[128];
+} p3t_name_cache;
+
+static p3t_name_cache *p3t_names=NULL;
+static u32 p3t_names_number=0;
+
+u8 GetP3TName(char *path, char *name)
+{
+	struct stat s;
+	u32 i;
+	
+	if(stat(path, &s) != 0) return FAILED;
+	
+	for(i=0; i<p3t_names_number; i++) {
+		if(strcmp(p3t_names[i].path, path) == 0) {
+			if(p3t_names[i].size == s.st_size && p3t_names[i].mtime == s.st_mtime) {
+				strcpy(name, p3t_names[i].name);
+				return SUCCESS;
+			}
+			break;
+		}
+	}
+	
+	char tmp[255]={0};
+	if(GetFromP3T(path, "name", tmp) == FAILED) return FAILED;
+	tmp[127]=0;
+	strcpy(name, tmp);
+	
+	if(p3t_names == NULL) {
+		p3t_names = (p3t_name_cache *) malloc(P3T_NAME_CACHE_MAX * sizeof(p3t_name_cache));
+		if(p3t_names == NULL) return SUCCESS;
+	}
+	if(i == p3t_names_number) {
+		if(P3T_NAME_CACHE_MAX <= p3t_names_number) return SUCCESS;
+		p3t_names_number++;
+	}
+	strcpy(p3t_names[i].path, path);
+	p3t_names[i].size = s.st_size;
+	p3t_names[i].mtime = s.st_mtime;
+	strcpy(p3t_names[i].name, tmp);
+	
 	return SUCCESS;
 }
 
@@ -7626,7 +7804,7 @@ void GetThemes()
 			if(ThemeType == P3T) {
 			
 				sprintf(TempPath, "%s/%s", THM_path, dir->d_name);
-				ret = GetFromP3T(TempPath, "name", TempName);
+				ret = GetP3TName(TempPath, TempName);
 				if(ret==FAILED) {
 					memcpy(TempName, dir->d_name, strlen(dir->d_name)-4);
 				}
@@ -7672,6 +7850,7 @@ u8 InstallTheme()
 {
 	char folder[255];
 	u8 ret=SUCCESS;
+	u32 i, j;
 	
 	if(strstr(Themes_Paths_list[UI_position][Themes_position[UI_position]], "dev_hdd0") != NULL) {
 		strcpy(Themes[UI_position], Themes_Names_list[UI_position][Themes_position[UI_position]]);
@@ -7727,27 +7906,52 @@ u8 InstallTheme()
 		
 		char dst[255];
 		if(UI_position == XMB) {
+			// XMB column -> P3T icon, icon_game is used by 3 columns
+			char *icons[6] = {"icon_setting", "icon_playermet", "icon_game", "icon_game", "icon_game", "icon_remoteplay"};
+			p3t_job jobs[6];
+			u32 jobs_number=0;
+			int last_job=-1;
+			
+			p3t_t *p3t = p3t_open(tmp);
+			if(p3t == NULL) ret=FAILED;
+			
+			if(p3t != NULL) {
+				for(i=0; i<6; i++) {
+					u8 GRID_ANIMATED;
 					
-			sprintf(dst, "%s/%s.PNG", folder, XMB_COLUMN_NAME[0]);
-			ret=GetFromP3T(tmp, "icon_setting", dst);
-			
-			sprintf(dst, "%s/%s.PNG", folder, XMB_COLUMN_NAME[1]);
-			ret=GetFromP3T(tmp, "icon_playermet", dst);
-			
-			sprintf(dst, "%s/%s.PNG", folder, XMB_COLUMN_NAME[2]);
-			ret=GetFromP3T(tmp, "icon_game", dst);
-			
-			sprintf(dst, "%s/%s.PNG", folder, XMB_COLUMN_NAME[3]);
-			ret=GetFromP3T(tmp, "icon_game", dst);
-			
-			sprintf(dst, "%s/%s.PNG", folder, XMB_COLUMN_NAME[4]);
-			ret=GetFromP3T(tmp, "icon_game", dst);
-			
-			sprintf(dst, "%s/%s.PNG", folder, XMB_COLUMN_NAME[5]);
-			ret=GetFromP3T(tmp, "icon_remoteplay", dst);
-			
-			sprintf(dst, "%s/BG.JPG", folder);
-			GetFromP3T(tmp, "background", dst); // pas de ret car facultatif
+					if(0 < i && strcmp(icons[i], icons[i-1]) == 0) continue;
+					
+					sprintf(jobs[jobs_number].dst, "%s/%s.PNG", folder, XMB_COLUMN_NAME[i]);
+					jobs[jobs_number].file_data_c = p3t_read_file(p3t, icons[i], &jobs[jobs_number].file_size_c, &GRID_ANIMATED);
+					jobs[jobs_number].ret = FAILED;
+					if(jobs[jobs_number].file_data_c == NULL) continue;
+					if(i==5) last_job = jobs_number;
+					jobs_number++;
+				}
+				
+				p3t_convert(jobs, jobs_number);
+				
+				for(j=0; j<jobs_number; j++) {
+					free(jobs[j].file_data_c);
+				}
+				// like before, only the last icon decides
+				if(last_job < 0) ret=FAILED;
+				else ret=jobs[last_job].ret;
+				
+				// same icon for the following columns
+				for(i=1; i<6; i++) {
+					if(strcmp(icons[i], icons[i-1]) != 0) continue;
+					char prev[255];
+					sprintf(prev, "%s/%s.PNG", folder, XMB_COLUMN_NAME[i-1]);
+					sprintf(dst, "%s/%s.PNG", folder, XMB_COLUMN_NAME[i]);
+					Copy(prev, dst);
+				}
+				
+				sprintf(dst, "%s/BG.JPG", folder);
+				p3t_extract(p3t, "background", dst); // pas de ret car facultatif
+				
+				p3t_close(p3t);
+			}
 			
 			Delete(tmp);
 		}
@@ -8242,9 +8446,42 @@ void LoadThemeColorSet()
 	if(OLD_FILTER_BG != FILTER_BG) ReloadTheme(_BG_);
 }
 
-u8 LoadTexture(char *texture_path, u32 *texture_offset, imgData *texture_data, u32 *texture_size, u8 gray)
+// the GIM are decoded straight in the texture memory
+u8 gimLoadTexture(char *texture_path, u32 *texture_offset, imgData *texture_data, u32 *texture_size)
 {
+	int file_size;
+	u32 width, height;
+	
+	u8 *buff = (u8 *) LoadFile(texture_path, &file_size);
+	if( buff == NULL ) return FAILED;
+	
+	if( gimGetInfo(buff, file_size, &width, &height) != 0
+	||  gimDecode(buff, file_size, (u8 *) texture_pointer, width*4) != 0 ) {
+		free(buff);
+		return FAILED;
+	}
+	free(buff);
+	
+	(*texture_data).bmp_out = NULL;
+	(*texture_data).width = width;
+	(*texture_data).height = height;
+	(*texture_data).pitch = width*4;
+	
+	*texture_offset = tiny3d_TextureOffset(texture_pointer);
+	
+	texture_pointer += ((width * 4 * height + 15) & ~15) / 4;
+	
+	if(texture_size != NULL) *texture_size += ((width * 4 * height + 15) & ~15) / 4;
+	
+	return SUCCESS;
+}
 
+u8 LoadTexture(char *texture_path, u32 *texture_offset, imgData *texture_data, u32 *texture_size, u8 gray)
+{
+	if( gray == NO && strcasecmp(get_ext(texture_path), ".gim") == 0 ) {
+		if( gimLoadTexture(texture_path, texture_offset, texture_data, texture_size) == SUCCESS ) return SUCCESS;
+	}
+	
 	if( imgLoadFromFile(texture_path, texture_data, gray) == FAILED ) { 
 		*texture_offset=0;
 		return FAILED;
@@ -8302,6 +8539,7 @@ void ReloadTheme(u8 i)
 	gray = NO;
 	
 	if(i == _BG_) {
+		free_ABG();
 		sprintf(temp, "%s/BG.PNG", thmPath);
 		if(is_apng(temp) == YES) {
 			Load_ANIMATED_BG(temp);
@@ -8339,6 +8577,8 @@ void Load_Theme()
 	
 	AddThemeColorSet();
 	
+	free_ABG();
+	
 	texture_pointer = texture_mem + TEXTURE_POINTER_THEME;
 	
 	memset(PICTURE_offset, 0, sizeof(PICTURE_offset));
@@ -8553,7 +8793,7 @@ void LOAD_COVER()
 	if(Show_COVER == NO) return;
 	if(position_CURPIC<0) return;
 
-	if(Read_GAMEPIC_COVER2D(position, &COVER) == SUCCESS) {
+	if(Read_GAMEPIC_COVER2D(position, &COVER, TEXTURE_COVER_SIZE_MAX*4) == SUCCESS) {
 		texture_pointer = texture_mem + TEXTURE_POINTER_COVER;
 		memcpy(texture_pointer, COVER.bmp_out, COVER.pitch*COVER.height);
 		free(COVER.bmp_out);
@@ -8782,6 +9022,10 @@ void Draw_Waves(u32 wav_color)
 	
 	int j=1;
 	int x;
+	
+	// moved every frame
+	Redraw_Animate(0);
+	
 	for(i=0; i<WAVES_NUMBER; i++) {
 		
 		tiny3d_SetPolygon(TINY3D_QUAD_STRIP);
@@ -8864,7 +9108,7 @@ void Draw_BG()
 	if(MENU==YES && MENU_SIDE == NO) return;
 	
 	u32 color = WHITE;
-	if(BG_offset[1] != 0 ) { // Animated
+	if(BG_stream != NULL) { // Animated
 		if(FILTER_BG==ENABLED) color = COLOR_BG;
 		
 		Draw_ABG(color);
@@ -8895,7 +9139,7 @@ void Draw_BGS()
 		Draw_Box(0, 0, 1000, 0, 848, 512, color, YES);
 		
 	} else 
-	if(BG_offset[1] != 0 ) { // Animated
+	if(BG_stream != NULL) { // Animated
 		if(FILTER_BGS==ENABLED) color=COLOR_BGS; else
 		if(FILTER_BG==ENABLED) color=COLOR_BG;
 		
@@ -9864,6 +10108,7 @@ void Draw_Notification()
 {
 	if(not_msg[0] == 0)	return;
 	time_not++;
+	Redraw_Animate(0);
 	if(time_not > 100) {
 		time_not=0; 
 		memset(not_msg, 0, sizeof(not_msg));
@@ -9888,10 +10133,13 @@ void show_msg(char *str)
 {
 	time_not=0;
 	strcpy(not_msg, str);
+	Redraw_Invalidate();
 }
 
 void DrawLoadingIcon()
 {
+	Redraw_Animate(0);
+	
 	if(LoadIconRot==720) LoadIconRot=360;
 	
 	float t;	
@@ -10379,14 +10627,28 @@ void Draw_Loading(void *unused)
 
 FILE *mgz_log=NULL;
 static char buff[4096];
-void print_load(char *format, ...)
+static sys_lwmutex_t print_load_lock;
+static u8 print_load_lock_init=NO;
+// 'level' : 0 message, 1 warning, 2 error
+static void print_load_level(u8 level, char *format, va_list opt)
 {	
 	char *str = (char *) buff;
-	va_list	opt;
+	u32 wait=0;
+	
+	// the RCO dumper calls it from its worker threads
+	if( print_load_lock_init == NO ) {
+		static const sys_lwmutex_attr_t attr = {
+			SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""
+		};
+		sysLwMutexCreate(&print_load_lock, &attr);
+		print_load_lock_init = YES;
+	}
+	sysLwMutexLock(&print_load_lock, 0);
+	
+	if( level == 1 ) WAR = TRUE;
+	if( level == 2 ) ERR = TRUE;
 	
-	va_start(opt, format);
 	vsprintf( (void *) buff, format, opt);
-	va_end(opt);
 	
 	int i;
 	for(i=19; i>0; i--){
@@ -10401,8 +10663,8 @@ void print_load(char *format, ...)
 	} else strcpy(loading_log[0], str);
 	
 	time_not=1;
-	if(strstr(loading_log[0], "Warning ")) sleep(1);
-	if(strstr(loading_log[0], "Error ")) sleep(2);
+	if(strstr(loading_log[0], "Warning ")) wait=1;
+	if(strstr(loading_log[0], "Error ")) wait=2;
 	
 	ERR = FALSE;
 	WAR = FALSE;
@@ -10419,12 +10681,43 @@ void print_load(char *format, ...)
 		}
 	}
 	
+	sysLwMutexUnlock(&print_load_lock);
+	
+	// the other threads can print while this one waits
+	if( wait ) sleep(wait);
+	
 	// If it freeze, it allow to display every messages before the freeze (loading screen thread is async)
 	if( DEBUG ) {
 		if( loading ) sleep(1);
 		else if( LOG ) usleep(100); // just to be sure it's logged if we are not on a loading screen
 	}
+}
+
+void print_load(char *format, ...)
+{
+	va_list	opt;
+	
+	va_start(opt, format);
+	print_load_level(0, format, opt);
+	va_end(opt);
+}
 
+void print_load_warning(char *format, ...)
+{
+	va_list	opt;
+	
+	va_start(opt, format);
+	print_load_level(1, format, opt);
+	va_end(opt);
+}
+
+void print_load_error(char *format, ...)
+{
+	va_list	opt;
+	
+	va_start(opt, format);
+	print_load_level(2, format, opt);
+	va_end(opt);
 }
 
 static char buff2[4096];
@@ -10670,11 +10963,43 @@ char *get_date()
 	return date;
 }
 
+u64 get_usec()
+{
+	u64 sec, nsec;
+	sysGetCurrentTime(&sec, &nsec);
+	
+	return sec * 1000000 + nsec / 1000;
+}
+
+// a button or a stick in use : the frames must be drawn
+void Redraw_Input()
+{
+	if(!pad_alive) return;
+	
+	if(old_pad
+	|| 28 < abs(paddata.button[4] - 128) || 28 < abs(paddata.button[5] - 128)
+	|| 28 < abs(paddata.button[6] - 128) || 28 < abs(paddata.button[7] - 128)) Redraw_Invalidate();
+}
+
+static u64 fps_last = 0;
+static float fps = 0;
+
+// called by cls() at the beginning of each frame
+void update_fps()
+{
+	u64 now = get_usec();
+	
+	if(fps_last != 0 && fps_last < now) {
+		float f = 1000000.0f / (float) (now - fps_last);
+		if(fps == 0) fps = f;
+		else fps = fps * 0.9f + f * 0.1f;
+	}
+	fps_last = now;
+}
+
 float get_fps()
 {
-	// TimeVal	time = FWTime::getCurrentTime();
-	// float fFPS = 1.f / (float)(time - mLastTime);
-	// mLastTime = time;
+	return fps;
 }
 
 //*******************************************************
@@ -12478,201 +12803,10 @@ error:
 	return ret;
 }
 
-//*******************************************************
-// RAR
-//*******************************************************
-
-u8 ExtractRar(const char* RarFile, char *dstPath)
-{
-	
-	HANDLE hArcData; //Archive Handle
-	struct RAROpenArchiveDataEx rarOpenArchiveData;
-    struct RARHeaderDataEx rarHeaderData;
-    memset(&rarOpenArchiveData, 0, sizeof(rarOpenArchiveData));
-    memset(&rarHeaderData, 0, sizeof(rarHeaderData));
-
-    rarOpenArchiveData.ArcName = (char*) RarFile;
-    rarOpenArchiveData.CmtBuf = NULL;
-    rarOpenArchiveData.CmtBufSize = 0;
-    rarOpenArchiveData.OpenMode = RAR_OM_EXTRACT;
-    hArcData = RAROpenArchiveEx(&rarOpenArchiveData);
-    
-    print_load("UnRAR [%s]", RarFile);
-     
-    if(rarOpenArchiveData.OpenResult != ERAR_SUCCESS) {   
-        print_load("OpenArchive '%s' Failed!", rarOpenArchiveData.ArcName);
-        return FAILED;   
-    }   
-      
-    while (RARReadHeaderEx(hArcData, &rarHeaderData) == ERAR_SUCCESS) {   
-        print_load("Extracting '%s' (%ld) ...", rarHeaderData.FileName, rarHeaderData.UnpSize + (((uint64_t)rarHeaderData.UnpSizeHigh) << 32));
-		
-        if (RARProcessFile(hArcData, RAR_EXTRACT, dstPath, NULL) != ERAR_SUCCESS) {   
-            print_load("ERROR: UnRAR Extract Failed!");
-            return FAILED;
-        }   
-    }
-
-    RARCloseArchive(hArcData);
-	
-	return SUCCESS;
-}
-
 //*******************************************************
 // ZIP
 //*******************************************************
 
-u8 ExtractZip(char* ZipFile, char *dstFolder)
-{
-	char FileOUT[255];
-
-	int err=0;
-	struct zip *f_zip=NULL;
-	
-	mkdir(dstFolder, 0777);
-	
-	f_zip = zip_open(ZipFile, ZIP_CHECKCONS, &err);
-	if(err != ZIP_ER_OK || f_zip==NULL)
-	{
-		print_load("Error : zip_open");
-		return FAILED;
-	}
-
-	int count = zip_get_num_files(f_zip);
-	if(count==-1)
-	{
-		print_load("Error : zip_get_num_files");
-		zip_close(f_zip);
-		return FAILED;
-	}
-	
-	prog_bar1_value = 0;
-	int i;
-	for(i=0; i<count; i++)
-	{
-		prog_bar1_value = (i*100)/count;
-		
-		struct zip_stat file_stat;
-		struct zip_file* file_zip=NULL;
-		
-		zip_stat_index(f_zip, i, 0, &file_stat);
-		
-		if(zip_stat(f_zip, file_stat.name, 0, &file_stat) == -1)
-		{
-			print_load("Error : zip_stat");
-			zip_close(f_zip);
-			return FAILED;
-		}
-		
-		print_load((char*)file_stat.name);
-		
-		sprintf(FileOUT, "%s/%s", dstFolder, file_stat.name);
-		
-		if(FileOUT[strlen(FileOUT)-1]=='/') {
-			FileOUT[strlen(FileOUT)-1]=0;
-			mkdir(FileOUT, 0777);
-			continue;
-		}
-		
-		file_zip=zip_fopen(f_zip, file_stat.name, ZIP_FL_UNCHANGED);
-		if(!file_zip)
-		{
-			print_load("Error : zip_fopen");
-			zip_close(f_zip);
-			return FAILED;
-		}
-		
-		u64 pos = 0ULL;
-		u64 read = 0, writed = 0;
-		FILE* f;
-		
-		prog_bar2_value=0;
-		
-		f = fopen(FileOUT, "wb");
-		if(f==NULL) {
-			zip_fclose(file_zip);
-			zip_close(f_zip);
-			return FAILED;
-		}
-
-		SetFilePerms(FileOUT);
-
-		int mem_size = 0x1000;
-		char *mem = malloc(mem_size);
-
-		while(pos < file_stat.size) {
-			
-			if(cancel==YES) {
-				zip_fclose(file_zip);
-				zip_close(f_zip);
-				fclose(f);
-				free(mem);
-				return FAILED;
-			}
-			
-			read = file_stat.size - pos; if(read > mem_size) read = mem_size;
-			
-			writed = zip_fread(file_zip, mem, (size_t) read);
-			if(writed<0) {
-				zip_fclose(file_zip);
-				zip_close(f_zip);
-				fclose(f);
-				free(mem);
-				return FAILED;
-			}
-			
-			if(copy_cancel==YES) {
-				zip_fclose(file_zip);
-				zip_close(f_zip);
-				fclose(f);
-				free(mem);
-				return FAILED;
-			}
-			
-			if(read != writed) {
-				zip_fclose(file_zip);
-				zip_close(f_zip);
-				fclose(f);
-				free(mem);
-				return FAILED;
-			}
-			
-			writed = fwrite(mem, 1, read, f);
-			if(writed<0) {
-				zip_fclose(file_zip);
-				zip_close(f_zip);
-				fclose(f);
-				free(mem);
-				return FAILED;
-			}
-			
-			if(read != writed) {
-				zip_fclose(file_zip);
-				zip_close(f_zip);
-				fclose(f);
-				free(mem);
-				return FAILED;
-			}
-			
-			pos += read;
-			
-			prog_bar2_value=pos*100/file_stat.size;
-		}
-		fclose(f);
-		zip_fclose(file_zip);
-		
-		free(mem);
-		
-	}
-		
-	prog_bar1_value = -1;
-	prog_bar2_value = -1;
-	
-	zip_close(f_zip);
-
-	return SUCCESS;
-}
-
 u8 ExtractZipFile(char* ZipFile, char* File, char* out)
 {
 
@@ -12680,6 +12814,10 @@ u8 ExtractZipFile(char* ZipFile, char* File, char* out)
 	struct zip *f_zip=NULL;
 	int err=0;
 
+	int ret = zip_extract_file(ZipFile, File, out);
+	if(ret == ZIP_EXTRACT_OK) return SUCCESS;
+	if(ret != ZIP_EXTRACT_UNSUPPORTED) return FAILED;
+
 	f_zip=zip_open(ZipFile, ZIP_CHECKCONS, &err);
 	/* s'il y a des erreurs */
 	if(err != ZIP_ER_OK || f_zip==NULL)
@@ -12698,16 +12836,14 @@ u8 ExtractZipFile(char* ZipFile, char* File, char* out)
 	
 	struct zip_stat file_stat;
 	struct zip_file* file_zip=NULL;
-	zip_stat_index(f_zip, id, 0, &file_stat);
-
-	if(zip_stat(f_zip, file_stat.name, 0, &file_stat) == -1)
+	if(zip_stat_index(f_zip, id, 0, &file_stat) == -1)
 	{
-		print_load("Error : zip_stat");
+		print_load("Error : zip_stat_index");
 		zip_close(f_zip);
 		return FAILED;
 	}
 
-	file_zip=zip_fopen(f_zip, file_stat.name, ZIP_FL_UNCHANGED);
+	file_zip=zip_fopen_index(f_zip, id, ZIP_FL_UNCHANGED);
 
 	if(!file_zip)
 	{
@@ -12748,22 +12884,6 @@ u8 ExtractZipFile(char* ZipFile, char* File, char* out)
 	return SUCCESS;
 }
 
-//*******************************************************
-// 7Z
-//*******************************************************
-
-void Callback_7z(const char* fileName, unsigned long fileSize, unsigned fileNum, unsigned numFiles)
-{
-    print_load("[%d/%d] File: %s Size: %ld\n", fileNum, numFiles, fileName, fileSize);
-}
-
-u8 Extract7z(char *src, char *dst)
-{
-	if( Extract7zFileEx(src, dst, &Callback_7z, DEFAULT_IN_BUF_SIZE) == 0) return SUCCESS;
-	
-	return FAILED;
-}
-
 //*******************************************************
 // ARCHIVE
 //*******************************************************
@@ -12781,27 +12901,79 @@ u8 is_archive(char *ext)
 	return NO;
 }
 
-u8 ExtractArchive(char *ArchFile)
+static u8 ExtractArchive_progress(archive_status *status, void *arg)
 {
-	char *ext = GetExtension(ArchFile);
+	if(status->files) {
+		prog_bar1_value = (status->files_done*100)/status->files;
+		if(status->total) prog_bar2_value = (status->done*100)/status->total;
+	} else
+	if(status->size) {
+		// tar : the number of files is unknown before the end
+		prog_bar1_value = (status->read*100)/status->size;
+		prog_bar2_value = -1;
+	}
 	
+	snprintf(head_title, sizeof(head_title), "Extracting archive... %d KB/s", (int) (status->speed/1024));
+	
+	if(cancel==YES || copy_cancel==YES) return NO;
+	
+	return YES;
+}
+
+u8 ExtractArchive(char *ArchFile)
+{
 	char DirName[255];
 	
 	strcpy(DirName, ArchFile);
 	RemoveExtension(DirName);
-	mkdir(DirName, 0777);
+	if( strcmp(DirName, ArchFile) == 0 ) strcat(DirName, "_");
+	
+	prog_bar1_value = 0;
+	prog_bar2_value = 0;
 	
-	if(	!strcasecmp(ext, ".zip") ) return ExtractZip(ArchFile, DirName);
-	if( !strcasecmp(ext, ".rar") ) return ExtractRar(ArchFile, DirName);
-	if( !strcasecmp(ext, ".7z") ) return Extract7z(ArchFile, DirName);
-	if( !strcasecmp(ext, ".tar.bz2") ) return !untar_bz2(ArchFile, DirName);
-	if( !strcasecmp(ext, ".tar.gz") ) return !untar_gz(ArchFile, DirName);
-	if( !strcasecmp(ext, ".tgz") ) return !untar_gz(ArchFile, DirName);
-	if( !strcasecmp(ext, ".tar") ) return !untar(ArchFile, DirName);
+	int ret = archive_extract(ArchFile, DirName, NULL, 0, ExtractArchive_progress, NULL);
+	
+	prog_bar1_value = -1;
+	prog_bar2_value = -1;
+	
+	if(ret == ARCHIVE_OK) return SUCCESS;
 	
 	return FAILED;
 }
 
+u8 archive_list_txt(char *ArchFile)
+{
+	archive_entry *entries;
+	u32 number;
+	u64 total=0;
+	u32 i;
+	
+	mkdir("/dev_hdd0/tmp", 0777);
+	
+	if( archive_list(ArchFile, &entries, &number) != ARCHIVE_OK ) return FAILED;
+	
+	FILE *txt = fopen("/dev_hdd0/tmp/archive_list.txt", "wb");
+	if(txt == NULL) {
+		print_load("Error : cannot create archive_list.txt");
+		archive_list_free(entries, number);
+		return FAILED;
+	}
+	
+	fprintf(txt, "%s archive : %s\n\n", archive_format_name(archive_format(ArchFile)), &strrchr(ArchFile, '/')[1]);
+	
+	for(i=0; i<number; i++) {
+		if(entries[i].dir) fprintf(txt, "%12s  %s\n", "<DIR>", entries[i].name);
+		else fprintf(txt, "%12llu  %s\n", (long long unsigned int) entries[i].size, entries[i].name);
+		total += entries[i].size;
+	}
+	
+	fprintf(txt, "\n%d entries, %llu bytes\n", number, (long long unsigned int) total);
+	
+	fclose(txt);
+	archive_list_free(entries, number);
+	
+	return SUCCESS;
+}
 
 //*******************************************************
 //NTFS
@@ -12826,11 +12998,13 @@ int NTFS_Test_Device(char *name)
 void NTFS_mount_all()
 {
 	u8 i;
+	delete_purge_stop();
 	for (i = 0; i < mountCount; i++) ntfsUnmount(mounts[i].name, 1);
 	
 	mounts = NULL;
 	mountCount = 0;
 	mountCount = ntfsMountAll(&mounts, NTFS_SU | NTFS_FORCE);
+	MGZ_mount_invalidate();
 	if(mountCount < 0) print_load("Error : ntfsMountAll failed	%d", mountCount);
 
 }
@@ -13065,55 +13239,65 @@ u32 crc_file(char *path)
 // Game OPTION
 //*******************************************************
 
-void get_hash(FILE* log, int hash_type, char *path)
+typedef struct
 {
-	u8 info = path_info(path);
-	char str[255];
+	FILE *log;
+	int hash_type;
+} hash_walk;
+
+static int get_hash_file(walk_entry *e, void *arg)
+{
+	hash_walk *hw = (hash_walk *) arg;
+	char str[128];
 	
-	if( info == _NOT_EXIST) return; else
-	if( info == _FILE) {
-		
-		print_load(&strrchr(path, '/')[1]);
-		if(hash_type == MD5_HASH) {
-			u64 res[2];
-			md5_file(path, (u8 *) res);	
-			sprintf(str, "%016llX%016llX  %s\n", (long long unsigned int) res[0], (long long unsigned int) res[1], &strrchr(path, '/')[1]);
-			fputs(str, log);
-			return;
-		} else
-		if(hash_type == SHA1_HASH) {
-			u32 res[5];
-			sha1_file(path, (u8 *) res);
-			sprintf(str, "%08lX%08lX%08lX%08lX%08lX  %s\n",
-			(long unsigned int) res[0],(long unsigned int) res[1],(long unsigned int) res[2],
-			(long unsigned int) res[3],(long unsigned int) res[4], &strrchr(path, '/')[1]);
-			fputs(str, log);
-			return;
-		}
-	}
+	print_load("%s", e->name);
+	if(hw->hash_type == MD5_HASH) {
+		u64 res[2];
+		md5_file(e->path, (u8 *) res);	
+		sprintf(str, "%016llX%016llX  ", (long long unsigned int) res[0], (long long unsigned int) res[1]);
+	} else
+	if(hw->hash_type == SHA1_HASH) {
+		u32 res[5];
+		sha1_file(e->path, (u8 *) res);
+		sprintf(str, "%08lX%08lX%08lX%08lX%08lX  ",
+		(long unsigned int) res[0],(long unsigned int) res[1],(long unsigned int) res[2],
+		(long unsigned int) res[3],(long unsigned int) res[4]);
+	} else return WALK_CONTINUE;
 	
-	sprintf(str, "\nPath : %s\n", path);
-	fputs(str, log);
+	fputs(str, hw->log);
+	fputs(e->name, hw->log);
+	fputs("\n", hw->log);
 	
-	char temp[255];
+	return WALK_CONTINUE;
+}
+
+static int get_hash_dir(walk_entry *e, void *arg)
+{
+	hash_walk *hw = (hash_walk *) arg;
 	
-	DIR *d;
-	struct dirent *dir;
+	fputs("\nPath : ", hw->log);
+	fputs(e->path, hw->log);
+	fputs("\n", hw->log);
 	
-	d = opendir(path);
-	if(d==NULL) return;
+	return WALK_CONTINUE;
+}
+
+// the files of a folder are listed under its path, before its subfolders
+void get_hash(FILE* log, int hash_type, char *path)
+{
+	hash_walk hw;
+	walk_visitor v;
 	
-	while ((dir = readdir(d))) {
-		if(!strcmp(dir->d_name, ".") || !strcmp(dir->d_name, "..")) continue;
-		
-		sprintf(temp, "%s/%s", path, dir->d_name);
+	hw.log = log;
+	hw.hash_type = hash_type;
 	
-		if(cancel==YES) break;
-		
-		get_hash(log, hash_type, temp);
-	}
-	closedir(d);
+	memset(&v, 0, sizeof(walk_visitor));
+	v.file = get_hash_file;
+	v.enter = get_hash_dir;
+	v.arg = &hw;
+	v.cancel = &cancel;
 	
+	walk(path, &v);
 }
 
 void HashFolder(int hash_type, char *dir)
@@ -13148,83 +13332,77 @@ void HashFolder(int hash_type, char *dir)
 	}
 }
 
-u64 get_size(char *path)
+// folders read at once by get_size
+#define GET_SIZE_THREADS	2
+
+typedef struct
 {
-	struct stat s;
+	u64 size;
+	sys_lwmutex_t lock;
+} size_walk;
+
+static int get_size_file(walk_entry *e, void *arg)
+{
+	size_walk *sw = (size_walk *) arg;
 	
-	if(stat(path, &s) != 0) {
-		print_load("Error : %s doesn't exist", path);
-		return 0;
-	} else 
-	if(!S_ISDIR(s.st_mode)) { //FILE
-		if(gathering) {
-			++gathering_nb_file;
-			gathering_total_size+=s.st_size;
-		}
-		return s.st_size;
+	sysLwMutexLock(&sw->lock, 0);
+	sw->size += e->size;
+	if(gathering) {
+		++gathering_nb_file;
+		gathering_total_size+=e->size;
 	}
+	sysLwMutexUnlock(&sw->lock);
 	
-	if(gathering_cancel==YES) return 0;
-	
-	if(gathering) ++gathering_nb_directory;
-	
-	u64 dir_size=0;
-	DIR *d;
-	struct dirent *dir;
-	
-	d = opendir(path);
-	if(d==NULL) return 0;
+	return WALK_CONTINUE;
+}
+
+static int get_size_dir(walk_entry *e, void *arg)
+{
+	size_walk *sw = (size_walk *) arg;
 	
-	while ((dir = readdir(d))) {
-		if(!strcmp(dir->d_name, ".") || !strcmp(dir->d_name, "..")) continue;
-		
-		char temp[255];
-		sprintf(temp, "%s/%s", path, dir->d_name);
-		
-		if(gathering_cancel==YES) return 0;
-		
-		dir_size += get_size(temp);		
+	if(gathering) {
+		sysLwMutexLock(&sw->lock, 0);
+		++gathering_nb_directory;
+		sysLwMutexUnlock(&sw->lock);
 	}
-	closedir(d);
 	
-	return dir_size;
+	return WALK_CONTINUE;
 }
 
-void Delete(char* path)
+u64 get_size(char *path)
 {
-	if(path==NULL) return;
+	size_walk sw;
+	walk_visitor v;
 	
-	DIR *d;
-	struct dirent *dir;
+	sw.size = 0;
+	sys_lwmutex_attr_t attr = {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""};
+	sysLwMutexCreate(&sw.lock, &attr);
 	
-	u8 info_file = path_info(path);
+	memset(&v, 0, sizeof(walk_visitor));
+	v.file = get_size_file;
+	v.enter = get_size_dir;
+	v.arg = &sw;
+	v.cancel = &gathering_cancel;
+	v.threads = GET_SIZE_THREADS;
 	
-	if(info_file == _NOT_EXIST) return; else
-	if(info_file == _FILE) {
-		unlink(path);
-		return;
-	} else if(info_file == _DIRECTORY) {
-		rmdir(path);
-	}
+	int ret = walk(path, &v);
 	
-	d = opendir(path);
-	if(d==NULL) return;
+	sysLwMutexDestroy(&sw.lock);
 	
-	while ((dir = readdir(d))) {
-		if(!strcmp(dir->d_name, ".") || !strcmp(dir->d_name, "..")) continue;
+	if(ret == WALK_ERROR) {
+		print_load("Error : %s doesn't exist", path);
+		return 0;
+	}
+	if(ret == WALK_CANCELED) return 0;
 	
-		char newpath[0x440];
+	return sw.size;
+}
 
-		strcpy(newpath, path);
-		strcat(newpath, "/");
-		strcat(newpath, dir->d_name);
-		
-		Delete(newpath);
-		
-	}
-	closedir(d);
-	rmdir(path);
+void Delete(char* path)
+{
+	if(path==NULL) return;
 	
+	delete_tree(path, DELETE_WORKERS_MAX, NULL, NULL);
 }
 
 int Delete_Game(char *path, int position)
@@ -13253,7 +13431,14 @@ int Delete_Game(char *path, int position)
 		}
 	} 
 	else {
-		Delete(game_path);
+		delete_stats stats;
+		// fast delete : the game leaves the device at once, its content is removed in background.
+		// The leftovers of a canceled copy are always removed here.
+		if(Fast_Delete && path == NULL) delete_trash(game_path, &stats);
+		else delete_tree(game_path, DELETE_WORKERS_MAX, NULL, &stats);
+		if(stats.trashed == NO && stats.files) {
+			print_load("%d files removed, %d files/s", stats.files, stats.files_per_sec);
+		}
 	}
 		
 	if(path != NULL) {
@@ -14238,7 +14423,11 @@ next_file:
 	if(f1==NULL) f1 = fopen(source, "rb");
 	if(f1==NULL) goto skip;
 	
-	if(f2==NULL) f2 = fopen(destination, "wb");
+	if(f2==NULL) {
+		f2 = fopen(destination, "wb");
+		// exFAT : the clusters of the destination are allocated at once
+		if(f2 && join==NO) MGZ_fexpand(f2, (split && SPLITSIZE < lenght - pos) ? SPLITSIZE : lenght - pos);
+	}
 	if(f2==NULL) goto skip;
 	
 	while(pos < lenght) {
@@ -14429,49 +14618,82 @@ void SpeedTest()
 	if(f) {fclose(f); f=NULL;}
 }
 
+typedef struct
+{
+	char *dst;
+	u32 src_len;
+	char *path;			// destination of the entry
+	u32 size;
+} copy_walk;
+
+// destination = dst + the path of the entry relative to src
+static char *copy_path(copy_walk *cw, char *src_path)
+{
+	char *rel = &src_path[cw->src_len];
+	u32 len = strlen(cw->dst) + strlen(rel) + 1;
+	
+	if(cw->size < len) {
+		char *path = (char *) realloc(cw->path, len);
+		if(path == NULL) return NULL;
+		cw->path = path;
+		cw->size = len;
+	}
+	sprintf(cw->path, "%s%s", cw->dst, rel);
+	
+	return cw->path;
+}
+
+static int copy_file_cb(walk_entry *e, void *arg)
+{
+	copy_walk *cw = (copy_walk *) arg;
+	
+	char *dst = copy_path(cw, e->path);
+	if(dst == NULL) return WALK_STOP;
+	
+	strncpy(copy_file, e->name, sizeof(copy_file)-1);
+	copy_file[sizeof(copy_file)-1]=0;
+	
+	if( CopyFile(e->path, dst) == FAILED) return WALK_STOP;
+	
+	return WALK_CONTINUE;
+}
+
+static int copy_dir_cb(walk_entry *e, void *arg)
+{
+	copy_walk *cw = (copy_walk *) arg;
+	
+	char *dst = copy_path(cw, e->path);
+	if(dst == NULL) return WALK_STOP;
+	
+	mkdir(dst, 0777);
+	
+	return WALK_CONTINUE;
+}
+
 u8 Copy(char *src, char *dst)
 {
 	
 	if(copy_cancel) return FAILED;
 	
-	u8 info_file = path_info(src);
+	copy_walk cw;
+	walk_visitor v;
 	
-	if(info_file == _NOT_EXIST) return FAILED; else
-	if(info_file == _FILE) {
-		char *tmp;
-		tmp = strrchr(src,'/');
-		tmp = &tmp[1];
-		strcpy(copy_file, tmp);
-		return CopyFile(src, dst);
-	}
-
-	char temp_src[255];
-	char temp_dst[255];
+	memset(&cw, 0, sizeof(copy_walk));
+	cw.dst = dst;
+	cw.src_len = strlen(src);
+	while(1 < cw.src_len && src[cw.src_len-1] == '/') cw.src_len--;
 	
-	if(path_info(dst) == _NOT_EXIST) mkdir(dst, 0777);
+	memset(&v, 0, sizeof(walk_visitor));
+	v.file = copy_file_cb;
+	v.enter = copy_dir_cb;
+	v.arg = &cw;
+	v.cancel = &copy_cancel;
 	
-	DIR *d;
-	struct dirent *dir;
-			
-	d = opendir(src);
-	if(d==NULL) return FAILED;
-			
-	while ((dir = readdir(d))) {
-		if(!strcmp(dir->d_name, ".") || !strcmp(dir->d_name, "..")) continue;
-		
-		sprintf(temp_src, "%s/%s", src, dir->d_name);
-		sprintf(temp_dst, "%s/%s", dst, dir->d_name);
-		
-		if(dir->d_type & DT_DIR) mkdir(temp_dst, 0777);
-		
-		if( Copy(temp_src, temp_dst) == FAILED) {closedir(d); return FAILED;}
-			
-		if(copy_cancel==YES) break;
-			
-	}
-	closedir(d);
+	int ret = walk(src, &v);
 	
-	if(copy_cancel==YES) return FAILED;
+	FREE(cw.path);
+	
+	if(ret != WALK_OK || v.errors || copy_cancel==YES) return FAILED;
 	
 	return SUCCESS;
 	
@@ -15812,753 +16034,81 @@ u8 patch_EBOOT(char *path)
 	return SUCCESS;
 }
 
-//====================================|
-// DigiCert High Assurance EV Root CA |
-//====================================|
-static char github_cert[] __attribute__((aligned(64))) =
-	"-----BEGIN CERTIFICATE-----\n"
-	"MIIDxTCCAq2gAwIBAgIQAqxcJmoLQJuPC3nyrkYldzANBgkqhkiG9w0BAQUFADBs\n"
-	"MQswCQYDVQQGEwJVUzEVMBMGA1UEChMMRGlnaUNlcnQgSW5jMRkwFwYDVQQLExB3\n"
-	"d3cuZGlnaWNlcnQuY29tMSswKQYDVQQDEyJEaWdpQ2VydCBIaWdoIEFzc3VyYW5j\n"
-	"ZSBFViBSb290IENBMB4XDTA2MTExMDAwMDAwMFoXDTMxMTExMDAwMDAwMFowbDEL\n"
-	"MAkGA1UEBhMCVVMxFTATBgNVBAoTDERpZ2lDZXJ0IEluYzEZMBcGA1UECxMQd3d3\n"
-	"LmRpZ2ljZXJ0LmNvbTErMCkGA1UEAxMiRGlnaUNlcnQgSGlnaCBBc3N1cmFuY2Ug\n"
-	"RVYgUm9vdCBDQTCCASIwDQYJKoZIhvcNAQEBBQADggEPADCCAQoCggEBAMbM5XPm\n"
-	"+9S75S0tMqbf5YE/yc0lSbZxKsPVlDRnogocsF9ppkCxxLeyj9CYpKlBWTrT3JTW\n"
-	"PNt0OKRKzE0lgvdKpVMSOO7zSW1xkX5jtqumX8OkhPhPYlG++MXs2ziS4wblCJEM\n"
-	"xChBVfvLWokVfnHoNb9Ncgk9vjo4UFt3MRuNs8ckRZqnrG0AFFoEt7oT61EKmEFB\n"
-	"Ik5lYYeBQVCmeVyJ3hlKV9Uu5l0cUyx+mM0aBhakaHPQNAQTXKFx01p8VdteZOE3\n"
-	"hzBWBOURtCmAEvF5OYiiAhF8J2a3iLd48soKqDirCmTCv2ZdlYTBoSUeh10aUAsg\n"
-	"EsxBu24LUTi4S8sCAwEAAaNjMGEwDgYDVR0PAQH/BAQDAgGGMA8GA1UdEwEB/wQF\n"
-	"MAMBAf8wHQYDVR0OBBYEFLE+w2kD+L9HAdSYJhoIAu9jZCvDMB8GA1UdIwQYMBaA\n"
-	"FLE+w2kD+L9HAdSYJhoIAu9jZCvDMA0GCSqGSIb3DQEBBQUAA4IBAQAcGgaX3Nec\n"
-	"nzyIZgYIVyHbIUf4KmeqvxgydkAQV8GK83rZEWWONfqe/EW1ntlMMUu4kehDLI6z\n"
-	"eM7b41N5cdblIZQB2lWHmiRk9opmzN6cN82oNLFpmyPInngiK3BD41VHMWEZ71jF\n"
-	"hS9OMPagMRYjyOfiZRYzy78aG6A9+MpeizGLYAiJLQwGXFK3xPkKmNEVX58Svnw2\n"
-	"Yzi9RKR/5CYrCsSXaQ3pjOLAEFe4yHYSkVXySGnYvCoCWw9E1CAx2/S6cCZdkGCe\n"
-	"vEsXCS+0yx5DaMkHJ8HSXPfqIbloEpw8nL+e/IBcm2PN7EeqJSdnoDfzAIJ9VNep\n"
-	"+OkuE6N36B9K\n"
-	"-----END CERTIFICATE-----\n";
-	
-#define HTTP_BUFFSIZE 1024
-static char getBuffer[HTTP_BUFFSIZE];
+// the modules, the clients and their connections are kept by http_session.c between the requests
 
-int download(char *url, char *dst)
+typedef struct
 {
-	int ret = 0, httpCode = 0;
-	s32 cert_size=0;
-	httpUri uri;
-	httpClientId httpClient = 0;
-	httpTransId httpTrans = 0;
-	FILE* fp=NULL;
-	s32 nRecv = -1;
-	s32 size = 0;
-	u64 dl=0;
-	uint64_t length = 0;
-	void *http_pool = NULL;
-	void *uri_pool = NULL;
-	void *ssl_pool = NULL;
-	void *cert_buffer = NULL;
-	httpsData *caList=NULL;
-	
-	u8 module_https_loaded=NO;
-	u8 module_http_loaded=NO;
-	u8 module_net_loaded=NO;
-	u8 module_ssl_loaded=NO;
-	
-	u8 https_init=NO;
-	u8 http_init=NO;
-	u8 net_init=NO;
-	u8 ssl_init=NO;
-
-	//init
-	ret = sysModuleLoad(SYSMODULE_NET);
-	if (ret < 0) {
-		print_load("Error : sysModuleLoad(SYSMODULE_NET) failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	} else module_net_loaded=YES;
-
-	ret = netInitialize();
-	if (ret < 0) {
-		print_load("Error : netInitialize failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	} else net_init=YES;
-
-	ret = sysModuleLoad(SYSMODULE_HTTP);
-	if (ret < 0) {
-		print_load("Error : sysModuleLoad(SYSMODULE_HTTP) failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	} else module_http_loaded=YES;
-
-	http_pool = malloc(0x10000);
-	if (http_pool == NULL) {
-		print_load("Error : out of memory (http_pool)");
-		ret=FAILED;
-		goto end;
-	}
-
-	ret = httpInit(http_pool, 0x10000);
-	if (ret < 0) {
-		print_load("Error : httpInit failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	} else http_init=YES;
-
-	// init SSL
-	if(strstr(url, "https")) {
-		ret = sysModuleLoad(SYSMODULE_HTTPS);
-		if (ret < 0) {
-			print_load("Error : sysModuleLoad(SYSMODULE_HTTP) failed (%x)", ret);
-			ret=FAILED;
-			goto end;
-		} else module_https_loaded=YES;
-
-		ret = sysModuleLoad(SYSMODULE_SSL);
-		if (ret < 0) {
-			print_load("Error : sysModuleLoad(SYSMODULE_HTTP) failed (%x)", ret);
-			ret=FAILED;
-			goto end;
-		} else module_ssl_loaded=YES;
-
-		ssl_pool = malloc(0x40000);
-		if (ret < 0) {
-			print_load("Error : out of memory (http_pool)");
-			ret=FAILED;
-			goto end;
-		}
-
-		ret = sslInit(ssl_pool, 0x40000);
-		if (ret < 0) {
-			print_load("Error : sslInit failed (%x)", ret);
-			ret=FAILED;
-			goto end;
-		} else ssl_init=YES;
-
-		caList = (httpsData *)malloc(sizeof(httpsData));
-		ret = sslCertificateLoader(SSL_LOAD_CERT_ALL, NULL, 0, &cert_size);
-		if (ret < 0) {
-			print_load("Error : sslCertificateLoader failed (%x)", ret);
-			ret=FAILED;
-			goto end;
-		}
-
-		cert_buffer = malloc(cert_size);
-		if (cert_buffer==NULL) {
-			print_load("Error : out of memory (cert_buffer)");
-			ret=FAILED;
-			goto end;
-		}
-
-		ret = sslCertificateLoader(SSL_LOAD_CERT_ALL, cert_buffer, cert_size, NULL);
-		if (ret < 0) {
-			print_load("Error : sslCertificateLoader failed (%x)", ret);
-			ret=FAILED;
-			goto end;
-		}
-
-		(&caList[0])->ptr = cert_buffer;
-		(&caList[0])->size = cert_size;
-		
-		(&caList[1])->ptr = github_cert;
-		(&caList[1])->size = sizeof(github_cert);
-
-		ret = httpsInit(2, (httpsData *) caList);
-		if (ret < 0) {
-			print_load("Error : httpsInit failed (%x)", ret);
-			ret=FAILED;
-			goto end;
-		} else https_init=YES;
-
-	}
-	// END of SSL
-	httpClient = 0;
-	httpTrans = 0;
- 
-	ret = httpCreateClient(&httpClient);
-	if (ret < 0) {
-		print_load("Error : httpCreateClient failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	}
-	// End of init
-
-	//URI
-	ret = httpUtilParseUri(&uri, url, NULL, 0, &size);
-	if (ret < 0) {
-		print_load("Error : httpUtilParseUri() failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	}
-
-	uri_pool = malloc(size);
-	if (uri_pool == NULL) {
-		print_load("Error : out of memory (uri_pool)");
-		ret=FAILED;
-		goto end;
-	}
-
-	ret = httpUtilParseUri(&uri, url, uri_pool, size, 0);
-	if (ret < 0) {
-		print_load("Error : httpUtilParseUri() failed (%x), %s", ret, url);
-		ret=FAILED;
-		goto end;
-	}
-	//END of URI	
-
-	//SEND REQUEST
-	ret = httpCreateTransaction(&httpTrans, httpClient, HTTP_METHOD_GET, &uri);
-	if (ret < 0) {
-		print_load("Error : httpCreateTransaction() failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	}
-	/*
-	if(strstr(url, "gamecovers.ezyro.com") != NULL) {
-		httpHeader headerCookie = { (const char*) "Cookie", (const char*) "__test=8f82a74fa6f891b017602f64b6aa7942" };
-		httpRequestAddHeader(httpTrans, &headerCookie);
-	}
-	*/
-	ret = httpSendRequest(httpTrans, NULL, 0, NULL);
-	if (ret < 0) {
-		print_load("Error : httpSendRequest() failed (%x), %s", ret, url);
-		ret=FAILED;
-		goto end;
-	}
-	
-	//GET SIZE
-	httpResponseGetContentLength(httpTrans, &length);
+	u64 done;
+	u8 task;			// upload : counted in the task progress bar
+	int64_t *bar;		// the progress bar free when the transfer started
+	u8 bar_used;
+} net_transfer;
 
-	ret = httpResponseGetStatusCode(httpTrans, &httpCode);
-	if (ret < 0) {
-		print_load("Error : cellHttpResponseGetStatusCode() failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	}
-
-	if(httpCode != HTTP_STATUS_CODE_OK && httpCode >= 400 ) {
-		//print_load("Error : Status code (%d)", httpCode);
-		ret=FAILED;
-		goto end;
-	}
-	
-//TRANSFERT
-	fp=NULL;
-	fp = fopen(dst, "wb");
-	if(fp == NULL) {
-		print_load("Error : fopen() failed : %s", dst);
-		ret=FAILED;
-		goto end;
-	}
+static u8 net_progress(u64 done, u64 total, void *arg)
+{
+	net_transfer *t = (net_transfer *) arg;
 	
-	if(length != 0) {
-		if(prog_bar1_value!=-1) prog_bar2_value=0;
-		else prog_bar1_value=0;
-	}
+	if(t->task) task_Update(done - t->done);
+	t->done = done;
 	
-	while(nRecv != 0) {
-		if(httpRecvResponse(httpTrans, (void*) getBuffer, sizeof(getBuffer)-1, &nRecv) > 0) break;
-		if(nRecv == 0)	break;
-		fwrite((char*) getBuffer, nRecv, 1, fp);
-		if(cancel==YES) break;
-		dl+=nRecv;
-		if(length != 0) {
-			if(prog_bar2_value!=-1) prog_bar2_value=(dl*100)/length;
-			else prog_bar1_value = (dl*100)/length;
-		}
+	if(total != 0) {
+		*t->bar = (done*100)/total;
+		t->bar_used = YES;
 	}
-	fclose(fp);
-		
-	if(prog_bar2_value!=-1) prog_bar2_value=-1;
-	else prog_bar1_value=-1;
-	
-//END of TRANSFERT
-
-	ret=SUCCESS;
-	
-	if(cancel==YES) {
-		Delete(dst);
-		ret=FAILED;
-		cancel=NO;
-	}
-	
-end:
-	if(caList) free(caList);
-	if(httpTrans) httpDestroyTransaction(httpTrans);
-	if(httpClient) httpDestroyClient(httpClient);
-	if(https_init) httpsEnd();
-	if(ssl_init) sslEnd();
-	if(http_init) httpEnd();
-	if(net_init) netDeinitialize();
-	
-	if(module_http_loaded) sysModuleUnload(SYSMODULE_HTTP);
-	if(module_https_loaded) sysModuleUnload(SYSMODULE_HTTPS);
-	if(module_net_loaded) sysModuleUnload(SYSMODULE_NET);
-	if(module_ssl_loaded) sysModuleUnload(SYSMODULE_SSL);
-	
-	if(uri_pool) free(uri_pool);
-	if(http_pool) free(http_pool);
-	if(ssl_pool) free(ssl_pool);
-	if(cert_buffer) free(cert_buffer);
 	
-	return ret;
+	if(cancel==YES) return NO;
+	return YES;
 }
 
-int http_response(char *url)
+static void net_transfer_init(net_transfer *t)
 {
-	int ret = 0, httpCode = 0;
-	s32 cert_size=0;
-	httpUri uri;
-	httpClientId httpClient = 0;
-	httpTransId httpTrans = 0;
-	s32 size = 0;
-	void *http_pool = NULL;
-	void *uri_pool = NULL;
-	void *ssl_pool = NULL;
-	void *cert_buffer = NULL;
-	httpsData *caList=NULL;
-	
-	u8 module_https_loaded=NO;
-	u8 module_http_loaded=NO;
-	u8 module_net_loaded=NO;
-	u8 module_ssl_loaded=NO;
-	
-	u8 https_init=NO;
-	u8 http_init=NO;
-	u8 net_init=NO;
-	u8 ssl_init=NO;
-
-	//init
-	ret = sysModuleLoad(SYSMODULE_NET);
-	if (ret < 0) {
-		print_load("Error : sysModuleLoad(SYSMODULE_NET) failed (%x)", ret);
-		goto end;
-	} else module_net_loaded=YES;
-
-	ret = netInitialize();
-	if (ret < 0) {
-		print_load("Error : netInitialize failed (%x)", ret);
-		goto end;
-	} else net_init=YES;
-
-	ret = sysModuleLoad(SYSMODULE_HTTP);
-	if (ret < 0) {
-		print_load("Error : sysModuleLoad(SYSMODULE_HTTP) failed (%x)", ret);
-		goto end;
-	} else module_http_loaded=YES;
-
-	http_pool = malloc(0x10000);
-	if (http_pool == NULL) {
-		print_load("Error : out of memory (http_pool)");
-		goto end;
-	}
-
-	ret = httpInit(http_pool, 0x10000);
-	if (ret < 0) {
-		print_load("Error : httpInit failed (%x)", ret);
-		goto end;
-	} else http_init=YES;
-
-	// init SSL
-	if(strstr(url, "https")) {
-		ret = sysModuleLoad(SYSMODULE_HTTPS);
-		if (ret < 0) {
-			print_load("Error : sysModuleLoad(SYSMODULE_HTTP) failed (%x)", ret);
-			goto end;
-		} else module_https_loaded=YES;
-
-		ret = sysModuleLoad(SYSMODULE_SSL);
-		if (ret < 0) {
-			print_load("Error : sysModuleLoad(SYSMODULE_HTTP) failed (%x)", ret);
-			goto end;
-		} else module_ssl_loaded=YES;
-
-		ssl_pool = malloc(0x40000);
-		if (ret < 0) {
-			print_load("Error : out of memory (http_pool)");
-			goto end;
-		}
-
-		ret = sslInit(ssl_pool, 0x40000);
-		if (ret < 0) {
-			print_load("Error : sslInit failed (%x)", ret);
-			goto end;
-		} else ssl_init=YES;
-
-		caList = (httpsData *)malloc(sizeof(httpsData));
-		ret = sslCertificateLoader(SSL_LOAD_CERT_ALL, NULL, 0, &cert_size);
-		if (ret < 0) {
-			print_load("Error : sslCertificateLoader failed (%x)", ret);
-			goto end;
-		}
-
-		cert_buffer = malloc(cert_size);
-		if (cert_buffer==NULL) {
-			print_load("Error : out of memory (cert_buffer)");
-				goto end;
-		}
-
-		ret = sslCertificateLoader(SSL_LOAD_CERT_ALL, cert_buffer, cert_size, NULL);
-		if (ret < 0) {
-			print_load("Error : sslCertificateLoader failed (%x)", ret);
-				goto end;
-		}
-
-		(&caList[0])->ptr = cert_buffer;
-		(&caList[0])->size = cert_size;
-		
-		(&caList[1])->ptr = github_cert;
-		(&caList[1])->size = sizeof(github_cert);
-
-		ret = httpsInit(2, (httpsData *) caList);
-		if (ret < 0) {
-			print_load("Error : httpsInit failed (%x)", ret);
-				goto end;
-		} else https_init=YES;
-
-	}
-	// END of SSL
-	httpClient = 0;
-	httpTrans = 0;
- 
-	ret = httpCreateClient(&httpClient);
-	if (ret < 0) {
-		print_load("Error : httpCreateClient failed (%x)", ret);
-		goto end;
-	}
-	// End of init
-
-	//URI
-	ret = httpUtilParseUri(&uri, url, NULL, 0, &size);
-	if (ret < 0) {
-		print_load("Error : httpUtilParseUri() failed (%x)", ret);
-		goto end;
-	}
-
-	uri_pool = malloc(size);
-	if (uri_pool == NULL) {
-		print_load("Error : out of memory (uri_pool)");
-		goto end;
-	}
-
-	ret = httpUtilParseUri(&uri, url, uri_pool, size, 0);
-	if (ret < 0) {
-		print_load("Error : httpUtilParseUri() failed (%x)", ret);
-		goto end;
-	}
-	//END of URI	
+	memset(t, 0, sizeof(net_transfer));
+	if(prog_bar1_value!=-1) t->bar = &prog_bar2_value;
+	else t->bar = &prog_bar1_value;
+}
 
-	//SEND REQUEST
-	ret = httpCreateTransaction(&httpTrans, httpClient, HTTP_METHOD_GET, &uri);
-	if (ret < 0) {
-		print_load("Error : httpCreateTransaction() failed (%x)", ret);
-		goto end;
-	}
+int download(char *url, char *dst)
+{
+	net_transfer t;
+	net_transfer_init(&t);
 	
-	print_debug("httpSendRequest");
-	ret = httpSendRequest(httpTrans, NULL, 0, NULL);
-	if (ret < 0) {
-		print_load("Error : httpSendRequest() failed (%x), %s", ret, url);
-		goto end;
-	}
+	int httpCode = http_get(url, dst, net_progress, &t);
 	
-	print_debug("httpResponseGetStatusCode");
-	ret = httpResponseGetStatusCode(httpTrans, &httpCode);
-	if (ret < 0) {
-		print_load("Error : cellHttpResponseGetStatusCode() failed (%x)", ret);
-		goto end;
-	}
+	if(t.bar_used) *t.bar = -1;
 	
-	ret = httpCode;
+	if(httpCode == HTTP_CANCELED) cancel=NO;
 	
-end:
-	if(caList) free(caList);
-	if(httpTrans) httpDestroyTransaction(httpTrans);
-	if(httpClient) httpDestroyClient(httpClient);
-	if(https_init) httpsEnd();
-	if(ssl_init) sslEnd();
-	if(http_init) httpEnd();
-	if(net_init) netDeinitialize();
-	
-	if(module_http_loaded) sysModuleUnload(SYSMODULE_HTTP);
-	if(module_https_loaded) sysModuleUnload(SYSMODULE_HTTPS);
-	if(module_net_loaded) sysModuleUnload(SYSMODULE_NET);
-	if(module_ssl_loaded) sysModuleUnload(SYSMODULE_SSL);
-	
-	if(uri_pool) free(uri_pool);
-	if(http_pool) free(http_pool);
-	if(ssl_pool) free(ssl_pool);
-	if(cert_buffer) free(cert_buffer);
+	if(httpCode < 0 || httpCode >= 400) return FAILED;
 	
-	return ret;
+	return SUCCESS;
 }
 
-int upload(char *url, char *src)
+int http_response(char *url)
 {
-	int ret = 0;
-	int httpCode = 0;
-	s32 cert_size=0;
-	httpUri uri;
-	httpClientId httpClient = 0;
-	httpTransId httpTrans = 0;
-	FILE* fp=NULL;
-	s64 toSend=-1;
-	s32 nSent=-1;
-	s32 size = 0;
-	u64 ul=0;
-	u64 length = 0;
-	void *http_pool = NULL;
-	void *uri_pool = NULL;
-	void *ssl_pool = NULL;
-	void *cert_buffer = NULL;
-	httpsData *caList=NULL;
-	
-	u8 module_https_loaded=NO;
-	u8 module_http_loaded=NO;
-	u8 module_net_loaded=NO;
-	u8 module_ssl_loaded=NO;
-	
-	u8 https_init=NO;
-	u8 http_init=NO;
-	u8 net_init=NO;
-	u8 ssl_init=NO;
-
-	//init
-	ret = sysModuleLoad(SYSMODULE_NET);
-	if (ret < 0) {
-		print_load("Error : sysModuleLoad(SYSMODULE_NET) failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	} else module_net_loaded=YES;
-
-	ret = netInitialize();
-	if (ret < 0) {
-		print_load("Error : netInitialize failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	} else net_init=YES;
-
-	ret = sysModuleLoad(SYSMODULE_HTTP);
-	if (ret < 0) {
-		print_load("Error : sysModuleLoad(SYSMODULE_HTTP) failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	} else module_http_loaded=YES;
-
-	http_pool = malloc(0x10000);
-	if (http_pool == NULL) {
-		print_load("Error : out of memory (http_pool)");
-		ret=FAILED;
-		goto end;
-	}
-
-	ret = httpInit(http_pool, 0x10000);
-	if (ret < 0) {
-		print_load("Error : httpInit failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	} else http_init=YES;
-
-	// init SSL
-	if(strstr(url, "https")) {
-		ret = sysModuleLoad(SYSMODULE_HTTPS);
-		if (ret < 0) {
-			print_load("Error : sysModuleLoad(SYSMODULE_HTTP) failed (%x)", ret);
-			ret=FAILED;
-			goto end;
-		} else module_https_loaded=YES;
-
-		ret = sysModuleLoad(SYSMODULE_SSL);
-		if (ret < 0) {
-			print_load("Error : sysModuleLoad(SYSMODULE_HTTP) failed (%x)", ret);
-			ret=FAILED;
-			goto end;
-		} else module_ssl_loaded=YES;
-
-		ssl_pool = malloc(0x40000);
-		if (ret < 0) {
-			print_load("Error : out of memory (http_pool)");
-			ret=FAILED;
-			goto end;
-		}
-
-		ret = sslInit(ssl_pool, 0x40000);
-		if (ret < 0) {
-			print_load("Error : sslInit failed (%x)", ret);
-			ret=FAILED;
-			goto end;
-		} else ssl_init=YES;
-
-		caList = (httpsData *)malloc(sizeof(httpsData));
-		ret = sslCertificateLoader(SSL_LOAD_CERT_ALL, NULL, 0, &cert_size);
-		if (ret < 0) {
-			print_load("Error : sslCertificateLoader failed (%x)", ret);
-			ret=FAILED;
-			goto end;
-		}
-
-		cert_buffer = malloc(cert_size);
-		if (cert_buffer==NULL) {
-			print_load("Error : out of memory (cert_buffer)");
-			ret=FAILED;
-			goto end;
-		}
-
-		ret = sslCertificateLoader(SSL_LOAD_CERT_ALL, cert_buffer, cert_size, NULL);
-		if (ret < 0) {
-			print_load("Error : sslCertificateLoader failed (%x)", ret);
-			ret=FAILED;
-			goto end;
-		}
-
-		(&caList[0])->ptr = cert_buffer;
-		(&caList[0])->size = cert_size;
-		
-		(&caList[1])->ptr = github_cert;
-		(&caList[1])->size = sizeof(github_cert);
-
-		ret = httpsInit(2, (httpsData *) caList);
-		if (ret < 0) {
-			print_load("Error : httpsInit failed (%x)", ret);
-			ret=FAILED;
-			goto end;
-		} else https_init=YES;
-
-	}
-	// END of SSL
-	httpClient = 0;
-	httpTrans = 0;
- 
-	ret = httpCreateClient(&httpClient);
-	if (ret < 0) {
-		print_load("Error : httpCreateClient failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	}
-	// End of init
-
-	//URI
-	ret = httpUtilParseUri(&uri, url, NULL, 0, &size);
-	if (ret < 0) {
-		print_load("Error : httpUtilParseUri() failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	}
-
-	uri_pool = malloc(size);
-	if (uri_pool == NULL) {
-		print_load("Error : out of memory (uri_pool)");
-		ret=FAILED;
-		goto end;
-	}
-
-	ret = httpUtilParseUri(&uri, url, uri_pool, size, 0);
-	if (ret < 0) {
-		print_load("Error : httpUtilParseUri() failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	}
-	//END of URI	
-
-	//SEND REQUEST
-	ret = httpCreateTransaction(&httpTrans, httpClient, HTTP_METHOD_POST, &uri);
-	if (ret < 0) {
-		print_load("Error : httpCreateTransaction() failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	}
+	return http_status(url);
+}
 
-// FILE UPLOAD
-	length = get_size(src);
-	
-	print_debug("httpRequestSetContentLength");
-	ret = httpRequestSetContentLength(httpTrans, length);
-	if( ret < 0) {
-		print_load("Error : httpRequestSetContentLength() failed (%x)", ret);
-		ret=FAILED;
-		goto end;
-	}
-	
-	fp=fopen(src, "rb");
-	if(fp==NULL) {
-		print_load("Error : fopen() failed : %s", src);
-		ret=FAILED;
-		goto end;
-	}
+int upload(char *url, char *src)
+{
+	net_transfer t;
+	net_transfer_init(&t);
+	t.task = YES;
 	
-	task_Init(length);
+	task_Init(get_size(src));
 	
-	print_debug("Sending data...");
-	while(nSent != 0 ) {
-		toSend = HTTP_BUFFSIZE; 
-		if(length < ul + toSend) toSend = length - ul;
-		
-		fread((char *) getBuffer, toSend, 1, fp);
-		ret = httpSendRequest(httpTrans, (void*) getBuffer, toSend, &nSent);
-		if( ret < 0) {
-			print_load(" Error : httpSendRequest %X", ret);
-			break;
-		}
-		
-		ul+=toSend;
-		
-		task_Update(toSend);
-		
-		if(length <= ul ) break;
-		if(cancel==YES) break;
-		if(nSent == 0)	break;
-		if(nSent != toSend) print_load(" Warning : nSent != toSend | %d != %d", toSend, nSent);
-		
-		if(length != 0) {
-			if(prog_bar2_value!=-1) prog_bar2_value=(ul*100)/length;
-			else prog_bar1_value = (ul*100)/length;
-		}
-	}
-	fclose(fp);
+	int ret = http_post_file(url, src, net_progress, &t);
 	
 	task_End();
 	
-	if(length != ul) {
-		print_load("Error : length != ul");
-		ret = FAILED;
-	}
+	if(t.bar_used) *t.bar = -1;
 	
-	print_debug("httpResponseGetStatusCode");
-	ret = httpResponseGetStatusCode(httpTrans, &httpCode);
-	if (ret < 0) {
-		print_load("Error : cellHttpResponseGetStatusCode() failed (%x)", ret);
-		goto end;
-	}
-	
-	ret = httpCode;
+	if(ret < 0) ret = FAILED;
 	
-//END of TRANSFERT
-end:
 	if(cancel) {
 		ret=FAILED;
 		cancel=NO;
 	}
 	
-	if(caList) free(caList);
-	if(httpTrans) httpDestroyTransaction(httpTrans);
-	if(httpClient) httpDestroyClient(httpClient);
-	if(https_init) httpsEnd();
-	if(ssl_init) sslEnd();
-	if(http_init) httpEnd();
-	if(net_init) netDeinitialize();
-	
-	if(module_http_loaded) sysModuleUnload(SYSMODULE_HTTP);
-	if(module_https_loaded) sysModuleUnload(SYSMODULE_HTTPS);
-	if(module_net_loaded) sysModuleUnload(SYSMODULE_NET);
-	if(module_ssl_loaded) sysModuleUnload(SYSMODULE_SSL);
-	
-	if(uri_pool) free(uri_pool);
-	if(http_pool) free(http_pool);
-	if(ssl_pool) free(ssl_pool);
-	if(cert_buffer) free(cert_buffer);
-	
 	return ret;
 }
 
@@ -16661,7 +16211,13 @@ void Draw_MemMonitor()
 	FontColor(WHITE);
 	FontSize(15);
 	float val = (float) ((MemUsed * 100) / MemInfo.total);
-	DrawFormatString(x, y, "RAM %.1f%% - %s/%s", val, MemUsed_u,  MemTot_u);
+	float x1 = DrawFormatString(x, y, "RAM %.1f%% - %s/%s", val, MemUsed_u,  MemTot_u);
+	
+	u32 batches, quads, drawn, skipped, frame_time;
+	QB_GetStats(&batches, &quads);
+	Redraw_GetStats(&drawn, &skipped, &frame_time);
+	DrawFormatString(x1 + 20, y, "%.1f FPS - %.1f ms - %d/%d frames skipped - text : %d quads in %d batches", 
+		get_fps(), (float) frame_time / 1000.0f, skipped, drawn + skipped, quads, batches);
 	
 	free(MemUsed_u);
 	free(MemTot_u);
@@ -16676,7 +16232,7 @@ void Draw_MemMonitor()
 	Draw_Box(x, y, 0, 0, w_font , h, GREEN, NO);
 	FontColor(BLUE);
 	
-	float x1 = DrawString(x, y+h+2*e, "FONT") + 10;
+	x1 = DrawString(x, y+h+2*e, "FONT") + 10;
 	
 	x+=w_font_max;
 	
@@ -16825,7 +16381,12 @@ void getDevices()
 		}
 	}
 	closedir(d);
-
+	
+	// what was left in the trash by the last run
+	for(i=0; i <= device_number; i++) {
+		sprintf(temp, "/%s", list_device[i]);
+		delete_purge_resume(temp);
+	}
 }
 
 
@@ -16960,6 +16521,7 @@ void PlugAndPlay_thread(void *unused)
 		
 		if ( Old_NumberOfDevice != NumberOfDevice) {
 			
+			MGZ_mount_invalidate();
 			do_Refresh=YES;
 						
 			if( Old_NumberOfDevice < NumberOfDevice && RefreshRetry == YES) {
@@ -17007,6 +16569,7 @@ void AutoRefresh_GAMELIST()
 	if(do_Refresh == NO) return;
 	
 	do_Refresh = NO;
+	Redraw_Invalidate();
 	
 	start_loading();
 	
@@ -17930,6 +17493,11 @@ void IRD_download(ird_t *ird, u32 meta_sig, char ***IRD_Path, u32 *IRD_nPath)
 	FILE *f = fopen(tmp, "rb");
 	if(f==NULL) return;
 	
+	// the IRD are downloaded at once, on several connections
+	http_job *jobs = NULL;
+	u32 jobs_N = 0;
+	u32 i;
+	
 	while(fgets(line, 255, f) != NULL) {
 		if(line[0]=='\r' || line[0]=='\n') continue;
 		if(strstr(line, "\r") != NULL) strtok(line, "\r");
@@ -17938,20 +17506,35 @@ void IRD_download(ird_t *ird, u32 meta_sig, char ***IRD_Path, u32 *IRD_nPath)
 		sprintf(URL, IRD_SERVER "/%s", line);
 		sprintf(filepath, "%s/%s", IRD_dir, line); 
 		
-		if( download(URL, filepath) == SUCCESS) {
+		http_job *tmp_jobs = (http_job *) realloc(jobs, (jobs_N+1) * sizeof(http_job));
+		if(tmp_jobs == NULL) break;
+		jobs = tmp_jobs;
+		jobs[jobs_N].url = strcpy_malloc(URL);
+		jobs[jobs_N].dst = strcpy_malloc(filepath);
+		jobs_N++;
+		
+		memset(line, 0, 255);
+	}
+	fclose(f);
+	Delete(tmp);
+	
+	http_get_queue(jobs, jobs_N, 3, NULL, NULL);
+	
+	for(i=0; i<jobs_N; i++) {
+		if(0 < jobs[i].ret && jobs[i].ret < 400) {
 			
-			u32 sig = IRD_meta_sig(filepath);
+			u32 sig = IRD_meta_sig(jobs[i].dst);
 				
 			if(sig==meta_sig) {
 				*IRD_nPath = *IRD_nPath + 1;
 				*IRD_Path = (char **) realloc(*IRD_Path, *IRD_nPath * sizeof(char*));
-				*IRD_Path[*IRD_nPath-1] = strcpy_malloc(filepath);
+				*IRD_Path[*IRD_nPath-1] = strcpy_malloc(jobs[i].dst);
 			}
 		}
-		memset(line, 0, 255);
+		FREE(jobs[i].url);
+		FREE(jobs[i].dst);
 	}
-	fclose(f);
-	Delete(tmp);	
+	FREE(jobs);
 }
 
 u8 IRD_check(char *G_PATH)
@@ -21871,6 +21454,8 @@ u8 MountGame(char *GamePath)
 		
 		if(direct_boot) {
 			end_loading();
+			http_session_end();
+			delete_purge_stop();
 			sysModuleUnload(SYSMODULE_PNGDEC);
 			sysModuleUnload(SYSMODULE_JPGDEC);
 			ioPadEnd();
@@ -23303,6 +22888,8 @@ void update_MGZ()
 		end_Load_GAMEPIC();
 		end_load_CURPIC();
 		end_loading();
+		http_session_end();
+		delete_purge_stop();
 		sysModuleUnload(SYSMODULE_PNGDEC);
 		sysModuleUnload(SYSMODULE_JPGDEC);
 		ioPadEnd();
@@ -23479,6 +23066,7 @@ void read_setting()
 		fread(&root_display, sizeof(u8), 1, fp);
 		fread(&LOG, sizeof(u8), 1, fp);
 		fread(&DEBUG, sizeof(u8), 1, fp);
+		fread(&Fast_Delete, sizeof(u8), 1, fp);
 		
 		fclose(fp);
 	} 
@@ -23550,6 +23138,7 @@ void write_setting()
 		fwrite(&root_display, sizeof(u8), 1, fp);
 		fwrite(&LOG, sizeof(u8), 1, fp);
 		fwrite(&DEBUG, sizeof(u8), 1, fp);
+		fwrite(&Fast_Delete, sizeof(u8), 1, fp);
 		
 		fclose(fp);
 		SetFilePerms(setPath);
@@ -24262,6 +23851,251 @@ float R2JoyStick_Y(int joystick)
 // File Manager
 //*******************************************************
 
+// The names of a listing are copied in big chunks freed at once by window_content_clear.
+// The sizes of the files aren't read by RefreshWindow : FM_prefetch_thread stats the displayed rows
+// and the ones around them, the other entries stay at WINDOW_SIZE_UNKNOWN. On exFAT and NTFS the
+// drivers can't be used by two threads at once, the displayed rows are read by FM_prefetch_post.
+
+#define WINDOW_ITEMS_STEP			256
+#define WINDOW_ARENA_SIZE			0x10000
+#define WINDOW_SIZE_UNKNOWN			((u64) -1)
+#define WINDOW_PREFETCH				128
+
+typedef struct window_arena
+{
+	struct window_arena *next;
+	u32 used;
+	char data[WINDOW_ARENA_SIZE];
+} window_arena;
+
+typedef struct
+{
+	u32 gen;		// window_content_gen when the job was posted
+	int first;		// displayed rows
+	int last;
+	char path[WINDOW_MAX_PATH_LENGTH];
+} FM_prefetch_job;
+
+static window_arena **window_content_Arena=NULL;
+static int *window_content_max=NULL;
+
+// incremented under FM_prefetch_lock when the entries move, the prefetch thread drops the jobs of the previous listing
+static u32 *window_content_gen=NULL;
+static FM_prefetch_job *FM_prefetch_jobs=NULL;
+static sys_lwmutex_t FM_prefetch_lock;
+static sys_ppu_thread_t FM_prefetch_id;
+static u8 FM_prefetch=NO;
+
+static void window_content_invalidate(int window_id)
+{
+	sysLwMutexLock(&FM_prefetch_lock, 0);
+	window_content_gen[window_id]++;
+	sysLwMutexUnlock(&FM_prefetch_lock);
+}
+
+static char *window_arena_strcpy(int window_id, char *str)
+{
+	u32 len = strlen(str) + 1;
+	window_arena *a = window_content_Arena[window_id];
+	
+	if(len > WINDOW_ARENA_SIZE) return NULL;
+	
+	if(a == NULL || a->used + len > WINDOW_ARENA_SIZE) {
+		a = (window_arena *) malloc(sizeof(window_arena));
+		if(a == NULL) return NULL;
+		a->next = window_content_Arena[window_id];
+		a->used = 0;
+		window_content_Arena[window_id] = a;
+	}
+	
+	char *dst = &a->data[a->used];
+	memcpy(dst, str, len);
+	a->used += len;
+	
+	return dst;
+}
+
+static u8 window_content_grow(int window_id)
+{
+	int max = window_content_max[window_id] ? window_content_max[window_id] * 2 : WINDOW_ITEMS_STEP;
+	u8 ret = SUCCESS;
+	
+	// realloc can move the arrays read by the prefetch thread
+	sysLwMutexLock(&FM_prefetch_lock, 0);
+	window_content_gen[window_id]++;
+	
+	char **Name = (char **) realloc(window_content_Name[window_id], max * sizeof(char *));
+	if(Name != NULL) window_content_Name[window_id] = Name; else ret = FAILED;
+	char **Type = (char **) realloc(window_content_Type[window_id], max * sizeof(char *));
+	if(Type != NULL) window_content_Type[window_id] = Type; else ret = FAILED;
+	u64 *Size = (u64 *) realloc(window_content_Size[window_id], max * sizeof(u64));
+	if(Size != NULL) window_content_Size[window_id] = Size; else ret = FAILED;
+	u8 *Selected = (u8 *) realloc(window_content_Selected[window_id], max * sizeof(u8));
+	if(Selected != NULL) window_content_Selected[window_id] = Selected; else ret = FAILED;
+	
+	if(ret == SUCCESS) window_content_max[window_id] = max;
+	
+	sysLwMutexUnlock(&FM_prefetch_lock);
+	
+	return ret;
+}
+
+// add an entry to the listing, type NULL : from the extension of the name. Returns its index, -1 if it failed.
+int window_content_add(int window_id, char *name, char *type, u64 size)
+{
+	int n = window_content_N[window_id] + 1;
+	
+	if(n >= window_content_max[window_id]) {
+		if(window_content_grow(window_id) == FAILED) return -1;
+	}
+	
+	char *str = window_arena_strcpy(window_id, name);
+	if(str == NULL) return -1;
+	
+	window_content_Name[window_id][n] = str;
+	window_content_Type[window_id][n] = type == NULL ? get_ext(str) : type;
+	window_content_Size[window_id][n] = size;
+	window_content_Selected[window_id][n] = NO;
+	window_content_N[window_id] = n;
+	
+	return n;
+}
+
+void window_content_clear(int window_id)
+{
+	window_content_invalidate(window_id);
+	
+	while(window_content_Arena[window_id] != NULL) {
+		window_arena *a = window_content_Arena[window_id];
+		window_content_Arena[window_id] = a->next;
+		free(a);
+	}
+	window_content_N[window_id] = -1;
+}
+
+void window_content_free(int window_id)
+{
+	window_content_clear(window_id);
+	
+	FREE(window_content_Name[window_id]);
+	FREE(window_content_Type[window_id]);
+	FREE(window_content_Size[window_id]);
+	FREE(window_content_Selected[window_id]);
+	window_content_max[window_id] = 0;
+}
+
+// next entry of the job without size : the displayed rows first, then WINDOW_PREFETCH rows around them
+static int FM_prefetch_next(int window_id)
+{
+	FM_prefetch_job *job = &FM_prefetch_jobs[window_id];
+	int N = window_content_N[window_id];
+	int i;
+	
+	for(i = job->first; i <= job->last && i <= N; i++) {
+		if(window_content_Size[window_id][i] == WINDOW_SIZE_UNKNOWN) return i;
+	}
+	for(i = job->last + 1; i <= job->last + WINDOW_PREFETCH && i <= N; i++) {
+		if(window_content_Size[window_id][i] == WINDOW_SIZE_UNKNOWN) return i;
+	}
+	for(i = job->first - 1; job->first - WINDOW_PREFETCH <= i && 0 <= i; i--) {
+		if(window_content_Size[window_id][i] == WINDOW_SIZE_UNKNOWN) return i;
+	}
+	
+	return -1;
+}
+
+void FM_prefetch_thread(void *unused)
+{
+	char path[WINDOW_MAX_PATH_LENGTH + 256];
+	struct stat s;
+	
+	while(FM_prefetch) {
+		int w, n=-1;
+		u32 gen=0;
+		
+		sysLwMutexLock(&FM_prefetch_lock, 0);
+		for(w=0; w<WINDOW_MAX; w++) {
+			if(window_open[w] == NO || window_content_Name[w] == NULL) continue;
+			if(FM_prefetch_jobs[w].gen != window_content_gen[w]) continue;
+			n = FM_prefetch_next(w);
+			if(n < 0) continue;
+			gen = window_content_gen[w];
+			snprintf(path, sizeof(path), "%s/%s", FM_prefetch_jobs[w].path, window_content_Name[w][n]);
+			break;
+		}
+		sysLwMutexUnlock(&FM_prefetch_lock);
+		
+		if(n < 0) {
+			usleep(20000);
+			continue;
+		}
+		
+		u64 size = 0;
+		if(stat(path, &s) == 0 && !S_ISDIR(s.st_mode)) size = s.st_size;
+		
+		sysLwMutexLock(&FM_prefetch_lock, 0);
+		if(window_content_gen[w] == gen) window_content_Size[w][n] = size;
+		sysLwMutexUnlock(&FM_prefetch_lock);
+	}
+	
+	sysThreadExit(0);
+}
+
+void start_FM_prefetch()
+{
+	if(FM_prefetch==NO) {
+		FM_prefetch = YES;
+		sysThreadCreate(&FM_prefetch_id, FM_prefetch_thread, NULL, 1500, 0x4000, THREAD_JOINABLE, "FM_prefetch");
+	}
+}
+
+void end_FM_prefetch()
+{
+	if(FM_prefetch) {
+		u64 ret;
+		FM_prefetch = NO;
+		sysThreadJoin(FM_prefetch_id, &ret);
+	}
+}
+
+// called for the displayed rows, returns YES while some of them don't have their size yet
+u8 FM_prefetch_post(int window_id, int first, int last)
+{
+	u8 pending = NO;
+	int i;
+	
+	if( MGZ_fs_threads(window_path[window_id]) == 1 ) {
+		char path[WINDOW_MAX_PATH_LENGTH + 256];
+		struct stat s;
+		
+		sysLwMutexLock(&FM_prefetch_lock, 0);
+		// a generation that doesn't match : no job for the prefetch thread
+		FM_prefetch_jobs[window_id].gen = window_content_gen[window_id] - 1;
+		for(i = first; i <= last && i <= window_content_N[window_id]; i++) {
+			if(window_content_Size[window_id][i] != WINDOW_SIZE_UNKNOWN) continue;
+			snprintf(path, sizeof(path), "%s/%s", window_path[window_id], window_content_Name[window_id][i]);
+			u64 size = 0;
+			if(stat(path, &s) == 0 && !S_ISDIR(s.st_mode)) size = s.st_size;
+			window_content_Size[window_id][i] = size;
+		}
+		sysLwMutexUnlock(&FM_prefetch_lock);
+		
+		return NO;
+	}
+	
+	sysLwMutexLock(&FM_prefetch_lock, 0);
+	FM_prefetch_jobs[window_id].gen = window_content_gen[window_id];
+	FM_prefetch_jobs[window_id].first = first;
+	FM_prefetch_jobs[window_id].last = last;
+	strcpy(FM_prefetch_jobs[window_id].path, window_path[window_id]);
+	for(i = first; i <= last && i <= window_content_N[window_id]; i++) {
+		if(window_content_Size[window_id][i] == WINDOW_SIZE_UNKNOWN) pending = YES;
+	}
+	sysLwMutexUnlock(&FM_prefetch_lock);
+	
+	return pending;
+}
+
 void init_FileExplorer()
 {
 	int i;
@@ -24284,6 +24118,16 @@ void init_FileExplorer()
 	for(i=0; i<WINDOW_MAX; i++) window_content_Type[i]=NULL;
 	window_content_Selected = (u8 **) malloc(WINDOW_MAX * sizeof(u8 *));
 	for(i=0; i<WINDOW_MAX; i++) window_content_Selected[i]=NULL;
+	window_content_Arena = (window_arena **) malloc(WINDOW_MAX * sizeof(window_arena *));
+	for(i=0; i<WINDOW_MAX; i++) window_content_Arena[i]=NULL;
+	window_content_max = (int *) malloc(WINDOW_MAX * sizeof(int));
+	memset(window_content_max, 0, WINDOW_MAX * sizeof(int));
+	window_content_gen = (u32 *) malloc(WINDOW_MAX * sizeof(u32));
+	memset(window_content_gen, 0, WINDOW_MAX * sizeof(u32));
+	FM_prefetch_jobs = (FM_prefetch_job *) malloc(WINDOW_MAX * sizeof(FM_prefetch_job));
+	memset(FM_prefetch_jobs, 0, WINDOW_MAX * sizeof(FM_prefetch_job));
+	// no job posted yet
+	for(i=0; i<WINDOW_MAX; i++) FM_prefetch_jobs[i].gen = -1;
 	
 	window_sort = (u8 *) malloc(WINDOW_MAX * sizeof(u8));
 	window_w_col_size = (float *) malloc(WINDOW_MAX * sizeof(float));
@@ -24300,20 +24144,26 @@ void init_FileExplorer()
 	
 	window_item_N = (s8 *) malloc(WINDOW_MAX * sizeof(s8));
 	
-	option_copy = (char **) malloc(WINDOW_MAX_ITEMS * sizeof(char *));
-	for(i=0; i<WINDOW_MAX_ITEMS; i++) option_copy[i]=NULL;
+	option_copy = NULL;
+	option_copy_N = -1;
 	
 	DevicesInfo = (DeviceInfo_t *) malloc(WINDOW_MAX_ITEMS * sizeof(DeviceInfo_t));
 	memset(DevicesInfo, 0, sizeof(DevicesInfo));
 	
 	DevicesInfo_N = -1;
+	
+	sys_lwmutex_attr_t attr = {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""};
+	sysLwMutexCreate(&FM_prefetch_lock, &attr);
+	start_FM_prefetch();
 }
 
 void finalize_FileExplorer()
 {
 
-	u32 i,j;
+	u32 i;
 
+	end_FM_prefetch();
+	
 	FREE(window_x);
 	FREE(window_y);
 	FREE(window_z);
@@ -24326,29 +24176,16 @@ void finalize_FileExplorer()
 	for(i=0; i<WINDOW_MAX; i++) FREE(window_lastpath[i]);
 	FREE(window_lastpath);
 	
-	for(i=0; i<WINDOW_MAX; i++) {
-		if(window_content_Name[i] == NULL) continue;
-		for(j=0; j<WINDOW_MAX_ITEMS; j++) {
-			FREE(window_content_Name[i][j]);
-		}
-		FREE(window_content_Name[i]);
-	}
+	for(i=0; i<WINDOW_MAX; i++) window_content_free(i);
 	FREE(window_content_Name);
-	
-	
-	for(i=0; i<WINDOW_MAX; i++) {
-		if(window_content_Type[i] == NULL) continue;
-		for(j=0; j<WINDOW_MAX_ITEMS; j++) {
-			FREE(window_content_Type[i][j]);
-		}
-		FREE(window_content_Type[i]);
-	}
 	FREE(window_content_Type);
-
-	for(i=0; i<WINDOW_MAX; i++) FREE(window_content_Size[i]);
 	FREE(window_content_Size);
-	for(i=0; i<WINDOW_MAX; i++) FREE(window_content_Selected[i]);
 	FREE(window_content_Selected);
+	FREE(window_content_Arena);
+	FREE(window_content_max);
+	FREE(window_content_gen);
+	FREE(FM_prefetch_jobs);
+	sysLwMutexDestroy(&FM_prefetch_lock);
 
 	FREE(window_sort);
 	FREE(window_w_col_size);
@@ -24363,8 +24200,9 @@ void finalize_FileExplorer()
 
 	FREE(window_item_N);
 
-	for(i=0; i<WINDOW_MAX_ITEMS; i++) FREE(option_copy[i]);
+	for(i=0; (int) i<=option_copy_N; i++) FREE(option_copy[i]);
 	FREE(option_copy);
+	option_copy_N = -1;
 	
 	free(DevicesInfo);
 }
@@ -25099,6 +24937,9 @@ void Draw_window()
 		window_scroll_size[n] = (window_h[n]-TOP_H-COL_H-BORDER) - (SCROLL_H_MIN*window_scroll_N[n]);
 		if( window_scroll_size[n] < SCROLL_H_MIN ) window_scroll_size[n] = SCROLL_H_MIN;
 		
+		// redraw until the sizes of the displayed files are known
+		if( FM_prefetch_post(n, window_scroll_P[n], window_scroll_P[n]+window_item_N[n]) ) Redraw_Animate(100000);
+		
 		if(window_scroll_N[n]>0) {
 			
 			SCROLL_W = SCROLL_W1;
@@ -25351,7 +25192,8 @@ void Draw_window()
 						 0, BLACK);
 							 
 			
-			if( is_folder(window_content_Type[n][window_scroll_P[n]+i]) == NO && strcmp(window_path[n], "/") != 0) {
+			if( is_folder(window_content_Type[n][window_scroll_P[n]+i]) == NO && strcmp(window_path[n], "/") != 0
+			&&  window_content_Size[n][window_scroll_P[n]+i] != WINDOW_SIZE_UNKNOWN) {
 				char *size_str = get_unit(window_content_Size[n][window_scroll_P[n]+i]);
 				float size_str_w = WidthFromStr(size_str);
 				DrawString(window_x[n]+window_w[n]-BORDER-SCROLL_W-size_str_w - 5  , window_y[n]+TOP_H+COL_H+LINE_H*i, size_str);
@@ -25786,179 +25628,85 @@ void Draw_cursor()
 	}
 }
 
+typedef struct
+{
+	char *name;
+	char *type;
+	u64 size;
+	u8 selected;
+	u8 folder;
+} sort_item;
+
+static u8 sort_order;
+
+static int sort_cmp(const void *a, const void *b)
+{
+	const sort_item *x = (const sort_item *) a;
+	const sort_item *y = (const sort_item *) b;
+	
+	// ASC : folders first, DSC : files first
+	if(x->folder != y->folder) {
+		if(sort_order == ASC) return x->folder ? -1 : 1;
+		return x->folder ? 1 : -1;
+	}
+	
+	int r = strcasecmp(x->name, y->name);
+	
+	return sort_order == ASC ? r : -r;
+}
+
 void sort(int window_id)
 {
 	if(window_id==-1) return;
 	
 	if(strcmp(window_path[window_id], "/") == 0) window_sort[window_id] = ASC;
 	
-	int min;
-	u8 t;
-	u64 t1;
-	int i, j;
-	int Folder_N = -1;
-	int File_N = -1;
-	
-	for (i = 0; i<=window_content_N[window_id]; i++) {
-		if(strcmp(window_content_Name[window_id][i], "..") == 0) continue;
-		if( is_folder(window_content_Type[window_id][i]) ) Folder_N++;
-		else File_N++;
-	}
+	int i, N=-1;
+	u8 Parent = strcmp(window_path[window_id], "/") != 0 ? YES : NO;
 	
-	char **list_Dir = (char **) malloc( (Folder_N+2) * sizeof(char*) );
-	u8 *list_Dir_sel = (u8 *) malloc( (Folder_N+2) * sizeof(u8) );
-	char **list_Dir_type = (char **) malloc( (Folder_N+2) * sizeof(char*) );
+	// only the pointers are moved
+	sort_item *list = (sort_item *) malloc( (window_content_N[window_id]+1) * sizeof(sort_item) );
+	if(list == NULL) return;
 	
-	char **list_Fil = (char **) malloc( (File_N+2) * sizeof(char*) );
-	u64 *list_Fil_siz = (u64 *) malloc( (File_N+2) * sizeof(u64) );
-	u8 *list_Fil_sel = (u8 *) malloc( (File_N+2) * sizeof(u8) );
-	char **list_Fil_type = (char **) malloc( (File_N+2) * sizeof(char*) );
-	
-
-	Folder_N = -1;
-	File_N = -1;
 	for (i = 0; i<=window_content_N[window_id]; i++) {
 		if(strcmp(window_content_Name[window_id][i], "..") == 0) continue;
-		if( is_folder(window_content_Type[window_id][i]) ) {
-			Folder_N++;
-			list_Dir[Folder_N] = strcpy_malloc(window_content_Name[window_id][i]);
-			list_Dir_sel[Folder_N] = window_content_Selected[window_id][i];
-			list_Dir_type[Folder_N] = strcpy_malloc(window_content_Type[window_id][i]);
-		} else {
-			File_N++;
-			list_Fil[File_N] = strcpy_malloc(window_content_Name[window_id][i]);
-			list_Fil_sel[File_N] = window_content_Selected[window_id][i];
-			list_Fil_siz[File_N] = window_content_Size[window_id][i];
-			list_Fil_type[File_N] = strcpy_malloc(window_content_Type[window_id][i]);
-		}
+		N++;
+		list[N].name = window_content_Name[window_id][i];
+		list[N].type = window_content_Type[window_id][i];
+		list[N].size = window_content_Size[window_id][i];
+		list[N].selected = window_content_Selected[window_id][i];
+		list[N].folder = is_folder(window_content_Type[window_id][i]);
 	}
 	
-	char *ta=NULL;
-	char *tb=NULL;
-	
-	for (i = 0; i<Folder_N; i++) { 
-		min = i;
-		for (j = i+1; j <= Folder_N; j++) { 
-			FREE(ta);
-			FREE(tb);
-			ta = strcpy_malloc(list_Dir[j]);
-			tb = strcpy_malloc(list_Dir[min]);
-			if(ta[0]>=97 && ta[0]<=123) ta[0]-=32;
-			if(tb[0]>=97 && tb[0]<=123) tb[0]-=32;
-			if(window_sort[window_id] == ASC) {
-				if(strcasecmp(ta, tb) < 0) min = j;
-			} else if(strcasecmp(ta, tb) > 0) min = j;
-		}
-		if(min==i) continue;
-		
-		FREE(ta);
-		ta = strcpy_malloc(list_Dir[min]);
-		FREE(list_Dir[min]);
-		list_Dir[min] = strcpy_malloc(list_Dir[i]);
-		FREE(list_Dir[i]);
-		list_Dir[i] = strcpy_malloc(ta);
-		
-		t = list_Dir_sel[min];
-		list_Dir_sel[min] = list_Dir_sel[i];
-		list_Dir_sel[i] = t;
-		
-		FREE(ta);
-		ta = strcpy_malloc(list_Dir_type[min]);
-		FREE(list_Dir_type[min]);
-		list_Dir_type[min] = strcpy_malloc(list_Dir_type[i]);
-		FREE(list_Dir_type[i]);
-		list_Dir_type[i] = strcpy_malloc(ta);
-	}
-	
-	for (i = 0; i<File_N; i++) { 
-		min = i;
-		for (j = i+1; j <= File_N; j++) {
-			FREE(ta);
-			FREE(tb);
-			ta = strcpy_malloc(list_Fil[j]);
-			tb = strcpy_malloc(list_Fil[min]);
-			if(ta[0]>=97 && ta[0]<=123) ta[0]-=32;
-			if(tb[0]>=97 && tb[0]<=123) tb[0]-=32;
-			if(window_sort[window_id] == ASC) {
-				if(strcasecmp(ta, tb) < 0) min = j;
-			} else if(strcasecmp(ta, tb) > 0) min = j;
+	while(window_content_max[window_id] <= N+Parent) {
+		if(window_content_grow(window_id) == FAILED) {
+			free(list);
+			return;
 		}
-		if(min==i) continue;
-		
-		FREE(ta);
-		ta = strcpy_malloc(list_Fil[min]);
-		FREE(list_Fil[min]);
-		list_Fil[min] = strcpy_malloc(list_Fil[i]);
-		FREE(list_Fil[i]);
-		list_Fil[i] = strcpy_malloc(ta);
-		
-		t = list_Fil_sel[min];
-		list_Fil_sel[min] = list_Fil_sel[i];
-		list_Fil_sel[i] = t;
-		
-		t1 = list_Fil_siz[min];
-		list_Fil_siz[min] = list_Fil_siz[i];
-		list_Fil_siz[i] = t1;
-
-		FREE(ta);
-		ta = strcpy_malloc(list_Fil_type[min]);
-		FREE(list_Fil_type[min]);
-		list_Fil_type[min] = strcpy_malloc(list_Fil_type[i]);
-		FREE(list_Fil_type[i]);
-		list_Fil_type[i] = strcpy_malloc(ta);
 	}
 	
-	FREE(ta);
-	FREE(tb);
+	sort_order = window_sort[window_id];
+	qsort(list, N+1, sizeof(sort_item), sort_cmp);
 	
-	u32 n;
-	for(n=0; n<WINDOW_MAX_ITEMS; n++) FREE(window_content_Name[window_id][n]);
+	// the sizes move under the prefetch thread
+	window_content_invalidate(window_id);
 	
-	u8 Parent=NO;
-	if(strcmp(window_path[window_id], "/") != 0) {
-		Parent=YES;
-		window_content_Name[window_id][0] = strcpy_malloc("..");
+	if(Parent) {
+		window_content_Name[window_id][0] = "..";
 		window_content_Selected[window_id][0] = NO;
-		window_content_Type[window_id][0] = strcpy_malloc(_SDIR);
+		window_content_Type[window_id][0] = _SDIR;
 		window_content_Size[window_id][0] = 0;
 	}
-
-	if(window_sort[window_id] == ASC) {
-		for(j=0; j<=Folder_N; j++) {
-			window_content_Name[window_id][j+Parent] = strcpy_malloc(list_Dir[j]);
-			window_content_Selected[window_id][j+Parent] = list_Dir_sel[j];
-			window_content_Type[window_id][j+Parent] = strcpy_malloc(list_Dir_type[j]);
-			window_content_Size[window_id][j+Parent] = 0;
-		}
-		for(j=0; j<=File_N; j++) {
-			window_content_Name[window_id][j+Parent+Folder_N+1] = strcpy_malloc(list_Fil[j]);
-			window_content_Selected[window_id][j+Parent+Folder_N+1] = list_Fil_sel[j];
-			window_content_Type[window_id][j+Parent+Folder_N+1] = strcpy_malloc(list_Fil_type[j]);
-			window_content_Size[window_id][j+Parent+Folder_N+1] = list_Fil_siz[j];
-		}
-	} else {
-		for(j=0; j<=File_N; j++) {
-			window_content_Name[window_id][j+Parent] = strcpy_malloc(list_Fil[j]);
-			window_content_Selected[window_id][j+Parent] = list_Fil_sel[j];
-			window_content_Type[window_id][j+Parent] = strcpy_malloc(list_Fil_type[j]);
-			window_content_Size[window_id][j+Parent] = list_Fil_siz[j];
-		}
-		for(j=0; j<=Folder_N; j++) {
-			window_content_Name[window_id][j+Parent+File_N+1] = strcpy_malloc(list_Dir[j]);
-			window_content_Selected[window_id][j+Parent+File_N+1] = list_Dir_sel[j];
-			window_content_Type[window_id][j+Parent+File_N+1] = strcpy_malloc(list_Dir_type[j]);
-			window_content_Size[window_id][j+Parent+File_N+1] = 0;
-		}
-	}
 	
+	for(i=0; i<=N; i++) {
+		window_content_Name[window_id][i+Parent] = list[i].name;
+		window_content_Selected[window_id][i+Parent] = list[i].selected;
+		window_content_Type[window_id][i+Parent] = list[i].type;
+		window_content_Size[window_id][i+Parent] = list[i].size;
+	}
+	window_content_N[window_id] = N+Parent;
 	
-	FREE(list_Dir);
-	FREE(list_Dir_sel);
-	FREE(list_Dir_type);
-	FREE(list_Fil);
-	FREE(list_Fil_siz);
-	FREE(list_Fil_sel);
-	FREE(list_Fil_type);
+	free(list);
 }
 
 void CloseWindow(int window_id)
@@ -25969,12 +25717,7 @@ void CloseWindow(int window_id)
 	
 	FREE(window_path[window_id]);
 	FREE(window_lastpath[window_id]);	
-	for(i=0; i<WINDOW_MAX_ITEMS; i++) FREE(window_content_Name[window_id][i]);
-	FREE(window_content_Name[window_id]);
-	FREE(window_content_Size[window_id]);
-	for(i=0; i<WINDOW_MAX_ITEMS; i++) FREE(window_content_Type[window_id][i]);
-	FREE(window_content_Type[window_id]);
-	FREE(window_content_Selected[window_id]);
+	window_content_free(window_id);
 	
 	window_open[window_id] = NO;
 	
@@ -26021,17 +25764,9 @@ u8 OpenWindow()
 	window_lastpath[window_activ] = (char *) malloc(WINDOW_MAX_PATH_LENGTH * sizeof(char));
 	window_path[window_activ] = (char *) malloc(WINDOW_MAX_PATH_LENGTH * sizeof(char));
 	
-	window_content_Type[window_activ] = (char **) malloc(WINDOW_MAX_ITEMS * sizeof(char *));
-	window_content_Name[window_activ] = (char **) malloc(WINDOW_MAX_ITEMS * sizeof(char *));
-	
-	for(n=0; n<WINDOW_MAX_ITEMS; n++) {
-		window_content_Name[window_activ][n]=NULL;
-		window_content_Type[window_activ][n]=NULL;
-	}
-
-	window_content_Size[window_activ] = (u64 *) malloc(WINDOW_MAX_ITEMS * sizeof(u64));
-	
-	window_content_Selected[window_activ] = (u8 *) malloc(WINDOW_MAX_ITEMS * sizeof(u8));
+	// the arrays grow with the listing
+	window_content_N[window_activ] = -1;
+	window_content_grow(window_activ);
 	
 	strcpy(window_path[window_activ], "/");
 	strcpy(window_lastpath[window_activ], window_path[window_activ]);
@@ -26079,6 +25814,7 @@ void RefreshDevices()
 		DevicesInfo_N++;
 		sprintf(temp, "/%s/", dir->d_name);
 		GetDeviceInfo(temp, &DevicesInfo[DevicesInfo_N]);
+		delete_purge_resume(temp);
 	}
 	closedir(d);
 	
@@ -26092,6 +25828,7 @@ void RefreshDevices()
 			sprintf(temp, "/ntfs%c:/", 48+i);
 			DevicesInfo_N++;
 			GetDeviceInfo(temp, &DevicesInfo[DevicesInfo_N]);
+			delete_purge_resume(temp);
 		}
 	}
 
@@ -26111,14 +25848,7 @@ void RefreshWindow(window_id)
 	int n, i; 
 	if(window_open[window_id] == NO) return;
 	
-	// clear
-	window_content_N[window_id]=-1;
-	for(n=0; n<WINDOW_MAX_ITEMS; n++) {
-		FREE(window_content_Name[window_id][n]);
-		FREE(window_content_Type[window_id][n]);
-		window_content_Size[window_id][n] = 0;
-		window_content_Selected[window_id][n] = NO;
-	}
+	window_content_clear(window_id);
 	
 	u8 hide_dev_flash=dev_blind_exist();
 	if( hide_dev_flash && !strncmp(window_path[window_id], "/dev_flash", 10) ) {
@@ -26150,59 +25880,51 @@ void RefreshWindow(window_id)
 		if(strcmp(dir->d_name, "..")==0) continue; // NTFS : added for all directories after
 		if(!strncmp(dir->d_name, "$", 1)) continue; // NTFS : ignore system files
 
-		if(window_content_N[window_id] == WINDOW_MAX_ITEMS-1) {
-			show_msg("Too many files...");
-			closedir(d);
-			sort(window_id);
-			return;
-		}
-		
 		if( hide_dev_flash ) {
 			if(strcmp(window_path[window_id], "/") == 0) {
 				if( !strcmp(dir->d_name, "dev_flash")) continue;
 			}
 		}
 		
-		window_content_N[window_id]++;
+		char *type = NULL;
+		u64 size = 0;
 		
 		if(dir->d_type & DT_DIR) {
-			window_content_Type[window_id][window_content_N[window_id]] = strcpy_malloc(_SDIR);
+			type = _SDIR;
 			if(strcmp(window_path[window_id], "/") == 0) {
 				if(strcmp(dir->d_name, "app_home") == 0 || strcmp(dir->d_name, "dev_bdvd") == 0) {
 					sprintf(temp, "/%s", dir->d_name);
-					window_content_Type[window_id][window_content_N[window_id]] = strcpy_malloc(get_ext(temp));
+					type = get_ext(temp);
 				}
 			}
 		} else 
 		if(dir->d_type & DT_REG) {
-			if(strcmp(window_path[window_id], "/") != 0) {
-				sprintf(temp, "%s/%s", window_path[window_id], dir->d_name);
-				window_content_Size[window_id][window_content_N[window_id]] = get_size(temp);	
-			}
-			window_content_Type[window_id][window_content_N[window_id]] = strcpy_malloc(get_ext(dir->d_name));
+			// read by the prefetch thread when it's displayed
+			if(strcmp(window_path[window_id], "/") != 0) size = WINDOW_SIZE_UNKNOWN;
 		} 
 		else {
 			if(strcmp(window_path[window_id], "/") == 0) {
 				sprintf(temp, "/%s", dir->d_name);
 				if( can_opendir(temp) ) {
-					window_content_Type[window_id][window_content_N[window_id]] = get_ext(temp);
-					if( is_folder(window_content_Type[window_id][window_content_N[window_id]]) == NO) {
-						window_content_Type[window_id][window_content_N[window_id]] = strcpy_malloc(_SDIR);
-					}
+					type = get_ext(temp);
+					if( is_folder(type) == NO) type = _SDIR;
 				} else {
-					window_content_Type[window_id][window_content_N[window_id]] = strcpy_malloc(_SFILE);
+					type = _SFILE;
 				}
 			} else {
 				sprintf(temp, "%s/%s", window_path[window_id], dir->d_name);
 				if( can_opendir(temp) ) {
-					window_content_Type[window_id][window_content_N[window_id]] = strcpy_malloc(_SDIR);
+					type = _SDIR;
 				} else {
-					window_content_Size[window_id][window_content_N[window_id]] = get_size(temp);
-					window_content_Type[window_id][window_content_N[window_id]] = strcpy_malloc(get_ext(dir->d_name));
+					size = WINDOW_SIZE_UNKNOWN;
 				}
 			}
 		}
-		window_content_Name[window_id][window_content_N[window_id]] = strcpy_malloc(dir->d_name);
+		
+		if( window_content_add(window_id, dir->d_name, type, size) < 0 ) {
+			show_msg(STR_FAILED);
+			break;
+		}
 	}
 	closedir(d);
 	
@@ -26213,26 +25935,20 @@ void RefreshWindow(window_id)
 			sprintf(temp, "ntfs%c", 48+i);
 			n = NTFS_Test_Device(temp);
 			if(n>=0) {
-				window_content_N[window_id]++;
-				window_content_Type[window_id][window_content_N[window_id]] = strcpy_malloc(_SDIR);
 				sprintf(temp, "ntfs%c:", 48+i);
-				window_content_Name[window_id][window_content_N[window_id]] = strcpy_malloc(temp);
+				window_content_add(window_id, temp, _SDIR, 0);
 			}
 		}
 		
 		for(i = 0; i < MAXFDS; i++) {
 			if( exFAT_is_mounted(i) ) {
-				window_content_N[window_id]++;
-				window_content_Type[window_id][window_content_N[window_id]] = strcpy_malloc(_SDIR);
 				sprintf(temp, "exFAT%d:", i);
-				window_content_Name[window_id][window_content_N[window_id]] = strcpy_malloc(temp);	
+				window_content_add(window_id, temp, _SDIR, 0);
 			}
 		}
 		
 	} else {
-		window_content_N[window_id]++;
-		window_content_Type[window_id][window_content_N[window_id]] = strcpy_malloc(_SDIR);
-		window_content_Name[window_id][window_content_N[window_id]] = strcpy_malloc("..");
+		window_content_add(window_id, "..", _SDIR, 0);
 	}
 	
 	sort(window_id);
@@ -26269,56 +25985,38 @@ void Window(char *directory)
 	
 #ifdef RPCS3
 	
-	window_content_N[window_activ]=-1;
+	window_content_clear(window_activ);
 	int n;
-	for(n=0; n<WINDOW_MAX_ITEMS; n++) {
-		FREE(window_content_Name[window_activ][n]);
-		FREE(window_content_Type[window_activ][n]);
-		window_content_Size[window_activ][n] = 0;
-		window_content_Selected[window_activ][n] = NO;
-	}
 	
 	if(strcmp(window_path[window_activ], "/") == 0) {
 		DevicesInfo_N=-1;
 		memset(DevicesInfo, 0, sizeof(DevicesInfo));
 		
-		window_content_N[window_activ]++;
-		window_content_Type[window_activ][window_content_N[window_activ]] = strcpy_malloc(_SDIR);
-		window_content_Name[window_activ][window_content_N[window_activ]] = strcpy_malloc("dev_hdd0");
+		n = window_content_add(window_activ, "dev_hdd0", _SDIR, 0);
 		DevicesInfo_N++;
-		GetDeviceInfo("/dev_hdd0/", &DevicesInfo[window_content_N[window_activ]]);
+		GetDeviceInfo("/dev_hdd0/", &DevicesInfo[n]);
 		
-		window_content_N[window_activ]++;
-		window_content_Type[window_activ][window_content_N[window_activ]] = strcpy_malloc(_SDIR);
-		window_content_Name[window_activ][window_content_N[window_activ]] = strcpy_malloc("dev_hdd1");
+		n = window_content_add(window_activ, "dev_hdd1", _SDIR, 0);
 		DevicesInfo_N++;
-		GetDeviceInfo("/dev_hdd1/", &DevicesInfo[window_content_N[window_activ]]);
+		GetDeviceInfo("/dev_hdd1/", &DevicesInfo[n]);
 		
-		window_content_N[window_activ]++;
-		window_content_Type[window_activ][window_content_N[window_activ]] = strcpy_malloc(_SDIR);
-		window_content_Name[window_activ][window_content_N[window_activ]] = strcpy_malloc("dev_usb000");
+		n = window_content_add(window_activ, "dev_usb000", _SDIR, 0);
 		DevicesInfo_N++;
-		GetDeviceInfo("/dev_usb000/", &DevicesInfo[window_content_N[window_activ]]);
+		GetDeviceInfo("/dev_usb000/", &DevicesInfo[n]);
 		
-		window_content_N[window_activ]++;
-		window_content_Type[window_activ][window_content_N[window_activ]] = strcpy_malloc(_SDIR);
-		window_content_Name[window_activ][window_content_N[window_activ]] = strcpy_malloc("dev_flash");
+		n = window_content_add(window_activ, "dev_flash", _SDIR, 0);
 		DevicesInfo_N++;
-		GetDeviceInfo("/dev_flash/", &DevicesInfo[window_content_N[window_activ]]);
+		GetDeviceInfo("/dev_flash/", &DevicesInfo[n]);
 		
 // RPCS3 app_home = /dev_hdd0/game/MANAGUNZ0/USRDIR
 
-		window_content_N[window_activ]++;
-		window_content_Type[window_activ][window_content_N[window_activ]] = strcpy_malloc(_SDIR);
-		window_content_Name[window_activ][window_content_N[window_activ]] = strcpy_malloc("app_home");
+		n = window_content_add(window_activ, "app_home", _SDIR, 0);
 		DevicesInfo_N++;
-		GetDeviceInfo("/app_home/", &DevicesInfo[window_content_N[window_activ]]);
+		GetDeviceInfo("/app_home/", &DevicesInfo[n]);
 		
-		window_content_N[window_activ]++;
-		window_content_Type[window_activ][window_content_N[window_activ]] = strcpy_malloc(_SDIR);
-		window_content_Name[window_activ][window_content_N[window_activ]] = strcpy_malloc("app_home");
+		n = window_content_add(window_activ, "app_home", _SDIR, 0);
 		DevicesInfo_N++;
-		GetDeviceInfo("/dev_bdvd/", &DevicesInfo[window_content_N[window_activ]]);
+		GetDeviceInfo("/dev_bdvd/", &DevicesInfo[n]);
 		
 		return;
 	}
@@ -26542,6 +26240,7 @@ void picture_viewer_input()
 		picture_viewer_activ=NO;
 		memset(TMP_PIC_path, 0, sizeof(TMP_PIC_path));
 		TMP_PIC_offset = 0;
+		free_APNG();
 	}
 }
 
@@ -26549,7 +26248,7 @@ void Draw_picture_viewer()
 {
 	if(picture_viewer_activ == NO) return;	
 	
-	if(APNG_offset[0]!=0) {Draw_APNG(); return;}
+	if(APNG_stream != NULL) {Draw_APNG(); return;}
 	
 	SetFontZ(0);
 	
@@ -27253,10 +26952,7 @@ void Option(char *item)
 		if(ret != 0 ) {
 			show_msg(STR_FAILED);
 		} else {
-			window_content_N[window_activ]++;
-			window_content_Size[window_activ][window_content_N[window_activ]] = 0;
-			window_content_Type[window_activ][window_content_N[window_activ]] = strcpy_malloc(_SDIR);
-			window_content_Name[window_activ][window_content_N[window_activ]] = strcpy_malloc(&strrchr(temp, '/')[1]);
+			window_content_add(window_activ, &strrchr(temp, '/')[1], _SDIR, 0);
 			sort(window_activ);
 		}
 	} else
@@ -27273,10 +26969,7 @@ void Option(char *item)
 		if(f==NULL) show_msg(STR_FAILED);
 		else {
 			fclose(f);
-			window_content_N[window_activ]++;
-			window_content_Size[window_activ][window_content_N[window_activ]] = 0;
-			window_content_Type[window_activ][window_content_N[window_activ]] = strcpy_malloc(_SFILE);
-			window_content_Name[window_activ][window_content_N[window_activ]] = strcpy_malloc(&strrchr(temp, '/')[1]);
+			window_content_add(window_activ, &strrchr(temp, '/')[1], _SFILE, 0);
 			sort(window_activ);
 		}
 	} else
@@ -27293,12 +26986,12 @@ void Option(char *item)
 	if(strcmp(item, STR_SYMLINK_SRC) == 0) {
 		FREE(FM_OLD_PATH);
 		FM_OLD_PATH = strcpy_malloc(option_sel[0]);
-		for(i=0; i<WINDOW_MAX_ITEMS; i++) window_content_Selected[window_activ][i]=NO;
+		for(i=0; i<=window_content_N[window_activ]; i++) window_content_Selected[window_activ][i]=NO;
 	} else
 	if(strcmp(item, STR_SYMLINK_TARGET) == 0) {
 		{sys_map_path((char*)FM_OLD_PATH, option_sel[0]);}
 		FREE(FM_OLD_PATH);
-		for(i=0; i<WINDOW_MAX_ITEMS; i++) window_content_Selected[window_activ][i]=NO;
+		for(i=0; i<=window_content_N[window_activ]; i++) window_content_Selected[window_activ][i]=NO;
 	} else
 	if(strcmp(item, STR_LOAD_MAMBA) == 0) {
 		mamba = install_mamba();
@@ -27339,7 +27032,8 @@ void Option(char *item)
 			end_copy_loading();
 		}
 		
-		for(i=0; i<WINDOW_MAX_ITEMS; i++) FREE(option_copy[i]);	
+		for(i=0; i<=option_copy_N; i++) FREE(option_copy[i]);	
+		FREE(option_copy);
 		option_copy_N=-1;
 		Window(".");
 	} else
@@ -27360,19 +27054,31 @@ void Option(char *item)
 		Window(".");
 	} else
 	if(strcmp(item, STR_COPY) == 0) {
-		for(i=0; i<WINDOW_MAX_ITEMS; i++) FREE(option_copy[i]);
-		for(i=0; i<=option_sel_N; i++) {
-			option_copy[i] = strcpy_malloc(option_sel[i]);
+		for(i=0; i<=option_copy_N; i++) FREE(option_copy[i]);
+		FREE(option_copy);
+		option_copy_N = -1;
+		option_copy = (char **) malloc( (option_sel_N+1) * sizeof(char *));
+		if(option_copy != NULL) {
+			for(i=0; i<=option_sel_N; i++) {
+				option_copy[i] = strcpy_malloc(option_sel[i]);
+				if(option_copy[i] == NULL) break;
+				option_copy_N = i;
+			}
 		}
-		option_copy_N = option_sel_N;
 		option_cut = NO;
 	} else
 	if(strcmp(item, STR_CUT) == 0) {
-		for(i=0; i<WINDOW_MAX_ITEMS; i++) FREE(option_copy[i]);
-		for(i=0; i<=option_sel_N; i++) {
-			option_copy[i] = strcpy_malloc(option_sel[i]);
+		for(i=0; i<=option_copy_N; i++) FREE(option_copy[i]);
+		FREE(option_copy);
+		option_copy_N = -1;
+		option_copy = (char **) malloc( (option_sel_N+1) * sizeof(char *));
+		if(option_copy != NULL) {
+			for(i=0; i<=option_sel_N; i++) {
+				option_copy[i] = strcpy_malloc(option_sel[i]);
+				if(option_copy[i] == NULL) break;
+				option_copy_N = i;
+			}
 		}
-		option_copy_N = option_sel_N;
 		option_cut = YES;
 	} else
 	if(strcmp(item, STR_DELETE) == 0) {
@@ -27384,7 +27090,7 @@ void Option(char *item)
 		Window(".");
 	} else
 	if(strcmp(item, STR_UNSELECT_ALL) == 0) {
-		for(i=0; i<WINDOW_MAX_ITEMS; i++) window_content_Selected[window_activ][i]=NO;
+		for(i=0; i<=window_content_N[window_activ]; i++) window_content_Selected[window_activ][i]=NO;
 	} else
 	if(strcmp(item, STR_SELECT_ALL) == 0) {
 		for(i=0; i<=window_content_N[window_activ]; i++) {
@@ -27891,30 +27597,21 @@ void Option(char *item)
 		Window(".");
 	}
 	else 
-	if(strcmp(item, STR_CONVERT_DDS_PNG) == 0) { 
+	if(strcmp(item, STR_CONVERT_DDS_PNG) == 0 || strcmp(item, STR_CONVERT_TO_PNG) == 0) { 
 		start_loading();
-		for(i=0; i<=option_sel_N; i++) {
-			print_head("Converting to PNG...");
-			char dst[255];
-			strcpy(dst, option_sel[i]);
-			dst[strlen(dst)-3]='p';
-			dst[strlen(dst)-2]='n';
-			dst[strlen(dst)-1]='g';
-			ConvertImage(option_sel[i], dst);
-		}
-		end_loading();
-		Window(".");
-	}
-	else
-	if(strcmp(item, STR_CONVERT_TO_PNG) == 0) { 
-		start_loading();
-		for(i=0; i<=option_sel_N; i++) {
-			print_head("Converting to PNG...");
-			char dst[255];
-			strcpy(dst, option_sel[i]);
-			RemoveExtension(dst);
-			strcat(dst, ".png");
-			convert_to_png(option_sel[i], dst);
+		print_head("Converting to PNG...");
+		char **dst = (char **) malloc((option_sel_N+1) * sizeof(char *));
+		if( dst != NULL ) {
+			for(i=0; i<=option_sel_N; i++) {
+				dst[i] = (char *) malloc(strlen(option_sel[i]) + 5);
+				if( dst[i] == NULL ) break;
+				strcpy(dst[i], option_sel[i]);
+				RemoveExtension(dst[i]);
+				strcat(dst[i], ".png");
+			}
+			if( i > option_sel_N ) convert_to_png_batch(option_sel, dst, option_sel_N+1, Z_DEFAULT_COMPRESSION, MAKEPNG_FILTER_ADAPTIVE);
+			while(i>0) FREE(dst[--i]);
+			FREE(dst);
 		}
 		end_loading();
 		Window(".");
@@ -27957,6 +27654,13 @@ void Option(char *item)
 		Window(".");
 	}
 	else
+	if(strcmp(item, STR_ARCHIVE_CONTENT) == 0) {
+		start_loading();
+		i=archive_list_txt(option_sel[0]);
+		end_loading();
+		if(i==SUCCESS) open_txt_viewer("/dev_hdd0/tmp/archive_list.txt");
+	}
+	else
 	if(strcmp(item, STR_MOUNTGAME) == 0) {
 		start_loading();
 		read_game_setting(-1);
@@ -27999,9 +27703,11 @@ void Open_option()
 	
 	int i;
 	option_item = (char **) malloc(OPTION_MAX * sizeof(char *));
-	option_sel = (char **) malloc(WINDOW_MAX_ITEMS * sizeof(char *));
+	// at most every entry of the listing is selected
+	int sel_max = window_activ == -1 ? 1 : window_content_N[window_activ]+1;
+	option_sel = (char **) malloc(sel_max * sizeof(char *));
 	
-	for(i=0; i<WINDOW_MAX_ITEMS; i++) option_sel[i]=NULL;
+	for(i=0; i<sel_max; i++) option_sel[i]=NULL;
 	for(i=0; i<OPTION_MAX; i++) option_item[i]=NULL;
 	
 	if(window_activ == -1) {
@@ -28242,8 +27948,9 @@ void Open_option()
 					if(!strcasecmp(ext, ".vag")) {
 						add_option_item(STR_CONVERT_VAG_WAV);
 					} else
-					if(is_archive(ext)) {
+					if(is_archive(ext) || archive_format(option_sel[0]) != ARCHIVE_UNKNOWN) {
 						add_option_item(STR_EXTRACT_HERE);
+						if(option_sel_N==0) add_option_item(STR_ARCHIVE_CONTENT);
 					} 
 					
 					
@@ -28303,7 +28010,7 @@ void close_option()
 	for(i=0; i<OPTION_MAX; i++) FREE(option_item[i]);
 	FREE(option_item);
 	
-	for(i=0; i<WINDOW_MAX_ITEMS; i++) FREE(option_sel[i]);
+	for(i=0; i<=option_sel_N; i++) FREE(option_sel[i]);
 	FREE(option_sel);
 		
 	option_activ = NO;
@@ -28964,6 +28671,8 @@ void AutoRefresh_Windows()
 	if(PlugAndPlay == NO) {start_PlugAndPlay(); return;}
 	if(do_Refresh == NO) return;
 	
+	Redraw_Invalidate();
+	
 	NTFS_mount_all();
 	
 	exFAT_mount_all();
@@ -28990,41 +28699,52 @@ void Draw_FileExplorer()
 	end_loading();
 	
 	u8 LoopBreak=1;
+	Redraw_Invalidate();
 	while(LoopBreak)
 	{		
-		cls();
+		Redraw_Input();
 		
-		Draw_BGS();
-		Draw_MemMonitor();
-		
-		if(MENU) {
-			scene = SCENE_SETTINGS;
-			Draw_MENU();
-			Draw_MENU_input();
-			Draw_picture_viewer();
-			Draw_txt_viewer();
-			Draw_SFO_viewer();
-			Draw_Notification();
+		// nothing changed : the previous frame stays on screen
+		if(Redraw_Frame(get_usec()) == NO) {
+			AutoRefresh_Windows();
+			usleep(1000000/60);
+			ps3pad_read();
 		} else {
-			scene = SCENE_FILEMANAGER;
-			Draw_window();
-			Draw_option();
-			Draw_properties();
-			Draw_picture_viewer();
-			Draw_txt_viewer();
-			Draw_SFO_viewer();
-			Draw_Notification();
-			Draw_input();
-			Draw_cursor();
+			cls();
+			
+			Draw_BGS();
+			Draw_MemMonitor();
+			
+			if(MENU) {
+				scene = SCENE_SETTINGS;
+				Draw_MENU();
+				Draw_MENU_input();
+				Draw_picture_viewer();
+				Draw_txt_viewer();
+				Draw_SFO_viewer();
+				Draw_Notification();
+			} else {
+				scene = SCENE_FILEMANAGER;
+				Draw_window();
+				Draw_option();
+				Draw_properties();
+				Draw_picture_viewer();
+				Draw_txt_viewer();
+				Draw_SFO_viewer();
+				Draw_Notification();
+				Draw_input();
+				Draw_cursor();
+			}
+			
+			AutoRefresh_Windows();
+			
+			Redraw_Done(get_usec());
+			tiny3d_Flip();
+			ps3pad_read();
+			
+			ScreenShot();
 		}
 		
-		AutoRefresh_Windows();
-		
-		tiny3d_Flip();
-		ps3pad_read();
-		
-		ScreenShot();
-		
 		if(MENU) {
 			input_MENU();
 		} else {
@@ -36895,6 +36615,9 @@ void init_SETTINGS()
 	
 	add_item_MENU(STR_FIX_PERMS, ITEM_TEXTBOX);
 	
+	add_item_MENU("Fast delete", ITEM_TOGGLE);
+	ITEMS_VALUE_POSITION[ITEMS_NUMBER] = Fast_Delete;
+	
 	add_item_MENU("MGZ log", ITEM_TOGGLE);
 	ITEMS_VALUE_POSITION[ITEMS_NUMBER] = LOG;
 	
@@ -36904,6 +36627,9 @@ void init_SETTINGS()
 
 void update_SETTINGS()
 {
+	if(item_is("Fast delete")) {
+		Fast_Delete = ITEMS_VALUE_POSITION[ITEMS_POSITION];
+	} else
 	if(item_is("MGZ log")) {
 		LOG = ITEMS_VALUE_POSITION[ITEMS_POSITION];
 	} else
@@ -40933,6 +40659,8 @@ void input_MAIN()
 		//end_MemMonitor();
 		end_Load_GAMEPIC();
 		end_load_CURPIC();
+		http_session_end();
+		delete_purge_stop();
 		sysModuleUnload(SYSMODULE_PNGDEC);
 		sysModuleUnload(SYSMODULE_JPGDEC);
 		ioPadEnd();
@@ -40976,6 +40704,8 @@ void input_MAIN()
 			if(mounted) {
 				end_Load_GAMEPIC();
 				end_load_CURPIC();
+				http_session_end();
+				delete_purge_stop();
 				sysModuleUnload(SYSMODULE_PNGDEC);
 				sysModuleUnload(SYSMODULE_JPGDEC);
 				ioPadEnd();
@@ -41484,6 +41214,8 @@ int main(void)
 	Draw_FileExplorer();
 	
 	ioPadEnd();
+	http_session_end();
+	delete_purge_stop();
 	sysModuleUnload(SYSMODULE_PNGDEC);
 	sysModuleUnload(SYSMODULE_JPGDEC);
 	
@@ -41514,6 +41246,8 @@ int main(void)
 			
 			if(NewPad(BUTTON_CIRCLE)) {
 				ioPadEnd();
+				http_session_end();
+				delete_purge_stop();
 				sysModuleUnload(SYSMODULE_PNGDEC);
 				sysModuleUnload(SYSMODULE_JPGDEC);
 				LoopBreak=0;
@@ -41559,6 +41293,8 @@ int main(void)
 			ps3pad_read();
 			
 			if(NewPad(BUTTON_CIRCLE)) {
+				http_session_end();
+				delete_purge_stop();
 				sysModuleUnload(SYSMODULE_PNGDEC);
 				sysModuleUnload(SYSMODULE_JPGDEC);
 				ioPadEnd();
@@ -41588,35 +41324,45 @@ int main(void)
 
 		scene = SCENE_MAIN;
 		
-		cls();
-		
-		Draw_BG();
-		Draw_MemMonitor();
-		
-		Draw_CURPIC();
-		Draw_MAIN();
-		Draw_MAIN_input();
-		Draw_Load_GAMEPIC();
+		Redraw_Input();
 		
-		Draw_filter();
-		Draw_filter_input();
-		
-		Draw_MENU();
-		Draw_MENU_input();
-		
-		Draw_txt_viewer();
-		Draw_txt_viewer_input();
-		
-		Draw_ICON0_creator();
-		Draw_ICON0_creator_input();
-		
-		Draw_Notification();
-		
-		AutoRefresh_GAMELIST();
-		
-		tiny3d_Flip();
-		ScreenShot();
-		ps3pad_read();
+		// nothing changed : the previous frame stays on screen
+		if(Redraw_Frame(get_usec()) == NO) {
+			AutoRefresh_GAMELIST();
+			usleep(1000000/60);
+			ps3pad_read();
+		} else {
+			cls();
+			
+			Draw_BG();
+			Draw_MemMonitor();
+			
+			Draw_CURPIC();
+			Draw_MAIN();
+			Draw_MAIN_input();
+			Draw_Load_GAMEPIC();
+			
+			Draw_filter();
+			Draw_filter_input();
+			
+			Draw_MENU();
+			Draw_MENU_input();
+			
+			Draw_txt_viewer();
+			Draw_txt_viewer_input();
+			
+			Draw_ICON0_creator();
+			Draw_ICON0_creator_input();
+			
+			Draw_Notification();
+			
+			AutoRefresh_GAMELIST();
+			
+			Redraw_Done(get_usec());
+			tiny3d_Flip();
+			ScreenShot();
+			ps3pad_read();
+		}
 		
 		input_MAIN();
 		input_filter();
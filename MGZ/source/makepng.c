@@ -1,65 +1,331 @@
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <png.h>
 #include <ppu-types.h>
+#include "zlib.h"
 #include "makepng.h"
 
-u8 make_png(char *outfile, imgData data)
-{	
+// size of the IDAT chunks written
+#define MAKEPNG_CHUNK_SIZE	0x10000
+
+struct makepng_writer
+{
+	u8 filter;
+
+	z_stream z;
+	u8 z_ready;
+
+	// current and previous rows in RGBA or RGB, the filtered candidates (filter byte included)
+	u32 width;
+	u32 bpp;
+	u8 *row;
+	u8 *prev;
+	u8 *cand[5];
+
+	u8 out[MAKEPNG_CHUNK_SIZE];
+};
+
+static void put_be32(u8 *p, u32 v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static u8 write_chunk(FILE *fp, const char *type, const u8 *data, u32 size)
+{
+	u8 head[8];
+	u8 crc_be[4];
+
+	put_be32(head, size);
+	memcpy(head+4, type, 4);
+
+	u32 crc = crc32(0, head+4, 4);
+	if(size) crc = crc32(crc, data, size);
+	put_be32(crc_be, crc);
+
+	if(fwrite(head, 1, 8, fp) != 8) return FAILED;
+	if(size && fwrite(data, 1, size, fp) != size) return FAILED;
+	if(fwrite(crc_be, 1, 4, fp) != 4) return FAILED;
+
+	return SUCCESS;
+}
+
+static u8 paeth(u8 a, u8 b, u8 c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+
+	if(pa <= pb && pa <= pc) return a;
+	if(pb <= pc) return b;
+	return c;
+}
+
+// filter 'type' of the row in cand[type], returns the sum of the bytes taken as signed (libpng heuristic)
+static u32 filter_row(makepng_writer *w, u8 type, u32 size)
+{
+	u32 bpp = w->bpp;
+	u8 *out = w->cand[type] + 1;
+	u8 *row = w->row;
+	u8 *prev = w->prev;
+	u32 sum = 0;
+	u32 i;
+
+	w->cand[type][0] = type;
+
+	switch(type)
+	{
+		case MAKEPNG_FILTER_NONE:
+			memcpy(out, row, size);
+			break;
+		case 1: // sub
+			for(i=0; i<bpp; i++) out[i] = row[i];
+			for(i=bpp; i<size; i++) out[i] = row[i] - row[i-bpp];
+			break;
+		case 2: // up
+			for(i=0; i<size; i++) out[i] = row[i] - prev[i];
+			break;
+		case 3: // average
+			for(i=0; i<bpp; i++) out[i] = row[i] - (prev[i] >> 1);
+			for(i=bpp; i<size; i++) out[i] = row[i] - ((row[i-bpp] + prev[i]) >> 1);
+			break;
+		case 4: // paeth
+			for(i=0; i<bpp; i++) out[i] = row[i] - prev[i];
+			for(i=bpp; i<size; i++) out[i] = row[i] - paeth(row[i-bpp], prev[i], prev[i-bpp]);
+			break;
+	}
+
+	if(w->filter == MAKEPNG_FILTER_ADAPTIVE) {
+		for(i=0; i<size; i++) sum += out[i] < 128 ? out[i] : 256 - out[i];
+	}
+
+	return sum;
+}
+
+static u8 *pick_filter(makepng_writer *w, u32 size)
+{
+	if(w->filter == MAKEPNG_FILTER_NONE) {
+		filter_row(w, 0, size);
+		return w->cand[0];
+	}
+	if(w->filter == MAKEPNG_FILTER_UP) {
+		filter_row(w, 2, size);
+		return w->cand[2];
+	}
+	if(w->filter == MAKEPNG_FILTER_PAETH) {
+		filter_row(w, 4, size);
+		return w->cand[4];
+	}
+
+	u8 best = 0;
+	u32 best_sum = filter_row(w, 0, size);
+	u8 t;
+	for(t=1; t<5; t++) {
+		u32 sum = filter_row(w, t, size);
+		if(sum < best_sum) {
+			best_sum = sum;
+			best = t;
+		}
+	}
+	return w->cand[best];
+}
+
+static u8 alloc_rows(makepng_writer *w, u32 width)
+{
+	u8 i;
+
+	if(width <= w->width) return SUCCESS;
+
+	free(w->row);
+	free(w->prev);
+	w->row = w->prev = NULL;
+	for(i=0; i<5; i++) {
+		free(w->cand[i]);
+		w->cand[i] = NULL;
+	}
+	w->width = 0;
+
+	w->row = (u8 *) malloc(width * 4);
+	w->prev = (u8 *) malloc(width * 4);
+	if(w->row == NULL || w->prev == NULL) return FAILED;
+	for(i=0; i<5; i++) {
+		w->cand[i] = (u8 *) malloc(width * 4 + 1);
+		if(w->cand[i] == NULL) return FAILED;
+	}
+	w->width = width;
+
+	return SUCCESS;
+}
+
+makepng_writer *makepng_new(int level, u8 filter)
+{
+	makepng_writer *w = (makepng_writer *) malloc(sizeof(makepng_writer));
+	if(w == NULL) return NULL;
+
+	memset(w, 0, sizeof(makepng_writer));
+	w->filter = filter;
+
+	// the deflate state is kept and reset between pictures
+	if(deflateInit2(&w->z, level, Z_DEFLATED, 15, 8, filter == MAKEPNG_FILTER_NONE ? Z_DEFAULT_STRATEGY : Z_FILTERED) != Z_OK) {
+		free(w);
+		return NULL;
+	}
+	w->z_ready = 1;
+
+	return w;
+}
+
+void makepng_free(makepng_writer *w)
+{
+	u8 i;
+
+	if(w == NULL) return;
+
+	if(w->z_ready) deflateEnd(&w->z);
+	free(w->row);
+	free(w->prev);
+	for(i=0; i<5; i++) free(w->cand[i]);
+	free(w);
+}
+
+// compress 'size' bytes, full IDAT chunks are written as soon as the output buffer is full
+static u8 deflate_data(makepng_writer *w, FILE *fp, u8 *data, u32 size, int flush)
+{
+	int ret;
+
+	w->z.next_in = data;
+	w->z.avail_in = size;
+
+	do {
+		ret = deflate(&w->z, flush);
+		if(ret == Z_STREAM_ERROR) return FAILED;
+
+		if(w->z.avail_out == 0 || (flush == Z_FINISH && w->z.avail_out < MAKEPNG_CHUNK_SIZE)) {
+			if(write_chunk(fp, "IDAT", w->out, MAKEPNG_CHUNK_SIZE - w->z.avail_out) == FAILED) return FAILED;
+			w->z.next_out = w->out;
+			w->z.avail_out = MAKEPNG_CHUNK_SIZE;
+		}
+	} while(w->z.avail_in != 0 || (flush == Z_FINISH && ret != Z_STREAM_END));
+
+	return SUCCESS;
+}
+
+// ARGB to RGBA, 4 pixels per iteration
+static void argb_to_rgba(u8 *out, const u8 *in, u32 width)
+{
+	u32 x = 0;
+
+	for(; x + 4 <= width; x += 4, in += 16, out += 16) {
+		out[0]  = in[1];  out[1]  = in[2];  out[2]  = in[3];  out[3]  = in[0];
+		out[4]  = in[5];  out[5]  = in[6];  out[6]  = in[7];  out[7]  = in[4];
+		out[8]  = in[9];  out[9]  = in[10]; out[10] = in[11]; out[11] = in[8];
+		out[12] = in[13]; out[13] = in[14]; out[14] = in[15]; out[15] = in[12];
+	}
+	for(; x < width; x++, in += 4, out += 4) {
+		out[0] = in[1];
+		out[1] = in[2];
+		out[2] = in[3];
+		out[3] = in[0];
+	}
+}
+
+// ARGB to RGB, 4 pixels per iteration
+static void argb_to_rgb(u8 *out, const u8 *in, u32 width)
+{
+	u32 x = 0;
+
+	for(; x + 4 <= width; x += 4, in += 16, out += 12) {
+		out[0] = in[1];  out[1]  = in[2];  out[2]  = in[3];
+		out[3] = in[5];  out[4]  = in[6];  out[5]  = in[7];
+		out[6] = in[9];  out[7]  = in[10]; out[8]  = in[11];
+		out[9] = in[13]; out[10] = in[14]; out[11] = in[15];
+	}
+	for(; x < width; x++, in += 4, out += 3) {
+		out[0] = in[1];
+		out[1] = in[2];
+		out[2] = in[3];
+	}
+}
+
+static u8 save_png(makepng_writer *w, char *outfile, imgData data, u8 alpha)
+{
+	u8 ihdr[13];
+	u32 bpp = alpha ? 4 : 3;
+	u32 size = data.width * bpp;
+	u32 pitch = data.width * 4 <= data.pitch ? data.pitch : data.width * 4;
+	u32 y;
+
+	if(w == NULL || data.bmp_out == NULL || data.width == 0 || data.height == 0) return FAILED;
+	if(alloc_rows(w, data.width) == FAILED) return FAILED;
+	w->bpp = bpp;
+
 	FILE *fp = fopen(outfile, "wb");
-    if(!fp) return FAILED; 
-    
-	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!png_ptr){
-		fclose(fp);
-		return FAILED;
+	if(!fp) return FAILED;
+
+	if(fwrite("\x89PNG\r\n\x1A\n", 1, 8, fp) != 8) goto error;
+
+	put_be32(ihdr, data.width);
+	put_be32(ihdr+4, data.height);
+	ihdr[8] = 8;				// bit depth
+	ihdr[9] = alpha ? 6 : 2;	// RGBA or RGB
+	ihdr[10] = 0;				// deflate
+	ihdr[11] = 0;				// adaptive filtering
+	ihdr[12] = 0;				// no interlace
+	if(write_chunk(fp, "IHDR", ihdr, 13) == FAILED) goto error;
+
+	deflateReset(&w->z);
+	w->z.next_out = w->out;
+	w->z.avail_out = MAKEPNG_CHUNK_SIZE;
+
+	memset(w->prev, 0, size);
+
+	for(y = 0; y < data.height; y++) {
+		u8 *in = (u8 *) data.bmp_out + y * pitch;
+
+		if(alpha) argb_to_rgba(w->row, in, data.width);
+		else argb_to_rgb(w->row, in, data.width);
+
+		u8 *filtered = pick_filter(w, size);
+		if(deflate_data(w, fp, filtered, size + 1, Z_NO_FLUSH) == FAILED) goto error;
+
+		u8 *tmp = w->prev;
+		w->prev = w->row;
+		w->row = tmp;
 	}
-	
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-       png_destroy_write_struct(&png_ptr, (png_infopp)NULL);
-       fclose(fp);
-       return FAILED;
-    }
-	
-	if (setjmp(png_jmpbuf(png_ptr))) {
-       png_destroy_write_struct(&png_ptr, &info_ptr);
-       fclose(fp);
-       return FAILED;
-    }
-
-	png_init_io(png_ptr, fp);
-
-    png_set_IHDR(png_ptr, info_ptr, data.width, data.height, 8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE, PNG_FILTER_TYPE_BASE);
-    
-	png_write_info(png_ptr, info_ptr);	
-
-	png_bytep *row_pointers = (png_bytep *) malloc( sizeof(png_bytep) * data.height);
-    int i,j;
-    for(i = 0; i < data.height; i++) {
-        row_pointers[i] = (png_byte*) malloc(sizeof(png_byte) * data.width * 4);
-        for(j = 0; j < data.width; j++) {
-			u8 ARGB[4] = {0};
-			memcpy(&ARGB, data.bmp_out + i*data.width*4 + j*4, 4);
-		
-            row_pointers[i][0+4*j] = ARGB[1];
-            row_pointers[i][1+4*j] = ARGB[2];   
-            row_pointers[i][2+4*j] = ARGB[3];   
-            row_pointers[i][3+4*j] = ARGB[0];
-        }
-    }
-	
-	png_write_image(png_ptr, row_pointers);
-	
-	png_write_end(png_ptr, NULL);
-	
-	for (i = 0; i < data.height; i++) {
-        free(row_pointers[i]);
-    }
-    free(row_pointers);
-	
-	png_destroy_write_struct(&png_ptr, &info_ptr);
-		
-	fclose(fp);
-	
+
+	if(deflate_data(w, fp, NULL, 0, Z_FINISH) == FAILED) goto error;
+	if(write_chunk(fp, "IEND", NULL, 0) == FAILED) goto error;
+
+	if(fclose(fp) != 0) return FAILED;
+
 	return SUCCESS;
-}
\ No newline at end of file
+
+error:
+	fclose(fp);
+	return FAILED;
+}
+
+u8 makepng_save(makepng_writer *w, char *outfile, imgData data)
+{
+	return save_png(w, outfile, data, 1);
+}
+
+u8 makepng_save_rgb(makepng_writer *w, char *outfile, imgData data)
+{
+	return save_png(w, outfile, data, 0);
+}
+
+u8 make_png(char *outfile, imgData data)
+{
+	makepng_writer *w = makepng_new(Z_DEFAULT_COMPRESSION, MAKEPNG_FILTER_ADAPTIVE);
+	if(w == NULL) return FAILED;
+
+	u8 ret = makepng_save(w, outfile, data);
+
+	makepng_free(w);
+
+	return ret;
+}
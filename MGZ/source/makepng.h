@@ -13,6 +13,24 @@ typedef struct
 	u32 height;
 } imgData;
 
+// row filters, ADAPTIVE tries the 5 PNG filters on each row like libpng
+#define MAKEPNG_FILTER_NONE		0
+#define MAKEPNG_FILTER_UP		1
+#define MAKEPNG_FILTER_PAETH	2
+#define MAKEPNG_FILTER_ADAPTIVE	3
+
+// PNG encoder keeping its deflate state and row buffers between pictures
+typedef struct makepng_writer makepng_writer;
+
+// level : zlib level 0-9 (0 stores the rows), Z_DEFAULT_COMPRESSION (-1) for 6
+makepng_writer *makepng_new(int level, u8 filter);
+void makepng_free(makepng_writer *w);
+// rows are read every data.pitch bytes (data.width*4 if it's smaller)
+u8 makepng_save(makepng_writer *w, char *outfile, imgData data);
+// same without the alpha channel, for the frame buffer
+u8 makepng_save_rgb(makepng_writer *w, char *outfile, imgData data);
+
+// ARGB picture to a RGBA png, zlib level 6 and adaptive filters
 u8 make_png(char *outfile, imgData data);
 
 #endif
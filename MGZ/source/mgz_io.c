@@ -1,4 +1,5 @@
 #include <sys/stat.h>
+#include <sys/mutex.h>
 #include <dirent.h>
 
 #include "mgz_io.h"
@@ -14,52 +15,640 @@
 
 //extern u8 SetFilePerms(char *path);
 
-int MGZ_truncate(char *path, u64 len)
+//*******************************************************************************************
+// Drivers
+//*******************************************************************************************
+
+typedef struct MGZ_driver {
+	int type;
+	
+	int (*file_open)(MGZ_FILE *mgz_file, char *path, int oflags);
+	int (*file_close)(MGZ_FILE *mgz_file);
+	s64 (*file_seek)(MGZ_FILE *mgz_file, s64 pos, int whence);
+	u64 (*file_tell)(MGZ_FILE *mgz_file);
+	size_t (*file_read)(MGZ_FILE *mgz_file, void *ptr, size_t size);
+	size_t (*file_write)(MGZ_FILE *mgz_file, void *ptr, size_t size);
+	char *(*file_gets)(MGZ_FILE *mgz_file, char *str, int length);
+	int (*file_puts)(MGZ_FILE *mgz_file, char *str);
+	char (*file_getc)(MGZ_FILE *mgz_file);
+	char (*file_putc)(MGZ_FILE *mgz_file, char c);
+	int (*file_expand)(MGZ_FILE *mgz_file, u64 size);
+	
+	int (*path_truncate)(char *path, u64 len);
+	int (*path_stat)(char *path, struct stat *st);
+	int (*path_rename)(char *old_path, char *new_path);
+	int (*path_unlink)(char *path);
+	int (*path_mkdir)(char *path, int mode);
+	
+	int (*dir_open)(MGZ_DIR *mgz_dir, char *path);
+	int (*dir_close)(MGZ_DIR *mgz_dir);
+	int (*dir_read)(MGZ_DIR *mgz_dir, struct dirent *d, struct stat *st);
+} MGZ_driver;
+
+// exFAT, FatFs
+
+// FatFs only keeps one sector of the file, a write that doesn't cover whole clusters is gathered in a
+// buffer of ~1MB and written when it reaches a cluster boundary.
+#define EXFAT_WBUF_SIZE		0x100000
+
+static u32 exfat_cluster_size(MGZ_FILE *mgz_file)
 {
-    int ret;
-    int fd;
+	FATFS *fs = mgz_file->fp.obj.fs;
+	
+#if FF_MAX_SS != FF_MIN_SS
+	return (u32) fs->csize * fs->ssize;
+#else
+	return (u32) fs->csize * FF_MAX_SS;
+#endif
+}
 
-	if( is_exFAT(path) ) {
-		
-		FIL fp;
-		FRESULT res;    
+static int exfat_flush(MGZ_FILE *mgz_file)
+{
+	u32 bw=0;
+	u32 len = mgz_file->wbuf_len;
+	
+	if(len == 0) return 0;
+	
+	mgz_file->wbuf_len = 0;
+	
+	if(f_write(&mgz_file->fp, mgz_file->wbuf, len, &bw) != FR_OK || bw != len) return -1;
+	
+	return 0;
+}
 
-		res = f_open(&fp, path, FA_CREATE_NEW | FA_WRITE | FA_READ); 
-		if(res != FR_OK) {
-			return -1;
-		}
-		res = f_lseek(&fp, f_size(&fp) - len);
-		if(res != FR_OK) {
-			f_close(&fp);
-			return -1;
+static int exfat_open(MGZ_FILE *mgz_file, char *path, int oflags)
+{
+	mgz_file->wbuf = NULL;
+	mgz_file->wbuf_len = 0;
+	mgz_file->wbuf_max = 0;
+	mgz_file->expanded = NO;
+	
+	if( f_open(&mgz_file->fp, path, oflags) != FR_OK) return -1;
+	return 0;
+}
+
+static int exfat_close(MGZ_FILE *mgz_file)
+{
+	int ret = exfat_flush(mgz_file);
+	
+	FREE(mgz_file->wbuf);
+	
+	// the copy didn't reach the size given to MGZ_fexpand
+	if(mgz_file->expanded && f_tell(&mgz_file->fp) < f_size(&mgz_file->fp)) {
+		if(f_truncate(&mgz_file->fp) != FR_OK) ret = -1;
+	}
+	
+	if(f_close(&mgz_file->fp) != FR_OK) ret = -1;
+	
+	return ret;
+}
+
+static int exfat_expand(MGZ_FILE *mgz_file, u64 size)
+{
+	if(size == 0) return 0;
+	
+	if(f_expand(&mgz_file->fp, size, 1) != FR_OK) return -1;
+	
+	mgz_file->expanded = YES;
+	
+	return 0;
+}
+
+static s64 exfat_seek(MGZ_FILE *mgz_file, s64 pos, int whence)
+{
+	FRESULT res = -1;
+	
+	if( exfat_flush(mgz_file) != 0) return -1;
+	
+	if(whence == SEEK_SET ) res = f_lseek(&mgz_file->fp, pos);
+	if(whence == SEEK_CUR ) res = f_lseek(&mgz_file->fp, f_tell(&mgz_file->fp) + pos);
+	if(whence == SEEK_END ) res = f_lseek(&mgz_file->fp, f_size(&mgz_file->fp));
+	
+	if( res == FR_OK ) return 0;
+	
+	return -1;
+}
+
+static u64 exfat_tell(MGZ_FILE *mgz_file)
+{
+	return f_tell(&mgz_file->fp) + mgz_file->wbuf_len;
+}
+
+static size_t exfat_read(MGZ_FILE *mgz_file, void *ptr, size_t size)
+{
+	u32 br=0;
+	
+	if( exfat_flush(mgz_file) != 0) return -1;
+	
+	if(f_read(&mgz_file->fp, ptr, (u32) size, &br)==FR_OK) return (size_t) br;
+	
+	return -1;
+}
+
+static size_t exfat_write(MGZ_FILE *mgz_file, void *ptr, size_t size)
+{
+	u8 *data = (u8 *) ptr;
+	size_t left = size;
+	u32 cs = exfat_cluster_size(mgz_file);
+	u32 bw=0;
+	
+	while(left) {
+		u32 offset = f_tell(&mgz_file->fp) % cs; // position of the buffer in its cluster
+		
+		// whole clusters are written directly
+		if(mgz_file->wbuf_len == 0 && offset == 0 && cs <= left) {
+			u32 len = (left < 0x80000000 ? left : 0x80000000);
+			len -= len % cs;
+			if(f_write(&mgz_file->fp, data, len, &bw) != FR_OK || bw != len) return -1;
+			data += len;
+			left -= len;
+			continue;
 		}
 		
-		res = f_truncate(&fp);
-		if(res != FR_OK) {
-			f_close(&fp);
-			return -1;
+		if(mgz_file->wbuf == NULL) {
+			mgz_file->wbuf_max = ((EXFAT_WBUF_SIZE + cs - 1) / cs) * cs;
+			mgz_file->wbuf = (u8 *) malloc(mgz_file->wbuf_max);
+			if(mgz_file->wbuf == NULL) {
+				if(f_write(&mgz_file->fp, data, (u32) left, &bw) != FR_OK || bw != left) return -1;
+				return size;
+			}
 		}
 		
-		res = f_close(&fp);
-		if( res != FR_OK) return -1;
+		// the buffer ends on a cluster boundary
+		u32 limit = mgz_file->wbuf_max - offset;
+		u32 len = limit - mgz_file->wbuf_len;
+		if(left < len) len = left;
+		
+		memcpy(mgz_file->wbuf + mgz_file->wbuf_len, data, len);
+		mgz_file->wbuf_len += len;
+		data += len;
+		left -= len;
+		
+		if(mgz_file->wbuf_len == limit && exfat_flush(mgz_file) != 0) return -1;
+	}
+	
+	return size;
+}
+
+static char *exfat_gets(MGZ_FILE *mgz_file, char *str, int length)
+{
+	if( exfat_flush(mgz_file) != 0) return NULL;
+	
+	return f_gets(str, length, &mgz_file->fp);
+}
+
+// f_puts and f_putc convert the end of lines, they don't go through the buffer
+static int exfat_puts(MGZ_FILE *mgz_file, char *str)
+{
+	if( exfat_flush(mgz_file) != 0) return -1;
+	
+	return f_puts(str, &mgz_file->fp);
+}
+
+static char exfat_getc(MGZ_FILE *mgz_file)
+{
+	char c;
+	u32 br=0;
+	
+	if( exfat_flush(mgz_file) != 0) return -1;
+	
+	if(f_read(&mgz_file->fp, &c, 1, &br)==FR_OK) {
+		if(br!=1) return -1;
+		return c;
+	}
+	
+	return -1;
+}
+
+static char exfat_putc(MGZ_FILE *mgz_file, char c)
+{
+	if( exfat_flush(mgz_file) != 0) return -1;
+	
+	return f_putc(c, &mgz_file->fp);
+}
+
+static int exfat_truncate(char *path, u64 len)
+{
+	FIL fp;
+	FRESULT res;    
+
+	res = f_open(&fp, path, FA_CREATE_NEW | FA_WRITE | FA_READ); 
+	if(res != FR_OK) {
+		return -1;
+	}
+	res = f_lseek(&fp, f_size(&fp) - len);
+	if(res != FR_OK) {
+		f_close(&fp);
+		return -1;
+	}
+	
+	res = f_truncate(&fp);
+	if(res != FR_OK) {
+		f_close(&fp);
+		return -1;
+	}
+	
+	res = f_close(&fp);
+	if( res != FR_OK) return -1;
+	
+	return res;
+}
+
+static void exfat_fill_stat(FILINFO *fno, struct stat *st)
+{
+	st->st_size = fno->fsize;
+	st->st_mtime = fno->ftime;
+	
+	// todo 
+	if(fno->fattrib & AM_DIR) {
+		st->st_mode = S_IFDIR | 0777;
+	} else {
+		st->st_mode = S_IFMT | 0777;
+	}
+}
+
+static int exfat_stat(char *path, struct stat *st)
+{
+	FILINFO fno;
+	
+	if(f_stat(path, &fno) != FR_OK) return -1;
+	
+	exfat_fill_stat(&fno, st);
+	return 0;
+}
+
+static int exfat_rename(char *old_path, char *new_path)
+{
+	return f_rename(old_path, new_path);
+}
+
+static int exfat_unlink(char *path)
+{
+	return f_unlink(path);
+}
+
+static int exfat_mkdir(char *path, int mode)
+{
+	FRESULT res = f_mkdir(path);
+	if( res!= FR_OK) return -1;
+	// todo convert mode fflib chmod flags...
+	res = f_chmod(path, 0, AM_RDO | AM_ARC | AM_SYS | AM_HID);
+	return res;
+}
+
+static int exfat_opendir(MGZ_DIR *mgz_dir, char *path)
+{
+	if( f_opendir(&mgz_dir->fdir, path) != FR_OK) return -1;
+	return 0;
+}
+
+static int exfat_closedir(MGZ_DIR *mgz_dir)
+{
+	return f_closedir(&mgz_dir->fdir);
+}
+
+static int exfat_readdir(MGZ_DIR *mgz_dir, struct dirent *d, struct stat *st)
+{
+	FILINFO fno;
+	
+	if( f_readdir(&mgz_dir->fdir, &fno) != FR_OK ) return -1;
+	
+	if( fno.fname[0] == 0 ) return -1;
+	
+	d->d_namlen = strlen(fno.fname);
+	strcpy(d->d_name, fno.fname);
+	
+	if(fno.fattrib & AM_DIR) {
+		d->d_type = DT_DIR;
+	} else {
+		d->d_type = DT_REG;
+	}
+	
+	exfat_fill_stat(&fno, st);
+	
+	return 0;
+}
+
+static MGZ_driver exfat_driver = {
+	TYPE_EXFAT,
+	exfat_open, exfat_close, exfat_seek, exfat_tell, exfat_read, exfat_write,
+	exfat_gets, exfat_puts, exfat_getc, exfat_putc, exfat_expand,
+	exfat_truncate, exfat_stat, exfat_rename, exfat_unlink, exfat_mkdir,
+	exfat_opendir, exfat_closedir, exfat_readdir
+};
+
+// ntfs lib, it also handles the paths of the lv2 file system
+
+static int ntfs_open(MGZ_FILE *mgz_file, char *path, int oflags)
+{
+	mgz_file->fd = ps3ntfs_open(path, oflags, 0777);
+	
+	if(mgz_file->fd<0) {
+		//SetFilePerms(path);
+		mgz_file->fd = ps3ntfs_open(path, oflags, 0777);
+		if(mgz_file->fd<0) return -1;
+	}
+	
+	return 0;
+}
+
+static int ntfs_close(MGZ_FILE *mgz_file)
+{
+	return ps3ntfs_close(mgz_file->fd);
+}
+
+static s64 ntfs_seek(MGZ_FILE *mgz_file, s64 pos, int whence)
+{
+	return ps3ntfs_seek64(mgz_file->fd, (s64) pos, whence);
+}
+
+static u64 ntfs_tell(MGZ_FILE *mgz_file)
+{
+	return ps3ntfs_seek64(mgz_file->fd, 0, SEEK_CUR);
+}
+
+static size_t ntfs_read(MGZ_FILE *mgz_file, void *ptr, size_t size)
+{
+	return ps3ntfs_read(mgz_file->fd, (char*)ptr, size);
+}
+
+static size_t ntfs_write(MGZ_FILE *mgz_file, void *ptr, size_t size)
+{
+	return ps3ntfs_write(mgz_file->fd, (char*)ptr, size);
+}
+
+static char *ntfs_gets(MGZ_FILE *mgz_file, char *str, int length)
+{
+	char c;
+	int count=0;
+	if(length==0) return NULL;
+	
+	memset(str, 0, length);
+	while(ps3ntfs_read(mgz_file->fd, &c, 1))
+	{	
+		str[count]=c;
+		if(count==length) break;
+		count++;
+		if(c=='\n' || c==0) break;
+	}
+	if(count == 0) return NULL;
+	
+	return str;
+}
+
+static int ntfs_puts(MGZ_FILE *mgz_file, char *str)
+{
+	return ps3ntfs_write(mgz_file->fd, str, strlen(str));
+}
+
+static char ntfs_getc(MGZ_FILE *mgz_file)
+{
+	char c;
+	
+	if( ps3ntfs_read(mgz_file->fd, &c, 1) != 1) return -1;
+	return c;
+}
+
+static char ntfs_putc(MGZ_FILE *mgz_file, char c)
+{
+	ps3ntfs_write(mgz_file->fd, (const char *) &c, 1);
+	
+	return -1;
+}
+
+static int ntfs_expand(MGZ_FILE *mgz_file, u64 size)
+{
+	return 0;
+}
+
+static int ntfs_truncate(char *path, u64 len)
+{
+	int ret;
+	int fd;
+	
+	fd = ret = ps3ntfs_open(path, O_RDWR, 0666);
+
+	if(ret < 0) return ret;
+
+	ret = ps3ntfs_ftruncate(fd, len);
+	
+	ps3ntfs_close(fd);
+	
+	return ret;
+}
+
+static int ntfs_stat(char *path, struct stat *st)
+{
+	return ps3ntfs_stat(path, st);
+}
+
+static int ntfs_rename(char *old_path, char *new_path)
+{
+	return ps3ntfs_rename(old_path, new_path);
+}
+
+static int ntfs_unlink(char *path)
+{
+	return ps3ntfs_unlink(path);
+}
+
+static int ntfs_mkdir(char *path, int mode)
+{
+	return ps3ntfs_mkdir(path, mode);
+}
+
+static int ntfs_opendir(MGZ_DIR *mgz_dir, char *path)
+{
+	mgz_dir->dir_iter = ps3ntfs_diropen(path);
+	if(mgz_dir->dir_iter == NULL) return -1;
+	return 0;
+}
+
+static int ntfs_closedir(MGZ_DIR *mgz_dir)
+{
+	return ps3ntfs_dirclose(mgz_dir->dir_iter);
+}
+
+static int ntfs_readdir(MGZ_DIR *mgz_dir, struct dirent *d, struct stat *st)
+{
+	// dirnext fills the stat of the entry, it's kept for MGZ_readdir_stat
+	if( ps3ntfs_dirnext(mgz_dir->dir_iter, d->d_name, st)  != 0) return -1;
+	
+	if(S_ISDIR(st->st_mode)) {
+		d->d_type = DT_DIR;
+	} else {
+		d->d_type = DT_REG;
+	}
+	return 0;
+}
+
+static MGZ_driver ntfs_driver = {
+	TYPE_NTFS,
+	ntfs_open, ntfs_close, ntfs_seek, ntfs_tell, ntfs_read, ntfs_write,
+	ntfs_gets, ntfs_puts, ntfs_getc, ntfs_putc, ntfs_expand,
+	ntfs_truncate, ntfs_stat, ntfs_rename, ntfs_unlink, ntfs_mkdir,
+	ntfs_opendir, ntfs_closedir, ntfs_readdir
+};
+
+//*******************************************************************************************
+// Mount table
+//*******************************************************************************************
+
+// A path is resolved by its mount point (the first folder, ex: "ntfs0:", "exFAT1:", "dev_usb000"),
+// the result is kept in the table until a device is plugged or unplugged.
+
+#define MGZ_MOUNT_MAX		32
+#define MGZ_MOUNT_NAME		24
+
+typedef struct {
+	char name[MGZ_MOUNT_NAME];
+	u8 len;
+	u8 fs;
+} MGZ_mount;
+
+static MGZ_mount mount_table[MGZ_MOUNT_MAX];
+static u32 mount_number = 0;
+static u32 mount_next = 0; // slot replaced when the table is full
+
+static MGZ_io_counters io_counters;
+
+static sys_lwmutex_t mount_lock;
+static u8 mount_lock_init = NO;
+
+static void mount_lock_get()
+{
+	if(mount_lock_init == NO) {
+		sys_lwmutex_attr_t attr = {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""};
+		sysLwMutexCreate(&mount_lock, &attr);
+		mount_lock_init = YES;
+	}
+	sysLwMutexLock(&mount_lock, 0);
+}
+
+static u8 mount_fs(char *name)
+{
+	if( strncmp(name, "exFAT", 5) == 0 ) return MGZ_FS_EXFAT;
+	if( strncmp(name, "ntfs", 4) == 0 ) return MGZ_FS_NTFS;
+	if( strncmp(name, "dev_usb", 7) == 0 ) return MGZ_FS_FAT32;
+	if( strncmp(name, "dev_cf", 6) == 0 ) return MGZ_FS_FAT32;
+	if( strncmp(name, "dev_sd", 6) == 0 ) return MGZ_FS_FAT32;
+	if( strncmp(name, "dev_ms", 6) == 0 ) return MGZ_FS_FAT32;
+	
+	return MGZ_FS_CELL;
+}
+
+static MGZ_driver *mount_driver(u8 fs)
+{
+	if(fs == MGZ_FS_EXFAT) return &exfat_driver;
+	
+	return &ntfs_driver;
+}
+
+// The file system is copied out while the lock is held, a slot can be replaced as soon as it's released
+static u8 MGZ_resolve(char *path, u8 op)
+{
+	u8 fs;
+	u32 i;
+	
+	char *name = path;
+	if(name[0] == '/') name++;
+	
+	u32 len = 0;
+	while(name[len] != 0 && name[len] != '/') len++;
+	
+	mount_lock_get();
+	
+	io_counters.resolve[op]++;
+	
+	for(i=0; i < mount_number; i++) {
+		if(mount_table[i].len == len && strncmp(mount_table[i].name, name, len) == 0) {
+			fs = mount_table[i].fs;
+			sysLwMutexUnlock(&mount_lock);
+			return fs;
+		}
+	}
+	
+	io_counters.miss++;
+	fs = mount_fs(name);
+	
+	// too long to be a mount point, not kept
+	if(len < MGZ_MOUNT_NAME) {
+		MGZ_mount *m;
+		if(mount_number < MGZ_MOUNT_MAX) {
+			m = &mount_table[mount_number];
+			mount_number++;
+		} else {
+			m = &mount_table[mount_next];
+			mount_next = (mount_next + 1) % MGZ_MOUNT_MAX;
+		}
 		
-		return res;
+		memset(m->name, 0, MGZ_MOUNT_NAME);
+		memcpy(m->name, name, len);
+		m->len = len;
+		m->fs = fs;
 	}
 	
-    fd = ret = ps3ntfs_open(path, O_RDWR, 0666);
+	sysLwMutexUnlock(&mount_lock);
+	
+	return fs;
+}
+
+static MGZ_driver *MGZ_get_driver(char *path, u8 op)
+{
+	return mount_driver(MGZ_resolve(path, op));
+}
 
-    if(ret < 0) return ret;
+u8 MGZ_fs_type(char *path)
+{
+	return MGZ_resolve(path, MGZ_OP_FS_TYPE);
+}
 
-    ret = ps3ntfs_ftruncate(fd, len);
+u32 MGZ_fs_threads(char *path)
+{
+	u8 fs = MGZ_fs_type(path);
 	
-    ps3ntfs_close(fd);
+	// FatFs is built without FF_FS_REENTRANT, libntfs takes one lock for every call
+	if(fs == MGZ_FS_EXFAT || fs == MGZ_FS_NTFS) return 1;
 	
-    return ret;
+	return MGZ_FS_THREADS;
+}
+
+void MGZ_mount_invalidate()
+{
+	mount_lock_get();
+	mount_number = 0;
+	mount_next = 0;
+	io_counters.invalidate++;
+	sysLwMutexUnlock(&mount_lock);
+}
+
+void MGZ_io_get_counters(MGZ_io_counters *counters)
+{
+	mount_lock_get();
+	memcpy(counters, &io_counters, sizeof(MGZ_io_counters));
+	sysLwMutexUnlock(&mount_lock);
+}
+
+void MGZ_io_reset_counters()
+{
+	mount_lock_get();
+	memset(&io_counters, 0, sizeof(MGZ_io_counters));
+	sysLwMutexUnlock(&mount_lock);
+}
+
+//*******************************************************************************************
+// Files
+//*******************************************************************************************
+
+int MGZ_truncate(char *path, u64 len)
+{
+	return MGZ_get_driver(path, MGZ_OP_TRUNCATE)->path_truncate(path, len);
 }
 
 MGZ_FILE* MGZ_fopen(char *filepath, const char *mode)
 {	
-	u8 exfat = is_exFAT(filepath); 	
+	MGZ_driver *drv = MGZ_get_driver(filepath, MGZ_OP_OPEN);
+	u8 exfat = (drv->type == TYPE_EXFAT); 	
 	
 	int oflags;
 	int m, o;
@@ -89,26 +678,12 @@ MGZ_FILE* MGZ_fopen(char *filepath, const char *mode)
 	MGZ_FILE *mgz_file = (MGZ_FILE *) malloc(sizeof(MGZ_FILE));
 	if(mgz_file == NULL) return NULL;
 	
-	mgz_file->type = exfat;
+	mgz_file->type = drv->type;
+	mgz_file->drv = drv;
 	
-	if(exfat) {
-		int res = f_open(&mgz_file->fp, filepath, oflags);
-		if( res != FR_OK) {
-			FREE(mgz_file); 
-			return NULL;
-		}
-	} 
-	else {
-		mgz_file->fd = ps3ntfs_open(filepath, oflags, 0777);
-		
-		if(mgz_file->fd<0) {
-			//SetFilePerms(filepath);
-			mgz_file->fd = ps3ntfs_open(filepath, oflags, 0777);
-			if(mgz_file->fd<0) {
-				FREE(mgz_file);
-				return NULL;
-			}
-		}
+	if( drv->file_open(mgz_file, filepath, oflags) != 0) {
+		FREE(mgz_file); 
+		return NULL;
 	}
 	
 	return mgz_file;
@@ -116,78 +691,32 @@ MGZ_FILE* MGZ_fopen(char *filepath, const char *mode)
 
 s64 MGZ_fseek(MGZ_FILE* mgz_file, s64 pos, int whence)
 {
-	if(mgz_file->type==TYPE_NTFS) return ps3ntfs_seek64(mgz_file->fd, (s64) pos, whence);
-		
-	FRESULT res = -1;
-	
-	if(whence == SEEK_SET ) res = f_lseek(&mgz_file->fp, pos);
-	if(whence == SEEK_CUR ) res = f_lseek(&mgz_file->fp, f_tell(&mgz_file->fp) + pos);
-	if(whence == SEEK_END ) res = f_lseek(&mgz_file->fp, f_size(&mgz_file->fp));
-	
-	if( res == FR_OK ) return 0;
-	
-	return -1;
-	
+	return mgz_file->drv->file_seek(mgz_file, pos, whence);
 }
 
 size_t MGZ_fread(void *ptr, size_t size, size_t count, MGZ_FILE* mgz_file)
 {
-	if(mgz_file->type==TYPE_NTFS) return ps3ntfs_read(mgz_file->fd, (char*)ptr, size*count);
-	
-	u32 br=0;
-	
-	if(f_read(&mgz_file->fp, ptr, (u32) size*count, &br)==FR_OK) return (size_t) br;
-	
-	return -1;
+	return mgz_file->drv->file_read(mgz_file, ptr, size*count);
 }
 
 size_t MGZ_fwrite(void *ptr, size_t size, size_t count, MGZ_FILE* mgz_file)
 {
-	if(mgz_file->type==TYPE_NTFS) return ps3ntfs_write(mgz_file->fd, (char*)ptr, size*count);
-	
-	u32 bw=0;
-	
-	if(f_write(&mgz_file->fp, ptr, (u32) size*count, &bw)==FR_OK) return (size_t) bw;
-	
-	return -1;
+	return mgz_file->drv->file_write(mgz_file, ptr, size*count);
 }
 
 char *MGZ_fgets(char *str, int length, MGZ_FILE* mgz_file)
 {
-	if(mgz_file->type==TYPE_NTFS) {
-		char c;
-		int count=0;
-		if(length==0) return NULL;
-		
-		memset(str, 0, length);
-		while(ps3ntfs_read(mgz_file->fd, &c, 1))
-		{	
-			str[count]=c;
-			if(count==length) break;
-			count++;
-			if(c=='\n' || c==0) break;
-		}
-		if(count == 0) return NULL;
-		
-		return str;
-	}
-	
-	return f_gets(str, length, &mgz_file->fp);
+	return mgz_file->drv->file_gets(mgz_file, str, length);
 }
 
 int MGZ_fputs(char *str, MGZ_FILE* mgz_file)
 {
-	if(mgz_file->type==TYPE_NTFS) return ps3ntfs_write(mgz_file->fd, str, strlen(str));
-	
-	return f_puts(str, &mgz_file->fp);
+	return mgz_file->drv->file_puts(mgz_file, str);
 }
 
 int MGZ_fclose(MGZ_FILE* mgz_file)
 {	
-	int ret = -1;
-	
-	if(mgz_file->type==TYPE_NTFS) ret=ps3ntfs_close(mgz_file->fd);
-	if(mgz_file->type==TYPE_EXFAT) ret=f_close(&mgz_file->fp);
+	int ret = mgz_file->drv->file_close(mgz_file);
 	
 	FREE(mgz_file);
 	
@@ -198,37 +727,22 @@ int MGZ_fclose(MGZ_FILE* mgz_file)
 
 u64 MGZ_ftell(MGZ_FILE* mgz_file)
 {
-	if(mgz_file->type==TYPE_NTFS) return ps3ntfs_seek64(mgz_file->fd, 0, SEEK_CUR);
-	
-	return f_tell(&mgz_file->fp);
+	return mgz_file->drv->file_tell(mgz_file);
 }
 
 char MGZ_fgetc(MGZ_FILE* mgz_file)
 {
-	char c;
-	
-	if(mgz_file->type==TYPE_NTFS) {
-		if( ps3ntfs_read(mgz_file->fd, &c, 1) != 1) return -1;
-		return c;
-	} else
-	if(mgz_file->type==TYPE_EXFAT) {
-		u32 br=0;
-		if(f_read(&mgz_file->fp, &c, 1, &br)==FR_OK) {
-			if(br!=1) return -1;
-			return c;
-		}
-	}
-	
-	return -1;
+	return mgz_file->drv->file_getc(mgz_file);
 }
 
 char MGZ_fputc(char c, MGZ_FILE* mgz_file)
 {
-	if(mgz_file->type==TYPE_NTFS) ps3ntfs_write(mgz_file->fd, (const char *) &c, 1);
-	
-	if(mgz_file->type==TYPE_EXFAT) return f_putc(c, &mgz_file->fp);
-	
-	return -1;
+	return mgz_file->drv->file_putc(mgz_file, c);
+}
+
+int MGZ_fexpand(MGZ_FILE* mgz_file, u64 size)
+{
+	return mgz_file->drv->file_expand(mgz_file, size);
 }
 
 // todo...
@@ -264,27 +778,22 @@ int MGZ_feof(MGZ_FILE *mgz_file)
 
 int MGZ_rename(char *old_path, char *new_path)
 {
-	if( is_exFAT(old_path) && is_exFAT(new_path)) return f_rename(old_path, new_path);
-	return ps3ntfs_rename(old_path, new_path);
+	MGZ_driver *drv = MGZ_get_driver(old_path, MGZ_OP_RENAME);
+	
+	// FatFs can't move a file to another device
+	if( drv != MGZ_get_driver(new_path, MGZ_OP_RENAME) ) drv = &ntfs_driver;
+	
+	return drv->path_rename(old_path, new_path);
 }
 
 int MGZ_unlink(char *path)
 {
-	if( is_exFAT(path) ) return f_unlink(path);
-	
-	return ps3ntfs_unlink(path);
+	return MGZ_get_driver(path, MGZ_OP_UNLINK)->path_unlink(path);
 }
 
 int MGZ_mkdir(char *path, int mode)
 {
-	if( is_exFAT(path) ) {
-		FRESULT res = f_mkdir(path);
-		if( res!= FR_OK) return -1;
-		// todo convert mode fflib chmod flags...
-		res = f_chmod(path, 0, AM_RDO | AM_ARC | AM_SYS | AM_HID);
-		return res;
-	}
-	return ps3ntfs_mkdir(path, mode);
+	return MGZ_get_driver(path, MGZ_OP_MKDIR)->path_mkdir(path, mode);
 }
 
 #define unlink		MGZ_unlink
@@ -294,23 +803,7 @@ int MGZ_mkdir(char *path, int mode)
 
 int MGZ_stat(char *path, struct stat *st)
 {
-	if(is_exFAT(path)) {
-		FILINFO fno;
-		
-		if(f_stat(path, &fno) != FR_OK) return -1;
-		
-		st->st_size = fno.fsize;
-		st->st_mtime = fno.ftime;
-		
-		// todo 
-		if(fno.fattrib & AM_DIR) {
-			st->st_mode = S_IFDIR | 0777;
-		} else {
-			st->st_mode = S_IFMT | 0777;
-		}
-		return 0;
-	}
-	return ps3ntfs_stat(path, st);
+	return MGZ_get_driver(path, MGZ_OP_STAT)->path_stat(path, st);
 }
 
 
@@ -329,21 +822,12 @@ MGZ_DIR* MGZ_opendir(char *path)
 		return NULL;
 	}
 	
-	u8 exfat = is_exFAT(path);
+	MGZ_driver *drv = MGZ_get_driver(path, MGZ_OP_OPENDIR);
 	
-	mgz_dir->type = exfat;
+	mgz_dir->type = drv->type;
+	mgz_dir->drv = drv;
 	
-	if(exfat) {
-		int x = f_opendir(&mgz_dir->fdir, path);
-		if(x != FR_OK) {
-			FREE(mgz_dir->dir);
-			FREE(mgz_dir);
-		}
-		return mgz_dir;
-	}
-	
-	mgz_dir->dir_iter = ps3ntfs_diropen(path);
-	if(mgz_dir->dir_iter == NULL) {
+	if( drv->dir_open(mgz_dir, path) != 0) {
 		FREE(mgz_dir->dir);
 		FREE(mgz_dir);
 	}
@@ -353,12 +837,7 @@ MGZ_DIR* MGZ_opendir(char *path)
 
 int MGZ_closedir(MGZ_DIR *mgz_dir)
 {
-	int res = -1;
-	if(mgz_dir->type == TYPE_EXFAT) {
-		res = f_closedir(&mgz_dir->fdir);
-	} else {
-		res = ps3ntfs_dirclose(mgz_dir->dir_iter);
-	}
+	int res = mgz_dir->drv->dir_close(mgz_dir);
 	
 	FREE(mgz_dir->dir);
 	FREE(mgz_dir);
@@ -368,38 +847,19 @@ int MGZ_closedir(MGZ_DIR *mgz_dir)
 
 struct dirent *MGZ_readdir(MGZ_DIR *mgz_dir)
 {
-	memset(mgz_dir->dir, 0, sizeof(struct dirent));
-	
-	struct dirent *d = mgz_dir->dir;
+	struct stat st;
 	
-	if(mgz_dir->type == TYPE_EXFAT) {
-		FILINFO fno;
-		
-		if( f_readdir(&mgz_dir->fdir, &fno) != FR_OK ) return NULL;
-		
-		if( fno.fname[0] == 0 ) return NULL;
-		
-		d->d_namlen = strlen(fno.fname);
-		strcpy(d->d_name, fno.fname);
-		
-		if(fno.fattrib & AM_DIR) {
-			d->d_type = DT_DIR;
-		} else {
-			d->d_type = DT_REG;
-		}
-		
-		return d;
-	}
+	return MGZ_readdir_stat(mgz_dir, &st);
+}
+
+struct dirent *MGZ_readdir_stat(MGZ_DIR *mgz_dir, struct stat *st)
+{
+	memset(mgz_dir->dir, 0, sizeof(struct dirent));
+	memset(st, 0, sizeof(struct stat));
 	
-	struct stat s;
-	if( ps3ntfs_dirnext(mgz_dir->dir_iter, d->d_name, &s)  != 0) return NULL;
+	if( mgz_dir->drv->dir_read(mgz_dir, mgz_dir->dir, st) != 0) return NULL;
 	
-	if(S_ISDIR(s.st_mode)) {
-		d->d_type = DT_DIR;
-	} else {
-		d->d_type = DT_REG;
-	}
-	return d;
+	return mgz_dir->dir;
 }
 
 #define DIR			MGZ_DIR
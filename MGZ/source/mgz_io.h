@@ -19,16 +19,58 @@
 #define TYPE_NTFS	0 // ntfs lib support file system
 #define TYPE_EXFAT	1
 
+// file system of a mount point
+#define MGZ_FS_CELL		0 // dev_hdd0, dev_bdvd, dev_flash...
+#define MGZ_FS_FAT32	1 // dev_usb, dev_cf, dev_sd, dev_ms
+#define MGZ_FS_NTFS		2
+#define MGZ_FS_EXFAT	3
+
+// threads that can use lv2 file systems at once
+#define MGZ_FS_THREADS	4
+
+// operations resolving a path to its driver
+#define MGZ_OP_OPEN			0
+#define MGZ_OP_TRUNCATE		1
+#define MGZ_OP_STAT			2
+#define MGZ_OP_RENAME		3
+#define MGZ_OP_UNLINK		4
+#define MGZ_OP_MKDIR		5
+#define MGZ_OP_OPENDIR		6
+#define MGZ_OP_FS_TYPE		7
+#define MGZ_OP_NUMBER		8
+
+typedef struct {
+	u32 resolve[MGZ_OP_NUMBER];	// path resolutions per operation
+	u32 miss;					// mount point not in the table
+	u32 invalidate;
+} MGZ_io_counters;
+
+struct MGZ_driver;
+
 typedef struct {
 	int type;
+	struct MGZ_driver *drv; // resolved once by MGZ_fopen
 	
 // exFAT
 	FIL fp;
+	u8 *wbuf;			// small writes are gathered up to a cluster boundary
+	u32 wbuf_len;
+	u32 wbuf_max;
+	u8 expanded;		// clusters allocated by MGZ_fexpand
 	
 // ntfs
 	int fd;
 } MGZ_FILE;
 
+// File system of the mount point of 'path', from the mount table
+u8 MGZ_fs_type(char *path);
+// Threads that can work at once on the file system of 'path' (1 when the driver isn't reentrant)
+u32 MGZ_fs_threads(char *path);
+// Forget the mount table, called when a device is plugged or unplugged
+void MGZ_mount_invalidate();
+void MGZ_io_get_counters(MGZ_io_counters *counters);
+void MGZ_io_reset_counters();
+
 int MGZ_truncate(char *path, u64 len);
 MGZ_FILE* MGZ_fopen(char *filepath, const char *mode);
 s64 MGZ_fseek(MGZ_FILE* mgz_file, s64 pos, int whence);
@@ -40,6 +82,9 @@ int MGZ_fclose(MGZ_FILE* mgz_file);
 u64 MGZ_ftell(MGZ_FILE* mgz_file);
 char MGZ_fgetc(MGZ_FILE* mgz_file);
 char MGZ_fputc(char c, MGZ_FILE* mgz_file);
+// Allocate 'size' bytes of contiguous clusters to a file just created (exFAT), what isn't written is
+// released by MGZ_fclose. It does nothing on the other file systems.
+int MGZ_fexpand(MGZ_FILE* mgz_file, u64 size);
 //int MGZ_ferror(FILE * mgz_file);
 //int feof(MGZ_FILE *mgz_file);
 
@@ -83,6 +128,7 @@ int MGZ_stat(char *path, struct stat *st);
 typedef struct {
 
 	int type;
+	struct MGZ_driver *drv;
 
 // exFAT
 	FDIR fdir;
@@ -97,6 +143,9 @@ typedef struct {
 MGZ_DIR* MGZ_opendir(char *path);
 int MGZ_closedir(MGZ_DIR *mgz_dir);
 struct dirent *MGZ_readdir(MGZ_DIR *mgz_dir);
+// Same as MGZ_readdir, with the stat of the entry the driver got while reading the folder
+// (st_mode and st_size at least), it saves a MGZ_stat per entry
+struct dirent *MGZ_readdir_stat(MGZ_DIR *mgz_dir, struct stat *st);
 
 #define DIR			MGZ_DIR
 
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <tiny3d.h>
+
+#include "quad_batch.h"
+
+static int qb_open = 0;
+static int qb_textured = 0;
+static qb_texture qb_tex;
+
+static u32 qb_batches = 0;
+static u32 qb_quads = 0;
+static u32 qb_last_batches = 0;
+static u32 qb_last_quads = 0;
+
+static int qb_same_texture(const qb_texture *a, const qb_texture *b)
+{
+	return a->offset == b->offset && a->width == b->width && a->height == b->height
+		&& a->stride == b->stride && a->format == b->format;
+}
+
+void QB_Flush(void)
+{
+	if(!qb_open) return;
+
+	tiny3d_End();
+	qb_open = 0;
+}
+
+void QB_Quad(const qb_texture *tex, float x, float y, float z, float w, float h, u32 rgba,
+	float u0, float v0, float u1, float v1)
+{
+	if(qb_open && (tex != NULL) == qb_textured && (tex == NULL || qb_same_texture(tex, &qb_tex))) {
+		// same state : only add the vertices
+	} else {
+		QB_Flush();
+
+		if(tex) {
+			tiny3d_SetTextureWrap(0, tex->offset, tex->width, tex->height, tex->stride,
+				tex->format, TEXTWRAP_CLAMP, TEXTWRAP_CLAMP, TEXTURE_LINEAR);
+			qb_tex = *tex;
+		}
+		qb_textured = tex != NULL;
+
+		tiny3d_SetPolygon(TINY3D_QUADS);
+		qb_open = 1;
+		qb_batches++;
+	}
+
+	qb_quads++;
+
+	// every vertex has its color so the quads stay independent inside the batch
+	tiny3d_VertexPos(x    , y    , z);
+	tiny3d_VertexColor(rgba);
+	if(qb_textured) tiny3d_VertexTexture(u0, v0);
+
+	tiny3d_VertexPos(x + w, y    , z);
+	tiny3d_VertexColor(rgba);
+	if(qb_textured) tiny3d_VertexTexture(u1, v0);
+
+	tiny3d_VertexPos(x + w, y + h, z);
+	tiny3d_VertexColor(rgba);
+	if(qb_textured) tiny3d_VertexTexture(u1, v1);
+
+	tiny3d_VertexPos(x    , y + h, z);
+	tiny3d_VertexColor(rgba);
+	if(qb_textured) tiny3d_VertexTexture(u0, v1);
+}
+
+void QB_NewFrame(void)
+{
+	qb_last_batches = qb_batches;
+	qb_last_quads = qb_quads;
+	qb_batches = qb_quads = 0;
+}
+
+void QB_GetStats(u32 *batches, u32 *quads)
+{
+	if(batches) *batches = qb_last_batches;
+	if(quads) *quads = qb_last_quads;
+}
@@ -0,0 +1,39 @@
+#ifndef __QUAD_BATCH_H__
+#define __QUAD_BATCH_H__
+
+#include <tiny3d.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Texture used by a batch. Several sprites stored one under the other in the
+// same texture (font glyphs) can be drawn in one batch with their v range.
+typedef struct
+{
+	u32 offset;
+	int width;
+	int height;
+	int stride;
+	u32 format;
+} qb_texture;
+
+// Queue one quad. Consecutive quads with the same texture are sent between a
+// single tiny3d_SetPolygon/tiny3d_End pair. tex NULL draws an untextured box.
+void QB_Quad(const qb_texture *tex, float x, float y, float z, float w, float h, u32 rgba,
+	float u0, float v0, float u1, float v1);
+
+// End the current batch. It must be called before any other tiny3d drawing.
+void QB_Flush(void);
+
+// Once per frame : keeps the counters of the previous frame for QB_GetStats.
+void QB_NewFrame(void);
+
+// batches and quads of the previous frame
+void QB_GetStats(u32 *batches, u32 *quads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __QUAD_BATCH_H__ */
@@ -0,0 +1,61 @@
+#include <ppu-types.h>
+
+#include "redraw.h"
+
+static u32 settle = REDRAW_SETTLE_FRAMES;
+static u64 frame_start = 0;
+static u64 deadline = 0;
+static u32 cls_count = 0;
+static u32 cls_expected = 0;
+
+static u32 drawn = 0;
+static u32 skipped = 0;
+static u32 frame_time = 0;
+
+void Redraw_Invalidate(void)
+{
+	settle = REDRAW_SETTLE_FRAMES;
+}
+
+void Redraw_Animate(u32 period)
+{
+	if(frame_start + period < deadline) deadline = frame_start + period;
+}
+
+void Redraw_NewFrame(void)
+{
+	cls_count++;
+}
+
+u8 Redraw_Frame(u64 now)
+{
+	// another loop (menu, loading screen...) drew over the screen since our last frame
+	if(cls_count != cls_expected) settle = REDRAW_SETTLE_FRAMES;
+
+	if(settle) settle--;
+	else
+	if(now < deadline) {
+		skipped++;
+		return 0;
+	}
+
+	// the elements drawn in this frame can ask an earlier one with Redraw_Animate
+	frame_start = now;
+	deadline = now + REDRAW_IDLE_PERIOD;
+	cls_expected = cls_count + 1;
+	drawn++;
+
+	return 1;
+}
+
+void Redraw_Done(u64 now)
+{
+	if(frame_start <= now) frame_time = now - frame_start;
+}
+
+void Redraw_GetStats(u32 *drawn_frames, u32 *skipped_frames, u32 *time)
+{
+	if(drawn_frames) *drawn_frames = drawn;
+	if(skipped_frames) *skipped_frames = skipped;
+	if(time) *time = frame_time;
+}
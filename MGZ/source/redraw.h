@@ -0,0 +1,36 @@
+#ifndef __REDRAW_H__
+#define __REDRAW_H__
+
+#include <ppu-types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// frames always drawn after a change, the UI animations (TranslateTo...) are frame based
+#define REDRAW_SETTLE_FRAMES	60
+// time between two frames when nothing changes, in us
+#define REDRAW_IDLE_PERIOD		250000
+
+// a state change : the next frames must be drawn
+void Redraw_Invalidate(void);
+
+// called by an animated element while it is drawn : it wants a new frame in 'period' us (0 : next frame)
+void Redraw_Animate(u32 period);
+
+// called by cls() for every frame drawn, by any loop
+void Redraw_NewFrame(void);
+
+// returns 1 if the frame must be drawn at 'now' (us), 0 if the previous one can stay on screen
+u8 Redraw_Frame(u64 now);
+
+// end of a drawn frame, to measure the time spent to build it
+void Redraw_Done(u64 now);
+
+void Redraw_GetStats(u32 *drawn, u32 *skipped, u32 *frame_time);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __REDRAW_H__ */
@@ -5,6 +5,7 @@
 #include <freetype/freetype.h> 
 #include <freetype/ftglyph.h>
 #include "ttf_render.h"
+#include "quad_batch.h"
 
 /******************************************************************************************************************************************************/
 /* TTF functions to load and convert fonts                                                                                                             */
@@ -16,6 +17,25 @@ static FT_Library freetype;
 static FT_Face face[4];
 static int f_face[4] = {0, 0, 0, 0};
 
+// pixel size currently set on the faces
+static int face_w = -1;
+static int face_h = -1;
+
+static void ttf_layout_reset(void);
+
+static void TTF_SetPixelSizes(int w, int h)
+{
+    if(w == face_w && h == face_h) return;
+
+    if(f_face[0]) FT_Set_Pixel_Sizes(face[0], w, h);
+    if(f_face[1]) FT_Set_Pixel_Sizes(face[1], w, h);
+    if(f_face[2]) FT_Set_Pixel_Sizes(face[2], w, h);
+    if(f_face[3]) FT_Set_Pixel_Sizes(face[3], w, h);
+
+    face_w = w;
+    face_h = h;
+}
+
 int TTFLoadFont(int set, char * path, void * from_memory, int size_from_memory)
 {
    
@@ -33,6 +53,9 @@ int TTFLoadFont(int set, char * path, void * from_memory, int size_from_memory)
 
     f_face[set] = 1;
 
+    face_w = face_h = -1;
+    ttf_layout_reset();
+
     return 0;
 }
 
@@ -60,10 +83,7 @@ y_correction : the Y correction to display the character correctly in the screen
 
 void TTF_to_Bitmap(u8 chr, u8 * bitmap, short *w, short *h, short *y_correction)
 {
-    if(f_face[0]) FT_Set_Pixel_Sizes(face[0], (*w), (*h));
-    if(f_face[1]) FT_Set_Pixel_Sizes(face[1], (*w), (*h));
-    if(f_face[2]) FT_Set_Pixel_Sizes(face[2], (*w), (*h));
-    if(f_face[3]) FT_Set_Pixel_Sizes(face[3], (*w), (*h));
+    TTF_SetPixelSizes((*w), (*h));
     
     FT_GlyphSlot slot;
 
@@ -111,10 +131,7 @@ int Render_String_UTF8(u16 * bitmap, int w, int h, u8 *string, int sw, int sh)
     u8 color;
     u32 ttf_char;
 
-    if(f_face[0]) FT_Set_Pixel_Sizes(face[0], sw, sh);
-    if(f_face[1]) FT_Set_Pixel_Sizes(face[1], sw, sh);
-    if(f_face[2]) FT_Set_Pixel_Sizes(face[2], sw, sh);
-    if(f_face[3]) FT_Set_Pixel_Sizes(face[3], sw, sh);
+    TTF_SetPixelSizes(sw, sh);
 
     //FT_Set_Pixel_Sizes(face, sw, sh);
     FT_GlyphSlot slot = NULL;
@@ -203,15 +220,128 @@ typedef struct ttf_dyn {
     u16 width;
     u16 height;
     u16 flags;
+    u16 hnext; // next slot + 1 in the hash chain
+    u16 prev;  // LRU list, 0 : none
+    u16 next;
 
 } ttf_dyn;
 
 #define MAX_CHARS 1600
 
+// the slots are contiguous : 128 slots one under the other make a 32x4096 texture
+// so a line of text is drawn in few batches
+#define TTF_GROUP 128
+
+// characters < 128 have their own slot, the others are found with a hash table
+// and take the least recently used slot when they are not there
+#define TTF_HASH_SIZE 2048
+
 static ttf_dyn ttf_font_datas[MAX_CHARS];
+static u16 ttf_hash[TTF_HASH_SIZE]; // first slot + 1
+static u16 lru_head = 0;
+static u16 lru_tail = 0;
 
 static u32 r_use= 0;
 
+static void ttf_lru_unlink(int n)
+{
+    if(ttf_font_datas[n].prev) ttf_font_datas[ttf_font_datas[n].prev].next = ttf_font_datas[n].next;
+    else lru_head = ttf_font_datas[n].next;
+    if(ttf_font_datas[n].next) ttf_font_datas[ttf_font_datas[n].next].prev = ttf_font_datas[n].prev;
+    else lru_tail = ttf_font_datas[n].prev;
+    ttf_font_datas[n].prev = ttf_font_datas[n].next = 0;
+}
+
+static void ttf_lru_push(int n)
+{
+    ttf_font_datas[n].prev = 0;
+    ttf_font_datas[n].next = lru_head;
+    if(lru_head) ttf_font_datas[lru_head].prev = n;
+    lru_head = n;
+    if(!lru_tail) lru_tail = n;
+}
+
+static void ttf_unhash(int n)
+{
+    u16 *p = &ttf_hash[ttf_font_datas[n].ttf & (TTF_HASH_SIZE - 1)];
+
+    while(*p) {
+        if(*p == n + 1) {*p = ttf_font_datas[n].hnext; break;}
+        p = &ttf_font_datas[*p - 1].hnext;
+    }
+    ttf_font_datas[n].hnext = 0;
+}
+
+static int ttf_get_slot(u32 ttf_char)
+{
+    int n = ttf_hash[ttf_char & (TTF_HASH_SIZE - 1)];
+
+    while(n) {
+        if(ttf_font_datas[n - 1].ttf == ttf_char) break;
+        n = ttf_font_datas[n - 1].hnext;
+    }
+
+    if(n) n--;
+    else {
+        n = lru_tail;
+        // the least recently used slot is already drawn in this frame, so are all the others :
+        // the GPU hasn't read it yet, it can't be replaced
+        if(ttf_font_datas[n].r_use == r_use) return -1;
+
+        if(ttf_font_datas[n].ttf) ttf_unhash(n);
+
+        ttf_font_datas[n].flags = 0;
+        ttf_font_datas[n].ttf = ttf_char;
+        ttf_font_datas[n].hnext = ttf_hash[ttf_char & (TTF_HASH_SIZE - 1)];
+        ttf_hash[ttf_char & (TTF_HASH_SIZE - 1)] = n + 1;
+    }
+
+    ttf_lru_unlink(n);
+    ttf_lru_push(n);
+
+    return n;
+}
+
+// result of the calls without color (WidthFromStr, GetNumberOfLine...) made every frame
+// with the same strings
+
+#define TTF_LAYOUT_SIZE 128
+#define TTF_LAYOUT_STR  128
+
+typedef struct ttf_layout {
+    char str[TTF_LAYOUT_STR];
+    int line;
+    int posx;
+    int posy;
+    int sw;
+    int sh;
+    int win_w;
+    int win_h;
+    u32 win_flag;
+    int ret;
+    float y;
+} ttf_layout;
+
+static ttf_layout ttf_layouts[TTF_LAYOUT_SIZE];
+
+static void ttf_layout_reset(void)
+{
+    int n;
+
+    for(n= 0; n < TTF_LAYOUT_SIZE; n++) ttf_layouts[n].str[0] = 0;
+}
+
+static u32 ttf_layout_hash(char *string, int line, int posx, int posy, int sw, int sh)
+{
+    u32 h = 2166136261u;
+
+    while(*string) h = (h ^ (u8) *(string++)) * 16777619u;
+
+    h ^= line * 31 + posx * 7 + posy * 13 + sw * 17 + sh;
+
+    return h % TTF_LAYOUT_SIZE;
+}
+
 float Y_ttf = 0.0f;
 float Z_ttf = 0.0f;
 
@@ -239,71 +369,30 @@ u16 * init_ttf_table(u16 *texture)
 {
     int n;
 
-    r_use= 0;
+    // the slots start with r_use 0, they aren't used by the first frame
+    r_use= 1;
+    memset(ttf_hash, 0, sizeof(ttf_hash));
+    lru_head = lru_tail = 0;
+
     for(n= 0; n <  MAX_CHARS; n++) {
         memset(&ttf_font_datas[n], 0, sizeof(ttf_dyn));
         ttf_font_datas[n].text = texture;
+        if(n >= 128) ttf_lru_push(n);
 
         texture+= 32*32;
     }
 
+    ttf_layout_reset();
+
     return texture;
 
 }
 
 void reset_ttf_frame(void)
 {
-    int n;
-
-    for(n= 0; n <  MAX_CHARS; n++) {
-        
-        ttf_font_datas[n].flags &= 1;
-
-    }
-
     r_use++;
-
-}
-
-static void DrawBox_ttf(float x, float y, float z, float w, float h, u32 rgba)
-{
-    tiny3d_SetPolygon(TINY3D_QUADS);
-    
-   
-    tiny3d_VertexPos(x    , y    , z);
-    tiny3d_VertexColor(rgba);
-
-    tiny3d_VertexPos(x + w, y    , z);
-
-    tiny3d_VertexPos(x + w, y + h, z);
-
-    tiny3d_VertexPos(x    , y + h, z);
-
-    tiny3d_End();
-}
-
-static void DrawTextBox_ttf(float x, float y, float z, float w, float h, u32 rgba, float tx, float ty)
-{
-    tiny3d_SetPolygon(TINY3D_QUADS);
-    
-   
-    tiny3d_VertexPos(x    , y    , z);
-    tiny3d_VertexColor(rgba);
-    tiny3d_VertexTexture(0.0f , 0.0f);
-
-    tiny3d_VertexPos(x + w, y    , z);
-    tiny3d_VertexTexture(tx, 0.0f);
-
-    tiny3d_VertexPos(x + w, y + h, z);
-    tiny3d_VertexTexture(tx, ty);
-
-    tiny3d_VertexPos(x    , y + h, z);
-    tiny3d_VertexTexture(0.0f , ty);
-
-    tiny3d_End();
 }
 
-
 //todo
 // else if(txt_viewer_content[i] == '\t') {
 	// for(j=TXT_X; j < TXT_X+TXT_W; j+=30) {
@@ -318,7 +407,7 @@ static void DrawTextBox_ttf(float x, float y, float z, float w, float h, u32 rgb
 #define UX 30
 #define UY 24
 
-int display_ttf_line(int line, int posx, int posy, char *string, u32 color, u32 bkcolor, int sw, int sh)
+static int ttf_line(int line, int posx, int posy, char *string, u32 color, u32 bkcolor, int sw, int sh)
 {
     int l,n, m, ww, ww2;
     u8 colorc;
@@ -383,39 +472,20 @@ int display_ttf_line(int line, int posx, int posy, char *string, u32 color, u32
         if(ttf_char < 32) ttf_char='?';     
 
         // search ttf_char
-        if(ttf_char < 128) n= ttf_char;
+        if(ttf_char < 128) l= ttf_char;
         else {
-            m= 0;
-            int rel=0;
-            
-            for(n= 128; n < MAX_CHARS; n++) {
-                if(!(ttf_font_datas[n].flags & 1)) m= n;
-                
-                if((ttf_font_datas[n].flags & 3)==1) {
-                    int trel= r_use - ttf_font_datas[n].r_use;
-                    if(m==0) {m= n;rel = trel;}
-                    else if(rel > trel) {m= n;rel = trel;}
-
-                }
-                if(ttf_font_datas[n].ttf == ttf_char) break;
-            }
-
-            if(m==0) m = 128;
-
+            l= ttf_get_slot(ttf_char);
+            // more characters in this frame than slots
+            if(l < 0) l = ttf_char = '?';
         }
 
-        if(n >= MAX_CHARS) {ttf_font_datas[m].flags = 0; l= m;} else l=n;
-
         u16 * bitmap = ttf_font_datas[l].text;
         
         // building the character
 
         if(!(ttf_font_datas[l].flags & 1)) { 
 
-            if(f_face[0]) FT_Set_Pixel_Sizes(face[0], UX, UY);
-            if(f_face[1]) FT_Set_Pixel_Sizes(face[1], UX, UY);
-            if(f_face[2]) FT_Set_Pixel_Sizes(face[2], UX, UY);
-            if(f_face[3]) FT_Set_Pixel_Sizes(face[3], UX, UY);
+            TTF_SetPixelSizes(UX, UY);
 
             FT_GlyphSlot slot = NULL;
             
@@ -437,13 +507,16 @@ int display_ttf_line(int line, int posx, int posy, char *string, u32 color, u32
             else ttf_char = 0;
     
 
+            // a missing glyph is kept as an empty slot, not searched again in every face
+            ttf_font_datas[l].flags = 1;
+            ttf_font_datas[l].width = ttf_font_datas[l].height = 0;
+
             if(ttf_char!=0) {
                 ww = ww2 = 0;
 
                 int y_correction = UY - 1 - slot->bitmap_top;
                 if(y_correction < 0) y_correction = 0;
 
-                ttf_font_datas[l].flags = 1;
                 ttf_font_datas[l].y_start = y_correction;
                 ttf_font_datas[l].height = slot->bitmap.rows;
                 ttf_font_datas[l].width = slot->bitmap.width;
@@ -470,7 +543,6 @@ int display_ttf_line(int line, int posx, int posy, char *string, u32 color, u32
         }
 
         // displaying the character
-        ttf_font_datas[l].flags |= 2; // in use
         ttf_font_datas[l].r_use = r_use;
        
         u32 ccolor = color;
@@ -501,15 +573,26 @@ int display_ttf_line(int line, int posx, int posy, char *string, u32 color, u32
         if(Win_W_ttf <= (posx + cx) || Win_H_ttf <= posy) ccolor=0;
 		
         if(ccolor) {
-			 tiny3d_SetTextureWrap(0, tiny3d_TextureOffset(bitmap), 32, 
-                32, 32 * 2, 
-                TINY3D_TEX_FORMAT_A4R4G4B4,  TEXTWRAP_CLAMP, TEXTWRAP_CLAMP,1);
-				
-            DrawBox_ttf((float) (Win_X_ttf + posx), (float) (Win_Y_ttf + posy) + ((float) ttf_font_datas[l].y_start * sh) * 0.03125f,
-            Z_ttf, (float) sw, (float) sh, bkcolor);
-            DrawTextBox_ttf((float) (Win_X_ttf + posx), (float) (Win_Y_ttf + posy) + ((float) ttf_font_datas[l].y_start * sh) * 0.03125f,
-            Z_ttf, (float) sw, (float) sh, color,
-            0.99f, 0.99f);
+            float x = (float) (Win_X_ttf + posx);
+            float y = (float) (Win_Y_ttf + posy) + ((float) ttf_font_datas[l].y_start * sh) * 0.03125f;
+
+            // a transparent box is discarded by the alpha test
+            if(bkcolor & 0xff) QB_Quad(NULL, x, y, Z_ttf, (float) sw, (float) sh, bkcolor, 0.0f, 0.0f, 0.0f, 0.0f);
+
+            if(ttf_font_datas[l].width) {
+                qb_texture tex;
+                int group = l & ~(TTF_GROUP - 1);
+                int slots = MAX_CHARS - group < TTF_GROUP ? MAX_CHARS - group : TTF_GROUP;
+                float v0 = (float) (l - group) / (float) slots;
+
+                tex.offset = tiny3d_TextureOffset(ttf_font_datas[group].text);
+                tex.width = 32;
+                tex.height = 32 * slots;
+                tex.stride = 32 * 2;
+                tex.format = TINY3D_TEX_FORMAT_A4R4G4B4;
+
+                QB_Quad(&tex, x, y, Z_ttf, (float) sw, (float) sh, color, 0.0f, v0, 0.99f, v0 + 0.99f / (float) slots);
+            }
 		}
 		
         posx+= cx;
@@ -523,6 +606,43 @@ int display_ttf_line(int line, int posx, int posy, char *string, u32 color, u32
 	return posx;
 }
 
+int display_ttf_line(int line, int posx, int posy, char *string, u32 color, u32 bkcolor, int sw, int sh)
+{
+    ttf_layout *layout = NULL;
+    int ret;
+
+    if(color == 0 && bkcolor == 0 && strlen(string) < TTF_LAYOUT_STR) {
+        layout = &ttf_layouts[ttf_layout_hash(string, line, posx, posy, sw, sh)];
+
+        if(layout->line == line && layout->posx == posx && layout->posy == posy
+        && layout->sw == sw && layout->sh == sh
+        && layout->win_w == Win_W_ttf && layout->win_h == Win_H_ttf && layout->win_flag == Win_flag
+        && layout->str[0] && strcmp(layout->str, string) == 0) {
+            Y_ttf = layout->y;
+            return layout->ret;
+        }
+    }
+
+    ret = ttf_line(line, posx, posy, string, color, bkcolor, sw, sh);
+    QB_Flush();
+
+    if(layout) {
+        strcpy(layout->str, string);
+        layout->line = line;
+        layout->posx = posx;
+        layout->posy = posy;
+        layout->sw = sw;
+        layout->sh = sh;
+        layout->win_w = Win_W_ttf;
+        layout->win_h = Win_H_ttf;
+        layout->win_flag = Win_flag;
+        layout->ret = ret;
+        layout->y = Y_ttf;
+    }
+
+    return ret;
+}
+
 int display_ttf_string(int posx, int posy, char *string, u32 color, u32 bkcolor, int sw, int sh)
 {
 	return display_ttf_line(0, posx, posy, string, color, bkcolor, sw, sh);
@@ -7,168 +7,298 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#include "vag2wav.h"
 
 #define SUCCESS 	1
 #define FAILED	 	0
 
+#define VAG_HEADER_SIZE		0x30
+#define VAG_FRAME_SIZE		16
+#define VAG_FRAME_SAMPLES	28
+#define VAG_CHANNELS_MAX	2
+
+// bytes read from the VAG and written to the WAV at once
+#define VAG_IO_SIZE			0x10000
+
 extern void print_load(char *format, ...);
 
-double f2[5][2] = { { 0.0, 0.0 },
-                    {   60.0 / 64.0,  0.0 },
-                    {  115.0 / 64.0, -52.0 / 64.0 },
-                    {   98.0 / 64.0, -55.0 / 64.0 },
-                    {  122.0 / 64.0, -60.0 / 64.0 } };
+// filter coefficients * 64, the predictors above 4 don't exist and decode as 0
+static const int vag_coef[16][2] = { {   0,   0 },
+                                     {  60,   0 },
+                                     { 115, -52 },
+                                     {  98, -55 },
+                                     { 122, -60 } };
 
-double samples[28];
+// nibble << 12 as a signed 16 bits value
+static const int vag_nibble[16] = { 0, 0x1000, 0x2000, 0x3000, 0x4000, 0x5000, 0x6000, 0x7000,
+                                    -0x8000, -0x7000, -0x6000, -0x5000, -0x4000, -0x3000, -0x2000, -0x1000 };
 
-int vag_to_wav(char *vag_path, char *wav_path)
+typedef struct
+{
+    int s_1;
+    int s_2;
+    int end;
+} vag_channel;
+
+static unsigned int be32(const unsigned char *p)
 {
-    FILE *vag, *pcm;
-    char vag_name[17];
-    int predict_nr, shift_factor, flags;
+    return (unsigned int) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static void le16(unsigned char *p, unsigned int v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void le32(unsigned char *p, unsigned int v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+// Decode a frame of 28 samples, written every 'step' shorts. Returns 0 at the end flag.
+static int vag_decode_frame(const unsigned char *frame, vag_channel *ch, short *out, int step)
+{
+    int k0 = vag_coef[frame[0] >> 4][0];
+    int k1 = vag_coef[frame[0] >> 4][1];
+    int shift = frame[0] & 0xF;
+    int s_1 = ch->s_1;
+    int s_2 = ch->s_2;
     int i;
-    int d, s;
-    static double s_1 = 0.0;
-    static double s_2 = 0.0;
-    int sz;
-    unsigned int samp_freq;
-    unsigned int data_size;
-    
-    vag = fopen( vag_path, "rb" );
-        
-    if(vag == NULL)
-    {
-    	print_load("Error : Can't open %s Aborting.\n", vag_path);
-		return FAILED;
+
+    if(frame[1] == 7) return 0;
+
+    for(i = 0; i < VAG_FRAME_SAMPLES; i++, out += step) {
+        int d = frame[2 + i/2];
+        int s = vag_nibble[i & 1 ? d >> 4 : d & 0xF] >> shift;
+
+        s += (s_1 * k0 + s_2 * k1 + 32) >> 6;
+        if(s > 32767) s = 32767;
+        else
+        if(s < -32768) s = -32768;
+
+        s_2 = s_1;
+        s_1 = s;
+        *out = s;
     }
-    
-	 fread(vag_name, sizeof(char), 4, vag);
-	
-    if(strncmp(vag_name, "VAGp", 4))
-    {
-    	print_load("Error : bad magic VAG");
-		return FAILED;
+
+    ch->s_1 = s_1;
+    ch->s_2 = s_2;
+
+    return 1;
+}
+
+int vag_read_header(const unsigned char *header, unsigned int file_size, vag_info *info)
+{
+    memset(info, 0, sizeof(vag_info));
+
+    if(file_size < VAG_HEADER_SIZE) return FAILED;
+
+    info->sample_rate = be32(header + 0x10);
+    info->data_size = be32(header + 0x0C);
+    info->data_offset = VAG_HEADER_SIZE;
+
+    if(memcmp(header, "VAGi", 4) == 0) {
+        // interleaved stereo, blocks of 'interleave' bytes per channel
+        info->channels = 2;
+        info->interleave = be32(header + 0x08);
+        info->data_size *= 2;
+    } else
+    if(memcmp(header, "VAGp", 4) == 0) {
+        // some PS3 files have the number of channels in the reserved field, frame interleaved
+        info->channels = header[0x1E] == 2 ? 2 : 1;
+        info->interleave = VAG_FRAME_SIZE;
+        // the first frame of a mono VAG is always silent
+        if(info->channels == 1) {
+            info->data_offset += VAG_FRAME_SIZE;
+            if(info->data_size >= VAG_FRAME_SIZE) info->data_size -= VAG_FRAME_SIZE;
+        }
+    } else return FAILED;
+
+    if(info->interleave == 0 || info->interleave % VAG_FRAME_SIZE) return FAILED;
+    // a block can't be bigger than the file, it also keeps interleave * channels in 32 bits
+    if(file_size / info->channels < info->interleave) return FAILED;
+    if(info->sample_rate == 0) return FAILED;
+
+    if(file_size < info->data_offset) info->data_size = 0;
+    else
+    if(file_size - info->data_offset < info->data_size) info->data_size = file_size - info->data_offset;
+
+    // whole blocks only
+    info->data_size -= info->data_size % ((unsigned long long) info->interleave * info->channels);
+
+    return SUCCESS;
+}
+
+int vag_decode(char *vag_path, vag_info *info, vag_output output, void *arg)
+{
+    vag_channel ch[VAG_CHANNELS_MAX];
+    unsigned char header[VAG_HEADER_SIZE];
+    unsigned char *in = NULL;
+    short *pcm = NULL;
+    int ret = FAILED;
+    unsigned int c, i;
+
+    FILE *vag = fopen(vag_path, "rb");
+    if(vag == NULL) {
+        print_load("Error : Can't open %s", vag_path);
+        return FAILED;
     }
-    
-    fseek(vag, 12, SEEK_SET);
-    data_size = fgetc(vag) << 24;
-    data_size |= fgetc(vag) << 16;
-    data_size |= fgetc(vag) << 8;
-    data_size |= fgetc(vag);
-    
-	
-    fseek(vag, 16, SEEK_SET);
-    
-    samp_freq = fgetc(vag)<<24;
-    samp_freq|=fgetc(vag)<<16;
-    samp_freq|=fgetc(vag)<<8;
-    samp_freq|=fgetc(vag);
-     
-    fseek( vag, 64, SEEK_SET );
-
-    pcm = fopen( wav_path, "wb" );
-    if ( pcm == NULL ) {
-        print_load("Error : cant write output file\n" );
-        return( -8 );
+
+    fseek(vag, 0, SEEK_END);
+    unsigned int file_size = ftell(vag);
+    fseek(vag, 0, SEEK_SET);
+
+    if(fread(header, 1, VAG_HEADER_SIZE, vag) != VAG_HEADER_SIZE || vag_read_header(header, file_size, info) == FAILED) {
+        print_load("Error : bad magic VAG");
+        goto end;
     }
 
-// Write header chunk	
-	fprintf(pcm, "RIFF");
-// Skip file size field for now
-	fseek(pcm, 4, SEEK_CUR);
-
-	fprintf(pcm, "WAVE");    
-// Write fmt chunk
-	fprintf(pcm, "fmt ");
-// Write chunk 1 size in little endian format	
-	fputc(0x10, pcm);
-	fputc(0, pcm);
-	fputc(0, pcm);
-	fputc(0, pcm);
-// Write audio format (1 = PCM)	
-	fputc(1, pcm);
-	fputc(0, pcm);
-// Number of channels (1)
-	fputc(1, pcm);
-	fputc(0, pcm);
-// Write sample rate
-	fputc((samp_freq & 0xff), pcm);
-	fputc((samp_freq >> 8) & 0xff, pcm);
-	fputc(0, pcm);
-	fputc(0, pcm);
-// Write byte rate (SampleRate * NumChannels * BitsPerSample/8)
-// That would be 44100*1*(16/8), thus 88200.
-	fputc(((samp_freq*2) & 0xff), pcm);
-	fputc(((samp_freq*2) >> 8) & 0xff, pcm);
-	fputc(((samp_freq*2) >> 16) & 0xff, pcm);
-	fputc(((samp_freq*2) >> 24) & 0xff, pcm);
-// Write block align (NumChannels * BitsPerSample/8), thus 2
-	fputc(2, pcm);
-	fputc(0, pcm);
-// Write BitsPerSample
-	fputc(16, pcm);
-	fputc(0, pcm);
-
-// Write data chunk
-	fprintf(pcm, "data");
-
-// Skip SubChunk2Size, we will return to it later
-	fseek(pcm, 4, SEEK_CUR);
-	
-// Now write data...
-
-    while( ftell(vag) < (data_size+48)) {
-        predict_nr = fgetc( vag );
-        shift_factor = predict_nr & 0xf;
-        predict_nr >>= 4;
-        flags = fgetc( vag );                           // flags
-        if ( flags == 7 )
-            break;              
-        for ( i = 0; i < 28; i += 2 ) {
-            d = fgetc( vag );
-            s = ( d & 0xf ) << 12;
-            if ( s & 0x8000 )
-                s |= 0xffff0000;
-            samples[i] = (double) ( s >> shift_factor  );
-            s = ( d & 0xf0 ) << 8;
-            if ( s & 0x8000 )
-                s |= 0xffff0000;
-            samples[i+1] = (double) ( s >> shift_factor  );
+    // read as many whole blocks as possible at once
+    unsigned int block = info->interleave * info->channels;
+    unsigned int chunk = block < VAG_IO_SIZE ? VAG_IO_SIZE - VAG_IO_SIZE % block : block;
+    unsigned int frames = chunk / VAG_FRAME_SIZE / info->channels;
+
+    in = (unsigned char *) malloc(chunk);
+    pcm = (short *) malloc(frames * VAG_FRAME_SAMPLES * info->channels * sizeof(short));
+    if(in == NULL || pcm == NULL) goto end;
+
+    memset(ch, 0, sizeof(ch));
+    fseek(vag, info->data_offset, SEEK_SET);
+
+    unsigned int left = info->data_size;
+    unsigned int done = 0;
+
+    while(left && done < info->channels) {
+        unsigned int size = left < chunk ? left : chunk;
+        if(fread(in, 1, size, vag) != size) break;
+        left -= size;
+
+        // the channels are decoded in place in the interleaved output
+        unsigned int samples = 0;
+        unsigned int decoded[VAG_CHANNELS_MAX];
+        for(c = 0; c < info->channels; c++) {
+            unsigned int n = 0;
+            for(i = 0; i < size; i += block) {
+                unsigned int f;
+                for(f = 0; f < info->interleave; f += VAG_FRAME_SIZE) {
+                    if(ch[c].end) break;
+                    if(vag_decode_frame(in + i + c * info->interleave + f, &ch[c], pcm + n * info->channels + c, info->channels) == 0) {
+                        ch[c].end = 1;
+                        done++;
+                        break;
+                    }
+                    n += VAG_FRAME_SAMPLES;
+                }
+            }
+            decoded[c] = n;
+            if(samples < n) samples = n;
         }
-    
-        for ( i = 0; i < 28; i++ ) {
-            samples[i] = samples[i] + s_1 * f2[predict_nr][0] + s_2 * f2[predict_nr][1];
-            s_2 = s_1;
-            s_1 = samples[i];
-            d = (int) ( samples[i] + 0.5 );
-            fputc( d & 0xff, pcm );
-            fputc( d >> 8, pcm );
+
+        // a channel which ended before the other one is completed with silence
+        for(c = 0; c < info->channels; c++) {
+            for(i = decoded[c]; i < samples; i++) pcm[i * info->channels + c] = 0;
         }
+
+        if(samples && output(pcm, samples, info->channels, arg) == FAILED) goto end;
+    }
+
+    ret = SUCCESS;
+
+end:
+    free(in);
+    free(pcm);
+    fclose(vag);
+
+    return ret;
+}
+
+typedef struct
+{
+    FILE *fp;
+    unsigned int size;
+    unsigned int written;
+    unsigned char buf[VAG_IO_SIZE];
+} wav_writer;
+
+static int wav_flush(wav_writer *w)
+{
+    if(w->size && fwrite(w->buf, 1, w->size, w->fp) != w->size) return FAILED;
+    w->written += w->size;
+    w->size = 0;
+    return SUCCESS;
+}
+
+static int wav_output(const short *pcm, unsigned int samples, unsigned int channels, void *arg)
+{
+    wav_writer *w = (wav_writer *) arg;
+    unsigned int n = samples * channels;
+    unsigned int i;
+
+    for(i = 0; i < n; i++) {
+        if(w->size == VAG_IO_SIZE && wav_flush(w) == FAILED) return FAILED;
+        le16(w->buf + w->size, pcm[i]);
+        w->size += 2;
     }
-    
-// Get file size    
-    sz = ftell(pcm);
-    
-// Now write ChunkSize
-    fseek(pcm, 4, SEEK_SET);
-    
-    fputc((sz-8) & 0xff, pcm);
-    fputc(((sz-8)>>8)&0xff, pcm);
-    fputc(((sz-8)>>16)&0xff,pcm);
-    fputc(((sz-8)>>24)&0xff,pcm);
-    
-// Now write Subchunk2Size
-    fseek(pcm, 40, SEEK_SET);
-    
-    fputc((sz-44) & 0xff, pcm);
-    fputc(((sz-44)>>8)&0xff, pcm);
-    fputc(((sz-44)>>16)&0xff,pcm);
-    fputc(((sz-44)>>24)&0xff,pcm);    
-    
-    fclose( pcm );
-    fclose( vag );
-	
+
     return SUCCESS;
 }
 
+int vag_to_wav(char *vag_path, char *wav_path)
+{
+    unsigned char header[44];
+    vag_info info;
+    int ret;
+
+    wav_writer *w = (wav_writer *) malloc(sizeof(wav_writer));
+    if(w == NULL) return FAILED;
+
+    w->fp = fopen(wav_path, "wb");
+    if(w->fp == NULL) {
+        print_load("Error : can't write output file %s", wav_path);
+        free(w);
+        return FAILED;
+    }
+
+    // the header is written at the end, when the sizes are known
+    memset(w->buf, 0, sizeof(header));
+    w->size = sizeof(header);
+    w->written = 0;
+
+    ret = vag_decode(vag_path, &info, wav_output, w);
+    if(ret == SUCCESS) ret = wav_flush(w);
+
+    if(ret == SUCCESS) {
+        unsigned int data_size = w->written - sizeof(header);
+
+        memcpy(header, "RIFF", 4);
+        le32(header + 4, w->written - 8);
+        memcpy(header + 8, "WAVEfmt ", 8);
+        le32(header + 16, 16);                                      // fmt chunk size
+        le16(header + 20, 1);                                       // PCM
+        le16(header + 22, info.channels);
+        le32(header + 24, info.sample_rate);
+        le32(header + 28, info.sample_rate * info.channels * 2);    // byte rate
+        le16(header + 32, info.channels * 2);                       // block align
+        le16(header + 34, 16);                                      // bits per sample
+        memcpy(header + 36, "data", 4);
+        le32(header + 40, data_size);
+
+        fseek(w->fp, 0, SEEK_SET);
+        if(fwrite(header, 1, sizeof(header), w->fp) != sizeof(header)) ret = FAILED;
+    }
+
+    if(fclose(w->fp) != 0) ret = FAILED;
+    free(w);
+
+    if(ret == FAILED) unlink(wav_path);
+
+    return ret;
+}
@@ -1,6 +1,23 @@
 #ifndef _VAG2WAV_H_
 #define _VAG2WAV_H_
 
+typedef struct
+{
+    unsigned int channels;
+    unsigned int sample_rate;
+    unsigned int interleave;    // bytes of a channel before the next one
+    unsigned int data_offset;
+    unsigned int data_size;     // all the channels
+} vag_info;
+
+// 'samples' samples per channel, interleaved, return 0 to stop the decoding
+typedef int (*vag_output)(const short *pcm, unsigned int samples, unsigned int channels, void *arg);
+
+int vag_read_header(const unsigned char *header, unsigned int file_size, vag_info *info);
+
+// decode a VAGp (mono or stereo) or VAGi file chunk by chunk, returns 1 on success
+int vag_decode(char *vag_path, vag_info *info, vag_output output, void *arg);
+
 int vag_to_wav(char *vag_path, char *wav_path);
 
 #endif
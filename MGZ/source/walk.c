@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <ppu-types.h>
+#include <sys/thread.h>
+#include <sys/mutex.h>
+
+#include "mgz_io.h"
+#include "walk.h"
+
+// first size of the path buffer of a worker, it grows with the path
+#define WALK_PATH_SIZE			0x400
+
+typedef struct walk_dir
+{
+	struct walk_dir *parent;
+	struct walk_dir *next;		// stack of the folders to read
+	u32 pending;				// 1 while it's read + its subfolders not finished
+	u32 depth;
+	u32 len;
+	char *path;					// allocated with the struct
+} walk_dir;
+
+typedef struct
+{
+	walk_visitor *v;
+	walk_dir *stack;
+	u32 busy;					// workers reading a folder
+	u32 next_worker;
+	int status;
+	sys_lwmutex_t lock;
+} walk_job;
+
+typedef struct
+{
+	walk_job *job;
+	u32 id;
+	char *path;
+	u32 size;
+} walk_worker;
+
+static walk_dir *dir_new(walk_dir *parent, char *path, u32 len)
+{
+	walk_dir *d = (walk_dir *) malloc(sizeof(walk_dir) + len + 1);
+	if(d == NULL) return NULL;
+
+	d->parent = parent;
+	d->next = NULL;
+	d->pending = 1;
+	d->depth = parent ? parent->depth + 1 : 0;
+	d->len = len;
+	d->path = (char *) &d[1];
+	memcpy(d->path, path, len);
+	d->path[len] = 0;
+
+	return d;
+}
+
+static void job_stop(walk_job *job, int status)
+{
+	sysLwMutexLock(&job->lock, 0);
+	if(job->status == WALK_OK) job->status = status;
+	sysLwMutexUnlock(&job->lock);
+}
+
+static u8 job_running(walk_job *job)
+{
+	walk_visitor *v = job->v;
+
+	if(v->cancel && *v->cancel) job_stop(job, WALK_CANCELED);
+
+	return job->status == WALK_OK;
+}
+
+// 'path' of the worker = folder + '/' + name
+static char *worker_path(walk_worker *w, walk_dir *d, char *name)
+{
+	u32 name_len = strlen(name);
+	u32 sep = (d->len && d->path[d->len-1] == '/') ? 0 : 1;
+	u32 len = d->len + sep + name_len;
+
+	if(w->size <= len) {
+		u32 size = w->size ? w->size : WALK_PATH_SIZE;
+		while(size <= len) size *= 2;
+
+		char *path = (char *) realloc(w->path, size);
+		if(path == NULL) return NULL;
+		w->path = path;
+		w->size = size;
+	}
+
+	memcpy(w->path, d->path, d->len);
+	if(sep) w->path[d->len] = '/';
+	memcpy(&w->path[d->len + sep], name, name_len + 1);
+
+	return w->path;
+}
+
+static char *last_name(char *path)
+{
+	char *name = strrchr(path, '/');
+	if(name == NULL) return path;
+	return &name[1];
+}
+
+static int call(walk_job *job, walk_callback callback, walk_entry *e)
+{
+	if(callback == NULL) return WALK_CONTINUE;
+
+	int ret = callback(e, job->v->arg);
+	if(ret == WALK_STOP) job_stop(job, WALK_CANCELED);
+
+	return ret;
+}
+
+// The folder is read or skipped, 'leave' is called for it and for the parents it was the last to wait for
+static void dir_done(walk_worker *w, walk_dir *d)
+{
+	walk_job *job = w->job;
+
+	while(d) {
+		sysLwMutexLock(&job->lock, 0);
+		u32 pending = --d->pending;
+		sysLwMutexUnlock(&job->lock);
+
+		if(pending) break;
+
+		if(job->status == WALK_OK) {
+			walk_entry e;
+			e.path = d->path;
+			e.name = last_name(d->path);
+			e.size = 0;
+			e.depth = d->depth;
+			e.worker = w->id;
+			e.dir = 1;
+			call(job, job->v->leave, &e);
+		}
+
+		walk_dir *parent = d->parent;
+		free(d);
+		d = parent;
+	}
+}
+
+static void dir_read(walk_worker *w, walk_dir *d)
+{
+	walk_job *job = w->job;
+	walk_visitor *v = job->v;
+	walk_entry e;
+	struct dirent *dir;
+	struct stat st;
+	walk_dir *first = NULL;
+	walk_dir *last = NULL;
+	u32 subs = 0;
+
+	e.path = d->path;
+	e.name = last_name(d->path);
+	e.size = 0;
+	e.depth = d->depth;
+	e.worker = w->id;
+	e.dir = 1;
+	if(call(job, v->enter, &e) != WALK_CONTINUE) return;
+
+	DIR *dh = opendir(d->path);
+	if(dh == NULL) {
+		sysLwMutexLock(&job->lock, 0);
+		v->errors++;
+		sysLwMutexUnlock(&job->lock);
+		return;
+	}
+
+	while((dir = MGZ_readdir_stat(dh, &st))) {
+		if(!strcmp(dir->d_name, ".") || !strcmp(dir->d_name, "..")) continue;
+
+		if(job_running(job) == 0) break;
+
+		char *path = worker_path(w, d, dir->d_name);
+		if(path == NULL) {
+			job_stop(job, WALK_ERROR);
+			break;
+		}
+
+		if(dir->d_type & DT_DIR) {
+			walk_dir *sub = dir_new(d, path, strlen(path));
+			if(sub == NULL) {
+				job_stop(job, WALK_ERROR);
+				break;
+			}
+			if(last) last->next = sub; else first = sub;
+			last = sub;
+			subs++;
+			continue;
+		}
+
+		// the driver didn't give the stat with the listing
+		if(st.st_mode == 0 && v->file) stat(path, &st);
+
+		e.path = path;
+		e.name = last_name(path);
+		e.size = st.st_size;
+		e.depth = d->depth + 1;
+		e.dir = 0;
+		call(job, v->file, &e);
+	}
+	closedir(dh);
+
+	// the subfolders are stacked together, in the order of the listing
+	if(first) {
+		sysLwMutexLock(&job->lock, 0);
+		d->pending += subs;
+		last->next = job->stack;
+		job->stack = first;
+		sysLwMutexUnlock(&job->lock);
+	}
+}
+
+static void walk_run(walk_job *job, u32 id)
+{
+	walk_worker w;
+
+	memset(&w, 0, sizeof(walk_worker));
+	w.job = job;
+	w.id = id;
+
+	while(1) {
+		sysLwMutexLock(&job->lock, 0);
+		walk_dir *d = job->stack;
+		if(d == NULL) {
+			u32 busy = job->busy;
+			sysLwMutexUnlock(&job->lock);
+			// the folders being read can still add subfolders
+			if(busy == 0) break;
+			usleep(1000);
+			continue;
+		}
+		job->stack = d->next;
+		job->busy++;
+		sysLwMutexUnlock(&job->lock);
+
+		// once stopped the stack is only emptied, so that every folder is freed
+		if(job_running(job)) dir_read(&w, d);
+		dir_done(&w, d);
+
+		sysLwMutexLock(&job->lock, 0);
+		job->busy--;
+		sysLwMutexUnlock(&job->lock);
+	}
+
+	free(w.path);
+}
+
+static void walk_thread(void *data)
+{
+	walk_job *job = (walk_job *) data;
+
+	sysLwMutexLock(&job->lock, 0);
+	u32 id = job->next_worker++;
+	sysLwMutexUnlock(&job->lock);
+
+	walk_run(job, id);
+
+	sysThreadExit(0);
+}
+
+int walk(char *path, walk_visitor *v)
+{
+	sys_ppu_thread_t id[WALK_THREADS_MAX];
+	u8 started[WALK_THREADS_MAX];
+	walk_job job;
+	struct stat st;
+	u64 thread_ret;
+	u32 i;
+
+	v->errors = 0;
+
+	if(stat(path, &st) != 0) return WALK_ERROR;
+
+	memset(&job, 0, sizeof(walk_job));
+	job.v = v;
+
+	if(!S_ISDIR(st.st_mode)) {
+		walk_entry e;
+		e.path = path;
+		e.name = last_name(path);
+		e.size = st.st_size;
+		e.depth = 0;
+		e.worker = 0;
+		e.dir = 0;
+		if(v->file && v->file(&e, v->arg) == WALK_STOP) return WALK_CANCELED;
+		return WALK_OK;
+	}
+
+	job.stack = dir_new(NULL, path, strlen(path));
+	if(job.stack == NULL) return WALK_ERROR;
+
+	sys_lwmutex_attr_t attr = {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""};
+	sysLwMutexCreate(&job.lock, &attr);
+
+	u32 threads = v->threads;
+	if(threads == 0) threads = 1;
+	if(threads > WALK_THREADS_MAX) threads = WALK_THREADS_MAX;
+	if(1 < threads) {
+		u32 fs_threads = MGZ_fs_threads(path);
+		if(fs_threads < threads) threads = fs_threads;
+	}
+
+	// the caller is the first worker
+	job.next_worker = 1;
+	for(i=1; i<threads; i++) {
+		started[i] = (sysThreadCreate(&id[i], walk_thread, (void *) &job, 1000, 0x4000, THREAD_JOINABLE, "walk") == 0);
+	}
+
+	walk_run(&job, 0);
+
+	for(i=1; i<threads; i++) {
+		if(started[i]) sysThreadJoin(id[i], &thread_ret);
+	}
+
+	sysLwMutexDestroy(&job.lock);
+
+	return job.status;
+}
@@ -0,0 +1,55 @@
+#ifndef __WALK_H__
+#define __WALK_H__
+
+#include <ppu-types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WALK_OK					0
+#define WALK_ERROR				1	// the root doesn't exist
+#define WALK_CANCELED			2	// canceled or stopped by a callback
+
+// returned by the callbacks
+#define WALK_CONTINUE			0
+#define WALK_SKIP				1	// from 'enter' : the content of the folder is ignored
+#define WALK_STOP				2
+
+#define WALK_THREADS_MAX		4
+
+typedef struct
+{
+	char *path;			// full path, only valid during the call
+	char *name;			// last component of 'path'
+	u64 size;			// files only
+	u32 depth;			// 0 for the root
+	u32 worker;			// 0 to threads-1, to keep results per worker without locking
+	u8 dir;
+} walk_entry;
+
+typedef int (*walk_callback)(walk_entry *entry, void *arg);
+
+typedef struct
+{
+	walk_callback file;		// every file, the root too when it's a file
+	walk_callback enter;	// folder, before its content
+	walk_callback leave;	// folder, after its whole content (bottom-up)
+	void *arg;
+	u8 *cancel;				// optional, checked between the entries
+	u32 threads;			// folders read at once (the caller is one of them), 0 or 1 keeps the callbacks in one thread,
+							// limited to what the file system allows (MGZ_fs_threads)
+	u32 errors;				// set by walk : folders that couldn't be opened
+} walk_visitor;
+
+// Visit 'path' and its whole content. The folders are read in one pass with an explicit stack, the size
+// and the type of the entries come with the folder listing, there's no stat per entry.
+// The files of a folder are visited before its subfolders. With more than one thread the callbacks are
+// called at once from different folders, 'leave' is still called after the whole content of the folder.
+int walk(char *path, walk_visitor *visitor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __WALK_H__ */
@@ -0,0 +1,634 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <ppu-types.h>
+#include <sys/thread.h>
+#include <sys/mutex.h>
+
+#include "zlib.h"
+#include "zip_extract.h"
+
+#define ZIP_LOCAL_SIG			0x04034b50
+#define ZIP_CENTRAL_SIG			0x02014b50
+#define ZIP_END_SIG				0x06054b50
+#define ZIP64_END_SIG			0x06064b50
+#define ZIP64_LOCATOR_SIG		0x07064b50
+
+#define ZIP_METHOD_STORE		0
+#define ZIP_METHOD_DEFLATE		8
+
+// compressed data read at once, data inflated before it's written
+#define ZIP_IN_SIZE				0x40000
+#define ZIP_OUT_SIZE			0x100000
+
+#define ZIP_WORKERS_MAX			4
+
+// a bigger central directory is refused
+#define ZIP_CENTRAL_MAX			0x4000000
+
+extern void print_load(char *format, ...);
+extern u8 SetFilePerms(char *path);
+
+typedef struct
+{
+	char *name;
+	char *path;			// output, NULL if the entry is skipped
+	u64 offset;			// local header
+	u64 comp_size;
+	u64 size;
+	u32 crc;
+	u16 method;
+	u16 flags;
+	u8 dir;
+} zip_entry;
+
+typedef struct
+{
+	zip_entry *entries;
+	u32 number;
+	char *names;
+} zip_directory;
+
+typedef struct
+{
+	char *zip_path;
+	zip_directory *dir;
+	u32 *order;			// index of the files to extract, the biggest first
+	u32 files;
+	u32 next;
+	u32 files_done;
+	u64 total;
+	u64 done;
+	int status;
+	zip_extract_progress progress;
+	void *arg;
+	sys_lwmutex_t lock;
+} zip_job;
+
+static u16 le16(const u8 *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static u32 le32(const u8 *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (u32) p[3] << 24;
+}
+
+static u64 le64(const u8 *p)
+{
+	return (u64) le32(p) | (u64) le32(p+4) << 32;
+}
+
+static void free_directory(zip_directory *dir)
+{
+	u32 i;
+
+	if(dir->entries) {
+		for(i=0; i<dir->number; i++) free(dir->entries[i].path);
+	}
+	free(dir->entries);
+	free(dir->names);
+	memset(dir, 0, sizeof(zip_directory));
+}
+
+// Read the whole central directory at once
+static int read_directory(FILE *f, zip_directory *dir)
+{
+	u8 *tail = NULL;
+	u8 *cd = NULL;
+	u8 rec[56];
+	int ret = ZIP_EXTRACT_ERROR;
+	u32 i;
+
+	memset(dir, 0, sizeof(zip_directory));
+
+	fseek(f, 0, SEEK_END);
+	u64 file_size = ftell(f);
+	if(file_size < 22) return ZIP_EXTRACT_ERROR;
+
+	// end of central directory record : the comment can be up to 64KB
+	u32 tail_size = file_size < 0xFFFF + 22 ? file_size : 0xFFFF + 22;
+	tail = (u8 *) malloc(tail_size);
+	if(tail == NULL) return ZIP_EXTRACT_ERROR;
+
+	fseek(f, file_size - tail_size, SEEK_SET);
+	if(fread(tail, 1, tail_size, f) != tail_size) goto end;
+
+	s64 eocd = -1;
+	s64 p;
+	for(p = tail_size - 22; p >= 0; p--) {
+		if(le32(tail + p) == ZIP_END_SIG) {
+			eocd = p;
+			break;
+		}
+	}
+	if(eocd < 0) {
+		print_load("Error : zip end of central directory not found");
+		goto end;
+	}
+
+	u64 number = le16(tail + eocd + 10);
+	u64 cd_size = le32(tail + eocd + 12);
+	u64 cd_offset = le32(tail + eocd + 16);
+
+	if(number == 0xFFFF || cd_size == 0xFFFFFFFF || cd_offset == 0xFFFFFFFF) {
+		if(eocd < 20 || le32(tail + eocd - 20) != ZIP64_LOCATOR_SIG) goto end;
+		fseek(f, le64(tail + eocd - 20 + 8), SEEK_SET);
+		if(fread(rec, 1, 56, f) != 56 || le32(rec) != ZIP64_END_SIG) goto end;
+		number = le64(rec + 32);
+		cd_size = le64(rec + 40);
+		cd_offset = le64(rec + 48);
+	}
+
+	if(cd_size > ZIP_CENTRAL_MAX || file_size < cd_offset + cd_size || cd_size < number * 46) {
+		print_load("Error : bad zip central directory");
+		goto end;
+	}
+
+	cd = (u8 *) malloc(cd_size);
+	dir->entries = (zip_entry *) malloc((number ? number : 1) * sizeof(zip_entry));
+	dir->names = (char *) malloc(cd_size);
+	if(cd == NULL || dir->entries == NULL || dir->names == NULL) goto end;
+	memset(dir->entries, 0, (number ? number : 1) * sizeof(zip_entry));
+
+	fseek(f, cd_offset, SEEK_SET);
+	if(fread(cd, 1, cd_size, f) != cd_size) goto end;
+
+	u8 *c = cd;
+	char *names = dir->names;
+	for(i=0; i<number; i++) {
+		zip_entry *e = &dir->entries[i];
+
+		if(cd + cd_size < c + 46 || le32(c) != ZIP_CENTRAL_SIG) goto end;
+
+		u16 flags = le16(c + 8);
+		u16 name_len = le16(c + 28);
+		u16 extra_len = le16(c + 30);
+		u16 comment_len = le16(c + 32);
+
+		if(cd + cd_size < c + 46 + name_len + extra_len + comment_len) goto end;
+
+		e->method = le16(c + 10);
+		e->crc = le32(c + 16);
+		e->comp_size = le32(c + 20);
+		e->size = le32(c + 24);
+		e->offset = le32(c + 42);
+
+		// the names are shorter than their record : they fit in a buffer of the size of the directory
+		e->name = names;
+		memcpy(names, c + 46, name_len);
+		names[name_len] = 0;
+		names += name_len + 1;
+
+		e->dir = name_len && (e->name[name_len-1] == '/' || e->name[name_len-1] == '\\');
+
+		// zip64 extended information, only the fields at 0xFFFFFFFF are there
+		u8 *x = c + 46 + name_len;
+		u8 *x_end = x + extra_len;
+		while(x + 4 <= x_end) {
+			u16 id = le16(x);
+			u16 len = le16(x + 2);
+			u8 *v = x + 4;
+			if(x_end < v + len) break;
+			if(id == 0x0001) {
+				if(e->size == 0xFFFFFFFF && v + 8 <= x + 4 + len) { e->size = le64(v); v += 8; }
+				if(e->comp_size == 0xFFFFFFFF && v + 8 <= x + 4 + len) { e->comp_size = le64(v); v += 8; }
+				if(e->offset == 0xFFFFFFFF && v + 8 <= x + 4 + len) { e->offset = le64(v); v += 8; }
+			}
+			x += 4 + len;
+		}
+
+		e->flags = flags;
+
+		c += 46 + name_len + extra_len + comment_len;
+		dir->number++;
+	}
+
+	ret = ZIP_EXTRACT_OK;
+
+end:
+	free(tail);
+	free(cd);
+	if(ret != ZIP_EXTRACT_OK) free_directory(dir);
+
+	return ret;
+}
+
+// checked before anything is written
+static u8 entry_supported(zip_entry *e)
+{
+	if(e->dir) return 1;
+
+	if(e->flags & 1) {
+		print_load("Warning : %s is encrypted", e->name);
+		return 0;
+	}
+	if(e->method != ZIP_METHOD_STORE && e->method != ZIP_METHOD_DEFLATE) {
+		print_load("Warning : %s, compression method %d", e->name, e->method);
+		return 0;
+	}
+
+	return 1;
+}
+
+// output path of an entry, NULL if it would be written outside of dst_dir
+static char *entry_path(char *dst_dir, char *name)
+{
+	char *path = (char *) malloc(strlen(dst_dir) + strlen(name) + 2);
+	if(path == NULL) return NULL;
+
+	sprintf(path, "%s/%s", dst_dir, name);
+
+	char *s = path + strlen(dst_dir) + 1;
+	char *p;
+	for(p = s; *p; p++) if(*p == '\\') *p = '/';
+
+	if(*s == '/' || strcmp(s, "..") == 0 || strncmp(s, "../", 3) == 0 || strstr(s, "/../") != NULL
+	|| (3 <= strlen(s) && strcmp(s + strlen(s) - 3, "/..") == 0)) {
+		print_load("Warning : %s skipped", name);
+		free(path);
+		return NULL;
+	}
+
+	// no trailing '/' for the folders
+	while(s < p && p[-1] == '/') *--p = 0;
+
+	return path;
+}
+
+// create the folders of 'path' up to its last '/', 'last' is the last folder created
+static void make_dirs(char *path, char *last)
+{
+	char *end = strrchr(path, '/');
+	if(end == NULL) return;
+
+	u32 len = end - path;
+	if(strlen(last) == len && strncmp(path, last, len) == 0) return;
+
+	char *p;
+	for(p = path + 1; p <= end; p++) {
+		if(*p != '/') continue;
+		*p = 0;
+		mkdir(path, 0777);
+		*p = '/';
+	}
+
+	memcpy(last, path, len);
+	last[len] = 0;
+}
+
+// data written, returns 0 if the extraction must stop
+static u8 job_update(zip_job *job, u64 size, u8 file_done)
+{
+	u8 go_on;
+
+	sysLwMutexLock(&job->lock, 0);
+	job->done += size;
+	if(file_done) job->files_done++;
+	if(job->status == ZIP_EXTRACT_OK && job->progress) {
+		if(job->progress(job->files_done, job->files, job->done, job->total, job->arg) == 0) job->status = ZIP_EXTRACT_CANCELED;
+	}
+	go_on = job->status == ZIP_EXTRACT_OK;
+	sysLwMutexUnlock(&job->lock);
+
+	return go_on;
+}
+
+static int extract_entry(zip_job *job, FILE *zf, zip_entry *e, char *path, u8 *in, u8 *out, z_stream *z)
+{
+	u8 local[30];
+	int ret = ZIP_EXTRACT_ERROR;
+	u32 crc = crc32(0, NULL, 0);
+	u64 written = 0;
+	u64 left = e->comp_size;
+
+	fseek(zf, e->offset, SEEK_SET);
+	if(fread(local, 1, 30, zf) != 30 || le32(local) != ZIP_LOCAL_SIG) {
+		print_load("Error : bad zip local header, %s", e->name);
+		return ZIP_EXTRACT_ERROR;
+	}
+	fseek(zf, e->offset + 30 + le16(local + 26) + le16(local + 28), SEEK_SET);
+
+	FILE *fo = fopen(path, "wb");
+	if(fo == NULL) {
+		print_load("Error : fopen() failed : %s", path);
+		return ZIP_EXTRACT_ERROR;
+	}
+	SetFilePerms(path);
+
+	if(e->method == ZIP_METHOD_STORE) {
+		while(left) {
+			u32 n = left < ZIP_OUT_SIZE ? left : ZIP_OUT_SIZE;
+			if(fread(out, 1, n, zf) != n) goto end;
+			crc = crc32(crc, out, n);
+			if(fwrite(out, 1, n, fo) != n) goto end;
+			left -= n;
+			written += n;
+			if(job && job_update(job, n, 0) == 0) {
+				ret = ZIP_EXTRACT_CANCELED;
+				goto end;
+			}
+		}
+	} else {
+		int zret = Z_OK;
+
+		inflateReset(z);
+		z->avail_in = 0;
+		z->next_out = out;
+		z->avail_out = ZIP_OUT_SIZE;
+
+		while(zret != Z_STREAM_END) {
+			// once the input is read, inflate is still called to flush what it holds
+			if(z->avail_in == 0 && left) {
+				u32 n = left < ZIP_IN_SIZE ? left : ZIP_IN_SIZE;
+				if(fread(in, 1, n, zf) != n) goto end;
+				left -= n;
+				z->next_in = in;
+				z->avail_in = n;
+			}
+
+			// Z_BUF_ERROR : no progress without more input, the data is truncated
+			zret = inflate(z, Z_NO_FLUSH);
+			if(zret != Z_OK && zret != Z_STREAM_END) goto end;
+
+			if(z->avail_out == 0 || zret == Z_STREAM_END) {
+				u32 n = ZIP_OUT_SIZE - z->avail_out;
+				crc = crc32(crc, out, n);
+				if(fwrite(out, 1, n, fo) != n) goto end;
+				written += n;
+				z->next_out = out;
+				z->avail_out = ZIP_OUT_SIZE;
+				if(job && job_update(job, n, 0) == 0) {
+					ret = ZIP_EXTRACT_CANCELED;
+					goto end;
+				}
+			}
+		}
+	}
+
+	if(written != e->size || crc != e->crc) {
+		print_load("Error : bad crc, %s", e->name);
+		goto end;
+	}
+
+	ret = ZIP_EXTRACT_OK;
+
+end:
+	if(fclose(fo) != 0 && ret == ZIP_EXTRACT_OK) ret = ZIP_EXTRACT_ERROR;
+	if(ret != ZIP_EXTRACT_OK) {
+		if(ret == ZIP_EXTRACT_ERROR) print_load("Error : failed to extract %s", e->name);
+		unlink(path);
+	}
+
+	return ret;
+}
+
+static void extract_run(zip_job *job)
+{
+	u8 *in = (u8 *) malloc(ZIP_IN_SIZE);
+	u8 *out = (u8 *) malloc(ZIP_OUT_SIZE);
+	z_stream z;
+	u8 z_ready = 0;
+
+	// every worker reads the archive with its own handle
+	FILE *zf = fopen(job->zip_path, "rb");
+
+	memset(&z, 0, sizeof(z_stream));
+	if(inflateInit2(&z, -MAX_WBITS) == Z_OK) z_ready = 1;
+
+	if(zf == NULL || in == NULL || out == NULL || z_ready == 0) {
+		sysLwMutexLock(&job->lock, 0);
+		if(job->status == ZIP_EXTRACT_OK) job->status = ZIP_EXTRACT_ERROR;
+		sysLwMutexUnlock(&job->lock);
+		goto end;
+	}
+
+	while(1) {
+		u32 i;
+
+		sysLwMutexLock(&job->lock, 0);
+		if(job->status != ZIP_EXTRACT_OK || job->files <= job->next) {
+			sysLwMutexUnlock(&job->lock);
+			break;
+		}
+		i = job->order[job->next++];
+		sysLwMutexUnlock(&job->lock);
+
+		zip_entry *e = &job->dir->entries[i];
+
+		print_load("%s", e->name);
+
+		int ret = extract_entry(job, zf, e, e->path, in, out, &z);
+		if(ret != ZIP_EXTRACT_OK) {
+			sysLwMutexLock(&job->lock, 0);
+			if(job->status == ZIP_EXTRACT_OK) job->status = ret;
+			sysLwMutexUnlock(&job->lock);
+			break;
+		}
+
+		job_update(job, 0, 1);
+	}
+
+end:
+	if(z_ready) inflateEnd(&z);
+	if(zf) fclose(zf);
+	free(in);
+	free(out);
+}
+
+static void extract_thread(void *data)
+{
+	extract_run((zip_job *) data);
+
+	sysThreadExit(0);
+}
+
+// qsort has no context argument
+static zip_entry *sort_entries;
+
+static int cmp_size(const void *a, const void *b)
+{
+	u64 x = sort_entries[*(const u32 *) a].comp_size;
+	u64 y = sort_entries[*(const u32 *) b].comp_size;
+
+	if(x == y) return 0;
+	return x < y ? 1 : -1;
+}
+
+int zip_extract(char *zip_path, char *dst_dir, u32 workers, zip_extract_progress progress, void *arg)
+{
+	return zip_extract_entries(zip_path, dst_dir, workers, NULL, progress, arg);
+}
+
+int zip_extract_entries(char *zip_path, char *dst_dir, u32 workers, zip_extract_filter filter, zip_extract_progress progress, void *arg)
+{
+	sys_ppu_thread_t id[ZIP_WORKERS_MAX];
+	u8 started[ZIP_WORKERS_MAX];
+	zip_directory dir;
+	zip_job job;
+	u64 thread_ret;
+	u32 i;
+
+	FILE *f = fopen(zip_path, "rb");
+	if(f == NULL) {
+		print_load("Error : fopen() failed : %s", zip_path);
+		return ZIP_EXTRACT_ERROR;
+	}
+	int ret = read_directory(f, &dir);
+	fclose(f);
+	if(ret != ZIP_EXTRACT_OK) return ret;
+
+	for(i=0; i<dir.number; i++) {
+		if(filter && filter(dir.entries[i].name, arg) == 0) continue;
+		if(entry_supported(&dir.entries[i]) == 0) {
+			free_directory(&dir);
+			return ZIP_EXTRACT_UNSUPPORTED;
+		}
+	}
+
+	memset(&job, 0, sizeof(zip_job));
+	job.zip_path = zip_path;
+	job.dir = &dir;
+	job.progress = progress;
+	job.arg = arg;
+	job.order = (u32 *) malloc((dir.number ? dir.number : 1) * sizeof(u32));
+	if(job.order == NULL) {
+		free_directory(&dir);
+		return ZIP_EXTRACT_ERROR;
+	}
+
+	// all the folders first, in one pass
+	// dst_dir + '/' + name (16 bits length) + '\0'
+	char *last = (char *) malloc(strlen(dst_dir) + 0x10000 + 2);
+	if(last == NULL) {
+		free(job.order);
+		free_directory(&dir);
+		return ZIP_EXTRACT_ERROR;
+	}
+	last[0] = 0;
+	mkdir(dst_dir, 0777);
+
+	for(i=0; i<dir.number; i++) {
+		zip_entry *e = &dir.entries[i];
+
+		if(filter && filter(e->name, arg) == 0) continue;
+
+		e->path = entry_path(dst_dir, e->name);
+		if(e->path == NULL) continue;
+
+		if(e->dir) {
+			make_dirs(e->path, last);
+			mkdir(e->path, 0777);
+			continue;
+		}
+
+		make_dirs(e->path, last);
+		job.order[job.files++] = i;
+		job.total += e->size;
+	}
+	free(last);
+
+	// the biggest files are started first, the small ones fill the gaps at the end
+	sort_entries = dir.entries;
+	qsort(job.order, job.files, sizeof(u32), cmp_size);
+
+	sys_lwmutex_attr_t attr = {SYS_LWMUTEX_ATTR_PROTOCOL, SYS_LWMUTEX_ATTR_RECURSIVE, ""};
+	sysLwMutexCreate(&job.lock, &attr);
+
+	if(workers == 0) workers = 1;
+	if(workers > ZIP_WORKERS_MAX) workers = ZIP_WORKERS_MAX;
+	if(workers > job.files) workers = job.files ? job.files : 1;
+
+	// the caller is the first worker
+	for(i=1; i<workers; i++) {
+		started[i] = (sysThreadCreate(&id[i], extract_thread, (void *) &job, 1000, 0x4000, THREAD_JOINABLE, "zip_extract") == 0);
+	}
+
+	extract_run(&job);
+
+	for(i=1; i<workers; i++) {
+		if(started[i]) sysThreadJoin(id[i], &thread_ret);
+	}
+
+	sysLwMutexDestroy(&job.lock);
+
+	ret = job.status;
+
+	free(job.order);
+	free_directory(&dir);
+
+	return ret;
+}
+
+int zip_extract_file(char *zip_path, char *name, char *out)
+{
+	zip_directory dir;
+	int ret;
+	u32 i;
+
+	FILE *f = fopen(zip_path, "rb");
+	if(f == NULL) {
+		print_load("Error : fopen() failed : %s", zip_path);
+		return ZIP_EXTRACT_ERROR;
+	}
+
+	ret = read_directory(f, &dir);
+	if(ret != ZIP_EXTRACT_OK) {
+		fclose(f);
+		return ret;
+	}
+
+	ret = ZIP_EXTRACT_ERROR;
+	for(i=0; i<dir.number; i++) {
+		if(dir.entries[i].dir || strcmp(dir.entries[i].name, name) != 0) continue;
+
+		if(entry_supported(&dir.entries[i]) == 0) {
+			ret = ZIP_EXTRACT_UNSUPPORTED;
+			break;
+		}
+
+		u8 *in = (u8 *) malloc(ZIP_IN_SIZE);
+		u8 *buf = (u8 *) malloc(ZIP_OUT_SIZE);
+		z_stream z;
+
+		memset(&z, 0, sizeof(z_stream));
+		if(in && buf && inflateInit2(&z, -MAX_WBITS) == Z_OK) {
+			ret = extract_entry(NULL, f, &dir.entries[i], out, in, buf, &z);
+			inflateEnd(&z);
+		}
+		free(in);
+		free(buf);
+		break;
+	}
+
+	fclose(f);
+	free_directory(&dir);
+
+	return ret;
+}
+
+int zip_list(char *zip_path, zip_list_callback callback, void *arg)
+{
+	zip_directory dir;
+	u32 i;
+
+	FILE *f = fopen(zip_path, "rb");
+	if(f == NULL) {
+		print_load("Error : fopen() failed : %s", zip_path);
+		return ZIP_EXTRACT_ERROR;
+	}
+	int ret = read_directory(f, &dir);
+	fclose(f);
+	if(ret != ZIP_EXTRACT_OK) return ret;
+
+	for(i=0; i<dir.number; i++) {
+		callback(dir.entries[i].name, dir.entries[i].size, dir.entries[i].dir, arg);
+	}
+
+	free_directory(&dir);
+
+	return ZIP_EXTRACT_OK;
+}
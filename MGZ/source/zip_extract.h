@@ -0,0 +1,41 @@
+#ifndef __ZIP_EXTRACT_H__
+#define __ZIP_EXTRACT_H__
+
+#include <ppu-types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZIP_EXTRACT_OK				0
+#define ZIP_EXTRACT_ERROR			1
+#define ZIP_EXTRACT_CANCELED		2
+// encrypted entry or compression method other than store/deflate, nothing was written
+#define ZIP_EXTRACT_UNSUPPORTED		3
+
+// returns 0 to skip the entry
+typedef u8 (*zip_extract_filter)(char *name, void *arg);
+
+typedef void (*zip_list_callback)(char *name, u64 size, u8 dir, void *arg);
+
+// called while the data is written, returns 0 to cancel
+typedef u8 (*zip_extract_progress)(u32 files_done, u32 files, u64 done, u64 total, void *arg);
+
+// Extract every entry of the archive in 'dst_dir', 'workers' files are inflated at once (the caller is one of them).
+// The central directory is read once, the folders are created before the files, the biggest files are started first.
+int zip_extract(char *zip_path, char *dst_dir, u32 workers, zip_extract_progress progress, void *arg);
+
+// Same as zip_extract, only the entries accepted by 'filter' are extracted, 'arg' is passed to both callbacks
+int zip_extract_entries(char *zip_path, char *dst_dir, u32 workers, zip_extract_filter filter, zip_extract_progress progress, void *arg);
+
+// Extract the entry 'name' of the archive to the file 'out'
+int zip_extract_file(char *zip_path, char *name, char *out);
+
+// Call 'callback' for every entry of the central directory
+int zip_list(char *zip_path, zip_list_callback callback, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ZIP_EXTRACT_H__ */